@@ -41,13 +41,24 @@ typedef int socket_t;
 #endif
 #include "vw_exception.h"
 #include <assert.h>
+#include <vector>
 
 const size_t ar_buf_size = 1<<16;
+const size_t ar_ring_chunk_size = 1<<20; // bytes the ring sends or receives at once (--allreduce_chunk)
+
+// How AllReduceSockets reduces (--allreduce).  tree passes the data up the spanning tree and
+// the result back down.  ring reduces each of total blocks of the data while passing it around
+// a ring of the nodes, then passes the reduced blocks around once more (a reduce-scatter, then
+// an allgather): every node sends and receives 2 (total - 1) / total of the data, at once, in
+// chunks, and a block moves on as soon as its first chunk is in.
+enum class AllReduceAlgorithm { tree, ring };
 
 struct node_socks
 { std::string current_master;
   socket_t parent;
   socket_t children[2];
+  std::vector<socket_t> next; // the ring: streams to the next node, nonblocking
+  std::vector<socket_t> prev; // and from the previous one
   ~node_socks()
   { if(current_master != "")
     { if(parent != -1)
@@ -56,6 +67,10 @@ struct node_socks
         CLOSESOCK(this->children[0]);
       if(children[1] != -1)
         CLOSESOCK(this->children[1]);
+      for (socket_t s : next)
+        CLOSESOCK(s);
+      for (socket_t s : prev)
+        CLOSESOCK(s);
     }
   }
   node_socks ()
@@ -79,6 +94,9 @@ public:
   { assert(node >= 0 && node < total);
   }
 
+  // bytes this node has sent and received over the network reducing, so far
+  virtual uint64_t traffic() const { return 0; }
+
   virtual ~AllReduce()
   {
   }
@@ -168,14 +186,142 @@ public:
   }
 };
 
+// Whether the last send or recv on a nonblocking socket failed only because it would block.
+bool socket_would_block();
+
 class AllReduceSockets : public AllReduce
 {
 private:
   node_socks socks;
   std::string span_server;
   size_t unique_id; //unique id for each node in the network, id == 0 means extra io.
+  AllReduceAlgorithm algorithm;
+  size_t chunk_size; // of the ring
+  size_t streams; // sockets of the ring to each neighbour
+  uint64_t bytes_moved; // sent and received reducing
 
   void all_reduce_init();
+  void ring_init(uint32_t ip);
+
+  // Where one stream of the ring is: each of the 2 (total - 1) steps sends a block to the next
+  // node and receives another from the previous one, which the next step sends on.
+  struct ring_stream
+  { size_t send_step;
+    size_t sent; // bytes of the block of send_step
+    size_t recv_step;
+    size_t received;
+  };
+
+  // The block sent at a step, one further back around the ring each step: the reduce-scatter
+  // ends with the node holding block node + 1 reduced, which the allgather starts with.  The
+  // block received at a step is the one sent at the next.
+  size_t ring_block(size_t step) const { return (node + 2 * total - step) % total; }
+
+  // The elements of block b stream k carries: its share of the block.
+  void ring_range(size_t n, size_t b, size_t k, size_t& lo, size_t& hi) const
+  { size_t block_lo = n * b / total, block_hi = n * (b + 1) / total;
+    lo = block_lo + (block_hi - block_lo) * k / streams;
+    hi = block_lo + (block_hi - block_lo) * (k + 1) / streams;
+  }
+
+  template <class T> size_t ring_bytes(size_t n, size_t step, size_t k) const
+  { size_t lo, hi;
+    ring_range(n, ring_block(step), k, lo, hi);
+    return (hi - lo) * sizeof(T);
+  }
+
+  // The bytes of the current block stream k may send: all of it, unless it is still coming in
+  // from the previous node at the step before.
+  template <class T> size_t ring_sendable(size_t n, ring_stream& r, size_t k) const
+  { size_t bytes = ring_bytes<T>(n, r.send_step, k);
+    if (r.send_step == 0 || r.recv_step >= r.send_step)
+      return bytes;
+    return r.recv_step + 1 == r.send_step ? r.received / sizeof(T) * sizeof(T) : 0;
+  }
+
+  // moves the stream past the blocks it is done with, and the empty ones
+  template <class T> void ring_advance(size_t n, ring_stream& r, size_t k) const
+  { size_t steps = 2 * (total - 1);
+    while (r.send_step < steps && r.sent == ring_bytes<T>(n, r.send_step, k))
+    { r.send_step++;
+      r.sent = 0;
+    }
+    while (r.recv_step < steps && r.received == ring_bytes<T>(n, r.recv_step + 1, k))
+    { r.recv_step++;
+      r.received = 0;
+    }
+  }
+
+  template <class T, void(*f)(T&, const T&)> void ring(T* buffer, const size_t n)
+  { size_t steps = 2 * (total - 1);
+    std::vector<ring_stream> s(streams, ring_stream{0, 0, 0, 0});
+    std::vector<char> staging(streams * (chunk_size + sizeof(T))); // for the blocks to reduce
+    for (size_t k = 0; k < streams; k++)
+      ring_advance<T>(n, s[k], k);
+
+    for (;;)
+    { fd_set readable, writable;
+      FD_ZERO(&readable);
+      FD_ZERO(&writable);
+      socket_t max_fd = 0;
+      bool busy = false;
+      for (size_t k = 0; k < streams; k++)
+      { if (s[k].send_step < steps && ring_sendable<T>(n, s[k], k) > s[k].sent)
+        { FD_SET(socks.next[k], &writable);
+          max_fd = (std::max)(max_fd, socks.next[k]);
+          busy = true;
+        }
+        if (s[k].recv_step < steps)
+        { FD_SET(socks.prev[k], &readable);
+          max_fd = (std::max)(max_fd, socks.prev[k]);
+          busy = true;
+        }
+      }
+      if (!busy)
+        break;
+      if (select((int)max_fd + 1, &readable, &writable, nullptr, nullptr) == -1)
+        THROWERRNO("select");
+
+      for (size_t k = 0; k < streams; k++)
+      { ring_stream& r = s[k];
+        size_t lo, hi;
+        if (r.send_step < steps && FD_ISSET(socks.next[k], &writable))
+        { ring_range(n, ring_block(r.send_step), k, lo, hi);
+          size_t count = (std::min)(chunk_size, ring_sendable<T>(n, r, k) - r.sent);
+          int write_size = send(socks.next[k], (char*)(buffer + lo) + r.sent, (int)count, 0);
+          if (write_size < 0 && !socket_would_block())
+            THROWERRNO("send to next node");
+          if (write_size > 0)
+          { r.sent += write_size;
+            bytes_moved += write_size;
+          }
+        }
+        if (r.recv_step < steps && FD_ISSET(socks.prev[k], &readable))
+        { ring_range(n, ring_block(r.recv_step + 1), k, lo, hi);
+          size_t count = (std::min)(chunk_size, (hi - lo) * sizeof(T) - r.received);
+          bool reducing = r.recv_step < total - 1;
+          // a partial element waits at the front of the staging buffer for the rest of it
+          size_t partial = r.received % sizeof(T);
+          char* to = reducing ? &staging[k * (chunk_size + sizeof(T))] : (char*)(buffer + lo) + r.received;
+          int read_size = recv(socks.prev[k], reducing ? to + partial : to, (int)count, 0);
+          if (read_size == 0)
+            THROW("previous node closed the ring");
+          if (read_size < 0 && !socket_would_block())
+            THROWERRNO("recv from previous node");
+          if (read_size > 0)
+          { bytes_moved += read_size;
+            if (reducing)
+            { size_t whole = (partial + read_size) / sizeof(T);
+              addbufs<T, f>(buffer + lo + r.received / sizeof(T), (T*)to, whole);
+              memmove(to, to + whole * sizeof(T), partial + read_size - whole * sizeof(T));
+            }
+            r.received += read_size;
+          }
+        }
+        ring_advance<T>(n, r, k);
+      }
+    }
+  }
 
   template <class T> void pass_up(char* buffer, size_t left_read_pos, size_t right_read_pos, size_t& parent_sent_pos)
   { size_t my_bufsize = (std::min)(ar_buf_size, (std::min)(left_read_pos, right_read_pos) / sizeof(T) * sizeof(T) - parent_sent_pos);
@@ -187,6 +333,7 @@ private:
         THROW("Write to parent failed " << my_bufsize << " " << write_size << " " << parent_sent_pos << " " << left_read_pos << " " << right_read_pos);
 
       parent_sent_pos += write_size;
+      bytes_moved += write_size;
     }
   }
 
@@ -236,6 +383,7 @@ private:
             int read_size = recv(socks.children[i], &child_read_buf[i][child_unprocessed[i]], (int)count, 0);
             if (read_size == -1)
               THROWERRNO("recv from child");
+            bytes_moved += read_size;
 
             addbufs<T, f>((T*)buffer + child_read_pos[i] / sizeof(T), (T*)child_read_buf[i], (child_read_pos[i] + read_size) / sizeof(T) - child_read_pos[i] / sizeof(T));
 
@@ -262,8 +410,11 @@ private:
   void broadcast(char* buffer, const size_t n);
 
 public:
-  AllReduceSockets(std::string pspan_server, const size_t punique_id, size_t ptotal, const size_t pnode)
-    : AllReduce(ptotal, pnode), span_server(pspan_server), unique_id(punique_id)
+  AllReduceSockets(std::string pspan_server, const size_t punique_id, size_t ptotal, const size_t pnode,
+                   AllReduceAlgorithm palgorithm = AllReduceAlgorithm::tree, size_t pchunk_size = ar_ring_chunk_size,
+                   size_t pstreams = 1)
+    : AllReduce(ptotal, pnode), span_server(pspan_server), unique_id(punique_id), algorithm(palgorithm),
+      chunk_size(pchunk_size), streams(pstreams), bytes_moved(0)
   {
   }
 
@@ -271,10 +422,82 @@ public:
   {
   }
 
+  uint64_t traffic() const { return bytes_moved; }
+
   template <class T, void(*f)(T&, const T&)> void all_reduce(T* buffer, const size_t n)
   { if (span_server != socks.current_master)
       all_reduce_init();
-    reduce<T, f>((char*)buffer, n*sizeof(T));
-    broadcast((char*)buffer, n*sizeof(T));
+    if (algorithm == AllReduceAlgorithm::ring && total > 1)
+      ring<T, f>(buffer, n);
+    else
+    { reduce<T, f>((char*)buffer, n*sizeof(T));
+      broadcast((char*)buffer, n*sizeof(T));
+    }
+  }
+};
+
+const size_t ar_local_slot_size = 1<<20; // bytes each member of a host reduces at once
+
+// A hierarchical allreduce: the local_total members of a host, processes or threads, reduce
+// through memory they share, then one of them (local_node 0) reduces the result with the other
+// hosts through AllReduceSockets, and every member copies back what it gets.  Only one
+// connection per host goes through the spanning tree.  Every host runs local_total members; a
+// member is node host * local_total + local_node of hosts * local_total.
+class AllReduceHierarchy : public AllReduce
+{
+private:
+  size_t local_total;
+  size_t local_node;
+  size_t host_count;
+  AllReduceSockets* hosts; // of local_node 0, when there are other hosts
+  std::string name; // of the shared memory, by which the processes of a host find it
+  char* shared; // a header, then a slot of ar_local_slot_size bytes per member
+  size_t shared_size;
+  bool owner; // mapped shared itself
+  bool attached; // past the first wait, after which the name can go
+
+  void map_shared(bool create);
+  void attach();
+  bool stale();
+  void knock(); // to local_node 0, before the first wait
+  void answer(size_t member); // its knock
+  void wait(); // for all the members of the host
+  char* slot(size_t member) { return shared + 64 + member * ar_local_slot_size; }
+
+public:
+  // the processes of a host, which find one another's memory by unique_id and host
+  AllReduceHierarchy(std::string span_server, const size_t unique_id, size_t phost_count, size_t host,
+                     size_t plocal_total, size_t plocal_node, AllReduceAlgorithm algorithm = AllReduceAlgorithm::tree,
+                     size_t chunk_size = ar_ring_chunk_size, size_t streams = 1);
+
+  // members 1 .. local_total - 1 as threads of root's process, root being local_node 0
+  AllReduceHierarchy(AllReduceHierarchy* root, size_t plocal_node);
+
+  virtual ~AllReduceHierarchy();
+
+  uint64_t traffic() const { return hosts != nullptr ? hosts->traffic() : 0; } // between the hosts
+
+  template <class T, void(*f)(T&, const T&)> void all_reduce(T* buffer, const size_t n)
+  { if (!attached)
+      attach();
+    size_t per_slot = ar_local_slot_size / sizeof(T);
+    T* first = (T*)slot(0);
+    for (size_t start = 0; start < n; start += per_slot)
+    { size_t m = n - start < per_slot ? n - start : per_slot;
+      memcpy(slot(local_node), buffer + start, m * sizeof(T));
+      wait();
+      // each member reduces its share of the elements into the first slot, in member order
+      for (size_t i = m * local_node / local_total; i < m * (local_node + 1) / local_total; i++)
+        for (size_t k = 1; k < local_total; k++)
+          f(first[i], ((T*)slot(k))[i]);
+      wait();
+      if (host_count > 1)
+      { if (hosts != nullptr)
+          hosts->all_reduce<T, f>(first, m);
+        wait();
+      }
+      memcpy(buffer + start, first, m * sizeof(T));
+      wait(); // before the first slot takes the next elements
+    }
   }
 };
@@ -0,0 +1,233 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD (revised)
+license as described in the file LICENSE.
+*/
+/*
+This implements the allreduce function over the members of each host, through shared memory,
+and over the hosts, through sockets.
+*/
+#include <sstream>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <new>
+#include <random>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#endif
+#include "allreduce.h"
+
+using namespace std;
+
+// The start of the shared memory.  The members spin on it rather than sleep on a mutex, which
+// is what they would have to share between processes otherwise.
+struct local_header
+{
+  atomic<uint32_t> waiting; // members at the current wait
+  atomic<uint32_t> generation; // of waits all the members got past
+  atomic<uint32_t> ready; // set once local_node 0 made the memory
+  uint64_t run; // random, one per run, set before ready
+};
+
+uint64_t random_nonce()
+{
+  random_device device;
+  uint64_t nonce = ((uint64_t)device() << 32 | device()) ^ (uint64_t)chrono::steady_clock::now().time_since_epoch().count();
+  return nonce != 0 ? nonce : 1;
+}
+
+// Till the first wait, the start of each member's slot: the token it knocks with, then the one
+// local_node 0 answered with.
+atomic<uint64_t>* door(char* slot) { return (atomic<uint64_t>*)slot; }
+
+void back_off(size_t spins)
+{
+  if (spins < 1000)
+    this_thread::yield();
+  else
+    this_thread::sleep_for(chrono::microseconds(50));
+}
+
+AllReduceHierarchy::AllReduceHierarchy(string span_server, const size_t unique_id, size_t phost_count, size_t host,
+                                       size_t plocal_total, size_t plocal_node, AllReduceAlgorithm algorithm,
+                                       size_t chunk_size, size_t streams)
+  : AllReduce(phost_count * plocal_total, host * plocal_total + plocal_node), local_total(plocal_total),
+    local_node(plocal_node), host_count(phost_count), hosts(nullptr), shared(nullptr),
+    shared_size(64 + plocal_total * ar_local_slot_size), owner(false), attached(false)
+{
+  static_assert(sizeof(local_header) <= 64, "the slots start 64 bytes in");
+  stringstream s;
+  s << "/vw_allreduce_" << unique_id << "_" << host;
+  name = s.str();
+  if (local_node == 0)
+  {
+    if (host_count > 1)
+      hosts = new AllReduceSockets(span_server, unique_id, host_count, host, algorithm, chunk_size, streams);
+    map_shared(true);
+  }
+}
+
+AllReduceHierarchy::AllReduceHierarchy(AllReduceHierarchy* root, size_t plocal_node)
+  : AllReduce(root->total, root->node + plocal_node), local_total(root->local_total), local_node(plocal_node),
+    host_count(root->host_count), hosts(nullptr), name(root->name), shared(root->shared),
+    shared_size(root->shared_size), owner(false), attached(false)
+{
+}
+
+AllReduceHierarchy::~AllReduceHierarchy()
+{
+  delete hosts;
+#ifndef _WIN32
+  if (owner)
+  {
+    if (local_node == 0 && !attached)
+      shm_unlink(name.c_str());
+    munmap(shared, shared_size);
+  }
+#endif
+}
+
+void AllReduceHierarchy::map_shared(bool create)
+{
+#ifdef _WIN32
+  THROW("reducing through shared memory is only implemented for POSIX systems");
+#else
+  int fd;
+  if (create)
+  {
+    shm_unlink(name.c_str()); // left by a job with the same unique_id that died
+    fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+      THROWERRNO("shm_open(" << name << ")");
+    if (ftruncate(fd, shared_size) != 0)
+    {
+      close(fd);
+      THROWERRNO("ftruncate(" << name << ")");
+    }
+  }
+  else
+    for (size_t tries = 0;; tries++)
+    { // local_node 0 may not have made it yet
+      fd = shm_open(name.c_str(), O_RDWR, 0600);
+      struct stat st;
+      if (fd >= 0 && fstat(fd, &st) == 0 && (size_t)st.st_size == shared_size)
+        break;
+      if (fd >= 0)
+        close(fd);
+      if (tries == 6000)
+        THROW("local_node 0 did not share its memory as " << name << " within a minute");
+      this_thread::sleep_for(chrono::milliseconds(10));
+    }
+
+  void* p = mmap(nullptr, shared_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED)
+    THROWERRNO("mmap(" << name << ")");
+  shared = (char*)p;
+  owner = true;
+
+  local_header* header = (local_header*)shared;
+  if (create)
+  {
+    new (header) local_header();
+    header->run = random_nonce();
+    header->ready.store(1, memory_order_release);
+  }
+  else
+    while (header->ready.load(memory_order_acquire) == 0)
+      this_thread::yield();
+#endif
+}
+
+// Whether the memory this member mapped is no longer the memory under the name: a dead run's,
+// which local_node 0 of this one has replaced.
+bool AllReduceHierarchy::stale()
+{
+#ifdef _WIN32
+  return false;
+#else
+  int fd = shm_open(name.c_str(), O_RDONLY, 0600);
+  if (fd < 0)
+    return false; // in between, or this run's once everyone mapped it
+  struct stat st;
+  bool replaced = true; // by memory still being made
+  if (fstat(fd, &st) == 0 && (size_t)st.st_size == shared_size)
+  {
+    void* p = mmap(nullptr, sizeof(local_header), PROT_READ, MAP_SHARED, fd, 0);
+    if (p != MAP_FAILED)
+    {
+      replaced = ((local_header*)p)->run != ((local_header*)shared)->run;
+      munmap(p, sizeof(local_header));
+    }
+  }
+  close(fd);
+  return replaced;
+#endif
+}
+
+// A run that dies leaves its memory under the name, ready and all, for the members of the next
+// run with the same unique_id to map before local_node 0 replaces it.  So a member knocks with a
+// token of its own, and goes on to the first wait only once local_node 0 answered it, mapping
+// the memory again if it is replaced meanwhile.
+void AllReduceHierarchy::knock()
+{
+  uint64_t token = random_nonce();
+  door(slot(local_node))[0].store(token, memory_order_release);
+  for (size_t spins = 0; door(slot(local_node))[1].load(memory_order_acquire) != token; spins++)
+  {
+    back_off(spins);
+    if (owner && spins % 2000 == 1999 && stale())
+    {
+#ifndef _WIN32
+      munmap(shared, shared_size);
+#endif
+      shared = nullptr;
+      owner = false;
+      map_shared(false);
+      door(slot(local_node))[0].store(token, memory_order_release);
+    }
+  }
+}
+
+void AllReduceHierarchy::answer(size_t member)
+{
+  uint64_t token;
+  for (size_t spins = 0; (token = door(slot(member))[0].load(memory_order_acquire)) == 0; spins++)
+    back_off(spins);
+  door(slot(member))[1].store(token, memory_order_release);
+}
+
+void AllReduceHierarchy::attach()
+{
+  if (shared == nullptr)
+    map_shared(false);
+  if (local_node == 0)
+    for (size_t k = 1; k < local_total; k++)
+      answer(k);
+  else
+    knock();
+  wait();
+#ifndef _WIN32
+  if (owner && local_node == 0) // everyone has it mapped
+    shm_unlink(name.c_str());
+#endif
+  attached = true;
+}
+
+void AllReduceHierarchy::wait()
+{
+  local_header& header = *(local_header*)shared;
+  uint32_t generation = header.generation.load(memory_order_acquire);
+  if (header.waiting.fetch_add(1, memory_order_acq_rel) + 1 == local_total)
+  {
+    header.waiting.store(0, memory_order_relaxed);
+    header.generation.fetch_add(1, memory_order_release);
+    return;
+  }
+  // yield at first, then sleep, as the others may be waiting on the other hosts
+  for (size_t spins = 0; header.generation.load(memory_order_acquire) == generation; spins++)
+    back_off(spins);
+}
@@ -22,6 +22,7 @@ Alekh Agarwal and John Langford, with help Olivier Chapelle.
 #include <io.h>
 #else
 #include <unistd.h>
+#include <fcntl.h>
 #include <arpa/inet.h>
 #endif
 #include <sys/timeb.h>
@@ -99,6 +100,73 @@ socket_t getsock()
   return sock;
 }
 
+bool socket_would_block()
+{
+#ifdef _WIN32
+  return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+  return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+void set_nonblocking(socket_t sock)
+{
+#ifdef _WIN32
+  u_long on = 1;
+  if (ioctlsocket(sock, FIONBIO, &on) != 0)
+    THROWERRNO("ioctlsocket FIONBIO");
+#else
+  int flags = fcntl(sock, F_GETFL, 0);
+  if (flags == -1 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) == -1)
+    THROWERRNO("fcntl O_NONBLOCK");
+#endif
+}
+
+// Listens on the first free port from netport up, and leaves netport at it.
+socket_t listen_from(short unsigned int& netport, int backlog)
+{
+  socket_t sock = getsock();
+  sockaddr_in address;
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = netport;
+
+  bool listening = false;
+  while(!listening)
+  {
+    if (::bind(sock,(sockaddr*)&address, sizeof(address)) < 0)
+    {
+#ifdef _WIN32
+      if (WSAGetLastError() == WSAEADDRINUSE)
+#else
+      if (errno == EADDRINUSE)
+#endif
+      {
+        netport = htons(ntohs(netport)+1);
+        address.sin_port = netport;
+      }
+      else
+        THROWERRNO("bind");
+    }
+    else
+    {
+      if (listen(sock, backlog) < 0)
+      {
+        cerr << "listen: " << strerror(errno) << endl;
+        CLOSESOCK(sock);
+        sock = getsock();
+      }
+      else
+      {
+        listening = true;
+      }
+    }
+  }
+  return sock;
+}
+
+void add_address(uint64_t& a, const uint64_t& b) { a += b; }
+
 void AllReduceSockets::all_reduce_init()
 {
 #ifdef _WIN32
@@ -148,45 +216,7 @@ void AllReduceSockets::all_reduce_init()
   socket_t sock = -1;
   short unsigned int netport = htons(26544);
   if(kid_count > 0)
-  {
-    sock = getsock();
-    sockaddr_in address;
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = htonl(INADDR_ANY);
-    address.sin_port = netport;
-
-    bool listening = false;
-    while(!listening)
-    {
-      if (::bind(sock,(sockaddr*)&address, sizeof(address)) < 0)
-      {
-#ifdef _WIN32
-        if (WSAGetLastError() == WSAEADDRINUSE)
-#else
-        if (errno == EADDRINUSE)
-#endif
-        {
-          netport = htons(ntohs(netport)+1);
-          address.sin_port = netport;
-        }
-        else
-          THROWERRNO("bind");
-      }
-      else
-      {
-        if (listen(sock, kid_count) < 0)
-        {
-          cerr << "listen: " << strerror(errno) << endl;
-          CLOSESOCK(sock);
-          sock = getsock();
-        }
-        else
-        {
-          listening = true;
-        }
-      }
-    }
-  }
+    sock = listen_from(netport, kid_count);
 
   if(send(master_sock, (const char*)&netport, sizeof(netport), 0) < (int)sizeof(netport))
     cerr << "write netport failed!" << endl;
@@ -207,6 +237,12 @@ void AllReduceSockets::all_reduce_init()
     cerr << "read parent_port failed!" << endl;
   else cerr << "read parent_port=" << parent_port << endl;
 
+  // the address the other nodes reach this one at, as the span server sees it
+  sockaddr_in local;
+  socklen_t local_size = sizeof(local);
+  if (getsockname(master_sock, (sockaddr*)&local, &local_size) < 0)
+    THROWERRNO("getsockname");
+
   CLOSESOCK(master_sock);
 
   if(parent_ip != (uint32_t)-1)
@@ -234,6 +270,52 @@ void AllReduceSockets::all_reduce_init()
 
   if (kid_count > 0)
     CLOSESOCK(sock);
+
+  if (algorithm == AllReduceAlgorithm::ring && total > 1)
+    ring_init(local.sin_addr.s_addr);
+}
+
+// Connects the ring: every node listens, the addresses go around the tree, and each node
+// opens its streams to the next node and accepts those of the previous one.
+void AllReduceSockets::ring_init(uint32_t ip)
+{
+  short unsigned int netport = htons(26544);
+  socket_t sock = listen_from(netport, (int)streams);
+
+  vector<uint64_t> addresses(total, 0);
+  addresses[node] = ((uint64_t)ip << 16) | netport;
+  reduce<uint64_t, add_address>((char*)addresses.data(), total * sizeof(uint64_t));
+  broadcast((char*)addresses.data(), total * sizeof(uint64_t));
+
+  uint64_t next = addresses[(node + 1) % total];
+  socks.next.resize(streams);
+  for (uint32_t k = 0; k < streams; k++)
+  {
+    socks.next[k] = sock_connect((uint32_t)(next >> 16), (int)(next & 0xffff));
+    if (send(socks.next[k], (const char*)&k, sizeof(k), 0) < (int)sizeof(k))
+      THROWERRNO("write stream to next node");
+  }
+
+  socks.prev.assign(streams, -1);
+  for (size_t i = 0; i < streams; i++)
+  {
+    sockaddr_in address;
+    socklen_t size = sizeof(address);
+    socket_t f = accept(sock, (sockaddr*)&address, &size);
+    if (f < 0)
+      THROWERRNO("accept");
+    uint32_t k;
+    if (recv(f, (char*)&k, sizeof(k), MSG_WAITALL) < (int)sizeof(k) || k >= streams || socks.prev[k] != -1)
+      THROW("bad stream from previous node");
+    socks.prev[k] = f;
+  }
+  CLOSESOCK(sock);
+
+  for (size_t k = 0; k < streams; k++)
+  {
+    set_nonblocking(socks.next[k]);
+    set_nonblocking(socks.prev[k]);
+  }
 }
 
 
@@ -249,6 +331,7 @@ void AllReduceSockets::pass_down(char* buffer, const size_t parent_read_pos, siz
       cerr<<"Write to left child failed\n";
     if(socks.children[1] != -1 && send(socks.children[1], buffer+children_sent_pos, (int)my_bufsize, 0) < (int)my_bufsize)
       cerr<<"Write to right child failed\n";
+    bytes_moved += my_bufsize * ((socks.children[0] != -1) + (socks.children[1] != -1));
 
     children_sent_pos += my_bufsize;
   }
@@ -287,6 +370,8 @@ void AllReduceSockets::broadcast(char* buffer, const size_t n)
         cerr <<" recv from parent: " << strerror(errno) << endl;
       }
       parent_read_pos += read_size;
+      if (read_size > 0)
+        bytes_moved += read_size;
     }
   }
 }
@@ -127,8 +127,13 @@ void SpanningTree::Start()
 
 void SpanningTree::Stop()
 {
-  CLOSESOCK(sock);
+  if (m_stop) // already, as the destructor stops it again
+    return;
   m_stop = true;
+#ifndef _WIN32
+  shutdown(sock, SHUT_RDWR); // closing alone does not wake the accept in Run
+#endif
+  CLOSESOCK(sock);
 
   // wait for run to stop
   if (m_future != nullptr)
@@ -6,6 +6,8 @@
 #include <vector>
 #include <memory>
 #include <thread>
+#include <atomic>
+#include <algorithm>
 
 // #include <cpprest/http_client.h>
 
@@ -103,61 +105,68 @@ namespace Microsoft {
       TObject* obj() { return _obj->val(); }
     };
 
+    // One generation of pooled objects: the factory building them and the idle ones.
+    // Requests only ever see a fully built epoch; update_factory replaces it as a whole.
     template<typename TObject, typename TFactory>
-    class ObjectPool {
-      int version;
+    struct ObjectPoolEpoch {
+      const int version;
+      std::unique_ptr<TFactory> factory;
       std::vector<PooledObject<TObject>*> pool;
-      TFactory* factory;
-      boost::mutex _mutex;
-      int used_objects;
+      boost::mutex mutex;
+      std::atomic_int created_objects;
 
-    public:
-      ObjectPool()
-        : version(0), factory(nullptr), used_objects(0)
+      ObjectPoolEpoch(int pversion, TFactory* pfactory)
+        : version(pversion), factory(pfactory), created_objects(0)
       { }
 
-      ~ObjectPool() {
-        // TODO: I'm not sure this is needed as we better not have outstanding
-        // make sure we have synchronized access
-        boost::unique_lock<boost::mutex> lock(_mutex);
-
-        // delete factory
-        if (factory) {
-          delete factory;
-          factory = nullptr;
-        }
-        
-        // delete each pool object
+      ~ObjectPoolEpoch() {
         for (auto&& obj : pool)
           delete obj;
-        pool.clear();
-
-        // TODO: log if used_objects > 0
       }
+    };
+
+    template<typename TObject, typename TFactory>
+    class ObjectPool {
+      typedef ObjectPoolEpoch<TObject, TFactory> Epoch;
+
+      // read with std::atomic_load so a swap is a single pointer flip for the request path
+      std::shared_ptr<Epoch> _epoch;
+      boost::mutex _update_mutex;
+
+    public:
+      ObjectPool()
+        : _epoch(std::make_shared<Epoch>(0, nullptr))
+      { }
+
+      // TODO: log if objects are still in use; they are deleted when returned
 
       PooledObject<TObject>* get_or_create() {
-        boost::unique_lock<boost::mutex> lock(_mutex);
+        std::shared_ptr<Epoch> epoch = std::atomic_load(&_epoch);
 
         // TODO: introduce exception handleable by swig
-        /*if (!factory)
+        /*if (!epoch->factory)
           throw new */
 
-        if (pool.size() == 0) {
-          used_objects++;
-          return new PooledObject<TObject>((*factory)(), version);
+        {
+          boost::unique_lock<boost::mutex> lock(epoch->mutex);
+          if (epoch->pool.size() > 0) {
+            auto back = epoch->pool.back();
+            epoch->pool.pop_back();
+            return back;
+          }
         }
 
-        auto back = pool.back();
-        pool.pop_back();
-
-        return back;
+        // build outside of the lock so other requests are not held up
+        epoch->created_objects++;
+        return new PooledObject<TObject>((*epoch->factory)(), epoch->version);
       }
 
       void return_to_pool(PooledObject<TObject>* obj) {
-        boost::unique_lock<boost::mutex> lock(_mutex);
+        std::shared_ptr<Epoch> epoch = std::atomic_load(&_epoch);
 
-        if (version == obj->version) {
-          pool.push_back(obj);
+        if (epoch->version == obj->version) {
+          boost::unique_lock<boost::mutex> lock(epoch->mutex);
+          epoch->pool.push_back(obj);
           return;
         }
 
@@ -165,21 +174,30 @@ namespace Microsoft {
       }
 
       // takes owner-ship of factory (and will free using delete)
+      // Builds as many objects as the current epoch needed before publishing them, so the
+      // calling (background) thread pays for construction instead of the first requests.
+      // If the factory throws, the current epoch keeps serving.
       void update_factory(TFactory* new_factory) {
-        boost::unique_lock<boost::mutex> lock(_mutex);
+        boost::unique_lock<boost::mutex> lock(_update_mutex);
 
-        // use new factory and delete old one
-        if (factory)
-          delete factory;
-        factory = new_factory;
+        std::shared_ptr<Epoch> current = std::atomic_load(&_epoch);
+        auto next = std::make_shared<Epoch>(current->version + 1, new_factory);
 
-        // increment the version
-        version++;
+        int warm_objects = std::max(1, (int)current->created_objects);
+        for (int i = 0; i < warm_objects; i++)
+          next->pool.push_back(new PooledObject<TObject>((*new_factory)(), next->version));
+        next->created_objects = warm_objects;
 
-        // dispose old objects
-        for (auto&& obj : pool)
+        std::atomic_store(&_epoch, next);
+
+        // dispose old idle objects here rather than in whichever request drops the last reference
+        std::vector<PooledObject<TObject>*> retired;
+        {
+          boost::unique_lock<boost::mutex> epoch_lock(current->mutex);
+          retired.swap(current->pool);
+        }
+        for (auto&& obj : retired)
           delete obj;
-        pool.clear();
       }
     };
   }
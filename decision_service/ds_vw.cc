@@ -142,6 +142,10 @@ namespace Microsoft {
     VowpalWabbitThreadSafe::~VowpalWabbitThreadSafe() {
     }
 
+    void VowpalWabbitThreadSafe::update_model(std::shared_ptr<VowpalWabbitModel> model) {
+      pool.update_factory(new VowpalWabbitFactory(model));
+    }
+
     std::vector<float> VowpalWabbitThreadSafe::rank(const char* context) {
       PooledObjectGuard<VowpalWabbit, VowpalWabbitFactory> guard(pool, pool.get_or_create());
 
@@ -48,6 +48,9 @@ namespace Microsoft {
       VowpalWabbitThreadSafe();
       virtual ~VowpalWabbitThreadSafe();
 
+      // clones and warms the new model in the calling thread, then switches requests over at once
+      void update_model(std::shared_ptr<VowpalWabbitModel> model);
+
       virtual std::vector<float> rank(const char* context);
     };
   }
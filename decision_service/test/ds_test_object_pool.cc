@@ -0,0 +1,62 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD (revised)
+license as described in the file LICENSE.
+*/
+
+#include <boost/test/unit_test.hpp>
+
+#include "ds_internal.h"
+
+using namespace boost::unit_test;
+using namespace std;
+using namespace Microsoft::DecisionService;
+
+namespace {
+  struct Model {
+    int generation;
+  };
+
+  struct ModelFactory {
+    int generation;
+    int* built;
+
+    Model* operator()() {
+      (*built)++;
+      return new Model{ generation };
+    }
+  };
+}
+
+BOOST_AUTO_TEST_SUITE( DecisionServiceObjectPool )
+
+BOOST_AUTO_TEST_CASE( UpdateWarmsObjects )
+{
+    int built = 0;
+    ObjectPool<Model, ModelFactory> pool;
+    pool.update_factory(new ModelFactory{ 1, &built });
+    BOOST_CHECK_EQUAL(built, 1);
+
+    // two concurrent requests need a second object
+    auto first = pool.get_or_create();
+    auto second = pool.get_or_create();
+    BOOST_CHECK_EQUAL(built, 2);
+    pool.return_to_pool(first);
+
+    // the new generation is built before it is published
+    pool.update_factory(new ModelFactory{ 2, &built });
+    BOOST_CHECK_EQUAL(built, 4);
+
+    // an object of the old generation is dropped when returned
+    pool.return_to_pool(second);
+
+    auto a = pool.get_or_create();
+    auto b = pool.get_or_create();
+    BOOST_CHECK_EQUAL(built, 4);
+    BOOST_CHECK_EQUAL(a->val()->generation, 2);
+    BOOST_CHECK_EQUAL(b->val()->generation, 2);
+    pool.return_to_pool(a);
+    pool.return_to_pool(b);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "../allreduce/allreduce.h"
+#include "spanning_tree.h"
+
+using namespace std;
+
+// Times AllReduceSockets summing a vector of floats over nodes that are threads of this process
+// talking through localhost, with the tree and with the ring at a few stream counts, against a
+// spanning tree server run in process, and AllReduceHierarchy with the nodes as two members of
+// each host.  The floats are small whole numbers, so the sums are
+// exact in any order, and every node checks it ends with them.
+//
+//   allreduce_bench [nodes] [floats, as a power of two] [rounds]
+
+void add_float(float& a, const float& b) { a += b; }
+
+struct setup
+{
+  const char* name;
+  AllReduceAlgorithm algorithm;
+  size_t streams;
+  size_t local; // members of each host, through shared memory, or 1 for sockets only
+};
+
+template <class A>
+void time_rounds(A& ar, size_t nodes, size_t node, size_t n, size_t rounds, double& seconds, char& right)
+{
+  vector<float> buffer(n);
+  float connect = 0;
+  ar.template all_reduce<float, add_float>(&connect, 1);
+
+  right = true;
+  auto start = chrono::steady_clock::now();
+  for (size_t r = 0; r < rounds; r++)
+  {
+    for (size_t i = 0; i < n; i++)
+      buffer[i] = (float)((node + 1) * (i % 7));
+    ar.template all_reduce<float, add_float>(buffer.data(), n);
+    for (size_t i = 0; i < n; i++)
+      right = right && buffer[i] == (float)(nodes * (nodes + 1) / 2 * (i % 7));
+  }
+  seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void node_main(size_t unique_id, size_t nodes, size_t node, setup s, size_t n, size_t rounds, double& seconds,
+               char& right)
+{
+  if (s.local > 1)
+  {
+    AllReduceHierarchy ar("localhost", unique_id, nodes / s.local, node / s.local, s.local, node % s.local,
+                          s.algorithm, ar_ring_chunk_size, s.streams);
+    time_rounds(ar, nodes, node, n, rounds, seconds, right);
+  }
+  else
+  {
+    AllReduceSockets ar("localhost", unique_id, nodes, node, s.algorithm, ar_ring_chunk_size, s.streams);
+    time_rounds(ar, nodes, node, n, rounds, seconds, right);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  size_t nodes = argc > 1 ? atoi(argv[1]) : 4;
+  size_t n = (size_t)1 << (argc > 2 ? atoi(argv[2]) : 24);
+  size_t rounds = argc > 3 ? atoi(argv[3]) : 3;
+
+  VW::SpanningTree server;
+  server.Start();
+
+  printf("%d nodes, %zu MB per node\n", (int)nodes, n * sizeof(float) >> 20);
+  printf("%12s %9s %10s %8s %6s\n", "allreduce", "seconds", "MB/s", "speedup", "sums");
+  setup setups[] = { { "tree", AllReduceAlgorithm::tree, 1, 1 }, { "ring", AllReduceAlgorithm::ring, 1, 1 },
+                     { "ring 2", AllReduceAlgorithm::ring, 2, 1 }, { "ring 4", AllReduceAlgorithm::ring, 4, 1 },
+                     { "2 per host", AllReduceAlgorithm::tree, 1, 2 } };
+  double tree_seconds = 0.;
+  for (size_t k = 0; k < sizeof(setups) / sizeof(setups[0]); k++)
+  {
+    if (nodes % setups[k].local != 0)
+      continue;
+    vector<thread> threads;
+    vector<double> seconds(nodes);
+    vector<char> right(nodes);
+    for (size_t node = 0; node < nodes; node++)
+      threads.push_back(thread(node_main, k + 1, nodes, node, setups[k], n, rounds, ref(seconds[node]),
+                               ref(right[node])));
+    for (thread& t : threads)
+      t.join();
+
+    double slowest = 0.;
+    bool all_right = true;
+    for (size_t node = 0; node < nodes; node++)
+    {
+      slowest = seconds[node] > slowest ? seconds[node] : slowest;
+      all_right = all_right && right[node];
+    }
+    if (k == 0)
+      tree_seconds = slowest;
+    printf("%12s %8.3fs %10.1f %7.2fx %6s\n", setups[k].name, slowest,
+           rounds * n * sizeof(float) / slowest / (1 << 20), tree_seconds / slowest, all_right ? "exact" : "WRONG");
+  }
+
+  server.Stop();
+  return 0;
+}
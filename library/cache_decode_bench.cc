@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "../vowpalwabbit/vw.h"
+#include "../vowpalwabbit/cache.h"
+#include "../vowpalwabbit/stream_vbyte.h"
+
+using namespace std;
+
+// Times the decoders for the indices column of a --cache_format 2 cache: the varint loop of
+// the row cache against Stream VByte, scalar and SIMD.  The deltas are those of a real cache,
+// made with eg. vw -d train-sets/0001.dat -c --cache_format 2, encoded both ways with the
+// cache's own codecs.
+//
+//   cache_decode_bench [cache] [rounds]
+
+template<class F> double mb_per_sec(size_t bytes, size_t rounds, F decode)
+{ auto start = chrono::steady_clock::now();
+  for (size_t r = 0; r < rounds; r++)
+    decode();
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  return (double)bytes * rounds / seconds / (1 << 20);
+}
+
+int main(int argc, char** argv)
+{ string cache = argc > 1 ? argv[1] : "../test/train-sets/0001.dat.cache";
+  size_t rounds = argc > 2 ? atoi(argv[2]) : 2000;
+
+  vw* all = VW::initialize("--quiet --cache_file " + cache);
+  if (all->p->reader != read_cached_columns)
+  { fprintf(stderr, "%s is not a --cache_format 2 cache\n", cache.c_str());
+    VW::finish(*all);
+    return 1;
+  }
+  v_array<uint32_t> deltas = v_init<uint32_t>();
+  size_t blocks = 0;
+  while (read_cache_block_deltas(*all, deltas))
+    blocks++;
+  VW::finish(*all);
+  size_t count = deltas.size();
+  if (count == 0)
+  { fprintf(stderr, "%s holds no features\n", cache.c_str());
+    return 1;
+  }
+
+  vector<char> varints(10 * count + 16, 0);
+  char* end = varints.data();
+  for (uint32_t d : deltas)
+    end = run_len_encode(end, d);
+  vector<char> svb(svb_max_size(count) + 16, 0);
+  size_t svb_bytes = svb_encode(deltas.begin(), count, svb.data());
+
+  vector<uint32_t> out(count);
+  size_t decoded_bytes = count * sizeof(uint32_t);
+  uint64_t sum = 0;
+
+  double varint_rate = mb_per_sec(decoded_bytes, rounds, [&]()
+  { char* p = varints.data();
+    for (size_t i = 0; i < count; i++)
+    { uint64_t v = 0;
+      p = run_len_decode(p, v);
+      out[i] = (uint32_t)v;
+    }
+    sum += out[count - 1];
+  });
+  double scalar_rate = mb_per_sec(decoded_bytes, rounds, [&]()
+  { svb_decode_scalar(svb.data(), svb_bytes, count, out.data());
+    sum += out[count - 1];
+  });
+  double simd_rate = mb_per_sec(decoded_bytes, rounds, [&]()
+  { svb_decode(svb.data(), svb_bytes, count, out.data());
+    sum += out[count - 1];
+  });
+
+  if (memcmp(out.data(), deltas.begin(), decoded_bytes) != 0)
+  { fprintf(stderr, "stream vbyte round trip failed\n");
+    return 1;
+  }
+
+  printf("%zu deltas in %zu blocks, %zu varint bytes, %zu stream vbyte bytes (checksum %llu)\n", count, blocks,
+         (size_t)(end - varints.data()), svb_bytes, (unsigned long long)sum);
+  printf("varint              %8.1f MB/s\n", varint_rate);
+  printf("stream vbyte scalar %8.1f MB/s\n", scalar_rate);
+  printf("stream vbyte %-6s %8.1f MB/s\n", svb_simd_available() ? "ssse3" : "(none)", simd_rate);
+  deltas.delete_v();
+  return 0;
+}
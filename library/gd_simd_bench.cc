@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include "../vowpalwabbit/gd_simd.h"
+
+using namespace std;
+
+// Times the kernels of gd_simd.h at every level the CPU supports against the scalar ones, on
+// namespaces of random features over a table of weight blocks of four floats (the stride of the
+// default update).  Checks that the norm and update passes leave the weights bit for bit as
+// the scalar passes do, and reports how far the dot products and the sums are from scalar.
+//
+//   gd_simd_bench [features per namespace] [bits] [rounds]
+
+struct sums
+{
+  vector<float> dots, norm_x, pred_per_update;
+};
+
+double run(simd_level level, vector<float>& w, uint64_t mask, vector<float>& x, vector<uint64_t>& index,
+           size_t n, size_t rounds, sums& out)
+{
+  size_t namespaces = x.size() / n;
+  auto start = chrono::steady_clock::now();
+  for (size_t r = 0; r < rounds; r++)
+    for (size_t k = 0; k < namespaces; k++)
+    {
+      const float* xs = &x[k * n];
+      const uint64_t* is = &index[k * n];
+      float dot = simd_dot(level, w.data(), mask, xs, is, n, 0);
+      float norm_x = 0., pred_per_update = 0.;
+      simd_norm_pass(level, w.data(), mask, xs, is, n, 0, 0.25f, norm_x, pred_per_update);
+      simd_update_pass(level, w.data(), mask, xs, is, n, 0, k % 2 ? -0.01f : 0.01f);
+      if (r == 0)
+      {
+        out.dots.push_back(dot);
+        out.norm_x.push_back(norm_x);
+        out.pred_per_update.push_back(pred_per_update);
+      }
+    }
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+float max_relative(vector<float>& a, vector<float>& b)
+{
+  float worst = 0.;
+  for (size_t i = 0; i < a.size(); i++)
+  {
+    float scale = fmaxf(fabsf(a[i]), 1e-30f);
+    worst = fmaxf(worst, fabsf(a[i] - b[i]) / scale);
+  }
+  return worst;
+}
+
+int main(int argc, char** argv)
+{
+  size_t n = argc > 1 ? atoi(argv[1]) : 64;
+  size_t bits = argc > 2 ? atoi(argv[2]) : 18;
+  size_t rounds = argc > 3 ? atoi(argv[3]) : 200;
+  size_t namespaces = 1000;
+  uint64_t mask = ((uint64_t)4 << bits) - 1;
+
+  srand(17);
+  vector<float> start_weights((size_t)4 << bits), x(n * namespaces);
+  vector<uint64_t> index(n * namespaces);
+  for (float& v : start_weights)
+    v = (float)rand() / RAND_MAX;
+  for (size_t j = 0; j < x.size(); j++)
+  {
+    x[j] = (float)rand() / RAND_MAX * 2.f - 1.f;
+    index[j] = ((uint64_t)rand() << 2) & mask;
+  }
+
+  printf("best level: %s\n", simd_level_name(best_simd_level()));
+  printf("%7s %10s %8s %10s %10s %10s %8s\n", "level", "time", "speedup", "dot", "norm_x", "pred/upd", "weights");
+  vector<float> scalar_weights;
+  sums scalar;
+  double scalar_time = 0.;
+  for (simd_level level : { simd_level::none, simd_level::avx2, simd_level::avx512 })
+  {
+    if (level > best_simd_level())
+      break;
+    vector<float> w = start_weights;
+    sums s;
+    double time = run(level, w, mask, x, index, n, rounds, s);
+    if (level == simd_level::none)
+    {
+      scalar_weights = w;
+      scalar = s;
+      scalar_time = time;
+    }
+    bool same = !memcmp(w.data(), scalar_weights.data(), w.size() * sizeof(float));
+    printf("%7s %8.3fs %7.2fx %10.2e %10.2e %10.2e %8s\n", simd_level_name(level), time, scalar_time / time,
+           max_relative(scalar.dots, s.dots), max_relative(scalar.norm_x, s.norm_x),
+           max_relative(scalar.pred_per_update, s.pred_per_update),
+           same ? "same" : "DIFFER");
+  }
+  return 0;
+}
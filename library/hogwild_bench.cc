@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include "../vowpalwabbit/vw.h"
+
+using namespace std;
+
+// Scaling curve of --learn_threads: trains on the same synthetic data with 1, 2, 4, ... threads
+// sharing one weight vector (Hogwild), then with --thread_average, and reports the wall time,
+// the speedup over one thread and the progressive loss.  The examples are read from a cache so
+// that parsing keeps up with the learners.  Labels come from a hidden linear model over
+// namespace a; namespaces a and b are interacted with -q ab so that learning dominates.
+//
+//   hogwild_bench [examples] [max threads] [width]
+
+double train(const string& args, float& loss)
+{ vw* all = VW::initialize(args);
+  auto start = chrono::steady_clock::now();
+  VW::start_parser(*all);
+  LEARNER::generic_driver(*all);
+  VW::end_parser(*all);
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  loss = (float)(all->sd->sum_loss / all->sd->weighted_labeled_examples);
+  VW::finish(*all);
+  return seconds;
+}
+
+int main(int argc, char** argv)
+{ size_t count = argc > 1 ? atoi(argv[1]) : 100000;
+  size_t max_threads = argc > 2 ? atoi(argv[2]) : 8;
+  size_t width = argc > 3 ? atoi(argv[3]) : 16;
+  const char* data = "hogwild_bench.dat";
+
+  srand(17);
+  { ofstream out(data);
+    for (size_t i = 0; i < count; i++)
+    { stringstream a, b;
+      float score = 0.;
+      for (size_t f = 0; f < width; f++)
+      { size_t id = rand() % 10000;
+        score += (float)((id * 2654435761u) % 1000) / 500.f - 1.f;
+        a << " f" << id;
+        b << " g" << rand() % 100000;
+      }
+      out << (score > 0 ? 1 : -1) << " |a" << a.str() << " |b" << b.str() << "\n";
+    }
+  }
+
+  string base = string("--quiet -b 22 -q ab -c -d ") + data;
+  float loss;
+  train(base + " -k", loss); // write the cache
+
+  printf("%7s %9s %8s %8s %9s %8s %8s\n", "threads", "hogwild", "speedup", "loss", "averaged", "speedup",
+         "loss");
+  double single = 0.;
+  for (size_t threads = 1; threads <= max_threads; threads *= 2)
+  { stringstream args;
+    args << base << " --learn_threads " << threads;
+    float hogwild_loss, averaged_loss;
+    double hogwild = train(args.str(), hogwild_loss);
+    double averaged = train(args.str() + " --thread_average", averaged_loss);
+    if (threads == 1)
+      single = hogwild;
+    printf("%7zu %8.2fs %7.2fx %8.4f %8.2fs %7.2fx %8.4f\n", threads, hogwild, single / hogwild, hogwild_loss,
+           averaged, single / averaged, averaged_loss);
+  }
+
+  remove(data);
+  remove((string(data) + ".cache").c_str());
+  return 0;
+}
@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include "../vowpalwabbit/vw.h"
+
+using namespace std;
+
+// Times multi-pass training with and without --interaction_cache for pairs, triples and
+// interactions of four namespaces, and checks that both reach the same loss.  The examples have
+// namespaces a to d of a few features each and are read from a cache file.
+//
+//   interaction_cache_bench [examples] [passes] [width]
+
+double train(const string& args, float& loss)
+{ vw* all = VW::initialize(args);
+  auto start = chrono::steady_clock::now();
+  VW::start_parser(*all);
+  LEARNER::generic_driver(*all);
+  VW::end_parser(*all);
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  loss = (float)(all->sd->sum_loss / all->sd->weighted_labeled_examples);
+  VW::finish(*all);
+  return seconds;
+}
+
+int main(int argc, char** argv)
+{ size_t count = argc > 1 ? atoi(argv[1]) : 2000;
+  size_t passes = argc > 2 ? atoi(argv[2]) : 3;
+  size_t width = argc > 3 ? atoi(argv[3]) : 6;
+  const char* data = "interaction_cache_bench.dat";
+
+  srand(17);
+  { ofstream out(data);
+    for (size_t i = 0; i < count; i++)
+    { out << (rand() % 2 ? 1 : -1);
+      for (const char* ns : { "a", "b", "c", "d" })
+      { out << " |" << ns;
+        for (size_t f = 0; f < width; f++)
+          out << " " << ns << rand() % 1000 << ":" << (float)rand() / RAND_MAX;
+      }
+      out << "\n";
+    }
+  }
+
+  stringstream base;
+  base << "--quiet -b 22 --holdout_off -c -d " << data << " --passes " << passes;
+  float loss;
+  train(base.str() + " -k", loss); // write the cache
+
+  printf("%24s %9s %9s %8s %9s %9s\n", "interactions", "plain", "cached", "speedup", "loss", "cached");
+  for (const char* interactions : { "-q ab", "--cubic abc", "--interactions abcd", "-q ab --interactions abcd" })
+  { string args = base.str() + " " + interactions;
+    float plain_loss, cached_loss;
+    double plain = train(args, plain_loss);
+    double cached = train(args + " --interaction_cache 1024", cached_loss);
+    printf("%24s %8.2fs %8.2fs %7.2fx %9.5f %9.5f\n", interactions, plain, cached, plain / cached, plain_loss,
+           cached_loss);
+  }
+
+  remove(data);
+  remove((string(data) + ".cache").c_str());
+  return 0;
+}
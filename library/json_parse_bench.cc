@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "../vowpalwabbit/vw.h"
+#include "../vowpalwabbit/parse_example_json.h"
+
+using namespace std;
+
+// Times turning a recorded corpus of JSON requests into examples, the way a ranking
+// service does for every request, and prints a checksum of the parsed feature indices
+// so runs of different builds can be compared.
+//
+//   json_parse_bench [corpus] [repetitions] [dsjson|json]
+
+struct example_pool
+{ vw* all;
+  vector<example*> free;
+  vector<example*> used;
+};
+
+example& get_example(void* context)
+{ example_pool& pool = *(example_pool*)context;
+  example* ec;
+  if (pool.free.empty())
+    ec = VW::alloc_examples(0, 1);
+  else
+  { ec = pool.free.back();
+    pool.free.pop_back();
+  }
+  pool.all->p->lp.default_label(&ec->l);
+  pool.used.push_back(ec);
+  return *ec;
+}
+
+void release_examples(example_pool& pool)
+{ for (example* ec : pool.used)
+  { VW::empty_example(*pool.all, *ec);
+    pool.all->p->lp.delete_label(&ec->l);
+    pool.free.push_back(ec);
+  }
+  pool.used.clear();
+}
+
+int main(int argc, char** argv)
+{ const char* corpus = argc > 1 ? argv[1] : "../test/train-sets/decisionservice.json";
+  size_t repetitions = argc > 2 ? atoi(argv[2]) : 2000;
+  bool dsjson = argc > 3 ? strcmp(argv[3], "json") != 0 : true;
+
+  vector<string> lines;
+  ifstream in(corpus);
+  for (string line; getline(in, line);)
+    if (!line.empty())
+      lines.push_back(line);
+  if (lines.empty())
+  { printf("no requests in %s\n", corpus);
+    return 1;
+  }
+
+  vw* all = VW::initialize(dsjson ? "--quiet --no_stdin --cb_explore_adf --dsjson" : "--quiet --no_stdin --cb_explore_adf --json");
+  example_pool pool = { all };
+  v_array<example*> examples = v_init<example*>();
+  vector<char> buffer;
+  size_t bytes = 0, feature_count = 0;
+  uint64_t checksum = 0;
+
+  auto start = chrono::steady_clock::now();
+  for (size_t r = 0; r < repetitions; r++)
+    for (string& line : lines)
+    { // parsing is destructive
+      buffer.assign(line.begin(), line.end());
+      buffer.push_back('\0');
+
+      examples.erase();
+      examples.push_back(&get_example(&pool));
+      if (dsjson)
+      { DecisionServiceInteraction interaction;
+        VW::read_line_decision_service_json<false>(*all, examples, buffer.data(), line.size(), false, get_example, &pool, &interaction);
+      }
+      else
+        VW::read_line_json<false>(*all, examples, buffer.data(), get_example, &pool);
+
+      if (r == 0)
+      { bytes += line.size();
+        for (example* ec : examples)
+          for (features& fs : *ec)
+          { feature_count += fs.size();
+            for (feature_index i : fs.indicies)
+              checksum = checksum * 31 + i;
+          }
+      }
+      release_examples(pool);
+    }
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  printf("%zu requests, %zu bytes, %zu features each pass, checksum %016llx\n",
+         lines.size(), bytes, feature_count, (unsigned long long)checksum);
+  printf("%.2f us per request, %.1f MB/s\n", seconds / (repetitions * lines.size()) * 1e6,
+         bytes * repetitions / seconds / 1e6);
+
+  for (example* ec : pool.free)
+  { VW::dealloc_example(all->p->lp.delete_label, *ec);
+    free(ec);
+  }
+  examples.delete_v();
+  VW::finish(*all);
+  return 0;
+}
@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <chrono>
+#include <sstream>
+#include <vector>
+#include "../vowpalwabbit/vw.h"
+
+using namespace std;
+using namespace LEARNER;
+
+// Times learning k one-against-all problems per example the way oaa did before multilearn (one
+// multipredict, then an update per problem) against one multilearn, on the learner below --oaa,
+// and checks that both leave the same weights.  The examples have namespaces a and b of random
+// features.
+//
+//   multilearn_bench [k] [features per namespace] [examples] [passes] [bits] [extra vw arguments]
+
+double train(base_learner& base, vector<example*>& examples, vector<uint32_t>& classes, size_t k, size_t passes,
+             bool batched)
+{
+  vector<polyprediction> pred(k);
+  vector<label_data> labels(k);
+  auto start = chrono::steady_clock::now();
+  for (size_t p = 0; p < passes; p++)
+    for (size_t e = 0; e < examples.size(); e++)
+    {
+      example& ec = *examples[e];
+      for (size_t c = 0; c < k; c++)
+        labels[c] = { classes[e] == c ? 1.f : -1.f, 1.f, 0.f };
+      if (batched)
+        base.multilearn(ec, 0, k, labels.data(), pred.data(), true);
+      else
+      {
+        ec.l.simple = { FLT_MAX, 0.f, 0.f };
+        base.multipredict(ec, 0, k, pred.data(), true);
+        for (size_t c = 0; c < k; c++)
+        {
+          ec.l.simple = labels[c];
+          ec.pred.scalar = pred[c].scalar;
+          base.update(ec, c);
+        }
+      }
+    }
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+  size_t k = argc > 1 ? atoi(argv[1]) : 10;
+  size_t width = argc > 2 ? atoi(argv[2]) : 20;
+  size_t count = argc > 3 ? atoi(argv[3]) : 5000;
+  size_t passes = argc > 4 ? atoi(argv[4]) : 5;
+  size_t bits = argc > 5 ? atoi(argv[5]) : 22;
+  string extra = argc > 6 ? argv[6] : "";
+
+  printf("%28s %4s %9s %9s %8s %8s\n", "arguments", "k", "one by one", "multilearn", "speedup", "weights");
+  for (const char* interaction : { "", "-q ab" })
+  {
+    vector<float> model[2];
+    double seconds[2];
+    for (int batched = 0; batched < 2; batched++)
+    {
+      stringstream args;
+      args << "--quiet --no_stdin -b " << bits << " --noconstant --oaa " << k << " " << interaction << " --ring_size "
+           << count + 1 << " " << extra;
+      vw* all = VW::initialize(args.str());
+
+      srand(17);
+      vector<example*> examples;
+      vector<uint32_t> classes;
+      for (size_t i = 0; i < count; i++)
+      {
+        stringstream line;
+        line << "1 |a";
+        for (size_t f = 0; f < width; f++)
+          line << " a" << rand() % 10000 << ":" << (float)rand() / RAND_MAX;
+        line << " |b";
+        for (size_t f = 0; f < width; f++)
+          line << " b" << rand() % 10000 << ":" << (float)rand() / RAND_MAX;
+        examples.push_back(VW::read_example(*all, line.str()));
+        classes.push_back(rand() % k);
+      }
+
+      seconds[batched] = train(*all->l->learn_base(), examples, classes, k, passes, batched != 0);
+      if (!all->weights.sparse)
+      {
+        dense_parameters& w = all->weights.dense_weights;
+        for (dense_iterator<weight> i = w.begin(); i != w.end(); ++i)
+          model[batched].push_back(*i);
+      }
+
+      for (example* ec : examples)
+        VW::finish_example(*all, ec);
+      VW::finish(*all);
+    }
+    bool same = model[0].size() == model[1].size() &&
+                !memcmp(model[0].data(), model[1].data(), model[0].size() * sizeof(float));
+    string shown = string(*interaction ? interaction : "none") + " " + extra;
+    printf("%28s %4zu %9.2fs %9.2fs %7.2fx %8s\n", shown.c_str(), k, seconds[0], seconds[1],
+           seconds[0] / seconds[1], same ? "same" : "differ");
+  }
+  return 0;
+}
@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <sstream>
+#include <vector>
+#include "../vowpalwabbit/vw.h"
+
+using namespace std;
+
+// Times scoring the candidates of a ranking request one at a time against VW::predict_batch.
+// Every candidate carries the same context namespace u plus its own namespace a; the batch
+// looks the context up in the weights once per request, and crosses it with itself once.
+// Checks that both give the same predictions.
+//
+//   predict_batch_bench [candidates] [context width] [requests]
+
+double seconds_for(vw& all, vector<example*>& examples, v_array<example*>& batch, size_t requests, bool batched)
+{ auto start = chrono::steady_clock::now();
+  for (size_t r = 0; r < requests; r++)
+    if (batched)
+      VW::predict_batch(all, batch);
+    else
+      for (example* ec : examples)
+        all.l->predict(*ec);
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{ size_t candidates = argc > 1 ? atoi(argv[1]) : 500;
+  size_t width = argc > 2 ? atoi(argv[2]) : 64;
+  size_t requests = argc > 3 ? atoi(argv[3]) : 200;
+
+  printf("%14s %6s %12s %12s %8s\n", "interaction", "width", "one by one", "batched", "speedup");
+  for (const char* interaction : { "", "-q ua", "-q uu", "-q uu -q ua" })
+  { stringstream args;
+    args << "--quiet --no_stdin -b 24 " << interaction << " --ring_size " << candidates + 1;
+    vw* all = VW::initialize(args.str());
+
+    srand(17);
+    stringstream context;
+    for (size_t f = 0; f < width; f++)
+      context << " c" << rand();
+    vector<example*> examples;
+    v_array<example*> batch = v_init<example*>();
+    for (size_t i = 0; i < candidates; i++)
+    { stringstream line;
+      line << (rand() % 2 ? 1 : -1) << " |u" << context.str() << " |a";
+      for (size_t f = 0; f < 8; f++)
+        line << " a" << rand();
+      example* ec = VW::read_example(*all, line.str());
+      all->learn(ec); // give the weights some values
+      examples.push_back(ec);
+      batch.push_back(ec);
+    }
+
+    vector<float> one_by_one;
+    for (example* ec : examples)
+    { all->l->predict(*ec);
+      one_by_one.push_back(ec->pred.scalar);
+    }
+    VW::predict_batch(*all, batch);
+    for (size_t i = 0; i < candidates; i++)
+      if (fabsf(one_by_one[i] - examples[i]->pred.scalar) > 1e-4f * fmaxf(1.f, fabsf(one_by_one[i]))) // summed in another order
+      { printf("prediction %zu differs: %f vs %f\n", i, one_by_one[i], examples[i]->pred.scalar);
+        return 1;
+      }
+
+    double single = seconds_for(*all, examples, batch, requests, false);
+    double batched = seconds_for(*all, examples, batch, requests, true);
+    printf("%14s %6zu %9.2f us %9.2f us %7.2fx\n", *interaction ? interaction : "none", width,
+           single / requests * 1e6, batched / requests * 1e6, single / batched);
+
+    for (example* ec : examples)
+      VW::finish_example(*all, ec);
+    batch.delete_v();
+    VW::finish(*all);
+  }
+  return 0;
+}
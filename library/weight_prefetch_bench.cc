@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <sstream>
+#include <vector>
+#include "../vowpalwabbit/vw.h"
+
+using namespace std;
+
+// Times predict and learn over the same examples with weight prefetching off and on
+// (--weight_prefetch 0 and 8), for a range of -b and namespace widths.  Features are random
+// strings, so the weights they hash to are spread over the whole table.  Each example has
+// namespaces a and b of the given width, interacted with -q ab.
+//
+//   weight_prefetch_bench [examples] [rounds]
+
+double seconds_for(vw& all, vector<example*>& examples, size_t rounds, bool training)
+{ all.training = training;
+  auto start = chrono::steady_clock::now();
+  for (size_t r = 0; r < rounds; r++)
+    for (example* ec : examples)
+      all.learn(ec);
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{ size_t count = argc > 1 ? atoi(argv[1]) : 1000;
+  size_t rounds = argc > 2 ? atoi(argv[2]) : 5;
+  const size_t bits[] = { 18, 22, 26 };
+  const size_t widths[] = { 4, 16, 64 };
+
+  printf("%4s %6s %9s %14s %14s %14s %14s\n", "-b", "width", "features", "predict off", "predict on",
+         "learn off", "learn on");
+  for (size_t b : bits)
+    for (size_t width : widths)
+    { srand(17);
+      vector<string> lines;
+      for (size_t i = 0; i < count; i++)
+      { stringstream line;
+        line << (rand() % 2 ? 1 : -1);
+        for (char ns : { 'a', 'b' })
+        { line << " |" << ns;
+          for (size_t f = 0; f < width; f++)
+            line << " f" << rand();
+        }
+        lines.push_back(line.str());
+      }
+
+      double ns_per_feature[4];
+      size_t features = 0;
+      for (size_t distance : { 0, 8 })
+      { stringstream args;
+        args << "--quiet --no_stdin -q ab -b " << b << " --weight_prefetch " << distance << " --ring_size " << count + 1;
+        vw* all = VW::initialize(args.str());
+        vector<example*> examples;
+        for (string& line : lines)
+          examples.push_back(VW::read_example(*all, line));
+        features = examples[0]->num_features;
+
+        seconds_for(*all, examples, 1, true); // touch the weights once
+        double predict = seconds_for(*all, examples, rounds, false);
+        double learn = seconds_for(*all, examples, rounds, true);
+        double total = (double)features * count * rounds / 1e9;
+        ns_per_feature[distance == 0 ? 0 : 1] = predict / total;
+        ns_per_feature[distance == 0 ? 2 : 3] = learn / total;
+
+        for (example* ec : examples)
+          VW::finish_example(*all, ec);
+        VW::finish(*all);
+      }
+      printf("%4zu %6zu %9zu %11.2f ns %11.2f ns %11.2f ns %11.2f ns\n", b, width, features, ns_per_feature[0],
+             ns_per_feature[1], ns_per_feature[2], ns_per_feature[3]);
+    }
+  return 0;
+}
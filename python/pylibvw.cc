@@ -196,6 +196,50 @@ float my_predict_string(vw_ptr all, char*str)
   return pp;
 }
 
+#if PY_MAJOR_VERSION >= 3
+#define PyBytesOrString_AsStringAndSize PyBytes_AsStringAndSize
+#define PyBytesOrString_FromStringAndSize PyBytes_FromStringAndSize
+#else
+#define PyBytesOrString_AsStringAndSize PyString_AsStringAndSize
+#define PyBytesOrString_FromStringAndSize PyString_FromStringAndSize
+#endif
+
+example* my_read_wire_example(vw_ptr all, py::object frame)
+{ char* data;
+  Py_ssize_t length;
+  if (PyBytesOrString_AsStringAndSize(frame.ptr(), &data, &length) < 0)
+    py::throw_error_already_set();
+  size_t consumed;
+  example* ec = VW::read_wire_example(*all, data, (size_t)length, consumed);
+  if (ec == nullptr)
+    THROW("wire example: incomplete frame of " << length << " bytes");
+  return ec;
+}
+
+float my_learn_wire(vw_ptr all, py::object frame)
+{ example*ec = my_read_wire_example(all, frame);
+  all->learn(ec);
+  float pp = ec->partial_prediction;
+  VW::finish_example(*all, ec);
+  return pp;
+}
+
+float my_predict_wire(vw_ptr all, py::object frame)
+{ example*ec = my_read_wire_example(all, frame);
+  all->l->predict(*ec);
+  float pp = ec->partial_prediction;
+  VW::finish_example(*all, ec);
+  return pp;
+}
+
+py::object my_example_to_wire(vw_ptr all, example_ptr ec)
+{ v_array<char> frame = v_init<char>();
+  VW::write_wire_example(*all, *ec, frame);
+  PyObject* ret = PyBytesOrString_FromStringAndSize(frame.begin(), frame.size());
+  frame.delete_v();
+  return py::object(py::handle<>(ret));
+}
+
 string varray_char_to_string(v_array<char> &a)
 { string ret = "";
   for (auto c : a)
@@ -671,6 +715,9 @@ BOOST_PYTHON_MODULE(pylibvw)
   .def("learn_string", &my_learn_string, "given an example specified as a string (as in a VW data file), learn on that example")
   .def("predict", &my_predict, "given a pyvw example, predict on that example")
   .def("predict_string", &my_predict_string, "given an example specified as a string (as in a VW data file), predict on that example")
+  .def("learn_wire", &my_learn_wire, "given one example as a wire frame (bytes, see cache.h), learn on that example")
+  .def("predict_wire", &my_predict_wire, "given one example as a wire frame (bytes, see cache.h), predict on that example")
+  .def("example_to_wire", &my_example_to_wire, "given a pyvw example with a simple label, return it as a wire frame (bytes)")
   .def("hash_space", &VW::hash_space, "given a namespace (as a string), compute the hash of that namespace")
   .def("hash_feature", &VW::hash_feature, "given a feature string (arg2) and a hashed namespace (arg3), hash that feature")
   .def("finish_example", &my_finish_example, "tell VW that you're done with a given example")
@@ -47,6 +47,21 @@ def test_delete():
     assert 'model' not in locals()
 
 
+def test_wire_example():
+    model = vw(quiet=True)
+    ex = model.example('1 2 foo| a b:0.5 |n c')
+    frame = model.example_to_wire(ex)
+    assert isinstance(frame, bytes)
+    text = vw(quiet=True)
+    wire = vw(quiet=True)
+    for _ in range(3):
+        text.learn_string('1 2 foo| a b:0.5 |n c')
+        wire.learn_wire(frame)
+    assert wire.predict_string('| a b:0.5 |n c') == text.predict_string('| a b:0.5 |n c')
+    assert wire.get_weighted_examples() == text.get_weighted_examples()
+    del model, text, wire
+
+
 # Test prediction types
 
 def test_scalar_prediction_type():
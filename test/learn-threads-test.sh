@@ -0,0 +1,86 @@
+#!/bin/bash
+# -- --learn_threads test
+#
+# Learner threads race on the weights, so the loss learning on several
+# threads can't be checked against a reference: it has to come out within
+# a tolerance of the loss learning on one.
+
+NAME='learn-threads-test'
+
+DataSet=train-sets/0001.dat
+Cache=${NAME}.cache
+SaveData=${NAME}.save.dat
+
+Errors=0
+
+warn() {
+    echo "$@" 1>&2
+    Errors=$(($Errors+1))
+}
+
+
+die() {
+    warn "$@"
+    exit 1
+}
+
+average_loss() {
+    $vw -k -c --cache_file "$Cache" --passes 3 --holdout_off -d "$DataSet" "$@" 2>&1 |
+        sed -n 's/^average loss = //p'
+}
+
+# check_loss <tolerance> <vw arguments>
+check_loss() {
+    tolerance="$1"
+    shift
+    loss=`average_loss "$@"`
+    awk -v loss="$loss" -v one="$OneThread" -v tolerance="$tolerance" \
+        'BEGIN { d = loss - one; if (d < 0) d = -d; exit !(loss != "" && d <= tolerance) }' || \
+        warn "$vw $*: average loss $loss, $OneThread on one thread, tolerance $tolerance"
+}
+
+# A save that fails has to end the run with its error, rather than leave
+# the other threads waiting for their turn.
+check_failed_save() {
+    (head -200 "$DataSet"; echo "save_/nonexistent/dir/model|"; tail -200 "$DataSet") > "$SaveData"
+    out=`timeout 60 $vw --learn_threads 2 -d "$SaveData" 2>&1`
+    status=$?
+    rm -f "$SaveData"
+    [ $status -ne 124 ] || warn "$vw --learn_threads 2: hung after a failed save"
+    case "$out" in
+        (*"can't open: /nonexistent/dir/model"*) : ;;
+        (*) warn "$vw --learn_threads 2: no error for a failed save" ;;
+    esac
+}
+
+verify_learn_threads() {
+    vw="$1"
+
+    OneThread=`average_loss`
+    [ -n "$OneThread" ] || die "$vw: no average loss on one thread"
+
+    check_loss 0.01 --learn_threads 3
+    check_loss 0.01 --learn_threads 2 --sparse_weights
+    # each thread learns from half the examples between averagings
+    check_loss 0.05 --learn_threads 2 --thread_average
+    check_failed_save
+
+    rm -f "$Cache"
+    case $Errors in
+        (0) : ;;
+        (*) warn "$vw: $Errors errors"
+            ;;
+    esac
+}
+
+
+#
+# main
+#
+case "$#" in
+    (1) verify_learn_threads "$1"
+        ;;
+    (*) die "Usage: $0 <vw_executable>"
+        ;;
+esac
+exit $Errors
@@ -12,13 +12,32 @@ Alekh Agarwal and John Langford, with help Olivier Chapelle.
 #include <sys/timeb.h>
 #include <cmath>
 #include <stdint.h>
+#include <string.h>
+#include <algorithm>
 #include "global_data.h"
+#include "cache.h"
 #include "vw_allreduce.h"
 
 using namespace std;
 
 void add_float(float& c1, const float& c2) { c1 += c2; }
 
+// Sparse weights are read without being created, and only created where the reduced value is
+// nonzero, so a reduction does not fill the table with every weight of the hash space.
+float get_sparse(const sparse_parameters& weights, uint64_t i, size_t offset)
+{
+  return (&weights[i])[offset];
+}
+
+void set_sparse(sparse_parameters& weights, uint64_t i, size_t offset, float value)
+{
+  weight* w = weights.find(i);
+  if (w == nullptr && value != 0.f)
+    w = &weights[i];
+  if (w != nullptr)
+    w[offset] = value;
+}
+
 void accumulate(vw& all, parameters& weights, size_t offset)
 {
   uint64_t length = UINT64_ONE << all.num_bits; //This is size of gradient
@@ -26,7 +45,7 @@ void accumulate(vw& all, parameters& weights, size_t offset)
 
   if (weights.sparse)
     for (uint64_t i = 0; i < length; i++)
-      local_grad[i] = (&(weights.sparse_weights[i << weights.sparse_weights.stride_shift()]))[offset];
+      local_grad[i] = get_sparse(weights.sparse_weights, i << weights.sparse_weights.stride_shift(), offset);
   else
     for (uint64_t i = 0; i < length; i++)
       local_grad[i] = (&(weights.dense_weights[i << weights.dense_weights.stride_shift()]))[offset];
@@ -35,7 +54,7 @@ void accumulate(vw& all, parameters& weights, size_t offset)
 
   if (weights.sparse)
     for (uint64_t i = 0; i < length; i++)
-      (&(weights.sparse_weights[i << weights.sparse_weights.stride_shift()]))[offset] = local_grad[i];
+      set_sparse(weights.sparse_weights, i << weights.sparse_weights.stride_shift(), offset, local_grad[i]);
   else
     for (uint64_t i = 0; i < length; i++)
       (&(weights.dense_weights[i << weights.dense_weights.stride_shift()]))[offset] = local_grad[i];
@@ -50,27 +69,28 @@ float accumulate_scalar(vw& all, float local_sum)
   return temp;
 }
 
-void accumulate_avg(vw& all, parameters& weights, size_t offset)
+// The helpers below work on dense or sparse weights alike, and on the copy an averaging in the
+// background works on; they reduce through all_reduce_now, their callers having waited for any
+// averaging in the background already.
+inline float read_weight(dense_parameters& weights, uint64_t i, size_t offset) { return (&weights[i])[offset]; }
+inline float read_weight(sparse_parameters& weights, uint64_t i, size_t offset) { return get_sparse(weights, i, offset); }
+inline void write_weight(dense_parameters& weights, uint64_t i, size_t offset, float value) { (&weights[i])[offset] = value; }
+inline void write_weight(sparse_parameters& weights, uint64_t i, size_t offset, float value) { set_sparse(weights, i, offset, value); }
+
+template<class W>
+void average(vw& all, W& weights, size_t offset)
 {
-  uint32_t length = 1 << all.num_bits; //This is size of gradient
+  uint64_t length = UINT64_ONE << all.num_bits; //This is size of gradient
   float numnodes = (float)all.all_reduce->total;
   float* local_grad = new float[length];
 
-  if (weights.sparse)
-    for (uint64_t i = 0; i < length; i++)
-      local_grad[i] = (&(weights.sparse_weights[i << weights.sparse_weights.stride_shift()]))[offset];
-  else
-    for (uint64_t i = 0; i < length; i++)
-      local_grad[i] = (&(weights.dense_weights[i << weights.dense_weights.stride_shift()]))[offset];
+  for (uint64_t i = 0; i < length; i++)
+    local_grad[i] = read_weight(weights, i << weights.stride_shift(), offset);
 
-  all_reduce<float, add_float>(all, local_grad, length); //TODO: modify to not use first()
+  all_reduce_now<float, add_float>(all, local_grad, length); //TODO: modify to not use first()
 
-  if (weights.sparse)
-    for (uint64_t i = 0; i < length; i++)
-      (&(weights.sparse_weights[i << weights.sparse_weights.stride_shift()]))[offset] = local_grad[i] / numnodes;
-  else
-    for (uint64_t i = 0; i < length; i++)
-      (&(weights.dense_weights[i << weights.dense_weights.stride_shift()]))[offset] = local_grad[i] / numnodes;
+  for (uint64_t i = 0; i < length; i++)
+    write_weight(weights, i << weights.stride_shift(), offset, local_grad[i] / numnodes);
 
   delete[] local_grad;
 }
@@ -91,27 +111,562 @@ float min_elem(float* arr, int length)
   return min;
 }
 
+inline weight* existing_weight(dense_parameters& weights, uint64_t i) { return &weights[i]; }
+inline weight* existing_weight(sparse_parameters& weights, uint64_t i) { return weights.find(i); }
+
+// local_weight comes in summed over the nodes, and goes out as this node's share of the weight
+inline void weigh(vw& all, float& local_weight, weight* weight)
+{
+  if (weight == nullptr)
+    local_weight = 0;
+  else if (local_weight > 0)
+  {
+    float ratio = weight[1] / local_weight;
+    local_weight = weight[0] * ratio;
+    weight[0] *= ratio;
+    weight[1] *= ratio; //A crude max
+    if (all.normalized_updates)
+      weight[all.normalized_idx] *= ratio; //A crude max
+  }
+  else
+  {
+    local_weight = 0;
+    *weight = 0;
+  }
+}
+
 template<class T>
 void do_weighting(vw& all, uint64_t length, float* local_weights, T& weights)
 {
   for (uint64_t i = 0; i < length; i++)
+    weigh(all, local_weights[i], existing_weight(weights, i << weights.stride_shift()));
+}
+
+// Returns how many bytes were reduced.
+template<class W>
+uint64_t weighted_average(vw& all, W& weights)
+{
+  uint64_t length = UINT64_ONE << all.num_bits; //This is the number of parameters
+  float* local_weights = new float[length];
+
+  for (uint64_t i = 0; i < length; i++)
+    local_weights[i] = read_weight(weights, i << weights.stride_shift(), 1);
+
+  //First compute weights for averaging
+  all_reduce_now<float, add_float>(all, local_weights, length);
+  do_weighting(all, length, local_weights, weights);
+  all_reduce_now<float, add_float>(all, weights.first(), length << weights.stride_shift());
+  delete[] local_weights;
+  return (length + (length << weights.stride_shift())) * sizeof(float);
+}
+
+uint64_t weighted_average(vw& all, sparse_parameters& weights);
+
+// --allreduce_delta: after an averaging every node holds the same weights, and a copy of them
+// is kept here, so a weight that differs from its copy at the next averaging changed on this
+// node since.  Comparing against the copy stands in for marking weights as they are learned,
+// which would slow down every update.  The first averaging is a full one, as the nodes may
+// start out different.
+struct delta_report
+{
+  uint64_t changed; // weights changed on this node
+  uint64_t bytes; // in the buffers reduced
+  uint64_t dense_bytes; // a full averaging would have reduced
+  uint64_t traffic; // this node sent and received over the network
+};
+
+struct delta_sync
+{
+  size_t bits; // of each change a plain average sends: 32, 16 or 8
+  float* synced; // the weights as of the last averaging: the first float of each, or all of them when weighted
+  float* residual; // what rounding left out of each change sent, added to the next one (16 or 8 bits)
+  float* changes; // summed over the nodes during a plain average, zero in between
+
+  delta_report last; // averaging, for the report
+};
+
+delta_sync* new_delta_sync(size_t bits)
+{
+  delta_sync* d = calloc_or_throw<delta_sync>(1);
+  d->bits = bits;
+  return d;
+}
+
+void free_delta_sync(delta_sync* d)
+{
+  if (d == nullptr)
+    return;
+  free(d->synced);
+  free(d->residual);
+  free(d->changes);
+  free(d);
+}
+
+// On the main thread only: an averaging in the background hands its report back to print.
+void report_delta(vw& all, const delta_report& r)
+{
+  if (all.allreduce_delta == nullptr || all.quiet)
+    return;
+  all.trace_message << "allreduce delta: " << r.changed << " weights changed here, " << r.bytes
+                    << " bytes reduced (" << r.traffic << " sent and received here), " << r.dense_bytes
+                    << " for a full averaging" << endl;
+}
+
+void add_uint64(uint64_t& c1, const uint64_t& c2) { c1 += c2; }
+void copy_segment_byte(char& c1, const char& c2) { if (c2 != 0) c1 = c2; }
+
+// Every node gets every node's segment of bytes, in node order, adding how many bytes were
+// reduced to bytes.  There is no allgather underneath, so this reduces a buffer of all the
+// segments, zero but for each node's own: every node moves about the number of nodes times what
+// it adds.  The nodes agree on the sizes first, so when the segments add up to more than limit
+// bytes they all return false without gathering, to average every weight instead.
+bool gather_segments(vw& all, vector<char>& mine, uint64_t limit, vector<char>& segments, vector<uint64_t>& sizes,
+                     uint64_t& bytes)
+{
+  size_t total = all.all_reduce->total;
+  sizes.assign(total, 0);
+  sizes[all.all_reduce->node] = mine.size();
+  all_reduce_now<uint64_t, add_uint64>(all, sizes.data(), total);
+
+  uint64_t before = 0, sum = 0;
+  for (size_t n = 0; n < total; n++)
+  {
+    if (n < all.all_reduce->node)
+      before += sizes[n];
+    sum += sizes[n];
+  }
+  bytes += total * sizeof(uint64_t);
+  if (sum > limit)
+    return false;
+  segments.assign(sum, 0);
+  if (sum > 0)
   {
-    float* weight = &weights[i << weights.stride_shift()];
-    if (local_weights[i] > 0)
+    memcpy(segments.data() + before, mine.data(), mine.size());
+    all_reduce_now<char, copy_segment_byte>(all, segments.data(), sum);
+  }
+  bytes += sum;
+  return true;
+}
+
+template<class T> void append(vector<char>& bytes, const T& value)
+{
+  bytes.insert(bytes.end(), (const char*)&value, (const char*)&value + sizeof(T));
+}
+
+template<class T> T extract(const char*& bytes)
+{
+  T value;
+  memcpy(&value, bytes, sizeof(T));
+  bytes += sizeof(T);
+  return value;
+}
+
+// Ascending indices, each as the varint of how far it is past the one before, as the cache
+// stores feature indices.
+template<class T> void append_indices(vector<char>& bytes, const vector<T>& indices)
+{
+  char buffer[10];
+  uint64_t previous = 0;
+  for (T i : indices)
+  {
+    char* end = run_len_encode(buffer, i - previous);
+    bytes.insert(bytes.end(), buffer, end);
+    previous = i;
+  }
+}
+
+inline uint64_t extract_index(const char*& bytes, uint64_t previous)
+{
+  uint64_t delta = 0;
+  bytes = run_len_decode((char*)bytes, delta);
+  return previous + delta;
+}
+
+// IEEE half precision, rounding to nearest even, and saturating rather than overflowing so that
+// the residual carries what did not fit.
+uint16_t to_half(float f)
+{
+  uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+  uint16_t sign = (uint16_t)((x >> 16) & 0x8000);
+  uint32_t magnitude = x & 0x7fffffff;
+  if (magnitude < 0x38800000) // below the smallest normal half, in steps of 2^-24
+  {
+    float a;
+    memcpy(&a, &magnitude, sizeof(a));
+    return sign | (uint16_t)lrintf(a * 16777216.f);
+  }
+  uint32_t h = (magnitude - 0x38000000) >> 13;
+  uint32_t rest = magnitude & 0x1fff;
+  if (rest > 0x1000 || (rest == 0x1000 && (h & 1)))
+    h++;
+  return sign | (uint16_t)(h < 0x7c00 ? h : 0x7bff);
+}
+
+float from_half(uint16_t h)
+{
+  uint32_t magnitude = h & 0x7fff;
+  float f;
+  if (magnitude < 0x400)
+    f = magnitude / 16777216.f;
+  else
+  {
+    uint32_t x = (magnitude << 13) + 0x38000000;
+    memcpy(&f, &x, sizeof(f));
+  }
+  return (h & 0x8000) ? -f : f;
+}
+
+// Every weight of sparse weights, through dense buffers of the whole hash space.
+uint64_t full_weighted_average(vw& all, sparse_parameters& weights)
+{
+  uint64_t length = UINT64_ONE << all.num_bits;
+  vector<float> local_weights(length);
+  for (uint64_t i = 0; i < length; i++)
+    local_weights[i] = get_sparse(weights, i << weights.stride_shift(), 1);
+  all_reduce_now<float, add_float>(all, local_weights.data(), length);
+  do_weighting(all, length, local_weights.data(), weights);
+
+  size_t stride = weights.stride();
+  vector<float> values(length << weights.stride_shift());
+  for (uint64_t i = 0; i < length; i++)
+    for (size_t o = 0; o < stride; o++)
+      values[(i << weights.stride_shift()) + o] = get_sparse(weights, i << weights.stride_shift(), o);
+  all_reduce_now<float, add_float>(all, values.data(), values.size());
+  for (uint64_t i = 0; i < length; i++)
+    for (size_t o = 0; o < stride; o++)
+      set_sparse(weights, i << weights.stride_shift(), o, values[(i << weights.stride_shift()) + o]);
+  return (local_weights.size() + values.size()) * sizeof(float);
+}
+
+inline uint64_t full_weighted_average(vw& all, dense_parameters& weights) { return weighted_average(all, weights); }
+
+// Sparse weights: the nodes first agree on which weights exist on any of them, then weigh and
+// reduce just those, rather than a dense copy of the whole hash space, unless the nodes have
+// so many that agreeing on them would move more than that.
+uint64_t weighted_average(vw& all, sparse_parameters& weights)
+{
+  vector<uint64_t> occupied;
+  for (sparse_parameters::iterator w = weights.begin(); w != weights.end(); ++w)
+    occupied.push_back(w.index());
+  sort(occupied.begin(), occupied.end());
+  vector<char> mine;
+  append_indices(mine, occupied);
+  uint64_t length = UINT64_ONE << all.num_bits;
+  uint64_t dense_bytes = (length + (length << weights.stride_shift())) * sizeof(float);
+  vector<char> segments;
+  vector<uint64_t> sizes;
+  uint64_t bytes = 0;
+  if (!gather_segments(all, mine, dense_bytes, segments, sizes, bytes))
+    return bytes + full_weighted_average(all, weights);
+
+  vector<uint64_t> slots; // on any node, each once
+  const char* segment = segments.data();
+  for (uint64_t size : sizes)
+  {
+    uint64_t i = 0;
+    for (const char* p = segment; p < segment + size;)
     {
-      float ratio = weight[1] / local_weights[i];
-      local_weights[i] = weight[0] * ratio;
-      weight[0] *= ratio;
-      weight[1] *= ratio; //A crude max
-      if (all.normalized_updates)
-        weight[all.normalized_idx] *= ratio; //A crude max
+      i = extract_index(p, i);
+      slots.push_back(i);
+    }
+    segment += size;
+  }
+  sort(slots.begin(), slots.end());
+  slots.erase(unique(slots.begin(), slots.end()), slots.end());
+  if (slots.empty())
+    return bytes;
+
+  vector<float> local_weights(slots.size());
+  for (size_t s = 0; s < slots.size(); s++)
+    local_weights[s] = get_sparse(weights, slots[s], 1);
+  all_reduce_now<float, add_float>(all, local_weights.data(), local_weights.size());
+  for (size_t s = 0; s < slots.size(); s++)
+    weigh(all, local_weights[s], weights.find(slots[s]));
+
+  size_t stride = weights.stride();
+  vector<float> values(slots.size() * stride);
+  for (size_t s = 0; s < slots.size(); s++)
+    for (size_t o = 0; o < stride; o++)
+      values[s * stride + o] = get_sparse(weights, slots[s], o);
+  all_reduce_now<float, add_float>(all, values.data(), values.size());
+  for (size_t s = 0; s < slots.size(); s++)
+    for (size_t o = 0; o < stride; o++)
+      set_sparse(weights, slots[s], o, values[s * stride + o]);
+  return bytes + (local_weights.size() + values.size()) * sizeof(float);
+}
+
+// A segment: how many changes, the scale of 8 bit ones, their values, then their indices.
+const size_t segment_header = sizeof(uint64_t) + 2 * sizeof(float);
+
+// Every weight, as the first averaging: the copy and the residual start over from it.
+template<class W>
+void full_delta_average(vw& all, W& weights)
+{
+  delta_sync& d = *all.allreduce_delta;
+  uint64_t length = UINT64_ONE << all.num_bits;
+  average(all, weights, 0);
+  for (uint64_t i = 0; i < length; i++)
+    d.synced[i] = read_weight(weights, i << weights.stride_shift(), 0);
+  if (d.residual != nullptr)
+    memset(d.residual, 0, length * sizeof(float));
+  d.last.bytes += d.last.dense_bytes;
+}
+
+template<class W>
+void delta_average(vw& all, W& weights)
+{
+  delta_sync& d = *all.allreduce_delta;
+  uint64_t length = UINT64_ONE << all.num_bits;
+  d.last.dense_bytes = length * sizeof(float);
+  if (d.synced == nullptr)
+  {
+    if (all.num_bits > 32)
+      THROW("--allreduce_delta keeps 32 bit indices, so -b can be at most 32");
+    d.synced = calloc_or_throw<float>(length);
+    d.changes = calloc_or_throw<float>(length);
+    if (d.bits < 32)
+      d.residual = calloc_or_throw<float>(length);
+    d.last.changed = length;
+    d.last.bytes = 0;
+    full_delta_average(all, weights);
+    return;
+  }
+
+  vector<uint32_t> changed; // here, including changes rounded away
+  vector<float> change;
+  float largest = 0.f;
+  for (uint64_t i = 0; i < length; i++)
+  {
+    float c = read_weight(weights, i << weights.stride_shift(), 0) - d.synced[i];
+    if (d.residual != nullptr)
+      c += d.residual[i];
+    if (c != 0.f)
+    {
+      changed.push_back((uint32_t)i);
+      change.push_back(c);
+      largest = fabsf(c) > largest ? fabsf(c) : largest;
+    }
+  }
+
+  // round the changes, keeping those that did not round to zero
+  float scale = largest / 127.f;
+  vector<uint32_t> sent;
+  vector<char> values;
+  for (size_t k = 0; k < changed.size(); k++)
+  {
+    float c = change[k];
+    float rounded = c;
+    if (d.bits == 16)
+    {
+      uint16_t h = to_half(c);
+      rounded = from_half(h);
+      if (rounded != 0.f)
+        append(values, h);
+    }
+    else if (d.bits == 8)
+    {
+      int8_t q = (int8_t)lrintf(c / scale);
+      rounded = q * scale;
+      if (q != 0)
+        append(values, q);
     }
     else
+      append(values, c);
+    if (d.residual != nullptr)
+      d.residual[changed[k]] = c - rounded;
+    if (rounded != 0.f)
+      sent.push_back(changed[k]);
+  }
+  vector<char> mine;
+  append(mine, (uint64_t)sent.size());
+  append(mine, scale);
+  append(mine, 0.f);
+  mine.insert(mine.end(), values.begin(), values.end());
+  append_indices(mine, sent);
+
+  vector<char> segments;
+  vector<uint64_t> sizes;
+  d.last.bytes = 0;
+  d.last.changed = changed.size();
+  if (!gather_segments(all, mine, d.last.dense_bytes, segments, sizes, d.last.bytes))
+  {
+    full_delta_average(all, weights);
+    return;
+  }
+
+  // sum the changes in node order, so that every node adds them up the same
+  vector<uint32_t> touched;
+  const char* segment = segments.data();
+  for (uint64_t size : sizes)
+  {
+    const char* p = segment;
+    uint64_t count = extract<uint64_t>(p);
+    float node_scale = extract<float>(p);
+    extract<float>(p);
+    const char* value = p;
+    p += count * (d.bits / 8);
+    uint64_t i = 0;
+    for (uint64_t k = 0; k < count; k++)
     {
-      local_weights[i] = 0;
-      *weight = 0;
+      i = extract_index(p, i);
+      if (d.bits == 16)
+        d.changes[i] += from_half(extract<uint16_t>(value));
+      else if (d.bits == 8)
+        d.changes[i] += extract<int8_t>(value) * node_scale;
+      else
+        d.changes[i] += extract<float>(value);
+      touched.push_back((uint32_t)i);
     }
+    segment += size;
+  }
+
+  float numnodes = (float)all.all_reduce->total;
+  for (uint32_t i : touched)
+  {
+    d.synced[i] += d.changes[i] / numnodes;
+    d.changes[i] = 0.f;
+    write_weight(weights, (uint64_t)i << weights.stride_shift(), 0, d.synced[i]);
+  }
+  for (uint32_t i : changed) // what was rounded away waits in the residual
+    write_weight(weights, (uint64_t)i << weights.stride_shift(), 0, d.synced[i]);
+}
+
+// After a weighted averaging of every weight: the copy starts over from it.
+template<class W>
+void copy_synced(vw& all, W& weights)
+{
+  delta_sync& d = *all.allreduce_delta;
+  uint64_t length = UINT64_ONE << all.num_bits;
+  for (uint64_t i = 0; i < length; i++)
+    for (size_t o = 0; o < weights.stride(); o++)
+      d.synced[(i << weights.stride_shift()) + o] = read_weight(weights, i << weights.stride_shift(), o);
+}
+
+// Weighted by the adaptive sums, the nodes first agree on which weights changed on any of them,
+// then weigh and reduce all the floats of just those, as weighted_average does for every weight.
+// Changes are not rounded here.
+template<class W>
+void delta_weighted_average(vw& all, W& weights)
+{
+  delta_sync& d = *all.allreduce_delta;
+  uint64_t length = UINT64_ONE << all.num_bits;
+  size_t stride = weights.stride();
+  uint32_t stride_shift = weights.stride_shift();
+  d.last.dense_bytes = (length + (length << stride_shift)) * sizeof(float);
+  if (d.synced == nullptr)
+  {
+    if (all.num_bits > 32)
+      THROW("--allreduce_delta keeps 32 bit indices, so -b can be at most 32");
+    d.synced = calloc_or_throw<float>(length << stride_shift);
+    d.last.changed = length;
+    d.last.bytes = weighted_average(all, weights);
+    copy_synced(all, weights);
+    return;
+  }
+
+  vector<uint32_t> changed;
+  for (uint64_t i = 0; i < length; i++)
+    for (size_t o = 0; o < stride; o++)
+      if (read_weight(weights, i << stride_shift, o) != d.synced[(i << stride_shift) + o])
+      {
+        changed.push_back((uint32_t)i);
+        break;
+      }
+  vector<char> mine;
+  append_indices(mine, changed);
+
+  vector<char> segments;
+  vector<uint64_t> sizes;
+  d.last.bytes = 0;
+  d.last.changed = changed.size();
+  if (!gather_segments(all, mine, d.last.dense_bytes, segments, sizes, d.last.bytes))
+  {
+    d.last.bytes += full_weighted_average(all, weights);
+    copy_synced(all, weights);
+    return;
+  }
+
+  vector<uint32_t> slots; // changed anywhere, each once
+  vector<bool> seen(length, false);
+  const char* segment = segments.data();
+  for (uint64_t size : sizes)
+  {
+    uint64_t i = 0;
+    for (const char* p = segment; p < segment + size;)
+    {
+      i = extract_index(p, i);
+      if (!seen[i])
+      {
+        seen[i] = true;
+        slots.push_back((uint32_t)i);
+      }
+    }
+    segment += size;
+  }
+  if (slots.empty())
+    return;
+
+  vector<float> local_weights(slots.size());
+  for (size_t s = 0; s < slots.size(); s++)
+    local_weights[s] = read_weight(weights, (uint64_t)slots[s] << stride_shift, 1);
+  all_reduce_now<float, add_float>(all, local_weights.data(), local_weights.size());
+  for (size_t s = 0; s < slots.size(); s++)
+    weigh(all, local_weights[s], existing_weight(weights, (uint64_t)slots[s] << stride_shift));
+
+  vector<float> values(slots.size() * stride);
+  for (size_t s = 0; s < slots.size(); s++)
+    for (size_t o = 0; o < stride; o++)
+      values[s * stride + o] = read_weight(weights, (uint64_t)slots[s] << stride_shift, o);
+  all_reduce_now<float, add_float>(all, values.data(), values.size());
+  for (size_t s = 0; s < slots.size(); s++)
+    for (size_t o = 0; o < stride; o++)
+    {
+      uint64_t i = (uint64_t)slots[s] << stride_shift;
+      write_weight(weights, i, o, values[s * stride + o]);
+      d.synced[i + o] = values[s * stride + o];
+    }
+  d.last.bytes += (local_weights.size() + values.size()) * sizeof(float);
+}
+
+// Returns the report of a delta averaging.
+template<class W>
+delta_report average_pass(vw& all, W& weights, bool weighted)
+{
+  uint64_t traffic = all.all_reduce->traffic();
+  if (weighted)
+  {
+    if (all.allreduce_delta != nullptr)
+      delta_weighted_average(all, weights);
+    else
+      weighted_average(all, weights);
+  }
+  else if (all.allreduce_delta != nullptr)
+    delta_average(all, weights);
+  else
+    average(all, weights, 0);
+  if (all.allreduce_delta == nullptr)
+    return delta_report();
+  delta_report r = all.allreduce_delta->last;
+  r.traffic = all.all_reduce->traffic() - traffic;
+  return r;
+}
+
+void accumulate_avg(vw& all, parameters& weights, size_t offset)
+{
+  wait_background_avg(all);
+  if (offset != 0) // the delta only follows the first float
+  {
+    if (weights.sparse)
+      average(all, weights.sparse_weights, offset);
+    else
+      average(all, weights.dense_weights, offset);
+    return;
   }
+  if (weights.sparse)
+    report_delta(all, average_pass(all, weights.sparse_weights, false));
+  else
+    report_delta(all, average_pass(all, weights.dense_weights, false));
 }
 
 void accumulate_weighted_avg(vw& all, parameters& weights)
@@ -121,28 +676,154 @@ void accumulate_weighted_avg(vw& all, parameters& weights)
     all.trace_message<<"Weighted averaging is implemented only for adaptive gradient, use accumulate_avg instead\n";
     return;
   }
-  uint32_t length = 1 << all.num_bits; //This is the number of parameters
-  float* local_weights = new float[length];
-
+  wait_background_avg(all);
   if (weights.sparse)
-    for (uint64_t i = 0; i < length; i++)
-      local_weights[i] = (&(weights.sparse_weights[i << weights.sparse_weights.stride_shift()]))[1];
+    report_delta(all, average_pass(all, weights.sparse_weights, true));
   else
-    for (uint64_t i = 0; i < length; i++)
-      local_weights[i] = (&(weights.dense_weights[i << weights.dense_weights.stride_shift()]))[1];
+    report_delta(all, average_pass(all, weights.dense_weights, true));
+}
 
-  //First compute weights for averaging
-  all_reduce<float, add_float>(all, local_weights, length);
+struct background_avg
+{
+  vw* all;
+  bool weighted;
+  bool sparse;
+  // the weights when the averaging started, and averaged: dense weights are copied whole, sparse
+  // weights just the slots in use
+  dense_parameters* before;
+  dense_parameters* after;
+  sparse_parameters sparse_before;
+  sparse_parameters sparse_after;
+#ifdef _WIN32
+  HANDLE thread;
+#else
+  pthread_t thread;
+#endif
+  bool running;
+  string error; // thrown on the thread
+  delta_report report; // printed once the thread is done
+
+  background_avg(vw& a, parameters& weights, uint64_t length)
+    : all(&a), weighted(a.adaptive), sparse(weights.sparse), before(nullptr), after(nullptr),
+      sparse_before(length, weights.stride_shift()), sparse_after(length, weights.stride_shift()), running(false)
+  {
+    if (!sparse)
+    {
+      before = new dense_parameters(length, weights.stride_shift());
+      after = new dense_parameters(length, weights.stride_shift());
+    }
+  }
 
+  ~background_avg()
+  {
+    delete before;
+    delete after;
+  }
+};
+
+#ifdef _WIN32
+DWORD WINAPI background_avg_thread(LPVOID arg)
+#else
+void* background_avg_thread(void* arg)
+#endif
+{
+  background_avg& avg = *(background_avg*)arg;
+  try
+  {
+    if (avg.sparse)
+      avg.report = average_pass(*avg.all, avg.sparse_after, avg.weighted);
+    else
+      avg.report = average_pass(*avg.all, *avg.after, avg.weighted);
+  }
+  catch (exception& e)
+  {
+    avg.error = e.what();
+  }
+  return 0L;
+}
+void start_background_avg(vw& all, parameters& weights)
+{
+  uint64_t length = UINT64_ONE << all.num_bits;
+  background_avg* avg = new background_avg(all, weights, length);
   if (weights.sparse)
-    do_weighting(all, length, local_weights, weights.sparse_weights);
+  {
+    sparse_parameters& sparse_weights = weights.sparse_weights;
+    size_t bytes = sparse_weights.stride() * sizeof(float);
+    avg->sparse_before.copy_default(sparse_weights);
+    avg->sparse_after.copy_default(sparse_weights);
+    for (sparse_parameters::iterator iter = sparse_weights.begin(); iter != sparse_weights.end(); ++iter)
+    {
+      memcpy(&avg->sparse_before[iter.index()], &(*iter), bytes);
+      memcpy(&avg->sparse_after[iter.index()], &(*iter), bytes);
+    }
+  }
   else
-    do_weighting(all, length, local_weights, weights.dense_weights);
+  {
+    uint64_t total = length << weights.stride_shift();
+    memcpy(avg->before->first(), weights.dense_weights.first(), total * sizeof(float));
+    memcpy(avg->after->first(), avg->before->first(), total * sizeof(float));
+  }
+
+  all.pending_avg = avg;
+  avg->running = true;
+#ifdef _WIN32
+  avg->thread = ::CreateThread(nullptr, 0, static_cast<LPTHREAD_START_ROUTINE>(background_avg_thread), avg, 0L, nullptr);
+#else
+  pthread_create(&avg->thread, nullptr, background_avg_thread, avg);
+#endif
+}
+
+void wait_background_avg(vw& all)
+{
+  background_avg* avg = all.pending_avg;
+  if (avg == nullptr || !avg->running)
+    return;
+#ifdef _WIN32
+  ::WaitForSingleObject(avg->thread, INFINITE);
+  ::CloseHandle(avg->thread);
+#else
+  pthread_join(avg->thread, nullptr);
+#endif
+  avg->running = false;
+  if (!avg->error.empty())
+  {
+    string error = avg->error;
+    all.pending_avg = nullptr;
+    delete avg;
+    THROW("averaging in the background failed: " << error);
+  }
+  report_delta(all, avg->report);
+}
+
+void finish_background_avg(vw& all, parameters& weights)
+{
+  wait_background_avg(all);
+  background_avg* avg = all.pending_avg;
+  if (avg == nullptr)
+    return;
+  all.pending_avg = nullptr;
 
   if (weights.sparse)
-    cout << "sparse parameters not supported with parallel computation!" << endl;
+  { // the averaging only ever adds slots, and a slot not in the snapshot read as the default
+    sparse_parameters& sparse_weights = weights.sparse_weights;
+    size_t stride = sparse_weights.stride();
+    for (sparse_parameters::iterator iter = avg->sparse_after.begin(); iter != avg->sparse_after.end(); ++iter)
+    {
+      const float* after = &(*iter);
+      const float* before = &((const sparse_parameters&)avg->sparse_before)[iter.index()];
+      for (size_t o = 0; o < stride; o++)
+        if (after[o] != before[o])
+          (&sparse_weights[iter.index()])[o] += after[o] - before[o];
+    }
+  }
   else
-    all_reduce<float, add_float>(all, weights.dense_weights.first(), length*weights.stride_shift());
-  delete[] local_weights;
+  {
+    uint64_t total = (UINT64_ONE << all.num_bits) << avg->after->stride_shift();
+    float* before = avg->before->first();
+    float* after = avg->after->first();
+    float* w = weights.dense_weights.first();
+    for (uint64_t i = 0; i < total; i++)
+      w[i] += after[i] - before[i];
+  }
+  delete avg;
 }
-
@@ -11,3 +11,17 @@ void accumulate(vw& all, parameters& weights, size_t o);
 float accumulate_scalar(vw& all, float local_sum);
 void accumulate_weighted_avg(vw& all, parameters& weights);
 void accumulate_avg(vw& all, parameters& weights, size_t o);
+
+// With --allreduce_delta the two averagings above exchange only the weights that changed since
+// the last one, and report how many bytes that took.
+delta_sync* new_delta_sync(size_t bits);
+void free_delta_sync(delta_sync* d);
+
+// The averaging at the end of a pass (accumulate_weighted_avg with --adaptive, else
+// accumulate_avg), on a copy of the weights taken now and on a thread of its own, so that
+// learning goes on meanwhile (--allreduce_async).  finish_background_avg waits for it and adds
+// to each weight what the averaging changed in the copy, keeping what was learned since.  The
+// copy and its averaged twin take twice the memory of the weights.
+void start_background_avg(vw& all, parameters& weights);
+void wait_background_avg(vw& all); // without applying it, so the connections are free again
+void finish_background_avg(vw& all, parameters& weights);
@@ -1,6 +1,7 @@
 #pragma once
 #include <string.h>
-#include <unordered_map>
+#include <algorithm>
+#include <vector>
 #ifndef _WIN32
 #include <sys/mman.h>
 #endif
@@ -11,12 +12,26 @@
 #define MAP_ANONYMOUS MAP_ANON
 #endif
 
+#include "weight_memory.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PREFETCH_WEIGHT(p) __builtin_prefetch(p)
+#elif defined(_MSC_VER)
+#include <xmmintrin.h>
+#define PREFETCH_WEIGHT(p) _mm_prefetch((const char*)(p), _MM_HINT_T0)
+#else
+#define PREFETCH_WEIGHT(p)
+#endif
+
 typedef float weight;
 
+// How many features ahead of the one being processed the feature loops prefetch its weight
+// (--weight_prefetch).  Hashed features land all over the table, so with large -b nearly
+// every lookup misses the cache; asking for the line a few features early hides most of that.
+const size_t default_weight_prefetch = 8;
+
 class dense_parameters;
 class sparse_parameters;
-typedef std::unordered_map<uint64_t, weight*> weight_map;
-
 template <typename T>
 class dense_iterator
 {
@@ -57,19 +72,31 @@ private:
 	uint64_t _weight_mask;  // (stride*(1 << num_bits) -1)
 	uint32_t _stride_shift;
 	bool _seeded; // whether the instance is sharing model state with others
+	size_t _mapped; // bytes mapped for _begin, 0 if it is on the heap
+	weight_memory _memory; // how _begin was allocated
+	size_t _prefetch; // features ahead to prefetch, 0 for none
+
+	void free_weights()
+	{ if (_mapped > 0)
+	    free_weight_memory(_begin, _mapped);
+	  else
+	    free(_begin);
+	}
 
  public:
 	typedef dense_iterator<weight> iterator;
 	typedef dense_iterator<const weight> const_iterator;
- dense_parameters(size_t length, uint32_t stride_shift=0)
-   : _begin(calloc_mergable_or_throw<weight>(length << stride_shift)),
+ dense_parameters(size_t length, uint32_t stride_shift=0, const weight_memory& requested=weight_memory())
+   : _begin(nullptr),
 	  _weight_mask((length << stride_shift) - 1),
 	  _stride_shift(stride_shift),
-	  _seeded(false)
-	    { }
+	  _seeded(false),
+	  _mapped(0),
+	  _prefetch(default_weight_prefetch)
+	    { _begin = alloc_weight_memory(length << stride_shift, requested, _memory, _mapped); }
 
  dense_parameters()
-	 : _begin(nullptr), _weight_mask(0), _stride_shift(0),_seeded(false)
+	 : _begin(nullptr), _weight_mask(0), _stride_shift(0),_seeded(false), _mapped(0), _prefetch(default_weight_prefetch)
 	  {}
 
 	bool not_null() { return (_weight_mask > 0 && _begin != nullptr);}
@@ -88,11 +115,18 @@ private:
 	const_iterator cend() { return const_iterator(_begin + _weight_mask + 1, _begin, stride()); }
 
 	inline weight& operator[](size_t i) const { return _begin[i & _weight_mask]; }
+	inline void prefetch(size_t i) const { PREFETCH_WEIGHT(&_begin[i & _weight_mask]); }
+	size_t prefetch_distance() const { return _prefetch; }
+	void prefetch_distance(size_t distance) { _prefetch = distance; }
+
 	void shallow_copy(const dense_parameters& input)
 	{
 	  if (!_seeded)
-		  free(_begin);
+		  free_weights();
 	  _begin = input._begin;
+	  _mapped = input._mapped;
+	  _memory = input._memory;
+	  _prefetch = input._prefetch;
 	  _weight_mask = input._weight_mask;
 	  _stride_shift = input._stride_shift;
 	  _seeded = true;
@@ -124,6 +158,8 @@ private:
 
 	uint64_t seeded() const { return _seeded; }
 
+	const weight_memory& memory() const { return _memory; }
+
 	uint32_t stride() const { return 1 << _stride_shift; }
 
 	uint32_t stride_shift() const { return _stride_shift; }
@@ -131,33 +167,84 @@ private:
 	void stride_shift(uint32_t stride_shift) { _stride_shift = stride_shift; }
 
 	#ifndef _WIN32
+	// moves the weights into memory shared with processes forked later, placed as they were
 	void share(size_t length)
 	{
-	  float* shared_weights = (float*)mmap(0, (length << _stride_shift) * sizeof(float),
-			                  PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
-          size_t float_count = length << _stride_shift;
-      	  weight* dest = shared_weights;
-		  memcpy(dest, _begin, float_count*sizeof(float));
-      	  free(_begin);
-      	  _begin = dest;
+	  size_t float_count = length << _stride_shift;
+	  weight_memory obtained;
+	  size_t mapped;
+	  weight* dest = alloc_shared_weight_memory(float_count, _memory, obtained, mapped);
+	  memcpy(dest, _begin, float_count*sizeof(float));
+	  free_weights();
+	  _begin = dest;
+	  _mapped = mapped;
+	  _memory = obtained;
 	}
 	#endif
 
 	~dense_parameters()
 	{  if (_begin != nullptr && !_seeded)  // don't free weight vector if it is shared with another instance
-	   {  free(_begin);
+	   {  free_weights();
 	      _begin = nullptr;
 	   }
 	}
 };
 
+/* sparse_parameters keeps its weights in an open addressing table with linear probing.  A slot
+** holds the index of a weight and a pointer to its stride() floats; those are handed out in
+** order from slabs of sparse_slab_blocks blocks, so they never move when the table grows and
+** references to them stay good.  Iteration walks the table in slot order.  Each weight is saved
+** with its index, so the order does not matter to loading a model, and it only depends on the
+** order weights were first touched in.
+**
+** share() makes the table concurrent, for daemon children, threads and seeded instances: the
+** slots and the weights move into one fixed size block of memory shared by all of them, with
+** room for a given number of weights.  Lookups and inserts are then lock free.  An insert
+** claims an empty slot by swapping its weights from nullptr to sparse_slot_busy, fills in the
+** index and initial weights, and publishes the slot by storing the weights.
+*/
+const size_t sparse_initial_slots = 1024;
+const size_t sparse_slab_blocks = 4096;
+const size_t default_sparse_capacity = (size_t)1 << 24; // weights a shared table has room for
+
+struct sparse_slot
+{
+	uint64_t index;
+	weight* weights; // nullptr for an empty slot
+};
+
+// head of the memory of a shared table, followed by its slots and then the weights
+struct sparse_arena
+{
+	size_t bytes;
+	size_t capacity; // weights there is room for
+	size_t used; // weights handed out, updated atomically
+};
+
+#define sparse_slot_busy ((weight*)(uintptr_t)1)
+
 template <typename T>
 class sparse_iterator
 {
 private:
-	weight_map::iterator _iter;
+	sparse_slot* _current;
+	sparse_slot* _end;
 	uint32_t _stride;
 
+	void skip_empty()
+	{
+		for (; _current != _end; _current++)
+		{
+#ifndef _WIN32
+			// an insert into a shared table has claimed the slot, wait for it to publish the weights
+			while (__atomic_load_n(&_current->weights, __ATOMIC_ACQUIRE) == sparse_slot_busy)
+				;
+#endif
+			if (_current->weights != nullptr)
+				break;
+		}
+	}
+
 public:
 	typedef std::forward_iterator_tag iterator_category;
 	typedef T value_type;
@@ -165,40 +252,48 @@ public:
 	typedef  T* pointer;
 	typedef  T& reference;
 
-	sparse_iterator(weight_map::iterator& iter, uint32_t stride)
-		: _iter(iter), _stride(stride)
-	{ }
+	sparse_iterator(sparse_slot* current, sparse_slot* end, uint32_t stride)
+		: _current(current), _end(end), _stride(stride)
+	{ skip_empty(); }
 
 	sparse_iterator& operator=(const sparse_iterator& other)
 	{
-		_iter = other._iter;
+		_current = other._current;
+		_end = other._end;
 		_stride = other._stride;
 		return *this;
 
 	}
-	uint64_t index() { return _iter->first; }
+	uint64_t index() { return _current->index; }
 
-	T& operator*() { return *(_iter->second); }
+	T& operator*() { return *(_current->weights); }
 
 	sparse_iterator& operator++()
 	{
-		_iter++;
+		_current++;
+		skip_empty();
 		return *this;
 	}
 
-	bool operator==(const sparse_iterator& rhs) const { return _iter == rhs._iter; }
-	bool operator!=(const sparse_iterator& rhs) const { return _iter != rhs._iter; }
+	bool operator==(const sparse_iterator& rhs) const { return _current == rhs._current; }
+	bool operator!=(const sparse_iterator& rhs) const { return _current != rhs._current; }
 };
 
 
 class sparse_parameters
 {
 private:
-	weight_map _map;
+	sparse_slot* _table;
+	uint64_t _table_mask; // slots - 1, the number of slots is a power of 2
+	uint32_t _table_shift; // 64 - log2(slots), for the multiplicative hash
+	size_t _count; // slots in use, until shared: then the arena counts them for every instance
+	std::vector<weight*> _slabs; // allocated by this instance, shallow copies share the original's
+	size_t _slab_free; // blocks left in _slabs.back()
 	uint64_t _weight_mask;  // (stride*(1 << num_bits) -1)
 	uint32_t _stride_shift;
 	bool _seeded; // whether the instance is sharing model state with others
-	bool _delete;
+	sparse_arena* _arena; // the memory of a shared table, nullptr until share()
+	bool _arena_owner; // whether share() was called on this instance, rather than on the one it copies
 	void* default_data;
   float* default_value;
 public:
@@ -206,66 +301,241 @@ public:
 	typedef sparse_iterator<const weight> const_iterator;
  private:
 	void(*fun)(const weight*, void*);
+
+	void table_size(size_t slots)
+	{
+		_table_mask = slots - 1;
+		_table_shift = 64;
+		for (size_t s = slots; s > 1; s >>= 1)
+			_table_shift--;
+		_count = 0;
+	}
+
+	void new_table(size_t slots)
+	{
+		_table = calloc_or_throw<sparse_slot>(slots);
+		table_size(slots);
+	}
+
+	// first slot to look for index in, the indices are strided so their low bits are no good
+	inline uint64_t home_slot(uint64_t index) const { return (index * 0x9E3779B97F4A7C15ull) >> _table_shift; }
+
+	// the slot with index, or the empty slot where it belongs
+	inline sparse_slot* find_slot(uint64_t index) const
+	{
+		uint64_t s = home_slot(index);
+		while (_table[s].weights != nullptr && _table[s].index != index)
+			s = (s + 1) & _table_mask;
+		return &_table[s];
+	}
+
+	void grow()
+	{
+		sparse_slot* old = _table;
+		size_t old_slots = _table_mask + 1;
+		new_table(2 * old_slots);
+		for (size_t s = 0; s < old_slots; s++)
+			if (old[s].weights != nullptr)
+			{
+				*find_slot(old[s].index) = old[s];
+				_count++;
+			}
+		free(old);
+	}
+
+	weight* new_block()
+	{
+		if (_slab_free == 0)
+		{
+			_slabs.push_back(calloc_mergable_or_throw<weight>(sparse_slab_blocks << _stride_shift));
+			_slab_free = sparse_slab_blocks;
+		}
+		return _slabs.back() + ((sparse_slab_blocks - _slab_free--) << _stride_shift);
+	}
+
+	void free_slabs()
+	{
+		for (weight* slab : _slabs)
+			free(slab);
+		_slabs.clear();
+		_slab_free = 0;
+	}
+
+	void free_weights()
+	{
+		free_slabs();
+#ifndef _WIN32
+		if (_arena != nullptr)
+		{
+			if (_arena_owner)
+				free_shared_memory(_arena, _arena->bytes);
+			_arena = nullptr;
+			_table = nullptr;
+			return;
+		}
+#endif
+		free(_table);
+		_table = nullptr;
+	}
+
+#ifndef _WIN32
+	weight& shared_weight(uint64_t index)
+	{
+		uint64_t s = home_slot(index);
+		for (uint64_t probes = 0; probes <= _table_mask; probes++, s = (s + 1) & _table_mask)
+		{
+			sparse_slot& slot = _table[s];
+			weight* w = __atomic_load_n(&slot.weights, __ATOMIC_ACQUIRE);
+			if (w == nullptr)
+			{
+				if (__atomic_load_n(&_arena->used, __ATOMIC_RELAXED) >= _arena->capacity)
+					THROW("the shared sparse weight table is full, --sparse_capacity must be larger than " << _arena->capacity);
+				if (__atomic_compare_exchange_n(&slot.weights, &w, sparse_slot_busy, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+				{
+					size_t block = __atomic_fetch_add(&_arena->used, 1, __ATOMIC_RELAXED);
+					w = (weight*)(_table + _table_mask + 1) + (block << _stride_shift);
+					slot.index = index;
+					if (fun != nullptr)
+						fun(w, default_data);
+					__atomic_store_n(&slot.weights, w, __ATOMIC_RELEASE);
+					return *w;
+				}
+				// lost the slot to another insert, w is what that stored
+			}
+			while (w == sparse_slot_busy)
+				w = __atomic_load_n(&slot.weights, __ATOMIC_ACQUIRE);
+			if (slot.index == index)
+				return *w;
+		}
+		THROW("the shared sparse weight table is full, --sparse_capacity must be larger than " << _arena->capacity);
+	}
+
+	const weight& shared_weight(uint64_t index) const
+	{
+		uint64_t s = home_slot(index);
+		for (uint64_t probes = 0; probes <= _table_mask; probes++, s = (s + 1) & _table_mask)
+		{
+			weight* w;
+			while ((w = __atomic_load_n(&_table[s].weights, __ATOMIC_ACQUIRE)) == sparse_slot_busy)
+				;
+			if (w == nullptr)
+				break;
+			if (_table[s].index == index)
+				return *w;
+		}
+		return *default_value;
+	}
+#endif
+
  public:
 
 	sparse_parameters(size_t length, uint32_t stride_shift = 0)
-		: _map(),
+		: _slab_free(0),
 		_weight_mask((length << stride_shift) - 1),
 		_stride_shift(stride_shift),
-		_seeded(false), _delete(false), default_data(nullptr),
+		_seeded(false), _arena(nullptr), _arena_owner(false), default_data(nullptr),
     fun(nullptr)
-	{ default_value = calloc_mergable_or_throw<weight>(stride());}
+	{ new_table(sparse_initial_slots);
+	  default_value = calloc_mergable_or_throw<weight>(stride());}
 
 	sparse_parameters()
-		: _map(), _weight_mask(0), _stride_shift(0), _seeded(false), _delete(false), default_data(nullptr), fun(nullptr)
-	{ default_value = calloc_mergable_or_throw<weight>(stride());}
+		: _slab_free(0), _weight_mask(0), _stride_shift(0), _seeded(false), _arena(nullptr), _arena_owner(false), default_data(nullptr), fun(nullptr)
+	{ new_table(sparse_initial_slots);
+	  default_value = calloc_mergable_or_throw<weight>(stride());}
+
+	// weights in the table
+	size_t count() const
+	{
+#ifndef _WIN32
+		if (_arena != nullptr)
+			return __atomic_load_n(&_arena->used, __ATOMIC_RELAXED);
+#endif
+		return _count;
+	}
 
-	bool not_null() { return (_weight_mask > 0 && !_map.empty()); }
+	bool not_null() { return (_weight_mask > 0 && count() > 0); }
 
-	sparse_parameters(const sparse_parameters &other) { shallow_copy(other); }
+	sparse_parameters(const sparse_parameters &other)
+		: _table(nullptr), _slab_free(0), _seeded(false), _arena(nullptr), _arena_owner(false), default_data(nullptr), default_value(nullptr), fun(nullptr)
+	{ shallow_copy(other); }
 	sparse_parameters(sparse_parameters &&) = delete;
 
-	weight* first() { throw 1; } //TODO: Throw better exceptions. Allreduce currently not supported in sparse.
+	weight* first() { throw 1; } //TODO: Throw better exceptions. Allreduce reduces sparse weights through find().
 
 	//iterator with stride
-	iterator begin() { weight_map::iterator i = _map.begin(); return iterator(i, stride()); }
-	iterator end() { weight_map::iterator i = _map.end(); return iterator(i, stride()); }
+	iterator begin() { return iterator(_table, _table + _table_mask + 1, stride()); }
+	iterator end() { return iterator(_table + _table_mask + 1, _table + _table_mask + 1, stride()); }
 
 	//const iterator
-	const_iterator cbegin() { weight_map::iterator i = _map.begin(); return const_iterator(i,  stride()); }
-	const_iterator cend() { weight_map::iterator i = _map.begin(); return const_iterator(i, stride()); }
+	const_iterator cbegin() { return const_iterator(_table, _table + _table_mask + 1, stride()); }
+	const_iterator cend() { return const_iterator(_table + _table_mask + 1, _table + _table_mask + 1, stride()); }
 
 	inline weight& operator[](size_t i)
 	{   uint64_t index = i & _weight_mask;
-    weight_map::iterator iter = _map.find(index);
-		if (iter == _map.end())
-		  {     _map.insert(std::make_pair(index, calloc_mergable_or_throw<weight>(stride())));
-			iter = _map.find(index);
+#ifndef _WIN32
+		if (_arena != nullptr)
+			return shared_weight(index);
+#endif
+		sparse_slot* slot = find_slot(index);
+		if (slot->weights == nullptr)
+		{
+			if (4 * (_count + 1) > 3 * (_table_mask + 1))
+			{
+				grow();
+				slot = find_slot(index);
+			}
+			slot->index = index;
+			slot->weights = new_block();
+			_count++;
 			if (fun != nullptr)
-        fun(iter->second, default_data);
+				fun(slot->weights, default_data);
 		}
-		return *(iter->second);
+		return *(slot->weights);
 	}
 
   inline const weight& operator[](size_t i) const
-	{   uint64_t index = i & _weight_mask;
-		weight_map::const_iterator iter = _map.find(index);
-		if (iter == _map.end())
+	{
+#ifndef _WIN32
+		if (_arena != nullptr)
+			return shared_weight(i & _weight_mask);
+#endif
+		const sparse_slot* slot = find_slot(i & _weight_mask);
+		if (slot->weights == nullptr)
       return *default_value;
-		return *(iter->second);
+		return *(slot->weights);
   }
 
 	inline weight& strided_index(size_t index) { return operator[](index << _stride_shift); }
 
+	// the weights at i if they were ever touched, nullptr otherwise
+	inline weight* find(size_t i) const
+	{
+		const weight& w = ((const sparse_parameters&)*this)[i];
+		return &w == default_value ? nullptr : (weight*)&w;
+	}
+
+	// looking a weight up may insert it, so there is nothing to prefetch
+	inline void prefetch(size_t) const {}
+	size_t prefetch_distance() const { return 0; }
+
+	// weights in the table now: the weights are shared, the table is copied, and weights
+	// inserted later go to slabs of this instance's own
 	void shallow_copy(const sparse_parameters& input)
 	{
-		// TODO: this is level-1 copy (weight* are stilled shared)
-		if (!_seeded)
+		free_weights();
+		if (input._arena != nullptr)
+		{ // a shared table is shared outright
+			_arena = input._arena;
+			_arena_owner = false;
+			_table = input._table;
+			table_size(input._table_mask + 1);
+		}
+		else
 		{
-		  for (auto iter = _map.begin(); iter != _map.end(); ++iter)
-				free(iter->second);
+			new_table(input._table_mask + 1);
+			memcpy(_table, input._table, (_table_mask + 1) * sizeof(sparse_slot));
 		}
-		_map = input._map;
+		_count = input._count;
 		_weight_mask = input._weight_mask;
 		_stride_shift = input._stride_shift;
     free(default_value);
@@ -286,10 +556,13 @@ public:
 
 	template<class T> void set_default() { fun = (void(*)(const weight*, void*))T::func; }
 
+	// read weights that are not in the table as other reads them
+	void copy_default(const sparse_parameters& other) { memcpy(default_value, other.default_value, stride() * sizeof(weight)); }
+
 	void set_zero(size_t offset)
 	{
-		for (weight_map::iterator iter = _map.begin(); iter != _map.end(); ++iter)
-			(&(*(iter->second)))[offset] = 0;
+		for (iterator iter = begin(); iter != end(); ++iter)
+			(&(*iter))[offset] = 0;
 	}
 
 	uint64_t mask()	const { return _weight_mask; }
@@ -309,19 +582,47 @@ public:
   }
 
 #ifndef _WIN32
-	void share(size_t length)
-	{throw 1; //TODO: add better exceptions
+	bool shared() const { return _arena != nullptr; }
+
+	// Moves the weights into a concurrent table with room for capacity weights, shared with
+	// processes forked from now on.  The table can't grow any more.
+	void share(size_t capacity)
+	{
+		if (_arena != nullptr)
+			return;
+		capacity = std::max(capacity, 2 * _count);
+		size_t slots = sparse_initial_slots;
+		while (slots < 2 * capacity)
+			slots *= 2;
+		// an insert can take its weights just past capacity, so there are weights for every slot
+		size_t bytes = sizeof(sparse_arena) + slots * sizeof(sparse_slot) + (slots << _stride_shift) * sizeof(weight);
+		sparse_arena* arena = (sparse_arena*)alloc_shared_memory(bytes);
+		arena->bytes = bytes;
+		arena->capacity = capacity;
+
+		sparse_slot* old = _table;
+		size_t old_slots = _table_mask + 1;
+		_arena = arena;
+		_arena_owner = true;
+		_table = (sparse_slot*)(arena + 1);
+		table_size(slots);
+		weight* blocks = (weight*)(_table + slots);
+		for (size_t s = 0; s < old_slots; s++)
+			if (old[s].weights != nullptr)
+			{
+				sparse_slot* slot = find_slot(old[s].index);
+				slot->index = old[s].index;
+				slot->weights = blocks + (arena->used++ << _stride_shift);
+				memcpy(slot->weights, old[s].weights, stride() * sizeof(weight));
+				_count++;
+			}
+		free(old);
+		free_slabs();
 	}
 #endif
 
 	~sparse_parameters()
-	{if (!_delete && !_seeded)  // don't free weight vector if it is shared with another instance
-		{
-    for (auto iter = _map.begin(); iter != _map.end(); ++iter)
-      free(iter->second);
-    _map.clear();
-		 _delete = true;
-		}
+	{free_weights(); // only the slabs of this instance, weights shared with another stay
     if (default_data != nullptr)
       free(default_data);
     free(default_value);
@@ -333,6 +634,16 @@ class parameters {
   bool sparse;
   dense_parameters dense_weights;
   sparse_parameters sparse_weights;
+  weight_memory placement; // asked for the dense weights (--huge_pages, --numa)
+  size_t sparse_capacity = 0; // weights a shared sparse table has room for (--sparse_capacity), 0 for the default
+  size_t prefetch_distance = default_weight_prefetch; // for the dense weights (--weight_prefetch)
+
+  // Set on a --thread_average learner thread to its own copy of the dense weights.
+  static thread_local dense_parameters* thread_dense_weights;
+
+  // the dense weights learning on the calling thread reads and updates
+  inline dense_parameters& learning_dense_weights()
+  { return thread_dense_weights != nullptr ? *thread_dense_weights : dense_weights; }
 
   inline weight& operator[](size_t i)
   {
@@ -393,7 +704,7 @@ class parameters {
   inline void share(size_t length)
   {
     if (sparse)
-      sparse_weights.share(length);
+      sparse_weights.share(sparse_capacity > 0 ? sparse_capacity : std::min(length, default_sparse_capacity));
     else
       dense_weights.share(length);
   }
@@ -53,6 +53,8 @@ struct boosting
   std::vector<float> alpha;
   std::vector<float> v;
   int t;
+  std::vector<polyprediction> pred; // for multipredict
+  std::vector<label_data> labels; // for multilearn
 };
 
 //---------------------------------------------------
@@ -70,8 +72,13 @@ void predict_or_learn(boosting& o, LEARNER::base_learner& base, example& ec)
 
   if (is_learn) o.t++;
 
+  // the weak learners' predictions do not depend on each other's updates, so all of them are
+  // made first, and the weights of the updates follow from them
+  base.multipredict(ec, 0, o.N, o.pred.data(), true);
+
   for (int i = 0; i < o.N; i++)
   {
+    float p = o.pred[i].scalar;
     if (is_learn)
     {
 
@@ -87,24 +94,19 @@ void predict_or_learn(boosting& o, LEARNER::base_learner& base, example& ec)
       float w = c * (float)pow((double)(0.5 + o.gamma), (double)k)
                 * (float)pow((double)0.5 - o.gamma,(double)(o.N-(i+1)-k));
 
-      // update ec.weight, weight for learner i (starting from 0)
-      ec.weight = u * w;
-
-      base.predict(ec, i);
+      // weight for learner i (starting from 0)
+      o.labels[i] = { ld.label, u * w, 0.f };
 
-      // ec.pred.scalar is now the i-th learner prediction on this example
-      s += ld.label * ec.pred.scalar;
+      // p is the i-th learner prediction on this example
+      s += ld.label * p;
 
-      final_prediction += ec.pred.scalar;
-
-      base.learn(ec, i);
+      final_prediction += p;
     }
     else
-    {
-      base.predict(ec, i);
-      final_prediction += ec.pred.scalar;
-    }
+      final_prediction += p;
   }
+  if (is_learn)
+    base.multilearn(ec, 0, o.N, o.labels.data(), o.pred.data(), true);
 
   ec.weight = u;
   ec.partial_prediction = final_prediction;
@@ -132,39 +134,38 @@ void predict_or_learn_logistic(boosting& o, LEARNER::base_learner& base, example
   if (is_learn) o.t++;
   float eta = 4.f / sqrtf((float)o.t);
 
+  base.multipredict(ec, 0, o.N, o.pred.data(), true);
+
   for (int i = 0; i < o.N; i++)
   {
+    float p = o.pred[i].scalar;
 
     if (is_learn)
     {
       float w = 1 / (1 + correctedExp(s));
 
-      ec.weight = u * w;
+      o.labels[i] = { ld.label, u * w, 0.f };
 
-      base.predict(ec, i);
       float z;
-      z = ld.label * ec.pred.scalar;
+      z = ld.label * p;
 
       s += z * o.alpha[i];
 
-      // if ld.label * ec.pred.scalar < 0, learner i made a mistake
+      // if ld.label * p < 0, learner i made a mistake
 
-      final_prediction += ec.pred.scalar * o.alpha[i];
+      final_prediction += p * o.alpha[i];
 
       // update alpha
       o.alpha[i] += eta * z / (1 + correctedExp(s));
       if (o.alpha[i] > 2.) o.alpha[i] = 2;
       if (o.alpha[i] < -2.) o.alpha[i] = -2;
 
-      base.learn(ec, i);
-
     }
     else
-    {
-      base.predict(ec, i);
-      final_prediction += ec.pred.scalar * o.alpha[i];
-    }
+      final_prediction += p * o.alpha[i];
   }
+  if (is_learn)
+    base.multilearn(ec, 0, o.N, o.labels.data(), o.pred.data(), true);
 
   ec.weight = u;
   ec.partial_prediction = final_prediction;
@@ -192,28 +193,30 @@ void predict_or_learn_adaptive(boosting& o, LEARNER::base_learner& base, example
 
   float stopping_point = merand48(o.all->random_state);
 
+  base.multipredict(ec, 0, o.N, o.pred.data(), true);
+
   for (int i = 0; i < o.N; i++)
   {
+    float p = o.pred[i].scalar;
 
     if (is_learn)
     {
       float w = 1 / (1 + correctedExp(s));
 
-      ec.weight = u * w;
+      o.labels[i] = { ld.label, u * w, 0.f };
 
-      base.predict(ec, i);
       float z;
 
-      z = ld.label * ec.pred.scalar;
+      z = ld.label * p;
 
       s += z * o.alpha[i];
 
       if (v_partial_sum <= stopping_point)
       {
-        final_prediction += ec.pred.scalar * o.alpha[i];
+        final_prediction += p * o.alpha[i];
       }
 
-      partial_prediction += ec.pred.scalar * o.alpha[i];
+      partial_prediction += p * o.alpha[i];
 
       v_partial_sum += o.v[i];
 
@@ -229,15 +232,12 @@ void predict_or_learn_adaptive(boosting& o, LEARNER::base_learner& base, example
       if (o.alpha[i] > 2.) o.alpha[i] = 2;
       if (o.alpha[i] < -2.) o.alpha[i] = -2;
 
-      base.learn(ec, i);
-
     }
     else
     {
-      base.predict(ec, i);
       if (v_partial_sum <= stopping_point)
       {
-        final_prediction += ec.pred.scalar * o.alpha[i];
+        final_prediction += p * o.alpha[i];
       }
       else
       {
@@ -248,6 +248,9 @@ void predict_or_learn_adaptive(boosting& o, LEARNER::base_learner& base, example
     }
   }
 
+  if (is_learn)
+    base.multilearn(ec, 0, o.N, o.labels.data(), o.pred.data(), true);
+
   // normalize v vector in training
   if (is_learn)
   {
@@ -331,6 +334,9 @@ void finish(boosting& o)
   delete o.alg;
   o.C.~vector();
   o.alpha.~vector();
+  o.v.~vector();
+  o.pred.~vector();
+  o.labels.~vector();
 }
 
 void return_example(vw& all, boosting& a, example& ec)
@@ -415,6 +421,8 @@ LEARNER::base_learner* boosting_setup(vw& all)
   data.all = &all;
   data.alpha = std::vector<float>(data.N,0);
   data.v = std::vector<float>(data.N,1);
+  data.pred = std::vector<polyprediction>(data.N);
+  data.labels = std::vector<label_data>(data.N);
 
   learner<boosting>* l;
   if (*data.alg == "BBM")
@@ -27,6 +27,8 @@ struct bs
   float ub;
   vector<double>* pred_vec;
   vw* all; // for raw prediction and loss
+  v_array<polyprediction> preds; // for multipredict and multilearn, B per problem
+  v_array<label_data> labels; // for multilearn
 };
 
 void bs_predict_mean(vw& all, example& ec, vector<double> &pred_vec)
@@ -178,6 +180,46 @@ void output_example(vw& all, bs& d, example& ec)
   print_update(all, ec);
 }
 
+// Draws the importance weights of count problems' bootstrap rounds in the order predict_or_learn
+// would, and learns or predicts all count*B rounds in one batch.  Prediction draws the weights
+// as well, to keep the random state where it was.
+template <bool is_learn>
+void batch(bs& d, base_learner& base, example& ec, size_t count, label_data* labels)
+{
+  size_t n = count * d.B;
+  if ((size_t)(d.preds.end_array - d.preds.begin()) < n)
+  {
+    d.preds.resize(n);
+    d.labels.resize(n);
+  }
+  for (size_t c = 0; c < count; c++)
+    for (size_t i = 0; i < d.B; i++)
+    {
+      float w = (float) BS::weight_gen(*d.all);
+      if (is_learn)
+        d.labels[c*d.B + i] = { labels[c].label, labels[c].weight * w, 0.f };
+    }
+  if (is_learn)
+    base.multilearn(ec, 0, n, d.labels.begin(), d.preds.begin(), true);
+  else
+    base.multipredict(ec, 0, n, d.preds.begin(), true);
+}
+
+void bs_predict(bs& d, example& ec)
+{
+  switch(d.bs_type)
+  {
+  case BS_TYPE_MEAN:
+    bs_predict_mean(*d.all, ec, *d.pred_vec);
+    break;
+  case BS_TYPE_VOTE:
+    bs_predict_vote(ec, *d.pred_vec);
+    break;
+  default:
+    THROW("Unknown bs_type specified: " << d.bs_type);
+  }
+}
+
 template <bool is_learn>
 void predict_or_learn(bs& d, base_learner& base, example& ec)
 {
@@ -189,42 +231,95 @@ void predict_or_learn(bs& d, base_learner& base, example& ec)
   stringstream outputStringStream;
   d.pred_vec->clear();
 
-  for (size_t i = 1; i <= d.B; i++)
-  {
-    ec.weight = weight_temp * (float) BS::weight_gen(all);
+  if (shouldOutput)
+    for (size_t i = 1; i <= d.B; i++)
+    {
+      ec.weight = weight_temp * (float) BS::weight_gen(all);
 
-    if (is_learn)
-      base.learn(ec, i-1);
-    else
-      base.predict(ec, i-1);
+      if (is_learn)
+        base.learn(ec, i-1);
+      else
+        base.predict(ec, i-1);
 
-    d.pred_vec->push_back(ec.pred.scalar);
+      d.pred_vec->push_back(ec.pred.scalar);
 
-    if (shouldOutput)
-    {
       if (i > 1) outputStringStream << ' ';
       outputStringStream << i << ':' << ec.partial_prediction;
     }
+  else
+  {
+    label_data ld = { ec.l.simple.label, weight_temp, 0.f };
+    batch<is_learn>(d, base, ec, 1, &ld);
+    for (size_t i = 0; i < d.B; i++)
+      d.pred_vec->push_back(d.preds[i].scalar);
   }
 
   ec.weight = weight_temp;
 
-  switch(d.bs_type)
-  {
-  case BS_TYPE_MEAN:
-    bs_predict_mean(all, ec, *d.pred_vec);
-    break;
-  case BS_TYPE_VOTE:
-    bs_predict_vote(ec, *d.pred_vec);
-    break;
-  default:
-    THROW("Unknown bs_type specified: " << d.bs_type);
-  }
+  bs_predict(d, ec);
 
   if (shouldOutput)
     all.print_text(all.raw_prediction, outputStringStream.str(), ec.tag);
 }
 
+// count problems at once, as count calls of predict_or_learn would do them.  multilearn returns
+// the predictions before the updates, which callers like oaa used to get from a predict of every
+// problem first: the weights that predict drew are drawn and dropped, so that the random
+// sequence, and the models learned, stay as they were.
+template <bool is_learn>
+void multi_predict_or_learn(bs& d, base_learner& base, example& ec, size_t count, size_t step, label_data* labels,
+                            polyprediction* pred, bool finalize_predictions)
+{
+  float label = ec.l.simple.label;
+  float weight = ec.weight;
+  if (is_learn)
+    for (size_t r = 0; r < count * d.B; r++)
+      BS::weight_gen(*d.all);
+  if (!finalize_predictions || d.all->raw_prediction > 0)
+  { // one problem at a time, as learner.h does without a batched path
+    for (size_t c = 0; c < count; c++)
+    {
+      if (is_learn)
+      {
+        ec.l.simple.label = labels[c].label;
+        ec.weight = labels[c].weight;
+      }
+      predict_or_learn<is_learn>(d, base, ec);
+      if (finalize_predictions) pred[c] = ec.pred;
+      else                      pred[c].scalar = ec.partial_prediction;
+      ec.ft_offset += (uint32_t)step;
+    }
+    ec.ft_offset -= (uint32_t)(step * count);
+  }
+  else
+  {
+    batch<is_learn>(d, base, ec, count, labels);
+    for (size_t c = 0; c < count; c++)
+    {
+      d.pred_vec->clear();
+      for (size_t i = 0; i < d.B; i++)
+        d.pred_vec->push_back(d.preds[c*d.B + i].scalar);
+      if (is_learn)
+      {
+        ec.l.simple.label = labels[c].label;
+        ec.weight = labels[c].weight;
+      }
+      bs_predict(d, ec);
+      pred[c] = ec.pred;
+    }
+  }
+  ec.l.simple.label = label;
+  ec.weight = weight;
+}
+
+void multilearn(bs& d, base_learner& base, example& ec, size_t count, size_t step, label_data* labels,
+                polyprediction* pred, bool finalize_predictions)
+{ multi_predict_or_learn<true>(d, base, ec, count, step, labels, pred, finalize_predictions); }
+
+void multipredict(bs& d, base_learner& base, example& ec, size_t count, size_t step, polyprediction* pred,
+                  bool finalize_predictions)
+{ multi_predict_or_learn<false>(d, base, ec, count, step, nullptr, pred, finalize_predictions); }
+
 void finish_example(vw& all, bs& d, example& ec)
 {
   output_example(all, d, ec);
@@ -232,7 +327,11 @@ void finish_example(vw& all, bs& d, example& ec)
 }
 
 void finish(bs& d)
-{ delete d.pred_vec; }
+{
+  delete d.pred_vec;
+  d.preds.delete_v();
+  d.labels.delete_v();
+}
 
 base_learner* bs_setup(vw& all)
 {
@@ -278,6 +377,8 @@ base_learner* bs_setup(vw& all)
                                 predict_or_learn<false>, data.B);
   l.set_finish_example(finish_example);
   l.set_finish(finish);
+  l.set_multipredict(multipredict);
+  l.set_multilearn(multilearn);
 
   return make_base(l);
 }
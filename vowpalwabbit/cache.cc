@@ -3,10 +3,14 @@ Copyright (c) by respective owners including Yahoo!, Microsoft, and
 individual contributors. All rights reserved.  Released under a BSD (revised)
 license as described in the file LICENSE.
  */
+#include "zlib.h" // before global_data.h declares gzFile
 #include "cache.h"
 #include "unique_sort.h"
 #include "global_data.h"
 #include "vw.h"
+#include "stream_vbyte.h"
+#include "best_constant.h"
+#include "rand48.h"
 
 using namespace std;
 
@@ -15,30 +19,6 @@ const size_t char_size = 2;
 const size_t neg_1 = 1;
 const size_t general = 2;
 
-inline char* run_len_decode(char *p, uint64_t& i)
-{
-  // read an int 7 bits at a time.
-  size_t count = 0;
-  while(*p & 128)
-    i = i | ((uint64_t)(*(p++) & 127) << 7*count++);
-  i = i | ((uint64_t)(*(p++)) << 7*count);
-  return p;
-}
-
-inline char* run_len_encode(char *p, uint64_t i)
-{
-  // store an int 7 bits at a time.
-  while (i >= 128)
-  {
-    *(p++) = (i & 127) | 128;
-    i = i >> 7;
-  }
-  *(p++) = (i & 127);
-  return p;
-}
-
-inline int64_t ZigZagDecode(uint64_t n) { return (n >> 1) ^ -static_cast<int64_t>(n & 1); }
-
 size_t read_cached_tag(io_buf& cache, example* ae)
 {
   char* c;
@@ -62,32 +42,30 @@ __attribute__((packed))
 #endif
 ;
 
-int read_cached_features(vw* all, v_array<example*>& examples)
+int read_cached_example(vw& all, io_buf& input, shared_data* sd, example* ae)
 {
-  example* ae = examples[0];
-  ae->sorted = all->p->sorted_cache;
-  io_buf* input = all->p->input;
+  ae->sorted = all.p->sorted_cache;
 
-  size_t total = all->p->lp.read_cached_label(all->sd, &ae->l, *input);
+  size_t total = all.p->lp.read_cached_label(sd, &ae->l, input);
   if (total == 0)
     return 0;
-  if (read_cached_tag(*input,ae) == 0)
+  if (read_cached_tag(input,ae) == 0)
     return 0;
   char* c;
   unsigned char num_indices = 0;
-  if (buf_read(*input, c, sizeof(num_indices)) < sizeof(num_indices))
+  if (buf_read(input, c, sizeof(num_indices)) < sizeof(num_indices))
     return 0;
   num_indices = *(unsigned char*)c;
   c += sizeof(num_indices);
 
-  all->p->input->set(c);
+  input.set(c);
   for (; num_indices > 0; num_indices--)
   {
     size_t temp;
     unsigned char index = 0;
-    if((temp = buf_read(*input,c,sizeof(index) + sizeof(size_t))) < sizeof(index) + sizeof(size_t))
+    if((temp = buf_read(input,c,sizeof(index) + sizeof(size_t))) < sizeof(index) + sizeof(size_t))
     {
-      all->trace_message << "truncated example! " << temp << " " << char_size + sizeof(size_t) << endl;
+      all.trace_message << "truncated example! " << temp << " " << char_size + sizeof(size_t) << endl;
       return 0;
     }
 
@@ -97,11 +75,11 @@ int read_cached_features(vw* all, v_array<example*>& examples)
     features& ours = ae->feature_space[index];
     size_t storage = *(size_t *)c;
     c += sizeof(size_t);
-    all->p->input->set(c);
+    input.set(c);
     total += storage;
-    if (buf_read(*input,c,storage) < storage)
+    if (buf_read(input,c,storage) < storage)
     {
-      all->trace_message << "truncated example! wanted: " << storage << " bytes" << endl;
+      all.trace_message << "truncated example! wanted: " << storage << " bytes" << endl;
       return 0;
     }
 
@@ -129,16 +107,15 @@ int read_cached_features(vw* all, v_array<example*>& examples)
       last = i;
       ours.push_back(v,i);
     }
-    all->p->input->set(c);
+    input.set(c);
   }
 
   return (int)total;
 }
 
-inline uint64_t ZigZagEncode(int64_t n)
+int read_cached_features(vw* all, v_array<example*>& examples)
 {
-  uint64_t ret = (n << 1) ^ (n >> 63);
-  return ret;
+  return read_cached_example(*all, *all->p->input, all->sd, examples[0]);
 }
 
 void output_byte(io_buf& cache, unsigned char s)
@@ -208,3 +185,867 @@ void cache_features(io_buf& cache, example* ae, uint64_t mask)
   for (namespace_index ns : ae->indices)
     output_features(cache, ns, ae->feature_space[ns], mask);
 }
+
+/* Columnar cache (--cache_format 2).  After the usual header, the file holds blocks of up to
+** cache_block_examples examples.  Each block starts with its example count and, for every
+** column, a codec byte followed by the raw and stored lengths of the column.  Then come the
+** columns themselves, each deflated when that saves space:
+**   labels     - the label parser's own cache format, one label after another
+**   tags       - varint length, then the bytes
+**   namespaces - per example a varint count, then per namespace its index byte and a varint
+**                feature count
+**   indices    - zigzag deltas of the masked feature indices, restarting per namespace: as
+**                varints, or when every delta in the block fits 32 bits as their count (a
+**                uint32) followed by their Stream VByte encoding, which decodes a whole
+**                block at a time with SIMD shuffles
+**   kinds      - 2 bits per feature: 0 for 1, 1 for -1, 2 for a value in the values column
+**   values     - floats
+** Blocks are independent of each other.  A block with no examples starts the index: the
+** number of blocks, the stream offset and example count of each block, the offset of the
+** index and the bytes "VWCI".  Reading front to back skips it; --shuffle_blocks reads it from
+** the end of the file to seek to the blocks in a new order every pass.
+*/
+enum cache_column { LABELS, TAGS, NAMESPACES, INDICES, KINDS, VALUES, NUM_CACHE_COLUMNS };
+
+const size_t cache_block_examples = 4096;
+const size_t cache_block_bytes = 1 << 22;
+const size_t column_padding = 16; // zeros after each decoded column, so varint reads stop there
+const unsigned char column_raw = 0;
+const unsigned char column_deflated = 1;
+const unsigned char column_stream_vbyte = 2; // indices only, combines with column_deflated
+
+// An io_buf over memory only: writes grow the buffer instead of flushing it to a file, and
+// reads stop where the buffer ends.
+class memory_io_buf : public io_buf
+{
+public:
+  memory_io_buf() { files.push_back(-1); }
+
+  virtual ssize_t fill(int) { return 0; }
+
+  virtual void flush()
+  {
+    size_t used = head - space.begin();
+    space.resize(2 * (space.end_array - space.begin()));
+    head = space.begin() + used;
+  }
+};
+
+struct cache_block_entry
+{
+  uint64_t offset;
+  uint32_t examples;
+};
+
+struct cache_columns
+{
+  memory_io_buf labels;
+  v_array<char> column[NUM_CACHE_COLUMNS]; // column[LABELS] is only used as scratch
+  size_t kinds; // features whose kind has been written or read in this block
+  size_t examples; // examples in this block
+  size_t next; // next example to read from this block
+
+  // writing
+  uint64_t offset; // stream offset of the next block
+  v_array<cache_block_entry> index; // of the blocks written, or read back for --shuffle_blocks
+  v_array<uint64_t> deltas; // indices column before encoding
+
+  // reading
+  char* pos[NUM_CACHE_COLUMNS];
+  bool stream_vbyte; // the block's indices are in narrow rather than varints
+  v_array<uint32_t> narrow; // decoded Stream VByte indices (scratch when writing)
+  v_array<size_t> order; // of the entries of index to read this pass, with --shuffle_blocks
+  size_t block; // next in order
+};
+
+cache_columns* new_cache_columns()
+{
+  cache_columns* cc = new cache_columns;
+  for (size_t i = 0; i < NUM_CACHE_COLUMNS; i++)
+  {
+    cc->column[i] = v_init<char>();
+    cc->pos[i] = nullptr;
+  }
+  cc->index = v_init<cache_block_entry>();
+  cc->deltas = v_init<uint64_t>();
+  cc->narrow = v_init<uint32_t>();
+  cc->order = v_init<size_t>();
+  reset_cache_columns(*cc, 0);
+  return cc;
+}
+
+void delete_cache_columns(cache_columns* cc)
+{
+  for (size_t i = 0; i < NUM_CACHE_COLUMNS; i++)
+    cc->column[i].delete_v();
+  cc->index.delete_v();
+  cc->deltas.delete_v();
+  cc->narrow.delete_v();
+  cc->order.delete_v();
+  delete cc;
+}
+
+void reset_cache_columns(cache_columns& cc, uint64_t offset)
+{
+  for (size_t i = 0; i < NUM_CACHE_COLUMNS; i++)
+    cc.column[i].erase();
+  cc.labels.head = cc.labels.space.begin();
+  cc.labels.space.end() = cc.labels.space.begin();
+  cc.kinds = 0;
+  cc.examples = 0;
+  cc.next = 0;
+  cc.offset = offset;
+  cc.index.erase();
+  cc.deltas.erase();
+  cc.narrow.erase();
+  cc.stream_vbyte = false;
+  cc.order.erase();
+  cc.block = 0;
+}
+
+inline void push_varint(v_array<char>& v, uint64_t i)
+{
+  if (v.end_array - v.end() < (ptrdiff_t)int_size)
+    v.resize(2 * (v.end_array - v.begin()) + int_size);
+  v.end() = run_len_encode(v.end(), i);
+}
+
+inline void write_bytes(io_buf& cache, const void* data, size_t len)
+{
+  char* c;
+  buf_write(cache, c, len);
+  memcpy(c, data, len);
+  cache.set(c + len);
+}
+
+void write_cache_block(io_buf& cache, cache_columns& cc)
+{
+  v_array<char>& indices = cc.column[INDICES];
+  unsigned char layout = column_raw;
+  uint64_t wide = 0;
+  for (uint64_t d : cc.deltas)
+    wide |= d;
+  indices.erase();
+  if (wide >> 32 == 0)
+  {
+    layout = column_stream_vbyte;
+    uint32_t count = (uint32_t)cc.deltas.size();
+    cc.narrow.erase();
+    cc.narrow.resize(count);
+    for (uint32_t i = 0; i < count; i++)
+      cc.narrow[i] = (uint32_t)cc.deltas[i];
+    indices.resize(sizeof(count) + svb_max_size(count));
+    memcpy(indices.begin(), &count, sizeof(count));
+    indices.end() = indices.begin() + sizeof(count) + svb_encode(cc.narrow.begin(), count, indices.begin() + sizeof(count));
+  }
+  else
+    for (uint64_t d : cc.deltas)
+      push_varint(indices, d);
+
+  size_t label_bytes = cc.labels.head - cc.labels.space.begin();
+  const char* raw[NUM_CACHE_COLUMNS];
+  size_t raw_length[NUM_CACHE_COLUMNS];
+  for (size_t i = 0; i < NUM_CACHE_COLUMNS; i++)
+  {
+    raw[i] = cc.column[i].begin();
+    raw_length[i] = cc.column[i].size();
+  }
+  raw[LABELS] = cc.labels.space.begin();
+  raw_length[LABELS] = label_bytes;
+
+  // deflate every column into one scratch buffer; column[LABELS] is free for it
+  v_array<char>& stored = cc.column[LABELS];
+  size_t bound = 0;
+  for (size_t i = 0; i < NUM_CACHE_COLUMNS; i++)
+    bound += compressBound((uLong)raw_length[i]);
+  stored.erase();
+  stored.resize(bound);
+
+  unsigned char codec[NUM_CACHE_COLUMNS];
+  uint32_t stored_length[NUM_CACHE_COLUMNS];
+  char* out = stored.begin();
+  for (size_t i = 0; i < NUM_CACHE_COLUMNS; i++)
+  {
+    uLongf len = compressBound((uLong)raw_length[i]);
+    if (raw_length[i] > 64 && compress2((Bytef*)out, &len, (const Bytef*)raw[i], (uLong)raw_length[i], 1) == Z_OK
+        && len <= raw_length[i] - raw_length[i] / 4)
+      codec[i] = column_deflated;
+    else
+    {
+      codec[i] = column_raw;
+      len = (uLongf)raw_length[i];
+      memcpy(out, raw[i], len);
+    }
+    stored_length[i] = (uint32_t)len;
+    out += len;
+  }
+  codec[INDICES] |= layout;
+
+  cache_block_entry entry = {cc.offset, (uint32_t)cc.examples};
+  cc.index.push_back(entry);
+
+  uint32_t examples = (uint32_t)cc.examples;
+  write_bytes(cache, &examples, sizeof(examples));
+  for (size_t i = 0; i < NUM_CACHE_COLUMNS; i++)
+  {
+    uint32_t length = (uint32_t)raw_length[i];
+    write_bytes(cache, &codec[i], sizeof(codec[i]));
+    write_bytes(cache, &length, sizeof(length));
+    write_bytes(cache, &stored_length[i], sizeof(stored_length[i]));
+  }
+  write_bytes(cache, stored.begin(), out - stored.begin());
+  cc.offset += sizeof(examples) + NUM_CACHE_COLUMNS * (1 + 2 * sizeof(uint32_t)) + (out - stored.begin());
+
+  for (size_t i = 0; i < NUM_CACHE_COLUMNS; i++)
+    cc.column[i].erase();
+  cc.deltas.erase();
+  cc.labels.head = cc.labels.space.begin();
+  cc.kinds = 0;
+  cc.examples = 0;
+}
+
+void cache_example_columns(vw& all, io_buf& cache, cache_columns& cc, example* ae)
+{
+  all.p->lp.cache_label(&ae->l, cc.labels);
+
+  push_varint(cc.column[TAGS], ae->tag.size());
+  push_many(cc.column[TAGS], ae->tag.begin(), ae->tag.size());
+
+  v_array<char>& kinds = cc.column[KINDS];
+  push_varint(cc.column[NAMESPACES], ae->indices.size());
+  for (namespace_index ns : ae->indices)
+  {
+    features& fs = ae->feature_space[ns];
+    cc.column[NAMESPACES].push_back((char)ns);
+    push_varint(cc.column[NAMESPACES], fs.size());
+
+    uint64_t last = 0;
+    for (features::iterator& f : fs)
+    {
+      feature_index fi = f.index() & all.parse_mask;
+      cc.deltas.push_back(ZigZagEncode(fi - last));
+      last = fi;
+
+      unsigned char kind = 0;
+      if (f.value() == -1.)
+        kind = 1;
+      else if (f.value() != 1.)
+      {
+        kind = 2;
+        push_many(cc.column[VALUES], (char*)&f.value(), sizeof(feature_value));
+      }
+      if ((cc.kinds & 3) == 0)
+        kinds.push_back(0);
+      *(kinds.end() - 1) |= kind << (2 * (cc.kinds & 3));
+      cc.kinds++;
+    }
+  }
+
+  size_t bytes = cc.labels.head - cc.labels.space.begin() + 4 * cc.deltas.size();
+  for (size_t i = TAGS; i < NUM_CACHE_COLUMNS; i++)
+    bytes += cc.column[i].size();
+  if (++cc.examples == cache_block_examples || bytes >= cache_block_bytes)
+    write_cache_block(cache, cc);
+}
+
+void finish_cache_columns(io_buf& cache, cache_columns& cc)
+{
+  if (cc.examples > 0)
+    write_cache_block(cache, cc);
+
+  uint32_t no_examples = 0;
+  uint64_t blocks = cc.index.size();
+  write_bytes(cache, &no_examples, sizeof(no_examples));
+  write_bytes(cache, &blocks, sizeof(blocks));
+  for (cache_block_entry& e : cc.index)
+  {
+    write_bytes(cache, &e.offset, sizeof(e.offset));
+    write_bytes(cache, &e.examples, sizeof(e.examples));
+  }
+  write_bytes(cache, &cc.offset, sizeof(cc.offset));
+  write_bytes(cache, "VWCI", 4);
+  reset_cache_columns(cc, 0);
+}
+
+// Reads the next block into cc, skipping over the index that ends each cache file.  Returns
+// false at the end of the input, or when the index is followed by a file in the row format.
+bool read_cache_block(vw& all, io_buf& input, cache_columns& cc)
+{
+  char* c;
+  uint32_t examples = 0;
+  while (examples == 0)
+  {
+    if (buf_read(input, c, sizeof(examples)) < sizeof(examples))
+      return false;
+    memcpy(&examples, c, sizeof(examples));
+    if (examples == 0)
+    {
+      uint64_t blocks;
+      if (buf_read(input, c, sizeof(blocks)) < sizeof(blocks))
+        return false;
+      memcpy(&blocks, c, sizeof(blocks));
+      size_t index_bytes = (size_t)blocks * (sizeof(uint64_t) + sizeof(uint32_t)) + sizeof(uint64_t) + 4;
+      if (buf_read(input, c, index_bytes) < index_bytes)
+        return false;
+      v_array<char>& formats = all.p->cache_formats;
+      if (!buf_ready(input) || (input.current < formats.size() && formats[input.current] != 'C'))
+        return false;
+    }
+  }
+
+  const size_t header_bytes = NUM_CACHE_COLUMNS * (1 + 2 * sizeof(uint32_t));
+  if (buf_read(input, c, header_bytes) < header_bytes)
+  {
+    all.trace_message << "truncated cache block!" << endl;
+    return false;
+  }
+  unsigned char codec[NUM_CACHE_COLUMNS];
+  uint32_t raw_length[NUM_CACHE_COLUMNS];
+  uint32_t stored_length[NUM_CACHE_COLUMNS];
+  for (size_t i = 0; i < NUM_CACHE_COLUMNS; i++)
+  {
+    codec[i] = (unsigned char)*c++;
+    memcpy(&raw_length[i], c, sizeof(uint32_t));
+    c += sizeof(uint32_t);
+    memcpy(&stored_length[i], c, sizeof(uint32_t));
+    c += sizeof(uint32_t);
+  }
+
+  for (size_t i = 0; i < NUM_CACHE_COLUMNS; i++)
+  {
+    if (buf_read(input, c, stored_length[i]) < stored_length[i])
+    {
+      all.trace_message << "truncated cache block!" << endl;
+      return false;
+    }
+    v_array<char>& col = cc.column[i];
+    col.erase();
+    col.resize(raw_length[i] + column_padding);
+    uLongf len = raw_length[i];
+    unsigned char layout = codec[i] & column_stream_vbyte;
+    if (layout != column_raw && i != INDICES)
+    {
+      all.trace_message << "corrupt cache block!" << endl;
+      return false;
+    }
+    if ((codec[i] & ~layout) == column_deflated)
+    {
+      if (uncompress((Bytef*)col.begin(), &len, (const Bytef*)c, stored_length[i]) != Z_OK || len != raw_length[i])
+      {
+        all.trace_message << "corrupt cache block!" << endl;
+        return false;
+      }
+    }
+    else if ((codec[i] & ~layout) == column_raw && stored_length[i] == raw_length[i])
+      memcpy(col.begin(), c, len);
+    else
+    {
+      all.trace_message << "corrupt cache block!" << endl;
+      return false;
+    }
+    col.end() = col.begin() + len;
+    memset(col.end(), 0, column_padding);
+    cc.pos[i] = col.begin();
+  }
+
+  // Stream VByte indices are expanded for the whole block up front
+  cc.narrow.erase();
+  cc.stream_vbyte = (codec[INDICES] & column_stream_vbyte) != 0;
+  if (cc.stream_vbyte)
+  {
+    v_array<char>& indices = cc.column[INDICES];
+    uint32_t count = 0;
+    if (indices.size() >= sizeof(count))
+      memcpy(&count, indices.begin(), sizeof(count));
+    size_t length = indices.size() - sizeof(count);
+    if (indices.size() < sizeof(count) || count / 4 > length)
+    {
+      all.trace_message << "corrupt cache block!" << endl;
+      return false;
+    }
+    if ((size_t)(cc.narrow.end_array - cc.narrow.begin()) < count)
+      cc.narrow.resize(count);
+    if (!svb_decode(indices.begin() + sizeof(count), length, count, cc.narrow.begin()))
+    {
+      all.trace_message << "corrupt cache block!" << endl;
+      return false;
+    }
+    cc.narrow.end() = cc.narrow.begin() + count;
+  }
+
+  // hand the label column to the label parser through its io_buf
+  v_array<char>& labels = cc.column[LABELS];
+  if (cc.labels.space.end_array - cc.labels.space.begin() < (ptrdiff_t)labels.size())
+    cc.labels.space.resize(labels.size());
+  memcpy(cc.labels.space.begin(), labels.begin(), labels.size());
+  cc.labels.space.end() = cc.labels.space.begin() + labels.size();
+  cc.labels.head = cc.labels.space.begin();
+  cc.labels.current = 0;
+
+  cc.examples = examples;
+  cc.next = 0;
+  cc.kinds = 0;
+  return true;
+}
+
+int read_cached_columns_example(vw& all, cache_columns& cc, io_buf& input, shared_data* sd, example* ae)
+{
+  if (cc.next == cc.examples && !read_cache_block(all, input, cc))
+    return 0;
+  cc.next++;
+
+  ae->sorted = all.p->sorted_cache;
+  if (all.p->lp.read_cached_label(sd, &ae->l, cc.labels) == 0)
+  {
+    all.trace_message << "corrupt cache block!" << endl;
+    return 0;
+  }
+
+  uint64_t tag_size = 0;
+  cc.pos[TAGS] = run_len_decode(cc.pos[TAGS], tag_size);
+  if (cc.pos[TAGS] > cc.column[TAGS].end() || tag_size > (uint64_t)(cc.column[TAGS].end() - cc.pos[TAGS]))
+  {
+    all.trace_message << "corrupt cache block!" << endl;
+    return 0;
+  }
+  ae->tag.erase();
+  push_many(ae->tag, cc.pos[TAGS], tag_size);
+  cc.pos[TAGS] += tag_size;
+
+  uint64_t num_indices = 0;
+  cc.pos[NAMESPACES] = run_len_decode(cc.pos[NAMESPACES], num_indices);
+  const unsigned char* kinds = (const unsigned char*)cc.column[KINDS].begin();
+  for (; num_indices > 0; num_indices--)
+  {
+    if (cc.pos[NAMESPACES] >= cc.column[NAMESPACES].end())
+    {
+      all.trace_message << "corrupt cache block!" << endl;
+      return 0;
+    }
+    unsigned char index = (unsigned char)*cc.pos[NAMESPACES]++;
+    uint64_t count = 0;
+    cc.pos[NAMESPACES] = run_len_decode(cc.pos[NAMESPACES], count);
+    if (count > 4 * cc.column[KINDS].size() - cc.kinds)
+    {
+      all.trace_message << "corrupt cache block!" << endl;
+      return 0;
+    }
+    ae->indices.push_back((size_t)index);
+    features& ours = ae->feature_space[index];
+
+    if (cc.stream_vbyte && count > cc.narrow.size() - cc.kinds)
+    {
+      all.trace_message << "corrupt cache block!" << endl;
+      return 0;
+    }
+    char* c = cc.pos[INDICES];
+    char* end = cc.column[INDICES].end();
+    char* values = cc.pos[VALUES];
+    char* values_end = cc.column[VALUES].end();
+    uint64_t last = 0;
+    for (uint64_t k = 0; k < count; k++, cc.kinds++)
+    {
+      uint64_t diff = 0;
+      if (cc.stream_vbyte)
+        diff = cc.narrow[cc.kinds];
+      else
+      {
+        // a varint runs at most int_size bytes into the padding after its column
+        if (c >= end)
+        {
+          all.trace_message << "corrupt cache block!" << endl;
+          return 0;
+        }
+        c = run_len_decode(c, diff);
+      }
+      int64_t s_diff = ZigZagDecode(diff);
+      if (s_diff < 0)
+        ae->sorted = false;
+      last += s_diff;
+
+      feature_value v = 1.f;
+      unsigned char kind = (kinds[cc.kinds >> 2] >> (2 * (cc.kinds & 3))) & 3;
+      if (kind == 1)
+        v = -1.f;
+      else if (kind == 2)
+      {
+        if (values + sizeof(feature_value) > values_end)
+        {
+          all.trace_message << "corrupt cache block!" << endl;
+          return 0;
+        }
+        memcpy(&v, values, sizeof(feature_value));
+        values += sizeof(feature_value);
+      }
+      ours.push_back(v, last);
+    }
+    cc.pos[INDICES] = c;
+    cc.pos[VALUES] = values;
+  }
+
+  return 1;
+}
+
+// Reads the index at the end of the cache file f into index.  Returns false if f has none.
+bool read_cache_index(io_buf& input, int f, v_array<cache_block_entry>& index)
+{
+  char* c;
+  uint64_t at;
+  const size_t trailer = sizeof(at) + 4;
+  if (!input.seek_file(f, -(int64_t)trailer) || buf_read(input, c, trailer) < trailer || memcmp(c + sizeof(at), "VWCI", 4))
+    return false;
+  memcpy(&at, c, sizeof(at));
+
+  uint32_t no_examples;
+  uint64_t blocks;
+  if (!input.seek_file(f, (int64_t)at) || buf_read(input, c, sizeof(no_examples) + sizeof(blocks)) < sizeof(no_examples) + sizeof(blocks))
+    return false;
+  memcpy(&no_examples, c, sizeof(no_examples));
+  memcpy(&blocks, c + sizeof(no_examples), sizeof(blocks));
+  if (no_examples != 0)
+    return false;
+  index.erase();
+  for (uint64_t b = 0; b < blocks; b++)
+  {
+    cache_block_entry e;
+    if (buf_read(input, c, sizeof(e.offset) + sizeof(e.examples)) < sizeof(e.offset) + sizeof(e.examples))
+      return false;
+    memcpy(&e.offset, c, sizeof(e.offset));
+    memcpy(&e.examples, c + sizeof(e.offset), sizeof(e.examples));
+    index.push_back(e);
+  }
+  return true;
+}
+
+// --shuffle_blocks: reads the block of this pass's order next, seeking to it through the index
+// of the cache file, which is read and shuffled at the start of every pass.  Falls back to
+// reading front to back, once warned, where the blocks can't be shuffled.
+bool read_shuffled_cache_block(vw& all, io_buf& input, cache_columns& cc)
+{
+  if (cc.block == 0 && cc.order.size() == 0)
+  {
+    const char* ignored = nullptr;
+    if (!all.holdout_set_off)
+      ignored = "without --holdout_off, holdout examples have to keep their place";
+    else if (input.files.size() != 1)
+      ignored = "unless a single cache file is read";
+    else if (!input.seek_file(input.files[0], 0))
+      ignored = "for a cache file that can't seek, such as a compressed one";
+    else if (!read_cache_index(input, input.files[0], cc.index))
+      THROW("the cache file has no block index for --shuffle_blocks, recreate it with -k");
+    if (ignored != nullptr)
+    {
+      all.trace_message << "--shuffle_blocks is ignored " << ignored << endl;
+      all.p->shuffle_blocks = false;
+      return read_cache_block(all, input, cc);
+    }
+
+    for (size_t b = 0; b < cc.index.size(); b++)
+      cc.order.push_back(b);
+    uint64_t state = all.random_seed + all.passes_complete;
+    for (size_t i = cc.order.size(); i > 1; i--)
+      swap(cc.order[i - 1], cc.order[(size_t)(merand48(state) * i) % i]);
+  }
+
+  if (cc.block == cc.order.size())
+    return false;
+  cache_block_entry& e = cc.index[cc.order[cc.block++]];
+  if (!input.seek_file(input.files[0], (int64_t)e.offset))
+  {
+    all.trace_message << "can't seek to a cache block!" << endl;
+    return false;
+  }
+  return read_cache_block(all, input, cc);
+}
+
+int read_cached_columns(vw* all, v_array<example*>& examples)
+{
+  cache_columns& cc = *all->p->columns;
+  io_buf& input = *all->p->input;
+  if (all->p->shuffle_blocks && cc.next == cc.examples && !read_shuffled_cache_block(*all, input, cc))
+    return 0;
+  return read_cached_columns_example(*all, cc, input, all->sd, examples[0]);
+}
+
+bool read_cache_block_deltas(vw& all, v_array<uint32_t>& deltas)
+{
+  cache_columns& cc = *all.p->columns;
+  if (!read_cache_block(all, *all.p->input, cc))
+    return false;
+  cc.next = cc.examples;
+  if (cc.stream_vbyte)
+    push_many(deltas, cc.narrow.begin(), cc.narrow.size());
+  else
+    for (char* p = cc.column[INDICES].begin(); p < cc.column[INDICES].end();)
+    {
+      uint64_t delta = 0;
+      p = run_len_decode(p, delta);
+      deltas.push_back((uint32_t)delta);
+    }
+  return true;
+}
+
+int read_cached_mixed(vw* all, v_array<example*>& examples)
+{
+  cache_columns& cc = *all->p->columns;
+  io_buf& input = *all->p->input;
+  // a block is read whole, so its examples come before anything still in the input
+  if (cc.next == cc.examples)
+  {
+    if (!buf_ready(input))
+      return 0;
+    if (all->p->cache_formats[input.current] != 'C')
+      return read_cached_features(all, examples);
+  }
+  int read = read_cached_columns(all, examples);
+  // the index ending a columnar file was followed by a file in the row format
+  if (read == 0 && cc.next == cc.examples && buf_ready(input) && all->p->cache_formats[input.current] != 'C')
+    return read_cached_features(all, examples);
+  return read;
+}
+
+/* Wire format: one example per frame, for services that hash their own features and hand the
+** examples to a daemon or to the library without going through text.  Every field is
+** little-endian:
+**   uint32 - size of the rest of the frame
+**   uint8  - version, wire_version
+**   uint8  - label kind: wire_no_label; wire_simple_label, followed by the float label, weight
+**            and initial; or wire_text_label, followed by a varint length and the label as it
+**            would appear in a text example, for any label type
+**   tag    - varint length, then the bytes
+**   uint8  - namespace count, then per namespace its index byte, a varint feature count and the
+**            features: zigzag deltas of the feature hashes shifted left by 2 as varints, as in
+**            the cache, with a float value after the varint when its low bits say so
+** Feature hashes are taken before the weight stride is applied, and the reader masks them
+** with the parse mask.  A stream of frames sent to the daemon starts with wire_marker.
+*/
+const unsigned char wire_version = 1;
+const unsigned char wire_no_label = 0;
+const unsigned char wire_simple_label = 1;
+const unsigned char wire_text_label = 2;
+
+inline uint64_t read_wire_varint(const char*& p, const char* end)
+{
+  uint64_t i = 0;
+  for (size_t shift = 0; p != end && shift < 64; shift += 7)
+  {
+    unsigned char b = *(p++);
+    i |= (uint64_t)(b & 127) << shift;
+    if (!(b & 128))
+      return i;
+  }
+  THROW("wire example: truncated frame");
+}
+
+inline void read_wire_bytes(const char*& p, const char* end, void* data, size_t len)
+{
+  if ((size_t)(end - p) < len)
+    THROW("wire example: truncated frame");
+  memcpy(data, p, len);
+  p += len;
+}
+
+// parses the body of a frame, everything after its size
+void read_wire_frame(vw& all, const char* p, const char* end, example* ae)
+{
+  unsigned char version, label_kind;
+  read_wire_bytes(p, end, &version, sizeof(version));
+  if (version != wire_version)
+    THROW("wire example: unsupported version " << (int)version << ", expected " << (int)wire_version);
+
+  all.p->lp.default_label(&ae->l);
+  read_wire_bytes(p, end, &label_kind, sizeof(label_kind));
+  if (label_kind == wire_simple_label)
+  {
+    if (all.p->lp.parse_label != simple_label.parse_label)
+      THROW("wire example: simple label sent for a reduction with another label type");
+    label_data& ld = ae->l.simple;
+    read_wire_bytes(p, end, &ld.label, sizeof(ld.label));
+    read_wire_bytes(p, end, &ld.weight, sizeof(ld.weight));
+    read_wire_bytes(p, end, &ld.initial, sizeof(ld.initial));
+    count_label(all.sd, ld.label);
+  }
+  else if (label_kind == wire_text_label)
+  {
+    size_t len = read_wire_varint(p, end);
+    if ((size_t)(end - p) < len)
+      THROW("wire example: truncated frame");
+    VW::parse_example_label(all, *ae, string(p, len)); // copied so number parsing stops at its end
+    p += len;
+  }
+  else if (label_kind != wire_no_label)
+    THROW("wire example: unknown label kind " << (int)label_kind);
+
+  size_t tag_size = read_wire_varint(p, end);
+  if ((size_t)(end - p) < tag_size)
+    THROW("wire example: truncated frame");
+  ae->tag.erase();
+  push_many(ae->tag, p, tag_size);
+  p += tag_size;
+
+  unsigned char num_indices;
+  read_wire_bytes(p, end, &num_indices, sizeof(num_indices));
+  ae->sorted = all.p->sorted_cache;
+  for (; num_indices > 0; num_indices--)
+  {
+    unsigned char index;
+    read_wire_bytes(p, end, &index, sizeof(index));
+    size_t count = read_wire_varint(p, end);
+    ae->indices.push_back(index);
+    features& ours = ae->feature_space[index];
+    uint64_t last = 0;
+    uint64_t last_masked = 0;
+    for (; count > 0; count--)
+    {
+      uint64_t i = read_wire_varint(p, end);
+      feature_value v = 1.f;
+      if (i & neg_1)
+        v = -1.f;
+      else if (i & general)
+        read_wire_bytes(p, end, &v, sizeof(v));
+      last += ZigZagDecode(i >> 2);
+      uint64_t masked = last & all.parse_mask;
+      if (masked < last_masked)
+        ae->sorted = false;
+      last_masked = masked;
+      ours.push_back(v, masked);
+    }
+  }
+  if (p != end)
+    THROW("wire example: " << (end - p) << " bytes left over in frame");
+}
+
+size_t wire_frame_size(const char* data, size_t length)
+{
+  uint32_t size;
+  if (length < sizeof(size))
+    return 0;
+  memcpy(&size, data, sizeof(size));
+  if (length - sizeof(size) < size)
+    return 0;
+  return sizeof(size) + size;
+}
+
+size_t read_wire_example(vw& all, const char* data, size_t length, example* ae)
+{
+  size_t frame_size = wire_frame_size(data, length);
+  if (frame_size > 0)
+    read_wire_frame(all, data + sizeof(uint32_t), data + frame_size, ae);
+  return frame_size;
+}
+
+int read_wire_features(vw* all, v_array<example*>& examples)
+{
+  io_buf& input = *all->p->input;
+  char* c;
+  uint32_t size;
+  if (buf_read(input, c, sizeof(size)) < sizeof(size))
+    return 0;
+  memcpy(&size, c, sizeof(size));
+  // buf_read only returns what fits in the buffer, and the buffer may be a memory mapped
+  // window, which can't grow: a larger frame is put together in a buffer of its own
+  size_t capacity = input.space.end_array - input.space.begin();
+  vector<char> frame;
+  size_t got;
+  if (size <= capacity)
+    got = buf_read(input, c, size);
+  else
+  {
+    frame.resize(size);
+    for (got = 0; got < size;)
+    {
+      size_t n = buf_read(input, c, min(size - got, capacity));
+      if (n == 0)
+        break;
+      memcpy(frame.data() + got, c, n);
+      got += n;
+    }
+    c = frame.data();
+  }
+  if (got < size)
+  {
+    all->trace_message << "truncated wire example! wanted: " << size << " bytes" << endl;
+    return 0;
+  }
+  read_wire_frame(*all, c, c + size, examples[0]);
+  return (int)(sizeof(size) + size);
+}
+
+bool is_wire_stream(io_buf& i)
+{
+  if (i.space.end() == i.head)
+    if (i.fill(i.files[i.current]) <= 0)
+      return false;
+
+  bool ret = (*i.head == wire_marker);
+  if (ret)
+    i.head++;
+
+  return ret;
+}
+
+void write_wire_example(vw& all, example& ec, v_array<char>& out)
+{
+  if (all.p->lp.parse_label != simple_label.parse_label)
+    THROW("wire example: only simple labels can be written");
+
+  size_t start = out.size();
+  size_t storage = sizeof(uint32_t) + 2 + sizeof(label_data) + int_size + ec.tag.size() + 1;
+  for (namespace_index ns : ec.indices)
+  {
+    features& fs = ec.feature_space[ns];
+    storage += 1 + int_size + fs.size() * (int_size + sizeof(feature_value));
+  }
+  if ((size_t)(out.end_array - out.end()) < storage)
+    out.resize(start + storage);
+
+  char* c = out.end() + sizeof(uint32_t);
+  *(c++) = wire_version;
+  *(c++) = wire_simple_label;
+  label_data& ld = ec.l.simple;
+  memcpy(c, &ld.label, sizeof(ld.label));
+  c += sizeof(ld.label);
+  memcpy(c, &ld.weight, sizeof(ld.weight));
+  c += sizeof(ld.weight);
+  memcpy(c, &ld.initial, sizeof(ld.initial));
+  c += sizeof(ld.initial);
+
+  c = run_len_encode(c, ec.tag.size());
+  memcpy(c, ec.tag.begin(), ec.tag.size());
+  c += ec.tag.size();
+
+  // the constant namespace is added again by the reader
+  unsigned char* num_indices = (unsigned char*)c++;
+  *num_indices = 0;
+  uint64_t multiplier = (uint64_t)all.wpp << all.weights.stride_shift();
+  for (namespace_index ns : ec.indices)
+  {
+    if (ns == constant_namespace)
+      continue;
+    (*num_indices)++;
+    features& fs = ec.feature_space[ns];
+    *(c++) = ns;
+    c = run_len_encode(c, fs.size());
+    uint64_t last = 0;
+    for (features::iterator& f : fs)
+    {
+      uint64_t fi = (f.index() / multiplier) & all.parse_mask;
+      uint64_t diff = ZigZagEncode((int64_t)(fi - last)) << 2;
+      last = fi;
+      if (f.value() == 1.)
+        c = run_len_encode(c, diff);
+      else if (f.value() == -1.)
+        c = run_len_encode(c, diff | neg_1);
+      else
+      {
+        c = run_len_encode(c, diff | general);
+        memcpy(c, &f.value(), sizeof(feature_value));
+        c += sizeof(feature_value);
+      }
+    }
+  }
+
+  uint32_t size = (uint32_t)(c - out.end() - sizeof(uint32_t));
+  memcpy(out.end(), &size, sizeof(size));
+  out.end() = c;
+}
@@ -8,12 +8,68 @@ license as described in the file LICENSE.
 #include "io_buf.h"
 #include "example.h"
 
-char* run_len_decode(char *p, size_t& i);
-char* run_len_encode(char *p, size_t i);
+inline char* run_len_decode(char *p, uint64_t& i)
+{
+  // read an int 7 bits at a time.
+  size_t count = 0;
+  while(*p & 128)
+    i = i | ((uint64_t)(*(p++) & 127) << 7*count++);
+  i = i | ((uint64_t)(*(p++)) << 7*count);
+  return p;
+}
+
+inline char* run_len_encode(char *p, uint64_t i)
+{
+  // store an int 7 bits at a time.
+  while (i >= 128)
+  {
+    *(p++) = (i & 127) | 128;
+    i = i >> 7;
+  }
+  *(p++) = (i & 127);
+  return p;
+}
+
+inline uint64_t ZigZagEncode(int64_t n)
+{
+  uint64_t ret = (n << 1) ^ (n >> 63);
+  return ret;
+}
+
+inline int64_t ZigZagDecode(uint64_t n) { return (n >> 1) ^ -static_cast<int64_t>(n & 1); }
 
 int read_cached_features(vw* all, v_array<example*>& examples);
+// reads an example from input, counting its label into sd
+int read_cached_example(vw& all, io_buf& input, shared_data* sd, example* ae);
 void cache_tag(io_buf& cache, v_array<char> tag);
 void cache_features(io_buf& cache, example* ae, uint64_t mask);
 void output_byte(io_buf& cache, unsigned char s);
 void output_features(io_buf& cache, unsigned char index, features& fs, uint64_t mask);
 
+// columnar cache format (--cache_format 2), see cache.cc
+struct cache_columns;
+cache_columns* new_cache_columns();
+void delete_cache_columns(cache_columns* cc);
+void reset_cache_columns(cache_columns& cc, uint64_t offset);
+void cache_example_columns(vw& all, io_buf& cache, cache_columns& cc, example* ae);
+void finish_cache_columns(io_buf& cache, cache_columns& cc);
+int read_cached_columns(vw* all, v_array<example*>& examples);
+int read_cached_columns_example(vw& all, cache_columns& cc, io_buf& input, shared_data* sd, example* ae);
+// Reads the next block of the columnar cache all is reading and appends its indices column,
+// the zigzagged deltas, to deltas.  Returns false at the end of the input.  For benchmarks.
+bool read_cache_block_deltas(vw& all, v_array<uint32_t>& deltas);
+// reads cache files of both formats, as listed in all->p->cache_formats
+int read_cached_mixed(vw* all, v_array<example*>& examples);
+
+
+// wire format for examples with hashed features, see cache.cc
+const unsigned char wire_marker = 1; // first byte of a wire stream, as 0 is for a cache stream
+// bytes of the frame data starts with, or 0 unless length holds all of it
+size_t wire_frame_size(const char* data, size_t length);
+// parses one frame from data, returning the bytes used or 0 when the frame is incomplete
+size_t read_wire_example(vw& all, const char* data, size_t length, example* ae);
+int read_wire_features(vw* all, v_array<example*>& examples);
+// consumes wire_marker if the input starts with it
+bool is_wire_stream(io_buf& i);
+// appends ec, which must have a simple label, to out as a frame
+void write_wire_example(vw& all, example& ec, v_array<char>& out);
@@ -0,0 +1,331 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD (revised)
+license as described in the file LICENSE.
+ */
+#include <algorithm>
+#include "cache_shards.h"
+#include "cache.h"
+#include "unique_sort.h"
+#include "best_constant.h"
+#include "rand48.h"
+#include "vw.h"
+
+using namespace std;
+
+string cache_shard_name(const string& name, size_t shard)
+{
+  return name + "." + to_string(shard);
+}
+
+io_buf* new_shard_io_buf(io_buf& like)
+{
+  if (!like.compressed())
+    return new io_buf;
+  comp_io_buf* b = new comp_io_buf;
+  b->inflate_threads = ((comp_io_buf&)like).inflate_threads;
+  b->block_output = ((comp_io_buf&)like).block_output;
+  return b;
+}
+
+cache_shards* new_cache_shards(vw& all, size_t count)
+{
+  cache_shards* s = &calloc_or_throw<cache_shards>();
+  s->all = &all;
+  s->count = count;
+  s->outputs = calloc_or_throw<io_buf*>(count);
+  s->columns = calloc_or_throw<cache_columns*>(count);
+  s->readers = calloc_or_throw<shard_reader>(count);
+  s->order = calloc_or_throw<size_t>(count);
+  s->queue_size = max((size_t)16, all.p->ring_size / 4);
+  s->shuffle = all.p->shuffle_shards;
+  s->shuffle_state = all.random_seed;
+  initialize_mutex(&s->lock);
+  initialize_condition_variable(&s->example_decoded);
+  initialize_condition_variable(&s->example_taken);
+  return s;
+}
+
+void delete_cache_shards(vw& all, cache_shards* s)
+{
+  stop_shard_readers(*s);
+  for (size_t i = 1; i < s->count; i++)
+  {
+    if (s->outputs[i] != nullptr)
+    {
+      s->outputs[i]->close_files();
+      s->outputs[i]->finalname.delete_v();
+      s->outputs[i]->currentname.delete_v();
+      delete s->outputs[i];
+    }
+    if (s->columns[i] != nullptr)
+      delete_cache_columns(s->columns[i]);
+  }
+  for (size_t i = 0; i < s->count; i++)
+  {
+    shard_reader& r = s->readers[i];
+    if (r.input == nullptr)
+      continue;
+    r.input->close_files();
+    delete r.input;
+    if (r.columns != nullptr)
+      delete_cache_columns(r.columns);
+    for (size_t q = 0; q < s->queue_size; q++)
+      VW::dealloc_example(all.p->lp.delete_label, r.queue[q]);
+    free(r.queue);
+    free(r.newline);
+    free(r.scratch);
+  }
+  free(s->outputs);
+  free(s->columns);
+  free(s->readers);
+  free(s->order);
+  s->error.delete_v();
+  delete_mutex(&s->lock);
+  free(s);
+}
+
+// Counts an example into the current stripe; true if that ends the stripe.  The writer and
+// the readers must agree on this.
+bool end_of_stripe(vw& all, cache_shards& s, bool newline)
+{
+  if (++s.stripe < cache_shard_stripe || (all.p->emptylines_separate_examples && !newline))
+    return false;
+  s.stripe = 0;
+  return true;
+}
+
+void add_write_shard(cache_shards& s, io_buf* output, cache_columns* columns)
+{
+  size_t i = 0;
+  while (s.outputs[i] != nullptr)
+    i++;
+  s.outputs[i] = output;
+  s.columns[i] = columns;
+}
+
+void cache_example_shard(vw& all, cache_shards& s, example* ae)
+{
+  io_buf& output = *s.outputs[s.current];
+  if (s.columns[s.current] != nullptr)
+    cache_example_columns(all, output, *s.columns[s.current], ae);
+  else
+  {
+    all.p->lp.cache_label(&ae->l, output);
+    cache_features(output, ae, all.parse_mask);
+  }
+  if (end_of_stripe(all, s, example_is_newline(*ae) != 0))
+    s.current = (s.current + 1) % s.count;
+}
+
+void add_read_shard(cache_shards& s, io_buf* input, bool columnar)
+{
+  size_t i = 0;
+  while (s.readers[i].input != nullptr)
+    i++;
+  shard_reader& r = s.readers[i];
+  r.shards = &s;
+  r.input = input;
+  r.columns = columnar ? new_cache_columns() : nullptr;
+  r.scratch = &calloc_or_throw<shared_data>();
+  r.queue = calloc_or_throw<example>(s.queue_size);
+  r.newline = calloc_or_throw<bool>(s.queue_size);
+  s.reading = true;
+}
+
+#ifdef _WIN32
+DWORD WINAPI shard_reader_thread(LPVOID in)
+#else
+void *shard_reader_thread(void *in)
+#endif
+{
+  shard_reader& r = *(shard_reader*)in;
+  cache_shards& s = *r.shards;
+  vw& all = *s.all;
+  v_array<size_t> gram_mask = v_init<size_t>();
+
+  mutex_lock(&s.lock);
+  while (!s.stopping)
+  {
+    if (r.decoded - r.taken == s.queue_size)
+    {
+      condition_variable_wait(&s.example_taken, &s.lock);
+      continue;
+    }
+    size_t slot = r.decoded % s.queue_size;
+    mutex_unlock(&s.lock);
+
+    example* ae = &r.queue[slot];
+    int num_read = 0;
+    string error;
+    try
+    {
+      num_read = r.columns != nullptr ? read_cached_columns_example(all, *r.columns, *r.input, r.scratch, ae)
+                 : read_cached_example(all, *r.input, r.scratch, ae);
+      if (num_read > 0)
+      {
+        r.newline[slot] = example_is_newline(*ae) != 0;
+        if (all.p->sort_features && ae->sorted == false)
+          unique_sort_features(all.parse_mask, ae);
+        setup_example_features(all, ae, gram_mask);
+      }
+      else // drop whatever a truncated example left behind
+        VW::empty_example(all, *ae);
+    }
+    catch (exception& e)
+    {
+      error = e.what();
+      num_read = 0;
+    }
+
+    mutex_lock(&s.lock);
+    if (!error.empty() && s.error.empty())
+    {
+      push_many(s.error, error.c_str(), error.size());
+      s.error.push_back('\0');
+    }
+    if (num_read <= 0)
+      r.eof = true;
+    else
+      r.decoded++;
+    condition_variable_signal_all(&s.example_decoded);
+    if (r.eof)
+      break;
+  }
+  mutex_unlock(&s.lock);
+
+  gram_mask.delete_v();
+  return 0L;
+}
+
+void shuffle_round(cache_shards& s)
+{
+  s.position = 0;
+  if (!s.shuffle)
+    return;
+  for (size_t i = s.live; i > 1; i--)
+    swap(s.order[i - 1], s.order[(size_t)(merand48(s.shuffle_state) * i) % i]);
+}
+
+void start_shard_readers(vw& all, cache_shards& s)
+{
+  if (s.shuffle && !all.holdout_set_off)
+  {
+    all.trace_message << "--shuffle_shards is ignored without --holdout_off, holdout examples have to keep their place" << endl;
+    s.shuffle = false;
+  }
+
+  s.live = 0;
+  for (size_t i = 0; i < s.count; i++)
+    if (s.readers[i].input != nullptr)
+      s.order[s.live++] = i;
+  s.stripe = 0;
+  shuffle_round(s);
+
+  s.running = true;
+  for (size_t i = 0; i < s.live; i++)
+  {
+    shard_reader& r = s.readers[s.order[i]];
+#ifndef _WIN32
+    pthread_create(&r.thread, nullptr, shard_reader_thread, &r);
+#else
+    r.thread = ::CreateThread(nullptr, 0, static_cast<LPTHREAD_START_ROUTINE>(shard_reader_thread), &r, 0L, nullptr);
+#endif
+  }
+}
+
+void stop_shard_readers(cache_shards& s)
+{
+  if (!s.running)
+    return;
+  mutex_lock(&s.lock);
+  s.stopping = true;
+  condition_variable_signal_all(&s.example_taken);
+  mutex_unlock(&s.lock);
+
+  for (size_t i = 0; i < s.count; i++)
+  {
+    shard_reader& r = s.readers[i];
+    if (r.input == nullptr)
+      continue;
+#ifndef _WIN32
+    pthread_join(r.thread, nullptr);
+#else
+    ::WaitForSingleObject(r.thread, INFINITE);
+    ::CloseHandle(r.thread);
+#endif
+    // examples decoded for a pass that ended early
+    for (uint64_t q = r.taken; q < r.decoded; q++)
+      VW::empty_example(*s.all, r.queue[q % s.queue_size]);
+    r.decoded = 0;
+    r.taken = 0;
+    r.eof = false;
+  }
+  s.stopping = false;
+  s.running = false;
+}
+
+// Moves a decoded example into an empty ring slot, leaving the slot's empty buffers behind.
+void move_example(example& from, example& to)
+{
+  swap(from.l, to.l);
+  swap(from.tag, to.tag);
+  for (namespace_index ns : from.indices)
+    if (to.feature_space[ns].size() == 0)
+      swap(from.feature_space[ns], to.feature_space[ns]);
+  swap(from.indices, to.indices);
+  to.sorted = from.sorted;
+  to.partial_prediction = from.partial_prediction;
+  to.num_features = from.num_features;
+  to.total_sum_feat_sq = from.total_sum_feat_sq;
+  to.loss = from.loss;
+}
+
+int read_cached_shards(vw& all, example* ae)
+{
+  cache_shards& s = *all.p->shards;
+  if (!s.running)
+    start_shard_readers(all, s);
+
+  while (s.live > 0)
+  {
+    shard_reader& r = s.readers[s.order[s.position]];
+    mutex_lock(&s.lock);
+    while (r.decoded == r.taken && !r.eof)
+      condition_variable_wait(&s.example_decoded, &s.lock);
+    bool exhausted = r.decoded == r.taken;
+    bool failed = !s.error.empty();
+    mutex_unlock(&s.lock);
+    if (failed)
+      THROW(s.error.begin());
+
+    if (exhausted)
+    {
+      // the shard is done for this pass, so are the rest of its round
+      memmove(s.order + s.position, s.order + s.position + 1, (s.live - s.position - 1) * sizeof(size_t));
+      s.live--;
+      s.stripe = 0;
+      if (s.position == s.live)
+        shuffle_round(s);
+      continue;
+    }
+
+    size_t slot = r.taken % s.queue_size;
+    bool newline = r.newline[slot];
+    move_example(r.queue[slot], *ae);
+    mutex_lock(&s.lock);
+    r.taken++;
+    condition_variable_signal_all(&s.example_taken);
+    mutex_unlock(&s.lock);
+
+    // the label statistics depend on the order labels are seen in
+    if (all.p->lp.read_cached_label == simple_label.read_cached_label)
+      count_label(all.sd, ae->l.simple.label);
+    count_example(all, ae, newline, all.p->end_parsed_examples);
+
+    if (end_of_stripe(all, s, newline) && ++s.position == s.live)
+      shuffle_round(s);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,93 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#pragma once
+#include <string>
+#include "io_buf.h"
+#include "parse_primitives.h"
+#include "example.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+/* Sharded caches (--cache_shards).  A cache file name becomes count files name.0, name.1, ...
+** The writer deals the examples out in stripes: a stripe is cache_shard_stripe examples, or
+** with multiline examples the first empty line at or after that, and stripes go round robin
+** over the shards.  Reading, every shard has a thread that decodes its examples ahead into a
+** small queue of its own, while the parser thread takes them back out stripe by stripe in the
+** same order, so a sharded cache replays the examples exactly as they were written.  With
+** --shuffle_shards the order of the shards is shuffled for every round of stripes instead.
+*/
+const size_t cache_shard_stripe = 1024;
+
+struct vw;
+struct cache_columns;
+struct shared_data;
+struct cache_shards;
+
+struct shard_reader
+{
+  cache_shards* shards;
+  io_buf* input;
+  cache_columns* columns; // for a columnar shard
+  shared_data* scratch; // takes the label statistics, the parser thread counts labels in order
+
+  example* queue;
+  bool* newline; // example_is_newline of each queued example before setup
+  uint64_t decoded; // examples queued by the reader
+  uint64_t taken; // examples taken out by the parser thread
+  bool eof; // the reader hit the end of its shard (or an error)
+#ifndef _WIN32
+  pthread_t thread;
+#else
+  HANDLE thread;
+#endif
+};
+
+struct cache_shards
+{
+  vw* all;
+  size_t count;
+  size_t stripe; // examples so far in the current stripe
+  size_t current; // shard of the current stripe
+
+  // writing: outputs[0] and columns[0] are the parser's own
+  io_buf** outputs;
+  cache_columns** columns;
+
+  // reading
+  bool reading;
+  bool running; // the reader threads exist and must be joined
+  bool stopping;
+  bool shuffle;
+  uint64_t shuffle_state;
+  shard_reader* readers;
+  size_t queue_size;
+  size_t* order; // shards left this pass, in the order of the current round
+  size_t live; // entries of order still in use
+  size_t position; // entry of order with the current stripe
+  MUTEX lock;
+  CV example_decoded;
+  CV example_taken;
+  v_array<char> error; // what stopped a reader, if anything
+};
+
+std::string cache_shard_name(const std::string& name, size_t shard);
+// a buffer of the same kind as like, for another shard of its file
+io_buf* new_shard_io_buf(io_buf& like);
+
+cache_shards* new_cache_shards(vw& all, size_t count);
+void delete_cache_shards(vw& all, cache_shards* s);
+
+// writing
+void add_write_shard(cache_shards& s, io_buf* output, cache_columns* columns);
+void cache_example_shard(vw& all, cache_shards& s, example* ae);
+
+// reading
+void add_read_shard(cache_shards& s, io_buf* input, bool columnar);
+void stop_shard_readers(cache_shards& s);
+void reset_cache_shards(vw& all, cache_shards& s);
+int read_cached_shards(vw& all, example* ae);
@@ -4,6 +4,7 @@
 #include "bs.h"
 #include "gen_cs_example.h"
 #include "cb_explore.h"
+#include "label_dictionary.h"
 
 using namespace LEARNER;
 using namespace ACTION_SCORE;
@@ -58,6 +59,11 @@ struct cb_explore_adf
   COST_SENSITIVE::label cs_labels_2;
 
   v_array<COST_SENSITIVE::label> prepped_cs_labels;
+
+  bool fuse_policies;
+  v_array<polyprediction> policy_scores;
+  v_array<float> best_scores;
+  v_array<uint32_t> best_actions;
 };
 
 template<class T> void swap(T& ele1, T& ele2)
@@ -81,6 +87,51 @@ void multiline_learn_or_predict(base_learner& base, v_array<example*>& examples,
   }
 }
 
+// Finds the lowest scoring action of policies lo..lo+count-1 with one multipredict per action
+// instead of one pass over the sequence per policy.  Ties go to the lower action, as in csoaa_ldf.
+void predict_policies(cb_explore_adf& data, v_array<example*>& examples, size_t lo, size_t count)
+{
+  base_learner& scorer = *data.all->scorer;
+  size_t start = CB::ec_is_example_header(*examples[0]) ? 1 : 0;
+  size_t end = examples.size() - 1;
+
+  data.policy_scores.resize(count);
+  data.best_scores.erase();
+  data.best_actions.erase();
+  for (size_t i = 0; i < count; i++)
+  {
+    data.best_scores.push_back(FLT_MAX);
+    data.best_actions.push_back(0);
+  }
+
+  label_data simple_label;
+  simple_label.label = FLT_MAX;
+  simple_label.weight = 1.;
+  simple_label.initial = 0.;
+  for (size_t k = start; k < end; k++)
+  {
+    example& ec = *examples[k];
+    if (start > 0)
+      LabelDict::add_example_namespaces_from_example(ec, *examples[0]);
+    polylabel saved_label = ec.l;
+    uint64_t old_offset = ec.ft_offset;
+    ec.l.simple = simple_label;
+    ec.ft_offset = data.offset;
+    scorer.multipredict(ec, lo, count, data.policy_scores.begin(), false);
+    ec.ft_offset = old_offset;
+    ec.l = saved_label;
+    if (start > 0)
+      LabelDict::del_example_namespaces_from_example(ec, *examples[0]);
+
+    for (size_t i = 0; i < count; i++)
+      if (data.policy_scores[i].scalar < data.best_scores[i])
+      {
+        data.best_scores[i] = data.policy_scores[i].scalar;
+        data.best_actions[i] = (uint32_t)(k - start);
+      }
+  }
+}
+
 example* test_adf_sequence(v_array<example*>& ec_seq)
 {
   uint32_t count = 0;
@@ -172,6 +223,21 @@ void predict_or_learn_bag(cb_explore_adf& data, base_learner& base, v_array<exam
   for (uint32_t i = 0; i < num_actions; i++)
     data.action_probs.push_back({ i,0. });
   float prob = 1.f / (float)data.bag_size;
+  if (!is_learn && data.fuse_policies)
+  {
+    predict_policies(data, examples, 0, data.bag_size);
+    for (uint32_t i = 0; i < data.bag_size; i++)
+      data.action_probs[data.best_actions[i]].score += prob;
+
+    CB_EXPLORE::safety(data.action_probs, data.epsilon, true);
+    qsort((void*) data.action_probs.begin(), data.action_probs.size(), sizeof(action_score), reverse_order);
+
+    preds.erase();
+    for (size_t i = 0; i < num_actions; i++)
+      preds.push_back(data.action_probs[i]);
+    return;
+  }
+
   bool test_sequence = test_adf_sequence(data.ec_seq) == nullptr;
   for (uint32_t i = 0; i < data.bag_size; i++)
   {
@@ -228,6 +294,10 @@ void predict_or_learn_cover(cb_explore_adf& data, base_learner& base, v_array<ex
 
   uint32_t shared = CB::ec_is_example_header(*examples[0]) ? 1 : 0;
 
+  bool fused = !is_learn && data.fuse_policies && data.cover_size > 1;
+  if (fused)
+    predict_policies(data, examples, 2, data.cover_size - 1);
+
   float norm = min_prob * num_actions + (additive_probability - min_prob);
   for (size_t i = 1; i < data.cover_size; i++)
   {
@@ -244,10 +314,10 @@ void predict_or_learn_cover(cb_explore_adf& data, base_learner& base, v_array<ex
       }
       GEN_CS::call_cs_ldf<true>(*(data.cs_ldf_learner), examples, data.cb_labels, data.cs_labels_2, data.prepped_cs_labels, data.offset, i+1);
     }
-    else
+    else if (!fused)
       GEN_CS::call_cs_ldf<false>(*(data.cs_ldf_learner), examples, data.cb_labels, data.cs_labels, data.prepped_cs_labels, data.offset, i+1);
 
-    uint32_t action = preds[0].action;
+    uint32_t action = fused ? data.best_actions[i-1] : preds[0].action;
     if (probs[action].score < min_prob)
       norm += max(0, additive_probability - (min_prob - probs[action].score));
     else
@@ -308,6 +378,9 @@ void finish(cb_explore_adf& data)
     data.prepped_cs_labels[i].costs.delete_v();
   data.prepped_cs_labels.delete_v();
   data.gen_cs.pred_scores.costs.delete_v();
+  data.policy_scores.delete_v();
+  data.best_scores.delete_v();
+  data.best_actions.delete_v();
 }
 
 
@@ -517,7 +590,8 @@ base_learner* cb_explore_adf_setup(vw& all)
   ("nounif", "do not explore uniformly on zero-probability actions in cover")
   ("softmax", "softmax exploration")
   ("greedify", "always update first policy once in bagging")
-  ("lambda", po::value<float>(), "parameter for softmax");
+  ("lambda", po::value<float>(), "parameter for softmax")
+  ("fuse_policies", "score all bag or cover policies in one sweep over the actions when predicting");
   add_options(all);
 
   po::variables_map& vm = all.vm;
@@ -600,6 +674,20 @@ base_learner* cb_explore_adf_setup(vw& all)
   data.gen_cs.scorer = all.scorer;
   data.cs_ldf_learner = all.cost_sensitive;
   data.gen_cs.cb_type = CB_TYPE_IPS;
+
+  // Fusing needs the policies to sit at consecutive scorer offsets right below csoaa_ldf,
+  // and raw scores that rank actions exactly as csoaa_ldf does.
+  if (vm.count("fuse_policies") && (data.explore_type == BAG_EXPLORE || data.explore_type == COVER))
+  {
+    size_t stride = data.explore_type == BAG_EXPLORE ? base->increment : data.cs_ldf_learner->increment;
+    if (data.cs_ldf_learner->learn_base() == all.scorer && stride == all.scorer->increment
+        && vm["link"].as<string>().compare("identity") == 0)
+      data.fuse_policies = true;
+    else
+      all.trace_message << "warning: --fuse_policies needs ips or mtr, the identity link and no reduction between "
+                        << "csoaa_ldf and the scorer; scoring policies one at a time" << endl;
+  }
+
   if (all.vm.count("cb_type"))
   {
     std::string type_string;
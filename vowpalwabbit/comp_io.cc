@@ -1,55 +1,490 @@
 #include "zlib.h"
 #include "comp_io.h"
+#include "parse_primitives.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+// BGZF block layout: an 18 byte gzip header with a 'BC' extra field holding the block size
+// minus one, raw deflate data, then the CRC32 and length of the uncompressed data.
+static const size_t bgzf_header_size = 18;
+static const size_t bgzf_footer_size = 8;
+static const size_t bgzf_max_block = 0x10000;
+static const size_t bgzf_max_input = 0xff00; // stays under bgzf_max_block even when stored
+static const size_t bgzf_chunk_blocks = 16; // blocks handed to a worker at once
+
+static bool is_bgzf_header(const unsigned char* h)
+{
+  return h[0] == 0x1f && h[1] == 0x8b && h[2] == 8 && (h[3] & 4) != 0 && h[10] == 6 && h[11] == 0 &&
+         h[12] == 'B' && h[13] == 'C' && h[14] == 2 && h[15] == 0;
+}
+
+static uint32_t get_le32(const unsigned char* p)
+{
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put_le16(unsigned char* p, uint32_t v)
+{
+  p[0] = (unsigned char)v;
+  p[1] = (unsigned char)(v >> 8);
+}
+
+static void put_le32(unsigned char* p, uint32_t v)
+{
+  put_le16(p, v);
+  put_le16(p + 2, v >> 16);
+}
+
+static size_t read_fully(int f, char* buf, size_t nbytes)
+{
+  size_t got = 0;
+  while (got < nbytes)
+  {
+    ssize_t num_read = io_buf::read_file_or_socket(f, buf + got, nbytes - got);
+    if (num_read <= 0)
+      break;
+    got += num_read;
+  }
+  return got;
+}
+
+static void seek_start(int f)
+{
+#ifdef _WIN32
+  _lseek(f, 0, SEEK_SET);
+#else
+  lseek(f, 0, SEEK_SET);
+#endif
+}
+
+struct bgzf_chunk
+{
+  v_array<char> in; // whole blocks, headers included
+  v_array<size_t> blocks; // offset of each block in in
+  v_array<char> out;
+  size_t consumed; // bytes of out already handed out
+  bool inflated;
+  bool corrupt;
+};
+
+struct bgzf_reader
+{
+  int file;
+  size_t num_threads;
+#ifndef _WIN32
+  pthread_t* threads;
+#else
+  HANDLE* threads;
+#endif
+  MUTEX lock;
+  CV chunk_submitted;
+  CV chunk_inflated;
+
+  bgzf_chunk* chunks;
+  size_t num_chunks;
+  uint64_t filled; // chunks read from file and submitted
+  uint64_t taken; // chunks picked up by a worker
+  uint64_t drained; // chunks fully handed out
+  bool input_done;
+  bool failed;
+  bool stop;
+};
+
+struct bgzf_writer
+{
+  int file;
+  v_array<char> pending; // input not yet making up a whole block
+  v_array<char> block;
+  z_stream z;
+};
+
+static bool inflate_chunk(bgzf_chunk& c)
+{
+  z_stream z;
+  memset(&z, 0, sizeof(z));
+  if (inflateInit2(&z, -MAX_WBITS) != Z_OK)
+    return false;
+
+  bool ok = true;
+  char* out = c.out.begin();
+  for (size_t i = 0; i < c.blocks.size() && ok; i++)
+  {
+    unsigned char* block = (unsigned char*)c.in.begin() + c.blocks[i];
+    size_t block_size = (i + 1 < c.blocks.size() ? c.blocks[i + 1] : c.in.size()) - c.blocks[i];
+    uint32_t length = get_le32(block + block_size - 4);
+    if (length == 0)
+      continue;
+
+    inflateReset(&z);
+    z.next_in = block + bgzf_header_size;
+    z.avail_in = (uInt)(block_size - bgzf_header_size - bgzf_footer_size);
+    z.next_out = (Bytef*)out;
+    z.avail_out = length;
+    ok = inflate(&z, Z_FINISH) == Z_STREAM_END && z.avail_out == 0 &&
+         crc32(crc32(0L, Z_NULL, 0), (Bytef*)out, length) == get_le32(block + block_size - 8);
+    out += length;
+  }
+  inflateEnd(&z);
+  return ok;
+}
+
+#ifdef _WIN32
+DWORD WINAPI bgzf_worker(LPVOID in)
+#else
+void *bgzf_worker(void *in)
+#endif
+{
+  bgzf_reader& r = *(bgzf_reader*)in;
+  while (true)
+  {
+    mutex_lock(&r.lock);
+    while (r.taken == r.filled && !r.stop)
+      condition_variable_wait(&r.chunk_submitted, &r.lock);
+    if (r.taken == r.filled)
+    {
+      mutex_unlock(&r.lock);
+      break;
+    }
+    bgzf_chunk& c = r.chunks[r.taken++ % r.num_chunks];
+    mutex_unlock(&r.lock);
+
+    bool ok = !c.corrupt && inflate_chunk(c);
+
+    mutex_lock(&r.lock);
+    c.corrupt = !ok;
+    c.inflated = true;
+    condition_variable_signal_all(&r.chunk_inflated);
+    mutex_unlock(&r.lock);
+  }
+  return 0L;
+}
+
+static bgzf_reader* new_bgzf_reader(int f, size_t num_threads)
+{
+  bgzf_reader* r = &calloc_or_throw<bgzf_reader>();
+  r->file = f;
+  r->num_threads = num_threads;
+  r->num_chunks = 2 * num_threads;
+  r->chunks = calloc_or_throw<bgzf_chunk>(r->num_chunks);
+  initialize_mutex(&r->lock);
+  initialize_condition_variable(&r->chunk_submitted);
+  initialize_condition_variable(&r->chunk_inflated);
+
+#ifndef _WIN32
+  r->threads = calloc_or_throw<pthread_t>(num_threads);
+  for (size_t i = 0; i < num_threads; i++)
+    pthread_create(&r->threads[i], nullptr, bgzf_worker, r);
+#else
+  r->threads = calloc_or_throw<HANDLE>(num_threads);
+  for (size_t i = 0; i < num_threads; i++)
+    r->threads[i] = ::CreateThread(nullptr, 0, static_cast<LPTHREAD_START_ROUTINE>(bgzf_worker), r, 0L, nullptr);
+#endif
+  return r;
+}
+
+static void wait_for_workers(bgzf_reader& r)
+{
+  mutex_lock(&r.lock);
+  for (uint64_t i = r.drained; i < r.filled; i++)
+    while (!r.chunks[i % r.num_chunks].inflated)
+      condition_variable_wait(&r.chunk_inflated, &r.lock);
+  mutex_unlock(&r.lock);
+}
+
+static void delete_bgzf_reader(bgzf_reader* r)
+{
+  mutex_lock(&r->lock);
+  r->stop = true;
+  condition_variable_signal_all(&r->chunk_submitted);
+  mutex_unlock(&r->lock);
+
+  for (size_t i = 0; i < r->num_threads; i++)
+  {
+#ifndef _WIN32
+    pthread_join(r->threads[i], nullptr);
+#else
+    ::WaitForSingleObject(r->threads[i], INFINITE);
+    ::CloseHandle(r->threads[i]);
+#endif
+  }
+  free(r->threads);
+  delete_mutex(&r->lock);
+
+  for (size_t i = 0; i < r->num_chunks; i++)
+  {
+    r->chunks[i].in.delete_v();
+    r->chunks[i].blocks.delete_v();
+    r->chunks[i].out.delete_v();
+  }
+  free(r->chunks);
+  io_buf::close_file_or_socket(r->file);
+  free(r);
+}
+
+// Reads the next run of whole blocks into c, sizing c.out for their contents.  Returns false
+// once the file is exhausted.
+static bool gather_chunk(bgzf_reader& r, bgzf_chunk& c)
+{
+  c.in.erase();
+  c.blocks.erase();
+  c.consumed = 0;
+  c.inflated = false;
+  c.corrupt = false;
+
+  size_t length = 0;
+  bool more = true;
+  while (c.blocks.size() < bgzf_chunk_blocks)
+  {
+    size_t start = c.in.size();
+    if (c.in.end_array - c.in.end() < (ptrdiff_t)bgzf_max_block)
+      c.in.resize(start + bgzf_chunk_blocks * bgzf_max_block);
+
+    size_t got = read_fully(r.file, c.in.begin() + start, bgzf_header_size);
+    if (got == 0)
+    {
+      more = false;
+      break;
+    }
+    unsigned char* header = (unsigned char*)c.in.begin() + start;
+    size_t block_size = (size_t)(header[16] | (header[17] << 8)) + 1;
+    if (got < bgzf_header_size || !is_bgzf_header(header) || block_size < bgzf_header_size + bgzf_footer_size ||
+        read_fully(r.file, c.in.begin() + start + bgzf_header_size, block_size - bgzf_header_size) !=
+            block_size - bgzf_header_size)
+    {
+      c.corrupt = true;
+      more = false;
+      break;
+    }
+    c.blocks.push_back(start);
+    c.in.end() = c.in.begin() + start + block_size;
+    length += get_le32((unsigned char*)c.in.end() - 4);
+  }
+
+  c.out.erase();
+  if ((size_t)(c.out.end_array - c.out.begin()) < length)
+    c.out.resize(length);
+  c.out.end() = c.out.begin() + length;
+  return more;
+}
+
+static ssize_t read_bgzf(bgzf_reader& r, char* buf, size_t nbytes)
+{
+  while (!r.failed)
+  {
+    // keep every chunk in the ring busy
+    while (!r.input_done && r.filled - r.drained < r.num_chunks)
+    {
+      bgzf_chunk& c = r.chunks[r.filled % r.num_chunks];
+      r.input_done = !gather_chunk(r, c);
+      if (c.blocks.size() == 0 && !c.corrupt)
+        break;
+      mutex_lock(&r.lock);
+      r.filled++;
+      condition_variable_signal(&r.chunk_submitted);
+      mutex_unlock(&r.lock);
+    }
+    if (r.drained == r.filled)
+      return 0;
+
+    bgzf_chunk& c = r.chunks[r.drained % r.num_chunks];
+    mutex_lock(&r.lock);
+    while (!c.inflated)
+      condition_variable_wait(&r.chunk_inflated, &r.lock);
+    mutex_unlock(&r.lock);
+
+    if (c.corrupt)
+    {
+      std::cerr << "error: corrupt gzip block, ignoring the rest of the file" << std::endl;
+      r.failed = true;
+      break;
+    }
+    size_t n = min(nbytes, c.out.size() - c.consumed);
+    memcpy(buf, c.out.begin() + c.consumed, n);
+    c.consumed += n;
+    if (c.consumed == c.out.size())
+      r.drained++;
+    if (n > 0)
+      return (ssize_t)n;
+  }
+  return 0;
+}
+
+static void reset_bgzf_reader(bgzf_reader& r)
+{
+  wait_for_workers(r);
+  r.filled = r.taken = r.drained = 0;
+  r.input_done = false;
+  r.failed = false;
+  seek_start(r.file);
+}
+
+static void write_bgzf_block(bgzf_writer& w, const char* data, size_t length)
+{
+  unsigned char* block = (unsigned char*)w.block.begin();
+  size_t compressed;
+
+  deflateReset(&w.z);
+  w.z.next_in = (Bytef*)data;
+  w.z.avail_in = (uInt)length;
+  w.z.next_out = block + bgzf_header_size;
+  w.z.avail_out = (uInt)(bgzf_max_block - bgzf_header_size - bgzf_footer_size);
+  if (deflate(&w.z, Z_FINISH) == Z_STREAM_END)
+    compressed = w.z.total_out;
+  else
+  {
+    // incompressible: a single stored deflate block
+    unsigned char* out = block + bgzf_header_size;
+    out[0] = 1;
+    put_le16(out + 1, (uint32_t)length);
+    put_le16(out + 3, ~(uint32_t)length);
+    memcpy(out + 5, data, length);
+    compressed = length + 5;
+  }
+
+  size_t block_size = bgzf_header_size + compressed + bgzf_footer_size;
+  static const unsigned char header[16] = {0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0};
+  memcpy(block, header, sizeof(header));
+  put_le16(block + 16, (uint32_t)(block_size - 1));
+  put_le32(block + block_size - 8, (uint32_t)crc32(crc32(0L, Z_NULL, 0), (const Bytef*)data, (uInt)length));
+  put_le32(block + block_size - 4, (uint32_t)length);
+
+  if (io_buf::write_file_or_socket(w.file, block, block_size) != (ssize_t)block_size)
+    std::cerr << "error, failed to write compressed block\n";
+}
+
+static ssize_t write_bgzf(bgzf_writer& w, const void* buf, size_t nbytes)
+{
+  push_many(w.pending, (const char*)buf, nbytes);
+  size_t written = 0;
+  while (w.pending.size() - written >= bgzf_max_input)
+  {
+    write_bgzf_block(w, w.pending.begin() + written, bgzf_max_input);
+    written += bgzf_max_input;
+  }
+  size_t left = w.pending.size() - written;
+  memmove(w.pending.begin(), w.pending.begin() + written, left);
+  w.pending.end() = w.pending.begin() + left;
+  return nbytes;
+}
+
+static bgzf_writer* new_bgzf_writer(int f)
+{
+  bgzf_writer* w = &calloc_or_throw<bgzf_writer>();
+  w->file = f;
+  w->block.resize(bgzf_max_block);
+  if (deflateInit2(&w->z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    THROW("deflateInit2 failed");
+  return w;
+}
+
+static void delete_bgzf_writer(bgzf_writer* w)
+{
+  if (w->pending.size() > 0)
+    write_bgzf_block(*w, w->pending.begin(), w->pending.size());
+  write_bgzf_block(*w, nullptr, 0); // the empty block BGZF readers expect at the end
+  deflateEnd(&w->z);
+  w->pending.delete_v();
+  w->block.delete_v();
+  io_buf::close_file_or_socket(w->file);
+  free(w);
+}
+
+// Opens name for reading if it is BGZF, returns -1 otherwise.
+static int open_bgzf(const char* name)
+{
+  int f = -1;
+#ifdef _WIN32
+  _sopen_s(&f, name, _O_RDONLY | _O_BINARY | _O_SEQUENTIAL, _SH_DENYWR, 0);
+#else
+  f = open(name, O_RDONLY | O_LARGEFILE);
+#endif
+  if (f == -1)
+    return -1;
+  unsigned char header[bgzf_header_size];
+  if (read_fully(f, (char*)header, bgzf_header_size) == bgzf_header_size && is_bgzf_header(header))
+  {
+    seek_start(f);
+    return f;
+  }
+  io_buf::close_file_or_socket(f);
+  return -1;
+}
 
 int comp_io_buf::open_file(const char* name, bool stdin_off, int flag)
 {
   gzFile fil = nullptr;
+  bgzf_reader* reader = nullptr;
+  bgzf_writer* writer = nullptr;
   int ret = -1;
   switch (flag)
   {
   case READ:
     if (*name != '\0')
-      fil = gzopen(name, "rb");
+    {
+      int f = inflate_threads > 1 ? open_bgzf(name) : -1;
+      if (f != -1)
+        reader = new_bgzf_reader(f, inflate_threads);
+      else
+        fil = gzopen(name, "rb");
+    }
     else if (!stdin_off)
 #ifdef _WIN32
       fil = gzdopen(_fileno(stdin), "rb");
 #else
       fil = gzdopen(fileno(stdin), "rb");
 #endif
-    if (fil != nullptr)
-    {
-      gz_files.push_back(fil);
-      ret = (int)gz_files.size() - 1;
-      files.push_back(ret);
-    }
     break;
 
   case WRITE:
-    fil = gzopen(name, "wb");
-    if (fil != nullptr)
+    if (block_output)
     {
-      gz_files.push_back(fil);
-      ret = (int)gz_files.size() - 1;
-      files.push_back(ret);
+      int f = -1;
+#ifdef _WIN32
+      _sopen_s(&f, name, _O_CREAT|_O_WRONLY|_O_BINARY|_O_TRUNC, _SH_DENYWR, _S_IREAD|_S_IWRITE);
+#else
+      f = open(name, O_CREAT|O_WRONLY|O_LARGEFILE|O_TRUNC, 0666);
+#endif
+      if (f != -1)
+        writer = new_bgzf_writer(f);
     }
+    else
+      fil = gzopen(name, "wb");
     break;
 
   default:
     std::cerr << "Unknown file operation. Something other than READ/WRITE specified" << std::endl;
   }
+
+  if (fil != nullptr || reader != nullptr || writer != nullptr)
+  {
+    gz_files.push_back(fil);
+    block_readers.push_back(reader);
+    block_writers.push_back(writer);
+    ret = (int)gz_files.size() - 1;
+    files.push_back(ret);
+  }
   return ret;
 }
 
 void comp_io_buf::reset_file(int f)
 {
-  gzFile fil = gz_files[f];
-  gzseek(fil, 0, SEEK_SET);
+  if (block_readers[f] != nullptr)
+    reset_bgzf_reader(*block_readers[f]);
+  else
+  {
+    gzFile fil = gz_files[f];
+    gzseek(fil, 0, SEEK_SET);
+  }
   space.end() = space.begin();
   head = space.begin();
 }
 
 ssize_t comp_io_buf::read_file(int f, void* buf, size_t nbytes)
 {
+  if (block_readers[f] != nullptr)
+    return read_bgzf(*block_readers[f], (char*)buf, nbytes);
   gzFile fil = gz_files[f];
   int num_read = gzread(fil, buf, (unsigned int)nbytes);
   return (num_read > 0) ? num_read : 0;
@@ -59,6 +494,8 @@ size_t comp_io_buf::num_files() { return gz_files.size(); }
 
 ssize_t comp_io_buf::write_file(int file, const void* buf, size_t nbytes)
 {
+  if (block_writers[file] != nullptr)
+    return write_bgzf(*block_writers[file], buf, nbytes);
   int num_written = gzwrite(gz_files[file], buf, (unsigned int)nbytes);
   return (num_written > 0) ? num_written : 0;
 }
@@ -76,8 +513,15 @@ bool comp_io_buf::close_file()
 {
   if (gz_files.size()>0)
   {
-    gzclose(gz_files.back());
+    if (block_readers.back() != nullptr)
+      delete_bgzf_reader(block_readers.back());
+    else if (block_writers.back() != nullptr)
+      delete_bgzf_writer(block_writers.back());
+    else
+      gzclose(gz_files.back());
     gz_files.pop_back();
+    block_readers.pop_back();
+    block_writers.pop_back();
     if (files.size() > 0)
       files.pop();
     return true;
@@ -16,15 +16,33 @@ struct gzFile_s;
 typedef struct gzFile_s *gzFile;
 #endif
 
+struct bgzf_reader;
+struct bgzf_writer;
+
+/* BGZF files (as written by bgzip, or with --gzip_blocks) are plain gzip made of independent
+** members of at most 64 KB, each carrying its compressed size in the header.  Member
+** boundaries can be found without inflating, so with inflate_threads > 1 a pool of workers
+** inflates runs of members in parallel while read_file hands them out in order.  Any other
+** gzip input is read through gzread as before.
+*/
 class comp_io_buf : public io_buf
 {
 public:
-  std::vector<gzFile> gz_files;
+  comp_io_buf() : inflate_threads(0), block_output(false) {}
+
+  std::vector<gzFile> gz_files; // nullptr where the file is handled by block_readers or block_writers
+  std::vector<bgzf_reader*> block_readers;
+  std::vector<bgzf_writer*> block_writers;
+
+  size_t inflate_threads; // inflate BGZF input on this many threads, if more than one
+  bool block_output; // write BGZF instead of a single gzip stream
 
   virtual int open_file(const char* name, bool stdin_off, int flag = READ);
 
   virtual void reset_file(int f);
 
+  virtual bool seek_file(int, int64_t) { return false; }
+
   virtual ssize_t read_file(int f, void* buf, size_t nbytes);
 
   virtual size_t num_files();
@@ -23,6 +23,7 @@ struct csoaa
 {
   uint32_t num_classes;
   polyprediction* pred;
+  label_data* labels; // for multilearn
 };
 
 template<bool is_learn>
@@ -49,6 +50,18 @@ inline void inner_loop(base_learner& base, example& ec, uint32_t i, float cost,
 
 #define DO_MULTIPREDICT true
 
+// whether the costs are those of every class, in order, so that they can be learned or predicted
+// in one batch
+inline bool all_classes(csoaa& c, COST_SENSITIVE::label& ld)
+{
+  if (ld.costs.size() != c.num_classes)
+    return false;
+  for (uint32_t i = 0; i < c.num_classes; i++)
+    if (ld.costs[i].class_index != i+1)
+      return false;
+  return true;
+}
+
 template <bool is_learn>
 void predict_or_learn(csoaa& c, base_learner& base, example& ec)
 {
@@ -58,7 +71,33 @@ void predict_or_learn(csoaa& c, base_learner& base, example& ec)
   float score = FLT_MAX;
   size_t pt_start = ec.passthrough ? ec.passthrough->size() : 0;
   ec.l.simple = { 0., 0., 0. };
-  if (ld.costs.size() > 0)
+  if (DO_MULTIPREDICT && all_classes(c, ld))
+  {
+    if (is_learn)
+    {
+      for (uint32_t i = 0; i < c.num_classes; i++)
+      {
+        float cost = ld.costs[i].x;
+        c.labels[i] = { cost, (cost == FLT_MAX) ? 0.f : 1.f, 0.f };
+      }
+      base.multilearn(ec, 0, c.num_classes, c.labels, c.pred, false);
+    }
+    else
+      base.multipredict(ec, 0, c.num_classes, c.pred, false);
+    for (uint32_t i = 1; i <= c.num_classes; i++)
+    {
+      float p = c.pred[i-1].scalar;
+      ld.costs[i-1].partial_prediction = p;
+      if (p < score)
+      {
+        score = p;
+        prediction = i;
+      }
+      add_passthrough_feature(ec, i, p);
+    }
+    ec.partial_prediction = score;
+  }
+  else if (ld.costs.size() > 0)
   {
     for (auto& cl : ld.costs)
       inner_loop<is_learn>(base, ec, cl.class_index, cl.x, prediction, score, cl.partial_prediction);
@@ -118,6 +157,7 @@ void finish_example(vw& all, csoaa&, example& ec)
 void finish(csoaa& c)
 {
   free(c.pred);
+  free(c.labels);
 }
 
 
@@ -129,6 +169,7 @@ base_learner* csoaa_setup(vw& all)
   csoaa& c = calloc_or_throw<csoaa>();
   c.num_classes = (uint32_t)all.vm["csoaa"].as<size_t>();
   c.pred = calloc_or_throw<polyprediction>(c.num_classes);
+  c.labels = calloc_or_throw<label_data>(c.num_classes);
 
   learner<csoaa>& l = init_learner(&c, setup_base(all), predict_or_learn<true>,
                                    predict_or_learn<false>, c.num_classes, prediction_type::multiclass);
@@ -164,6 +205,10 @@ struct ldf
   uint64_t ft_offset;
 
   v_array<action_scores > stored_preds;
+
+  v_array<example*> batch; // the examples make_predictions hands to the base learner
+  v_array<COST_SENSITIVE::label> batch_labels;
+  v_array<uint64_t> batch_offsets;
 };
 
 bool ec_is_label_definition(example& ec) // label defs look like "0:___" or just "label:___"
@@ -260,6 +305,41 @@ void make_single_prediction(ldf& data, base_learner& base, example& ec)
   ec.l.cs = ld;
 }
 
+// Scores ec_seq[start_K..] in one batch, which lets the base learner share work such as the
+// shared header features copied into every example.
+void make_predictions(ldf& data, base_learner& base, size_t start_K)
+{
+  label_data simple_label;
+  simple_label.initial = 0.;
+  simple_label.label = FLT_MAX;
+
+  data.batch.erase();
+  data.batch_labels.erase();
+  data.batch_offsets.erase();
+  for (size_t k=start_K; k<data.ec_seq.size(); k++)
+  {
+    example& ec = *data.ec_seq[k];
+    data.batch_labels.push_back(ec.l.cs);
+    LabelDict::add_example_namespace_from_memory(data.label_features, ec, ec.l.cs.costs[0].class_index);
+    ec.l.simple = simple_label;
+    data.batch_offsets.push_back(ec.ft_offset);
+    ec.ft_offset = data.ft_offset;
+    data.batch.push_back(&ec);
+  }
+
+  base.predict_batch(data.batch); // make the predictions
+
+  for (size_t j=0; j<data.batch.size(); j++)
+  {
+    example& ec = *data.batch[j];
+    COST_SENSITIVE::label ld = data.batch_labels[j];
+    ec.ft_offset = data.batch_offsets[j];
+    ld.costs[0].partial_prediction = ec.partial_prediction;
+    LabelDict::del_example_namespace_from_memory(data.label_features, ec, ld.costs[0].class_index);
+    ec.l.cs = ld;
+  }
+}
+
 bool test_ldf_sequence(ldf& data, size_t start_K)
 {
   bool isTest;
@@ -440,10 +520,11 @@ void do_actual_learning(ldf& data, base_learner& base)
     if (start_K > 0)
       data.stored_preds.push_back(data.ec_seq[0]->pred.a_s);
     for (uint32_t k=start_K; k<K; k++)
-    {
       data.stored_preds.push_back(data.ec_seq[k]->pred.a_s);
+    make_predictions(data, base, start_K);
+    for (uint32_t k=start_K; k<K; k++)
+    {
       example *ec = data.ec_seq[k];
-      make_single_prediction(data, base, *ec);
       action_score s;
       s.score = ec->partial_prediction;
       s.action = k - start_K;
@@ -455,10 +536,10 @@ void do_actual_learning(ldf& data, base_learner& base)
   else
   {
     float  min_score = FLT_MAX;
+    make_predictions(data, base, start_K);
     for (uint32_t k=start_K; k<K; k++)
     {
       example *ec = data.ec_seq[k];
-      make_single_prediction(data, base, *ec);
       if (ec->partial_prediction < min_score)
       {
         min_score = ec->partial_prediction;
@@ -782,6 +863,9 @@ void finish(ldf& data)
   LabelDict::free_label_features(data.label_features);
   data.a_s.delete_v();
   data.stored_preds.delete_v();
+  data.batch.delete_v();
+  data.batch_labels.delete_v();
+  data.batch_offsets.delete_v();
 }
 
 template <bool is_learn>
@@ -33,6 +33,7 @@ struct ftrl
   struct update_data data;
   size_t no_win_counter;
   size_t early_stop_thres;
+  v_array<update_data> multi_data; // for multilearn, one per problem
 };
 
 struct uncertainty
@@ -86,8 +87,10 @@ void multipredict(ftrl& b, base_learner&, example& ec, size_t count, size_t step
   }
   else
   {
-    GD::multipredict_info<dense_parameters> mp = { count, step, pred, all.weights.dense_weights, (float)all.sd->gravity };
-    GD::foreach_feature<GD::multipredict_info<dense_parameters>, uint64_t, GD::vec_add_multipredict>(all, ec, mp);
+    dense_parameters& weights = all.weights.learning_dense_weights();
+    GD::multipredict_info<dense_parameters> mp = { count, step, pred, weights, (float)all.sd->gravity };
+    GD::multi_weights<dense_parameters> mw = { weights, count, step };
+    GD::foreach_feature<GD::multipredict_info<dense_parameters>, GD::vec_add_multipredict>(all, ec, mp, mw);
   }
   if (all.sd->contraction != 1.)
     for (size_t c=0; c<count; c++)
@@ -178,6 +181,90 @@ void update_after_prediction_pistol(ftrl& b, example& ec)
   GD::foreach_feature<update_data, inner_update_pistol_post>(*b.all, ec, b.data);
 }
 
+template <class W>
+struct multi_update_info
+{
+  size_t count;
+  size_t step;
+  W& weights;
+  update_data* data;
+};
+
+template <class W, void (*T)(update_data&, float, float&)>
+inline void multi_update_feature(multi_update_info<W>& m, float x, uint64_t fi)
+{
+  for (size_t c = 0; c < m.count; c++, fi += m.step)
+    T(m.data[c], x, m.weights[fi]);
+}
+
+template <void (*T)(update_data&, float, float&)>
+void multi_foreach_feature(ftrl& b, example& ec, size_t count, size_t step)
+{
+  vw& all = *b.all;
+  if (all.weights.sparse)
+  {
+    multi_update_info<sparse_parameters> m = { count, step, all.weights.sparse_weights, b.multi_data.begin() };
+    GD::multi_weights<sparse_parameters> mw = { all.weights.sparse_weights, count, step };
+    GD::foreach_feature<multi_update_info<sparse_parameters>, multi_update_feature<sparse_parameters, T> >(all, ec, m, mw);
+  }
+  else
+  {
+    dense_parameters& weights = all.weights.learning_dense_weights();
+    multi_update_info<dense_parameters> m = { count, step, weights, b.multi_data.begin() };
+    GD::multi_weights<dense_parameters> mw = { weights, count, step };
+    GD::foreach_feature<multi_update_info<dense_parameters>, multi_update_feature<dense_parameters, T> >(all, ec, m, mw);
+  }
+}
+
+// Sets up the update_data of count problems, with predict left at 0.
+void init_multi_data(ftrl& b, size_t count)
+{
+  if ((size_t)(b.multi_data.end_array - b.multi_data.begin()) < count)
+    b.multi_data.resize(count);
+  for (size_t c = 0; c < count; c++)
+  {
+    b.multi_data[c] = b.data;
+    b.multi_data[c].predict = 0;
+  }
+}
+
+// The gradient of each problem from its finalized prediction, as update_after_prediction_* set it.
+void multi_gradients(ftrl& b, size_t count, label_data* labels, polyprediction* pred, bool finalize_predictions)
+{
+  for (size_t c = 0; c < count; c++)
+  {
+    update_data& d = b.multi_data[c];
+    float raw = d.predict;
+    float finalized = GD::finalize_prediction(b.all->sd, raw);
+    d.update = b.all->loss->first_derivative(b.all->sd, finalized, labels[c].label) * labels[c].weight;
+    pred[c].scalar = finalize_predictions ? finalized : raw;
+  }
+}
+
+// Proximal FTRL on count problems at once: one multipredict, then one walk over the features
+// that updates every problem's weights.
+void multilearn_proximal(ftrl& b, base_learner& base, example& ec, size_t count, size_t step, label_data* labels,
+                         polyprediction* pred, bool finalize_predictions)
+{
+  init_multi_data(b, count);
+  multipredict<false>(b, base, ec, count, step, pred, false);
+  for (size_t c = 0; c < count; c++)
+    b.multi_data[c].predict = pred[c].scalar;
+  multi_gradients(b, count, labels, pred, finalize_predictions);
+  multi_foreach_feature<inner_update_proximal>(b, ec, count, step);
+}
+
+// PiSTOL on count problems at once: one walk that updates the state and predicts, and one that
+// applies the gradients.
+void multilearn_pistol(ftrl& b, base_learner&, example& ec, size_t count, size_t step, label_data* labels,
+                       polyprediction* pred, bool finalize_predictions)
+{
+  init_multi_data(b, count);
+  multi_foreach_feature<inner_update_pistol_state_and_predict>(b, ec, count, step);
+  multi_gradients(b, count, labels, pred, finalize_predictions);
+  multi_foreach_feature<inner_update_pistol_post>(b, ec, count, step);
+}
+
 template<bool audit>
 void learn_proximal(ftrl& a, base_learner& base, example& ec)
 {
@@ -221,6 +308,11 @@ void save_load(ftrl& b, io_buf& model_file, bool read, bool text)
   }
 }
 
+void finish(ftrl& b)
+{
+  b.multi_data.delete_v();
+}
+
 void end_pass(ftrl& g)
 {
   vw& all = *g.all;
@@ -322,7 +414,10 @@ base_learner* ftrl_setup(vw& all)
     l.set_multipredict(multipredict<true>);
   else
     l.set_multipredict(multipredict<false>);
+  if (!all.audit && !all.hash_inv)
+    l.set_multilearn(vm.count("ftrl") ? multilearn_proximal : multilearn_pistol);
   l.set_save_load(save_load);
   l.set_end_pass(end_pass);
+  l.set_finish(finish);
   return make_base(l);
 }
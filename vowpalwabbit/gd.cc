@@ -25,6 +25,7 @@ license as described in the file LICENSE.
 #include "reductions.h"
 #include "vw.h"
 #include "floatbits.h"
+#include "gd_simd.h"
 
 #define VERSION_SAVE_RESUME_FIX "7.10.1"
 #define VERSION_PASS_UINT64 "8.3.3"
@@ -35,6 +36,44 @@ using namespace LEARNER;
 //4. Factor various state out of vw&
 namespace GD
 {
+// A namespace's linear terms, kept by predict_batch for the examples after the first carrying it.
+struct namespace_sum
+{
+  uint64_t hash; // of the features and offset, 0 for an empty slot
+  features* fs;
+  uint64_t offset;
+  example* first; // carrying it
+  float sum;
+  bool summed;
+};
+
+// An interaction's terms, kept by predict_batch for the examples after the first whose
+// namespaces in it all repeat, as a shared context crossed with itself does.
+struct interaction_sum
+{
+  uint64_t key; // of the interaction and its namespaces, 0 for an empty slot
+  float sum;
+};
+
+// The combined hash and value of the features of an interaction's namespaces but the last, each
+// starting a loop over the last namespace.
+struct prefix_term
+{
+  feature_index halfhash;
+  feature_value value;
+};
+
+// Kept by predict_batch for interactions whose namespaces all repeat but the last, as a shared
+// context crossed with a candidate's own features does: its terms in batch_prefix_terms.
+struct interaction_prefix
+{
+  uint64_t key; // of the interaction and its leading namespaces, 0 for an empty slot
+  size_t begin;
+  size_t end;
+};
+
+struct norm_data;
+
 struct gd
 {
   //double normalized_sum_norm_x;
@@ -45,15 +84,26 @@ struct gd
   float neg_norm_power;
   float neg_power_t;
   float sparse_l2;
-  float update_multiplier;
+  v_array<namespace_sum> batch_sums; // open addressed, for predict_batch
+  v_array<interaction_sum> batch_interactions; // the same
+  v_array<interaction_prefix> batch_prefixes; // the same
+  v_array<prefix_term> batch_prefix_terms;
+  v_array<uint32_t> batch_slots; // of the example's namespaces in batch_sums
+  v_array<bool> batch_selected; // interactions to generate
+  v_array<norm_data> multi_norms; // per problem, for multilearn
+  v_array<float> multi_preds;
+  v_array<float> multi_updates;
   void (*predict)(gd&, base_learner&, example&);
   void (*learn)(gd&, base_learner&, example&);
   void (*update)(gd&, base_learner&, example&);
   float (*sensitivity)(gd&, base_learner&, example&);
   void (*multipredict)(gd&, base_learner&, example&, size_t, size_t, polyprediction*, bool);
+  void (*predict_batch)(gd&, base_learner&, v_array<example*>&);
+  void (*multilearn)(gd&, base_learner&, example&, size_t, size_t, label_data*, polyprediction*, bool);
   bool normalized;
   bool adaptive;
   bool adax;
+  simd_level simd; // vector kernels for the linear terms of dense weights
 
   vw* all; //parallel, features, parameters
 };
@@ -131,24 +181,79 @@ float average_update(float total_weight, float normalized_sum_norm_x, float neg_
   return 1.f;
 }
 
+// The multiplier of an update given the normalizer sums so far.  Each update works its own out
+// rather than leaving it in gd, where learner threads would overwrite each other's.
+template<bool sqrt_rate, size_t adaptive, size_t normalized>
+inline float update_multiplier(gd& g)
+{ return average_update<sqrt_rate, adaptive, normalized>((float)g.total_weight, (float)g.all->normalized_sum_norm_x, g.neg_norm_power);
+}
+
+// Whether the linear terms go through the vector kernels of gd_simd.h.
+inline bool use_simd(gd& g)
+{ return g.simd != simd_level::none && !g.all->weights.sparse;
+}
+
+// The default update (power_t 0.5, adaptive, normalized, no feature mask) is the one with
+// vector kernels.
+template<bool sqrt_rate, bool feature_mask_off, size_t adaptive, size_t normalized, size_t spare, bool stateless>
+inline bool simd_update(gd& g)
+{ return sqrt_rate && feature_mask_off && adaptive == 1 && normalized == 2 && spare == 3 && !stateless && use_simd(g);
+}
+
 template<bool sqrt_rate, bool feature_mask_off, size_t adaptive, size_t normalized, size_t spare>
 void train(gd& g, example& ec, float update)
 {
-  if (normalized)
-    update *= g.update_multiplier;
-  foreach_feature<float, update_feature<sqrt_rate, feature_mask_off, adaptive, normalized, spare> >(*g.all, ec, update);
+  if (simd_update<sqrt_rate, feature_mask_off, adaptive, normalized, spare, false>(g))
+  {
+    vw& all = *g.all;
+    dense_parameters& weights = all.weights.learning_dense_weights();
+    for (example::iterator i = ec.begin(); i != ec.end(); ++i)
+      if (!all.ignore_some_linear || !all.ignore_linear[i.index()])
+      {
+        features& fs = *i;
+        simd_update_pass(g.simd, weights.first(), weights.mask(), fs.values.begin(), fs.indicies.begin(), fs.size(),
+                         ec.ft_offset, update);
+      }
+    INTERACTIONS::generate_interactions<float, float&, update_feature<sqrt_rate, feature_mask_off, adaptive, normalized, spare> >(all, ec, update);
+  }
+  else
+    foreach_feature<float, update_feature<sqrt_rate, feature_mask_off, adaptive, normalized, spare> >(*g.all, ec, update);
+}
+
+void finish(gd& g)
+{
+  finish_background_avg(*g.all, g.all->weights);
+  g.batch_sums.delete_v();
+  g.batch_interactions.delete_v();
+  g.batch_prefixes.delete_v();
+  g.batch_prefix_terms.delete_v();
+  g.batch_slots.delete_v();
+  g.batch_selected.delete_v();
+  g.multi_norms.delete_v();
+  g.multi_preds.delete_v();
+  g.multi_updates.delete_v();
 }
 
 void end_pass(gd& g)
 {
   vw& all = *g.all;
   sync_weights(all);
+  // With --allreduce_async the weights are averaged while the next pass learns, and what the
+  // averaging changed is added at the end of that pass, before anything else is reduced.  The
+  // last pass averages at once, so the model comes out averaged, and so does every pass with
+  // --save_per_pass, so that each model saved is.
+  bool background = all.all_reduce != nullptr && all.allreduce_async && all.current_pass + 1 < all.numpasses &&
+                    !all.save_per_pass;
   if (all.all_reduce != nullptr)
   {
-    if (all.adaptive)
-      accumulate_weighted_avg(all, all.weights);
-    else
-      accumulate_avg(all, all.weights, 0);
+    finish_background_avg(all, all.weights);
+    if (!background)
+    {
+      if (all.adaptive)
+        accumulate_weighted_avg(all, all.weights);
+      else
+        accumulate_avg(all, all.weights, 0);
+    }
   }
   all.eta *= all.eta_decay_rate;
   if (all.save_per_pass)
@@ -165,6 +270,19 @@ void end_pass(gd& g)
          ((all.current_pass % all.check_holdout_every_n_passes) == 0)))
       set_done(all);
   }
+
+  if (background)
+  {
+    if (all.early_terminate) // no next pass to overlap with
+    {
+      if (all.adaptive)
+        accumulate_weighted_avg(all, all.weights);
+      else
+        accumulate_avg(all, all.weights, 0);
+    }
+    else
+      start_background_avg(all, all.weights);
+  }
 }
 
 #include <algorithm>
@@ -355,6 +473,23 @@ inline void vec_add_trunc(trunc_data& p, const float fx, float& fw)
   p.prediction += trunc_weight(fw, p.gravity) * fx;
 }
 
+// inline_predict with the linear terms summed by the vector kernels.
+inline float simd_predict(gd& g, example& ec)
+{
+  vw& all = *g.all;
+  dense_parameters& weights = all.weights.learning_dense_weights();
+  float prediction = ec.l.simple.initial;
+  for (example::iterator i = ec.begin(); i != ec.end(); ++i)
+    if (!all.ignore_some_linear || !all.ignore_linear[i.index()])
+    {
+      features& fs = *i;
+      prediction += simd_dot(g.simd, weights.first(), weights.mask(), fs.values.begin(), fs.indicies.begin(),
+                             fs.size(), ec.ft_offset);
+    }
+  INTERACTIONS::generate_interactions<float, const float&, vec_add, false, INTERACTIONS::dummy_func<float>, dense_parameters>(all, ec, prediction, weights);
+  return prediction;
+}
+
 inline float trunc_predict(vw& all, example& ec, double gravity)
 {
   trunc_data temp = {ec.l.simple.initial, (float)gravity};
@@ -374,6 +509,8 @@ void predict(gd& g, base_learner&, example& ec)
   vw& all = *g.all;
   if (l1)
     ec.partial_prediction = trunc_predict(all, ec, all.sd->gravity);
+  else if (use_simd(g))
+    ec.partial_prediction = simd_predict(g, ec);
   else
     ec.partial_prediction = inline_predict(all, ec);
 
@@ -383,6 +520,287 @@ void predict(gd& g, base_learner&, example& ec)
     print_audit_features(all, ec);
 }
 
+inline uint64_t hash_namespace(features& fs, uint64_t offset)
+{
+  uint64_t h = (offset + fs.size()) * 0x9E3779B97F4A7C15ULL;
+  for (size_t j = 0; j < fs.size(); j++)
+    h = (h ^ fs.indicies[j] ^ ((uint64_t)float_to_bits(fs.values[j]) << 32)) * 0x100000001B3ULL;
+  return h | 1;
+}
+
+inline bool same_namespace(features& a, features& b)
+{
+  return a.size() == b.size() && !memcmp(a.values.begin(), b.values.begin(), a.size() * sizeof(feature_value))
+         && !memcmp(a.indicies.begin(), b.indicies.begin(), a.size() * sizeof(feature_index));
+}
+
+const uint32_t no_slot = (uint32_t)-1;
+
+// The slot of fs at offset in sums, found by its hash and confirmed by comparing the features,
+// or no_slot when there are no indices to hash.
+uint32_t namespace_slot(namespace_sum* sums, uint64_t mask, example* ec, features& fs, uint64_t offset)
+{
+  if (fs.indicies.size() != fs.size())
+    return no_slot;
+  uint64_t h = hash_namespace(fs, offset);
+  for (uint64_t slot = h & mask; ; slot = (slot + 1) & mask)
+  {
+    namespace_sum& s = sums[slot];
+    if (s.hash == 0)
+    {
+      s = { h, &fs, offset, ec, 0.f, false };
+      return (uint32_t)slot;
+    }
+    if (s.hash == h && s.offset == offset && same_namespace(*s.fs, fs))
+      return (uint32_t)slot;
+  }
+}
+
+inline float linear_terms(gd&, sparse_parameters& weights, features& fs, uint64_t offset)
+{
+  float sum = 0.;
+  foreach_feature<float, vec_add, sparse_parameters>(weights, fs, sum, offset);
+  return sum;
+}
+
+inline float linear_terms(gd& g, dense_parameters& weights, features& fs, uint64_t offset)
+{
+  if (use_simd(g))
+    return simd_dot(g.simd, weights.first(), weights.mask(), fs.values.begin(), fs.indicies.begin(), fs.size(), offset);
+  float sum = 0.;
+  foreach_feature<float, vec_add, dense_parameters>(weights, fs, sum, offset);
+  return sum;
+}
+
+// The linear terms of fs, summed once for every example in the batch carrying the same
+// features at the same offset.
+template <class W>
+float namespace_linear_sum(gd& g, W& weights, namespace_sum* sums, uint32_t slot, features& fs, uint64_t offset)
+{
+  if (slot == no_slot)
+    return linear_terms(g, weights, fs, offset);
+  namespace_sum& s = sums[slot];
+  if (!s.summed)
+  {
+    s.sum = linear_terms(g, weights, fs, offset);
+    s.summed = true;
+  }
+  return s.sum;
+}
+
+// Interaction k over the namespaces ec has in slots, or 0 unless an earlier example of the batch
+// carried each of them.  The first example of the batch keys all of its interactions, as it
+// can't tell yet which will repeat.
+inline uint64_t interaction_key(size_t k, v_string& ns, uint32_t* slots, namespace_sum* sums, example* ec, bool first)
+{
+  uint64_t key = (k + 1) * 0x9E3779B97F4A7C15ULL;
+  for (unsigned char n : ns)
+  {
+    if (slots[n] == no_slot || (!first && sums[slots[n]].first == ec))
+      return 0;
+    key = (key ^ slots[n]) * 0x100000001B3ULL;
+  }
+  return key | 1;
+}
+
+// The terms of interaction k, generated once for every example in the batch with the same
+// namespaces in it.  only has nothing selected, and is left that way.
+template <class W>
+float interaction_terms(vw& all, example& ec, W& weights, interaction_sum* sums, uint64_t mask, uint64_t key,
+                        size_t k, bool* only)
+{
+  for (uint64_t slot = key & mask; ; slot = (slot + 1) & mask)
+  {
+    interaction_sum& s = sums[slot];
+    if (s.key == key)
+      return s.sum;
+    if (s.key == 0)
+    {
+      s = { key, 0.f };
+      only[k] = true;
+      INTERACTIONS::generate_uncached_interactions<float, const float&, vec_add, false, INTERACTIONS::dummy_func<float>, W>(all, ec, s.sum, weights, INTERACTIONS::interaction_set::all, only);
+      only[k] = false;
+      return s.sum;
+    }
+  }
+}
+
+// Pair or triple k, over the namespaces ec has in slots, or 0 unless an earlier example of the
+// batch carried each of its namespaces but the last, and the last is ec's own.
+inline uint64_t prefix_key(size_t k, v_string& ns, uint32_t* slots, namespace_sum* sums, example* ec)
+{
+  size_t len = ns.size();
+  if (len < 2 || len > 3 || slots[ns[len - 1]] == no_slot || sums[slots[ns[len - 1]]].first != ec)
+    return 0;
+  uint64_t key = (k + 1) * 0xC2B2AE3D27D4EB4FULL;
+  for (size_t n = 0; n + 1 < len; n++)
+  {
+    if (slots[ns[n]] == no_slot || sums[slots[ns[n]]].first == ec)
+      return 0;
+    key = (key ^ slots[ns[n]]) * 0x100000001B3ULL;
+  }
+  return key | 1;
+}
+
+// Crosses the namespaces of ns but the last as generate_uncached_interactions does, into terms.
+void prefix_terms(vw& all, example& ec, v_string& ns, v_array<prefix_term>& terms)
+{
+  features& first = ec.feature_space[ns[0]];
+  if (ns.size() == 2)
+  {
+    for (size_t i = 0; i < first.indicies.size(); ++i)
+      terms.push_back({ FNV_prime * (uint64_t)first.indicies[i], first.values[i] });
+    return;
+  }
+  using INTERACTIONS::feature_self_interactions; // for PROCESS_SELF_INTERACTIONS
+  features& second = ec.feature_space[ns[1]];
+  const bool same_namespace = !all.permutations && ns[0] == ns[1];
+  for (size_t i = 0; i < first.indicies.size(); ++i)
+  {
+    const uint64_t halfhash1 = FNV_prime * (uint64_t)first.indicies[i];
+    const float first_ft_value = first.values[i];
+    size_t j = 0;
+    if (same_namespace)
+      j = PROCESS_SELF_INTERACTIONS(first_ft_value) ? i : i + 1;
+    for (; j < second.indicies.size(); ++j)
+      terms.push_back({ FNV_prime * (halfhash1 ^ (uint64_t)second.indicies[j]),
+                        INTERACTIONS::INTERACTION_VALUE(first_ft_value, second.values[j]) });
+  }
+}
+
+// The terms of interaction k whose leading namespaces repeat: they are crossed once for the
+// batch, and each example crosses the result with its own last namespace.
+template <class W>
+float prefixed_interaction_terms(gd& g, example& ec, W& weights, interaction_prefix* prefixes, uint64_t mask,
+                                 uint64_t key, v_string& ns)
+{
+  interaction_prefix* p;
+  for (uint64_t slot = key & mask; ; slot = (slot + 1) & mask)
+  {
+    p = &prefixes[slot];
+    if (p->key == key)
+      break;
+    if (p->key == 0)
+    {
+      p->key = key;
+      p->begin = g.batch_prefix_terms.size();
+      prefix_terms(*g.all, ec, ns, g.batch_prefix_terms);
+      p->end = g.batch_prefix_terms.size();
+      break;
+    }
+  }
+
+  float sum = 0.f;
+  features& last = ec.feature_space[ns[ns.size() - 1]];
+  for (size_t t = p->begin; t < p->end; t++)
+  {
+    prefix_term& term = g.batch_prefix_terms[t];
+    features::features_value_index_audit_range range = last.values_indices_audit();
+    features::iterator_all begin = range.begin();
+    features::iterator_all end = range.end();
+    INTERACTIONS::inner_kernel<float, const float&, vec_add, false, INTERACTIONS::dummy_func<float>, W>(sum, begin, end, ec.ft_offset, weights, term.value, term.halfhash);
+  }
+  return sum;
+}
+
+// an empty open addressed table for entries, at most half full
+template <class T>
+T* batch_table(v_array<T>& table, size_t entries, uint64_t& mask)
+{
+  size_t slots = 16;
+  while (slots < 2 * entries)
+    slots *= 2;
+  if ((size_t)(table.end_array - table.begin()) < slots)
+    table.resize(slots);
+  memset(table.begin(), 0, slots * sizeof(T));
+  mask = slots - 1;
+  return table.begin();
+}
+
+// Predicts the examples of a batch, sharing what repeats across it: in a ranking request the
+// context features copied into every candidate are looked up in the weights once instead of
+// once per candidate, and interactions among context namespaces only are generated for the
+// first candidate.  Pairs and triples of context namespaces with a later candidate's own
+// namespace cross the context features once, and only the candidate's features per example;
+// other interactions with its own features are generated per example as in predict.
+template <class W>
+void predict_batch(gd& g, W& weights, v_array<example*>& examples)
+{
+  vw& all = *g.all;
+  size_t namespaces = 0;
+  for (example* ec : examples)
+    namespaces += ec->indices.size();
+  size_t interactions = all.interactions.size();
+  uint64_t mask, interaction_mask;
+  namespace_sum* sums = batch_table(g.batch_sums, namespaces, mask);
+  interaction_sum* interaction_sums = batch_table(g.batch_interactions, examples.size() * interactions, interaction_mask);
+  uint64_t prefix_mask;
+  interaction_prefix* prefixes = batch_table(g.batch_prefixes, examples.size() * interactions, prefix_mask);
+  g.batch_prefix_terms.erase();
+  if (g.batch_slots.end_array == g.batch_slots.begin())
+  {
+    g.batch_slots.resize(256);
+    memset(g.batch_slots.begin(), 0xff, 256 * sizeof(uint32_t));
+  }
+  uint32_t* slots = g.batch_slots.begin(); // no_slot but for the example's namespaces
+  if ((size_t)(g.batch_selected.end_array - g.batch_selected.begin()) < 2 * interactions)
+    g.batch_selected.resize(2 * interactions);
+  bool* only = g.batch_selected.begin();
+  bool* rest = only + interactions;
+  memset(only, 0, interactions * sizeof(bool));
+
+  for (example* ec : examples)
+  {
+    float prediction = ec->l.simple.initial;
+    for (example::iterator i = ec->begin(); i != ec->end(); ++i)
+    {
+      uint32_t slot = namespace_slot(sums, mask, ec, *i, ec->ft_offset);
+      slots[i.index()] = slot;
+      if (!all.ignore_some_linear || !all.ignore_linear[i.index()])
+        prediction += namespace_linear_sum(g, weights, sums, slot, *i, ec->ft_offset);
+    }
+
+    size_t left = 0; // interactions to generate for this example alone
+    for (size_t k = 0; k < interactions; k++)
+    {
+      uint64_t key = interaction_key(k, all.interactions[k], slots, sums, ec, ec == examples[0]);
+      rest[k] = false;
+      if (key != 0)
+        prediction += interaction_terms(all, *ec, weights, interaction_sums, interaction_mask, key, k, only);
+      else if ((key = prefix_key(k, all.interactions[k], slots, sums, ec)) != 0)
+        prediction += prefixed_interaction_terms(g, *ec, weights, prefixes, prefix_mask, key, all.interactions[k]);
+      else
+      {
+        rest[k] = true;
+        left++;
+      }
+    }
+    if (left == interactions)
+      INTERACTIONS::generate_interactions<float, const float&, vec_add, false, INTERACTIONS::dummy_func<float>, W>(all, *ec, prediction, weights);
+    else if (left > 0)
+      INTERACTIONS::generate_uncached_interactions<float, const float&, vec_add, false, INTERACTIONS::dummy_func<float>, W>(all, *ec, prediction, weights, INTERACTIONS::interaction_set::all, rest);
+
+    for (namespace_index n : ec->indices)
+      slots[n] = no_slot;
+
+    ec->partial_prediction = prediction * (float)all.sd->contraction;
+    ec->pred.scalar = finalize_prediction(all.sd, ec->partial_prediction);
+  }
+}
+
+template<bool l1, bool audit>
+void predict_batch(gd& g, base_learner& base, v_array<example*>& examples)
+{
+  // the vector kernels sum a namespace about as fast as the batch can tell it repeats
+  if (l1 || audit || (use_simd(g) && g.all->interactions.size() == 0))
+    for (example* ec : examples)
+      predict<l1, audit>(g, base, *ec);
+  else if (g.all->weights.sparse)
+    predict_batch(g, g.all->weights.sparse_weights, examples);
+  else
+    predict_batch(g, g.all->weights.learning_dense_weights(), examples);
+}
+
 template <class T> inline void vec_add_trunc_multipredict(multipredict_info<T>& mp, const float fx, uint64_t fi)
 {
   size_t index = fi;
@@ -405,10 +823,11 @@ void multipredict(gd& g, base_learner&, example& ec, size_t count, size_t step,
   }
   else
   {
-    multipredict_info<dense_parameters> mp =
-    { count, step, pred, g.all->weights.dense_weights, (float)all.sd->gravity };
-    if (l1) foreach_feature<multipredict_info<dense_parameters>, uint64_t, vec_add_trunc_multipredict>(all, ec, mp);
-    else    foreach_feature<multipredict_info<dense_parameters>, uint64_t, vec_add_multipredict      >(all, ec, mp);
+    dense_parameters& weights = g.all->weights.learning_dense_weights();
+    multipredict_info<dense_parameters> mp = { count, step, pred, weights, (float)all.sd->gravity };
+    multi_weights<dense_parameters> mw = { weights, count, step };
+    if (l1) foreach_feature<multipredict_info<dense_parameters>, vec_add_trunc_multipredict>(all, ec, mp, mw);
+    else    foreach_feature<multipredict_info<dense_parameters>, vec_add_multipredict      >(all, ec, mp, mw);
   }
   if (all.sd->contraction != 1.)
     for (size_t c=0; c<count; c++)
@@ -528,7 +947,7 @@ inline void pred_per_update_feature(norm_data& nd, float x, float& fw)
 
 bool global_print_features = false;
 template<bool sqrt_rate, bool feature_mask_off, bool adax, size_t adaptive, size_t normalized, size_t spare, bool stateless>
-float get_pred_per_update(gd& g, example& ec)
+float get_pred_per_update(gd& g, example& ec, float& multiplier)
 {
   //We must traverse the features in _precisely_ the same order as during training.
   label_data& ld = ec.l.simple;
@@ -538,34 +957,52 @@ float get_pred_per_update(gd& g, example& ec)
   if (!adax)
     grad_squared *= all.loss->getSquareGrad(ec.pred.scalar, ld.label);
 
-  if (grad_squared == 0 && !stateless) return 1.;
+  if (grad_squared == 0 && !stateless)
+  {
+    if (normalized)
+      multiplier = update_multiplier<sqrt_rate, adaptive, normalized>(g);
+    return 1.;
+  }
 
   norm_data nd = {grad_squared, 0., 0., {g.neg_power_t, g.neg_norm_power}};
-  foreach_feature<norm_data,pred_per_update_feature<sqrt_rate, feature_mask_off, adaptive, normalized, spare, stateless> >(all, ec, nd);
+  if (simd_update<sqrt_rate, feature_mask_off, adaptive, normalized, spare, stateless>(g))
+  {
+    dense_parameters& weights = all.weights.learning_dense_weights();
+    for (example::iterator i = ec.begin(); i != ec.end(); ++i)
+      if (!all.ignore_some_linear || !all.ignore_linear[i.index()])
+      {
+        features& fs = *i;
+        simd_norm_pass(g.simd, weights.first(), weights.mask(), fs.values.begin(), fs.indicies.begin(), fs.size(),
+                       ec.ft_offset, grad_squared, nd.norm_x, nd.pred_per_update);
+      }
+    INTERACTIONS::generate_interactions<norm_data, float&, pred_per_update_feature<sqrt_rate, feature_mask_off, adaptive, normalized, spare, stateless> >(all, ec, nd);
+  }
+  else
+    foreach_feature<norm_data,pred_per_update_feature<sqrt_rate, feature_mask_off, adaptive, normalized, spare, stateless> >(all, ec, nd);
   if(normalized)
   {
     if(!stateless)
     {
       g.all->normalized_sum_norm_x += ec.weight * nd.norm_x;
       g.total_weight += ec.weight;
-      g.update_multiplier = average_update<sqrt_rate, adaptive, normalized>((float)g.total_weight, (float)g.all->normalized_sum_norm_x, g.neg_norm_power);
+      multiplier = update_multiplier<sqrt_rate, adaptive, normalized>(g);
     }
     else
     {
       double nsnx = g.all->normalized_sum_norm_x + ec.weight * nd.norm_x;
       double tw = g.total_weight + ec.weight;
-      g.update_multiplier = average_update<sqrt_rate, adaptive, normalized>((float)tw, (float)nsnx, g.neg_norm_power);
+      multiplier = average_update<sqrt_rate, adaptive, normalized>((float)tw, (float)nsnx, g.neg_norm_power);
     }
-    nd.pred_per_update *= g.update_multiplier;
+    nd.pred_per_update *= multiplier;
   }
   return nd.pred_per_update;
 }
 
 template<bool sqrt_rate, bool feature_mask_off, bool adax, size_t adaptive, size_t normalized, size_t spare, bool stateless>
-float sensitivity(gd& g, example& ec)
+float sensitivity(gd& g, example& ec, float& multiplier)
 {
   if(adaptive || normalized)
-    return get_pred_per_update<sqrt_rate, feature_mask_off, adax, adaptive, normalized, spare, stateless>(g,ec);
+    return get_pred_per_update<sqrt_rate, feature_mask_off, adax, adaptive, normalized, spare, stateless>(g,ec,multiplier);
   else
     return ec.total_sum_feat_sq;
 }
@@ -585,12 +1022,13 @@ float get_scale(gd& g, example& ec, float weight)
 template<bool sqrt_rate, bool feature_mask_off, bool adax, size_t adaptive, size_t normalized, size_t spare>
 float sensitivity(gd& g, base_learner& base, example& ec)
 {
+  float multiplier;
   return get_scale<adaptive>(g, ec, 1.)
-         * sensitivity<sqrt_rate, feature_mask_off, adax, adaptive, normalized, spare, true>(g,ec);
+         * sensitivity<sqrt_rate, feature_mask_off, adax, adaptive, normalized, spare, true>(g,ec,multiplier);
 }
 
 template<bool sparse_l2, bool invariant, bool sqrt_rate, bool feature_mask_off, bool adax, size_t adaptive, size_t normalized, size_t spare>
-float compute_update(gd& g, example& ec)
+float compute_update(gd& g, example& ec, float& multiplier)
 {
   //invariant: not a test label, importance weight > 0
   label_data& ld = ec.l.simple;
@@ -600,7 +1038,7 @@ float compute_update(gd& g, example& ec)
   ec.updated_prediction = ec.pred.scalar;
   if (all.loss->getLoss(all.sd, ec.pred.scalar, ld.label) > 0.)
   {
-    float pred_per_update = sensitivity<sqrt_rate, feature_mask_off, adax, adaptive, normalized, spare, false>(g, ec);
+    float pred_per_update = sensitivity<sqrt_rate, feature_mask_off, adax, adaptive, normalized, spare, false>(g, ec, multiplier);
     float update_scale = get_scale<adaptive>(g, ec, ec.weight);
     if(invariant)
       update = all.loss->getUpdate(ec.pred.scalar, ld.label, update_scale, pred_per_update);
@@ -619,6 +1057,8 @@ float compute_update(gd& g, example& ec)
       all.sd->gravity += eta_bar * all.l1_lambda;
     }
   }
+  else if (normalized)
+    multiplier = update_multiplier<sqrt_rate, adaptive, normalized>(g);
 
   if (sparse_l2)
     update -= g.sparse_l2 * ec.pred.scalar;
@@ -630,9 +1070,9 @@ template<bool sparse_l2, bool invariant, bool sqrt_rate, bool feature_mask_off,
 void update(gd& g, base_learner&, example& ec)
 {
   //invariant: not a test label, importance weight > 0
-  float update;
-  if ( (update = compute_update<sparse_l2, invariant, sqrt_rate, feature_mask_off, adax, adaptive, normalized, spare> (g, ec)) != 0.)
-    train<sqrt_rate, feature_mask_off, adaptive, normalized, spare>(g, ec, update);
+  float update, multiplier = 1.f;
+  if ( (update = compute_update<sparse_l2, invariant, sqrt_rate, feature_mask_off, adax, adaptive, normalized, spare> (g, ec, multiplier)) != 0.)
+    train<sqrt_rate, feature_mask_off, adaptive, normalized, spare>(g, ec, update * multiplier);
 
   if (g.all->sd->contraction < 1e-10)  // updating weights now to avoid numerical instability
     sync_weights(*g.all);
@@ -649,6 +1089,173 @@ void learn(gd& g, base_learner& base, example& ec)
   update<sparse_l2, invariant, sqrt_rate, feature_mask_off, adax, adaptive, normalized, spare>(g,base,ec);
 }
 
+template <class W>
+struct multi_norm_data
+{
+  size_t count;
+  size_t step;
+  W& weights;
+  norm_data* norms; // a problem with grad_squared 0 is left alone
+};
+
+template<bool sqrt_rate, bool feature_mask_off, size_t adaptive, size_t normalized, size_t spare, class W>
+inline void multi_pred_per_update_feature(multi_norm_data<W>& m, float x, uint64_t fi)
+{
+  for (size_t c = 0; c < m.count; c++, fi += m.step)
+    if (m.norms[c].grad_squared != 0.)
+      pred_per_update_feature<sqrt_rate, feature_mask_off, adaptive, normalized, spare, false>(m.norms[c], x, m.weights[fi]);
+}
+
+template <class W>
+struct multi_update_data
+{
+  size_t count;
+  size_t step;
+  W& weights;
+  float* updates;
+};
+
+template<bool sqrt_rate, bool feature_mask_off, size_t adaptive, size_t normalized, size_t spare, class W>
+inline void multi_update_feature(multi_update_data<W>& m, float x, uint64_t fi)
+{
+  for (size_t c = 0; c < m.count; c++, fi += m.step)
+    if (m.updates[c] != 0.)
+      update_feature<sqrt_rate, feature_mask_off, adaptive, normalized, spare>(m.updates[c], x, m.weights[fi]);
+}
+
+// The updates of multilearn: one walk over the features for the adaptive and normalizer state
+// of every problem, and one to move their weights.  In between, each problem's update is
+// computed as compute_update would, in order, so the shared normalizer sums come out as if the
+// problems were learned one after another.  Problems sit at different offsets and so touch
+// different weights, barring hash collisions between them.  With --simd the linear terms still
+// take a vector pass per problem, as train would; only the interactions are walked once.
+template<bool sparse_l2, bool invariant, bool sqrt_rate, bool feature_mask_off, bool adax, size_t adaptive, size_t normalized, size_t spare, class W>
+void multi_update(gd& g, example& ec, W& weights, size_t count, size_t step, label_data* labels, float* preds)
+{
+  vw& all = *g.all;
+  norm_data* norms = g.multi_norms.begin();
+  float* updates = g.multi_updates.begin();
+  bool any = false;
+  for (size_t c = 0; c < count; c++)
+  {
+    norms[c] = {0., 0., 0., {g.neg_power_t, g.neg_norm_power}};
+    updates[c] = 0.;
+    float label = labels[c].label, weight = labels[c].weight;
+    if (label == FLT_MAX || weight <= 0. || all.loss->getLoss(all.sd, preds[c], label) <= 0.)
+      continue;
+    updates[c] = 1.; // to be learned
+    any = true;
+    norms[c].grad_squared = adax ? weight : weight * all.loss->getSquareGrad(preds[c], label);
+  }
+  if (!any)
+    return;
+
+  bool vector_linear = simd_update<sqrt_rate, feature_mask_off, adaptive, normalized, spare, false>(g);
+  if (adaptive || normalized)
+  {
+    multi_norm_data<W> m = { count, step, weights, norms };
+    multi_weights<W> mw = { weights, count, step };
+    if (vector_linear)
+    {
+      dense_parameters& dense = all.weights.learning_dense_weights();
+      for (size_t c = 0; c < count; c++)
+        if (norms[c].grad_squared != 0.)
+          for (example::iterator i = ec.begin(); i != ec.end(); ++i)
+            if (!all.ignore_some_linear || !all.ignore_linear[i.index()])
+            {
+              features& fs = *i;
+              simd_norm_pass(g.simd, dense.first(), dense.mask(), fs.values.begin(), fs.indicies.begin(), fs.size(),
+                             ec.ft_offset + c * step, norms[c].grad_squared, norms[c].norm_x, norms[c].pred_per_update);
+            }
+      INTERACTIONS::generate_interactions<multi_norm_data<W>, uint64_t, multi_pred_per_update_feature<sqrt_rate, feature_mask_off, adaptive, normalized, spare, W>, false, INTERACTIONS::dummy_func<multi_norm_data<W> >, multi_weights<W> >(all, ec, m, mw);
+    }
+    else
+      foreach_feature<multi_norm_data<W>, multi_pred_per_update_feature<sqrt_rate, feature_mask_off, adaptive, normalized, spare, W> >(all, ec, m, mw);
+  }
+
+  for (size_t c = 0; c < count; c++)
+  {
+    if (updates[c] == 0.)
+      continue;
+    float label = labels[c].label, weight = labels[c].weight;
+    float pred_per_update = ec.total_sum_feat_sq;
+    float multiplier = 1.f;
+    if (adaptive || normalized)
+    {
+      norm_data& nd = norms[c];
+      pred_per_update = 1.;
+      if (nd.grad_squared != 0.)
+      {
+        pred_per_update = nd.pred_per_update;
+        if (normalized)
+        {
+          all.normalized_sum_norm_x += weight * nd.norm_x;
+          g.total_weight += weight;
+          multiplier = update_multiplier<sqrt_rate, adaptive, normalized>(g);
+          pred_per_update *= multiplier;
+        }
+      }
+      else if (normalized)
+        multiplier = update_multiplier<sqrt_rate, adaptive, normalized>(g);
+    }
+    float update_scale = get_scale<adaptive>(g, ec, weight);
+    float update;
+    if (invariant)
+      update = all.loss->getUpdate(preds[c], label, update_scale, pred_per_update);
+    else
+      update = all.loss->getUnsafeUpdate(preds[c], label, update_scale);
+    if (sparse_l2)
+      update -= g.sparse_l2 * preds[c];
+    if (normalized)
+      update *= multiplier;
+    updates[c] = update;
+  }
+
+  multi_update_data<W> m = { count, step, weights, updates };
+  multi_weights<W> mw = { weights, count, step };
+  if (vector_linear)
+  {
+    dense_parameters& dense = all.weights.learning_dense_weights();
+    for (size_t c = 0; c < count; c++)
+      if (updates[c] != 0.)
+        for (example::iterator i = ec.begin(); i != ec.end(); ++i)
+          if (!all.ignore_some_linear || !all.ignore_linear[i.index()])
+          {
+            features& fs = *i;
+            simd_update_pass(g.simd, dense.first(), dense.mask(), fs.values.begin(), fs.indicies.begin(), fs.size(),
+                             ec.ft_offset + c * step, updates[c]);
+          }
+    INTERACTIONS::generate_interactions<multi_update_data<W>, uint64_t, multi_update_feature<sqrt_rate, feature_mask_off, adaptive, normalized, spare, W>, false, INTERACTIONS::dummy_func<multi_update_data<W> >, multi_weights<W> >(all, ec, m, mw);
+  }
+  else
+    foreach_feature<multi_update_data<W>, multi_update_feature<sqrt_rate, feature_mask_off, adaptive, normalized, spare, W> >(all, ec, m, mw);
+}
+
+template<bool sparse_l2, bool invariant, bool sqrt_rate, bool feature_mask_off, bool adax, size_t adaptive, size_t normalized, size_t spare>
+void multilearn(gd& g, base_learner& base, example& ec, size_t count, size_t step, label_data* labels, polyprediction* pred, bool finalize_predictions)
+{
+  vw& all = *g.all;
+  g.multipredict(g, base, ec, count, step, pred, false);
+
+  if ((size_t)(g.multi_norms.end_array - g.multi_norms.begin()) < count)
+  {
+    g.multi_norms.resize(count);
+    g.multi_preds.resize(count);
+    g.multi_updates.resize(count);
+  }
+  float* preds = g.multi_preds.begin(); // finalized, the updates start from them
+  for (size_t c = 0; c < count; c++)
+    preds[c] = finalize_prediction(all.sd, pred[c].scalar);
+  if (finalize_predictions)
+    for (size_t c = 0; c < count; c++)
+      pred[c].scalar = preds[c];
+
+  if (all.weights.sparse)
+    multi_update<sparse_l2, invariant, sqrt_rate, feature_mask_off, adax, adaptive, normalized, spare>(g, ec, all.weights.sparse_weights, count, step, labels, preds);
+  else
+    multi_update<sparse_l2, invariant, sqrt_rate, feature_mask_off, adax, adaptive, normalized, spare>(g, ec, all.weights.learning_dense_weights(), count, step, labels, preds);
+}
+
 void sync_weights(vw& all)
 {
   //todo, fix length dependence
@@ -989,6 +1596,7 @@ uint64_t set_learn(vw& all, gd& g)
   if (g.adax)
   {
     g.learn = learn<sparse_l2, invariant, sqrt_rate, feature_mask_off, true, adaptive, normalized, spare>;
+    g.multilearn = multilearn<sparse_l2, invariant, sqrt_rate, feature_mask_off, true, adaptive, normalized, spare>;
     g.update = update<sparse_l2, invariant, sqrt_rate, feature_mask_off, true, adaptive, normalized, spare>;
     g.sensitivity = sensitivity<sqrt_rate, feature_mask_off, true, adaptive, normalized, spare>;
     return next;
@@ -996,6 +1604,7 @@ uint64_t set_learn(vw& all, gd& g)
   else
   {
     g.learn = learn<sparse_l2, invariant, sqrt_rate, feature_mask_off, false, adaptive, normalized, spare>;
+    g.multilearn = multilearn<sparse_l2, invariant, sqrt_rate, feature_mask_off, false, adaptive, normalized, spare>;
     g.update = update<sparse_l2, invariant, sqrt_rate, feature_mask_off, false, adaptive, normalized, spare>;
     g.sensitivity = sensitivity<sqrt_rate, feature_mask_off, false, adaptive, normalized, spare>;
     return next;
@@ -1065,7 +1674,8 @@ base_learner* setup(vw& all)
   ("adax", "use adaptive learning rates with x^2 instead of g^2x^2")
   ("invariant", "use safe/importance aware updates.")
   ("normalized", "use per feature normalized updates")
-  ("sparse_l2", po::value<float>()->default_value(0.f), "use per feature normalized updates");
+  ("sparse_l2", po::value<float>()->default_value(0.f), "use per feature normalized updates")
+  ("simd", po::value<string>()->default_value("none"), "vector kernels for the linear terms of dense weights: none, auto (the widest the CPU has), avx512 or avx2");
   add_options(all);
   po::variables_map& vm = all.vm;
   gd& g = calloc_or_throw<gd>();
@@ -1079,6 +1689,7 @@ base_learner* setup(vw& all)
   g.neg_power_t = - all.power_t;
   g.adaptive = all.adaptive;
   g.normalized = all.normalized_updates;
+  g.simd = parse_simd_level(vm["simd"].as<string>());
 
   if(all.initial_t > 0)//for the normalized update: if initial_t is bigger than 1 we interpret this as if we had seen (all.initial_t) previous fake datapoints all with norm 1
   {
@@ -1146,18 +1757,22 @@ base_learner* setup(vw& all)
     if (all.audit || all.hash_inv)
     {
       g.predict = predict<true, true>;   g.multipredict = multipredict<true, true>;
+      g.predict_batch = predict_batch<true, true>;
     }
     else
     {
       g.predict = predict<true, false>;  g.multipredict = multipredict<true, false>;
+      g.predict_batch = predict_batch<true, false>;
     }
   else if (all.audit || all.hash_inv)
   {
     g.predict = predict<false, true>;    g.multipredict = multipredict<false, true>;
+    g.predict_batch = predict_batch<false, true>;
   }
   else
   {
     g.predict = predict<false, false>;   g.multipredict = multipredict<false, false>;
+    g.predict_batch = predict_batch<false, false>;
   }
 
   uint64_t stride;
@@ -1172,9 +1787,15 @@ base_learner* setup(vw& all)
   ret.set_predict(g.predict);
   ret.set_sensitivity(g.sensitivity);
   ret.set_multipredict(g.multipredict);
+  ret.set_predict_batch(g.predict_batch);
+  // else learn one problem at a time, as also when the vector kernels would cover every feature
+  if (all.reg_mode == 0 && !all.audit && !all.hash_inv && (!use_simd(g) || all.interactions.size() > 0))
+    ret.set_multilearn(g.multilearn);
   ret.set_update(g.update);
   ret.set_save_load(save_load);
   ret.set_end_pass(end_pass);
+  ret.set_finish(finish);
+  all.gd_base = true;
   return make_base(ret);
 }
 
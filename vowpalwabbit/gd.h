@@ -50,20 +50,58 @@ inline void vec_add_multipredict(multipredict_info<T>& mp, const float fx, uint6
 		}
 }
 
+// The weights as the walks over several problems at offsets step apart (multipredict, multilearn)
+// see them: prefetching a feature's weight fetches those of all count problems.
+template <class W>
+struct multi_weights
+{
+  W& weights;
+  size_t count;
+  size_t step;
+  inline weight& operator[](size_t i) const { return weights[i]; }
+  // once per cache line the problems' weights span, as they often share lines
+  inline void prefetch(size_t i) const
+  {
+    const size_t line = 64 / sizeof(weight);
+    size_t last = i + (count - 1) * step;
+    for (; i < last; i += step < line ? line : step)
+      weights.prefetch(i);
+    weights.prefetch(last);
+  }
+  size_t prefetch_distance() const { return weights.prefetch_distance(); }
+  uint64_t mask() const { return weights.mask(); }
+};
+
 // iterate through one namespace (or its part), callback function T(some_data_R, feature_value_x, feature_weight)
+// weights are prefetched weights.prefetch_distance() features ahead of the one passed to T
 template <class R, void (*T)(R&, const float, float&), class W>
 inline void foreach_feature(W& weights, features& fs, R& dat, uint64_t offset = 0, float mult = 1.)
 {
+  features::iterator ahead = fs.begin();
+  for (size_t i = weights.prefetch_distance(); i > 0 && ahead != fs.end(); i--, ++ahead)
+    weights.prefetch(ahead.index() + offset);
   for (features::iterator& f : fs)
-      T(dat, mult*f.value(), weights[(f.index() + offset)]);
+  { if (ahead != fs.end())
+    { weights.prefetch(ahead.index() + offset);
+      ++ahead;
+    }
+    T(dat, mult*f.value(), weights[(f.index() + offset)]);
+  }
 }
 
  // iterate through one namespace (or its part), callback function T(some_data_R, feature_value_x, feature_weight)
 template <class R, void (*T)(R&, const float, const float&), class W>
 inline void foreach_feature(const W& weights, features& fs, R& dat, uint64_t offset = 0, float mult = 1.)
 {
+  features::iterator ahead = fs.begin();
+  for (size_t i = weights.prefetch_distance(); i > 0 && ahead != fs.end(); i--, ++ahead)
+    weights.prefetch(ahead.index() + offset);
   for (features::iterator& f : fs)
     {
+      if (ahead != fs.end())
+      { weights.prefetch(ahead.index() + offset);
+        ++ahead;
+      }
       const weight& w = weights[(f.index() + offset)];
       T(dat, mult*f.value(), w);
     }
@@ -76,7 +114,7 @@ inline void foreach_feature(vw& all, features& fs, R& dat, uint64_t offset = 0,
   if (all.weights.sparse)
     foreach_feature(all.weights.sparse_weights, fs, dat, offset, mult);
   else
-    foreach_feature(all.weights.dense_weights, fs, dat, offset, mult);
+    foreach_feature(all.weights.learning_dense_weights(), fs, dat, offset, mult);
 }
 
 // iterate through one namespace (or its part), callback function T(some_data_R, feature_value_x, feature_index)
@@ -112,16 +150,40 @@ inline void foreach_feature(vw& all, example& ec, R& dat)
           if (!all.ignore_linear[i.index()])
             {
               features& f = *i;
-              foreach_feature<R, T, dense_parameters>(all.weights.dense_weights, f, dat, offset);
+              foreach_feature<R, T, dense_parameters>(all.weights.learning_dense_weights(), f, dat, offset);
             }
         }
     else
       for (features& f : ec)
-        foreach_feature<R, T, dense_parameters>(all.weights.dense_weights, f, dat, offset);
+        foreach_feature<R, T, dense_parameters>(all.weights.learning_dense_weights(), f, dat, offset);
 
   INTERACTIONS::generate_interactions<R,S,T>(all, ec, dat);
 }
 
+// iterate through all namespaces and quadratic&cubic features for several problems at once,
+// callback function T(some_data_R, feature_value_x, feature_index), prefetching the weights of
+// every problem prefetch_distance() features ahead
+template <class R, void (*T)(R&, float, uint64_t), class W>
+inline void foreach_feature(vw& all, example& ec, R& dat, multi_weights<W>& weights)
+{ uint64_t offset = ec.ft_offset;
+  for (example::iterator i = ec.begin(); i != ec.end(); ++i)
+    if (!all.ignore_some_linear || !all.ignore_linear[i.index()])
+    { features& fs = *i;
+      features::iterator ahead = fs.begin();
+      for (size_t d = weights.prefetch_distance(); d > 0 && ahead != fs.end(); d--, ++ahead)
+        weights.prefetch(ahead.index() + offset);
+      for (features::iterator& f : fs)
+      { if (ahead != fs.end())
+        { weights.prefetch(ahead.index() + offset);
+          ++ahead;
+        }
+        T(dat, f.value(), f.index() + offset);
+      }
+    }
+
+  INTERACTIONS::generate_interactions<R, uint64_t, T, false, INTERACTIONS::dummy_func<R>, multi_weights<W> >(all, ec, dat, weights);
+}
+
 // iterate through all namespaces and quadratic&cubic features, callback function T(some_data_R, feature_value_x, feature_weight)
 template <class R, void (*T)(R&, float, float&)>
 inline void foreach_feature(vw& all, example& ec, R& dat)
@@ -146,3 +208,9 @@ inline float trunc_weight(const float w, const float gravity)
 }
 
 }
+
+namespace INTERACTIONS
+{
+template <class W>
+struct prefetch_for_indices<GD::multi_weights<W> > { static const bool value = true; };
+}
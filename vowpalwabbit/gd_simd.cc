@@ -0,0 +1,496 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD (revised)
+license as described in the file LICENSE.
+ */
+#include <float.h>
+#include <math.h>
+#include "gd_simd.h"
+#include "vw_exception.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#if !defined(__clang__)
+// the update kernels must round every multiply and add on its own, as the scalar code does
+#pragma GCC optimize ("fp-contract=off")
+#endif
+#define GD_AVX2 __attribute__((target("avx2")))
+#define GD_AVX2_FMA __attribute__((target("avx2,fma")))
+#define GD_AVX512 __attribute__((target("avx512f,avx512cd,avx2,fma")))
+#include <immintrin.h>
+#endif
+
+namespace
+{
+// as in gd.cc
+const float x_min = 1.084202e-19f;
+const float x2_min = x_min*x_min;
+const float x2_max = FLT_MAX;
+
+inline float inv_sqrt(float x)
+{
+#ifdef GD_AVX2
+  return _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+#else
+  return 1.f / sqrtf(x);
+#endif
+}
+
+// gd's pred_per_update_feature<true, true, 1, 2, 3, false>
+inline void norm_feature(float* w, float x, float grad_squared, float& norm_x, float& pred_per_update)
+{
+  float x2 = x * x;
+  if (x2 < x2_min)
+  {
+    x = (x>0)? x_min:-x_min;
+    x2 = x2_min;
+  }
+  if (x2 > x2_max)
+    THROW("your features have too much magnitude");
+  w[1] += grad_squared * x2;
+  float x_abs = fabsf(x);
+  if (x_abs > w[2])
+  {
+    if (w[2] > 0.)
+      w[0] *= w[2]/x_abs;
+    w[2] = x_abs;
+  }
+  norm_x += x2 / (w[2] * w[2]);
+  w[3] = inv_sqrt(w[1]) * (1.f / w[2]);
+  pred_per_update += x2 * w[3];
+}
+
+// gd's update_feature<true, true, 1, 2, 3>
+inline void update_feature(float* w, float x, float update)
+{
+  x *= w[3];
+  w[0] += update * x;
+}
+
+float dot_scalar(const float* w, uint64_t mask, const float* x, const uint64_t* index, size_t n, uint64_t offset)
+{
+  float sum = 0.;
+  for (size_t j = 0; j < n; j++)
+    sum += x[j] * w[(index[j] + offset) & mask];
+  return sum;
+}
+
+void norm_scalar(float* w, uint64_t mask, const float* x, const uint64_t* index, size_t n, uint64_t offset,
+                 float grad_squared, float& norm_x, float& pred_per_update)
+{
+  for (size_t j = 0; j < n; j++)
+    norm_feature(w + ((index[j] + offset) & mask), x[j], grad_squared, norm_x, pred_per_update);
+}
+
+void update_scalar(float* w, uint64_t mask, const float* x, const uint64_t* index, size_t n, uint64_t offset,
+                   float update)
+{
+  for (size_t j = 0; j < n; j++)
+    update_feature(w + ((index[j] + offset) & mask), x[j], update);
+}
+
+#ifdef GD_AVX2
+/* AVX2, 8 features a step.  Row r holds the weight blocks of features r and r + 4; transposing
+** the rows within each 128-bit lane leaves float c of features 0..7 in vector c, and
+** transposing again puts the blocks back.
+*/
+GD_AVX2 inline void transpose(__m256& r0, __m256& r1, __m256& r2, __m256& r3)
+{
+  __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+  __m256 t1 = _mm256_unpacklo_ps(r2, r3);
+  __m256 t2 = _mm256_unpackhi_ps(r0, r1);
+  __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+  r0 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+  r1 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+  r2 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+  r3 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+GD_AVX2 inline __m256 load_row(float** at, size_t r)
+{ return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(at[r])), _mm_loadu_ps(at[r + 4]), 1); }
+
+GD_AVX2 inline void store_row(float** at, size_t r, __m256 row)
+{
+  _mm_storeu_ps(at[r], _mm256_castps256_ps128(row));
+  _mm_storeu_ps(at[r + 4], _mm256_extractf128_ps(row, 1));
+}
+
+// Masked indices of 8 features.
+GD_AVX2 inline void indices8(const uint64_t* index, uint64_t offset, uint64_t mask, __m256i& lo, __m256i& hi)
+{
+  __m256i off = _mm256_set1_epi64x((long long)offset);
+  __m256i m = _mm256_set1_epi64x((long long)mask);
+  lo = _mm256_and_si256(_mm256_add_epi64(_mm256_loadu_si256((const __m256i*)index), off), m);
+  hi = _mm256_and_si256(_mm256_add_epi64(_mm256_loadu_si256((const __m256i*)(index + 4)), off), m);
+}
+
+// Points at the weight blocks of 8 features; false if two of them may share a block.  Indices
+// are compared on their low 32 bits, which can only report sharing that isn't there.
+GD_AVX2 inline bool blocks8(float* w, const uint64_t* index, uint64_t offset, uint64_t mask, float** at)
+{
+  __m256i lo, hi;
+  indices8(index, offset, mask, lo, hi);
+  uint64_t i[8];
+  _mm256_storeu_si256((__m256i*)i, lo);
+  _mm256_storeu_si256((__m256i*)(i + 4), hi);
+  for (size_t k = 0; k < 8; k++)
+    at[k] = w + i[k];
+
+  __m256i low_halves = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+  __m256i v = _mm256_blend_epi32(_mm256_permutevar8x32_epi32(lo, low_halves),
+                                 _mm256_permutevar8x32_epi32(hi, low_halves), 0xF0);
+  __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  __m256i seven = _mm256_set1_epi32(7);
+  __m256i same = _mm256_setzero_si256();
+  for (int d = 1; d <= 4; d++) // every pair of lanes is d apart one way or the other
+  {
+    __m256i rotation = _mm256_and_si256(_mm256_add_epi32(lane, _mm256_set1_epi32(d)), seven);
+    same = _mm256_or_si256(same, _mm256_cmpeq_epi32(v, _mm256_permutevar8x32_epi32(v, rotation)));
+  }
+  return _mm256_testz_si256(same, same) != 0;
+}
+
+GD_AVX2 inline float sum8(__m256 v)
+{
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+  return _mm_cvtss_f32(s);
+}
+
+GD_AVX2_FMA float dot_avx2(const float* w, uint64_t mask, const float* x, const uint64_t* index, size_t n,
+                           uint64_t offset)
+{
+  __m256 sum = _mm256_setzero_ps();
+  size_t j = 0;
+  for (; j + 8 <= n; j += 8)
+  {
+    __m256i lo, hi;
+    indices8(index + j, offset, mask, lo, hi);
+    __m256 weights = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_i64gather_ps(w, lo, 4)),
+                                          _mm256_i64gather_ps(w, hi, 4), 1);
+    sum = _mm256_fmadd_ps(_mm256_loadu_ps(x + j), weights, sum);
+  }
+  return sum8(sum) + dot_scalar(w, mask, x + j, index + j, n - j, offset);
+}
+
+GD_AVX2 void norm_avx2(float* w, uint64_t mask, const float* x, const uint64_t* index, size_t n, uint64_t offset,
+                       float grad_squared, float& norm_x, float& pred_per_update)
+{
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one = _mm256_set1_ps(1.f);
+  const __m256 sign = _mm256_set1_ps(-0.f);
+  const __m256 g = _mm256_set1_ps(grad_squared);
+  __m256 norm = zero, ppu = zero;
+  float norm_rest = 0., ppu_rest = 0.;
+  size_t j = 0;
+  for (; j + 8 <= n; j += 8)
+  {
+    float* at[8];
+    __m256 v = _mm256_loadu_ps(x + j);
+    __m256 v2 = _mm256_mul_ps(v, v);
+    if (!blocks8(w, index + j, offset, mask, at) || _mm256_movemask_ps(_mm256_cmp_ps(v2, _mm256_set1_ps(x2_max), _CMP_GT_OQ)))
+    {
+      norm_scalar(w, mask, x + j, index + j, 8, offset, grad_squared, norm_rest, ppu_rest);
+      continue;
+    }
+    __m256 tiny = _mm256_cmp_ps(v2, _mm256_set1_ps(x2_min), _CMP_LT_OQ);
+    __m256 clamped = _mm256_blendv_ps(_mm256_set1_ps(-x_min), _mm256_set1_ps(x_min), _mm256_cmp_ps(v, zero, _CMP_GT_OQ));
+    v = _mm256_blendv_ps(v, clamped, tiny);
+    v2 = _mm256_blendv_ps(v2, _mm256_set1_ps(x2_min), tiny);
+
+    __m256 w0 = load_row(at, 0), w1 = load_row(at, 1), w2 = load_row(at, 2), w3 = load_row(at, 3);
+    transpose(w0, w1, w2, w3);
+    w1 = _mm256_add_ps(w1, _mm256_mul_ps(g, v2));
+    __m256 v_abs = _mm256_andnot_ps(sign, v);
+    __m256 grown = _mm256_cmp_ps(v_abs, w2, _CMP_GT_OQ);
+    __m256 rescaled = _mm256_and_ps(grown, _mm256_cmp_ps(w2, zero, _CMP_GT_OQ));
+    w0 = _mm256_blendv_ps(w0, _mm256_mul_ps(w0, _mm256_div_ps(w2, v_abs)), rescaled);
+    w2 = _mm256_blendv_ps(w2, v_abs, grown);
+    norm = _mm256_add_ps(norm, _mm256_div_ps(v2, _mm256_mul_ps(w2, w2)));
+    w3 = _mm256_mul_ps(_mm256_rsqrt_ps(w1), _mm256_div_ps(one, w2));
+    ppu = _mm256_add_ps(ppu, _mm256_mul_ps(v2, w3));
+    transpose(w0, w1, w2, w3);
+    store_row(at, 0, w0);
+    store_row(at, 1, w1);
+    store_row(at, 2, w2);
+    store_row(at, 3, w3);
+  }
+  norm_scalar(w, mask, x + j, index + j, n - j, offset, grad_squared, norm_rest, ppu_rest);
+  norm_x += sum8(norm) + norm_rest;
+  pred_per_update += sum8(ppu) + ppu_rest;
+}
+
+GD_AVX2 void update_avx2(float* w, uint64_t mask, const float* x, const uint64_t* index, size_t n, uint64_t offset,
+                         float update)
+{
+  const __m256 u = _mm256_set1_ps(update);
+  size_t j = 0;
+  for (; j + 8 <= n; j += 8)
+  {
+    float* at[8];
+    if (!blocks8(w, index + j, offset, mask, at))
+    {
+      update_scalar(w, mask, x + j, index + j, 8, offset, update);
+      continue;
+    }
+    __m256 w0 = load_row(at, 0), w1 = load_row(at, 1), w2 = load_row(at, 2), w3 = load_row(at, 3);
+    transpose(w0, w1, w2, w3);
+    w0 = _mm256_add_ps(w0, _mm256_mul_ps(u, _mm256_mul_ps(_mm256_loadu_ps(x + j), w3)));
+    transpose(w0, w1, w2, w3);
+    store_row(at, 0, w0);
+    store_row(at, 1, w1);
+    store_row(at, 2, w2);
+    store_row(at, 3, w3);
+  }
+  update_scalar(w, mask, x + j, index + j, n - j, offset, update);
+}
+
+/* AVX-512, 16 features a step, laid out as for AVX2 with four 128-bit lanes: row r holds the
+** blocks of features r, r + 4, r + 8 and r + 12.  Rates use the AVX2 rsqrt estimate on each
+** half so that they match the scalar code's.
+**
+** Vectors are built up on zeroed registers, and the intrinsics that would pass an undefined
+** vector through to the lanes they leave alone are used in their masked forms, with a full
+** mask and zeros: the same instructions, without -Wuninitialized warnings from GCC's headers.
+*/
+const __mmask8 all8 = 0xFF;
+const __mmask16 all16 = 0xFFFF;
+
+GD_AVX512 inline void transpose(__m512& r0, __m512& r1, __m512& r2, __m512& r3)
+{
+  const __m512 zero = _mm512_setzero_ps();
+  __m512 t0 = _mm512_mask_unpacklo_ps(zero, all16, r0, r1);
+  __m512 t1 = _mm512_mask_unpacklo_ps(zero, all16, r2, r3);
+  __m512 t2 = _mm512_mask_unpackhi_ps(zero, all16, r0, r1);
+  __m512 t3 = _mm512_mask_unpackhi_ps(zero, all16, r2, r3);
+  r0 = _mm512_mask_shuffle_ps(zero, all16, t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+  r1 = _mm512_mask_shuffle_ps(zero, all16, t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+  r2 = _mm512_mask_shuffle_ps(zero, all16, t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+  r3 = _mm512_mask_shuffle_ps(zero, all16, t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+GD_AVX512 inline __m512 load_row16(float** at, size_t r)
+{
+  __m512 row = _mm512_insertf32x4(_mm512_setzero_ps(), _mm_loadu_ps(at[r]), 0);
+  row = _mm512_insertf32x4(row, _mm_loadu_ps(at[r + 4]), 1);
+  row = _mm512_insertf32x4(row, _mm_loadu_ps(at[r + 8]), 2);
+  return _mm512_insertf32x4(row, _mm_loadu_ps(at[r + 12]), 3);
+}
+
+GD_AVX512 inline void store_row16(float** at, size_t r, __m512 row)
+{
+  const __m128 zero = _mm_setzero_ps();
+  _mm_storeu_ps(at[r], _mm512_mask_extractf32x4_ps(zero, all8, row, 0));
+  _mm_storeu_ps(at[r + 4], _mm512_mask_extractf32x4_ps(zero, all8, row, 1));
+  _mm_storeu_ps(at[r + 8], _mm512_mask_extractf32x4_ps(zero, all8, row, 2));
+  _mm_storeu_ps(at[r + 12], _mm512_mask_extractf32x4_ps(zero, all8, row, 3));
+}
+
+// the low (h = 0) or high (h = 1) 8 floats
+template<int h> GD_AVX512 inline __m256 half16(__m512 v)
+{
+  return _mm256_castpd_ps(_mm512_mask_extractf64x4_pd(_mm256_setzero_pd(), all8, _mm512_castps_pd(v), h));
+}
+
+GD_AVX512 inline float sum16(__m512 v) { return sum8(_mm256_add_ps(half16<0>(v), half16<1>(v))); }
+
+// lo in the low 8 floats, hi in the high 8
+GD_AVX512 inline __m512 join16(__m256 lo, __m256 hi)
+{
+  const __m512d zero = _mm512_setzero_pd();
+  __m512d v = _mm512_mask_insertf64x4(zero, all8, zero, _mm256_castps_pd(lo), 0);
+  return _mm512_castpd_ps(_mm512_mask_insertf64x4(zero, all8, v, _mm256_castps_pd(hi), 1));
+}
+
+GD_AVX512 inline __m512i indices16(const uint64_t* index, uint64_t offset, uint64_t mask, size_t half)
+{
+  return _mm512_and_si512(_mm512_add_epi64(_mm512_loadu_si512(index + 8 * half), _mm512_set1_epi64((long long)offset)),
+                          _mm512_set1_epi64((long long)mask));
+}
+
+// As blocks8, for 16 features.
+GD_AVX512 inline bool blocks16(float* w, const uint64_t* index, uint64_t offset, uint64_t mask, float** at)
+{
+  __m512i lo = indices16(index, offset, mask, 0), hi = indices16(index, offset, mask, 1);
+  uint64_t i[16];
+  _mm512_storeu_si512(i, lo);
+  _mm512_storeu_si512(i + 8, hi);
+  for (size_t k = 0; k < 16; k++)
+    at[k] = w + i[k];
+  const __m256i zero = _mm256_setzero_si256();
+  __m512i v = _mm512_mask_inserti64x4(_mm512_setzero_si512(), all8, _mm512_setzero_si512(),
+                                      _mm512_mask_cvtepi64_epi32(zero, all8, lo), 0);
+  v = _mm512_mask_inserti64x4(_mm512_setzero_si512(), all8, v, _mm512_mask_cvtepi64_epi32(zero, all8, hi), 1);
+  return _mm512_test_epi32_mask(_mm512_conflict_epi32(v), _mm512_conflict_epi32(v)) == 0;
+}
+
+GD_AVX512 inline __m512 rsqrt16(__m512 v)
+{
+  return join16(_mm256_rsqrt_ps(half16<0>(v)), _mm256_rsqrt_ps(half16<1>(v)));
+}
+
+GD_AVX512 float dot_avx512(const float* w, uint64_t mask, const float* x, const uint64_t* index, size_t n,
+                           uint64_t offset)
+{
+  __m512 sum = _mm512_setzero_ps();
+  size_t j = 0;
+  for (; j + 16 <= n; j += 16)
+  {
+    const __m256 zero = _mm256_setzero_ps();
+    __m512 weights = join16(_mm512_mask_i64gather_ps(zero, all8, indices16(index + j, offset, mask, 0), w, 4),
+                            _mm512_mask_i64gather_ps(zero, all8, indices16(index + j, offset, mask, 1), w, 4));
+    sum = _mm512_fmadd_ps(_mm512_loadu_ps(x + j), weights, sum);
+  }
+  return sum16(sum) + dot_scalar(w, mask, x + j, index + j, n - j, offset);
+}
+
+GD_AVX512 void norm_avx512(float* w, uint64_t mask, const float* x, const uint64_t* index, size_t n, uint64_t offset,
+                           float grad_squared, float& norm_x, float& pred_per_update)
+{
+  const __m512 zero = _mm512_setzero_ps();
+  const __m512 one = _mm512_set1_ps(1.f);
+  const __m512 g = _mm512_set1_ps(grad_squared);
+  __m512 norm = zero, ppu = zero;
+  float norm_rest = 0., ppu_rest = 0.;
+  size_t j = 0;
+  for (; j + 16 <= n; j += 16)
+  {
+    float* at[16];
+    __m512 v = _mm512_loadu_ps(x + j);
+    __m512 v2 = _mm512_mul_ps(v, v);
+    if (!blocks16(w, index + j, offset, mask, at) || _mm512_cmp_ps_mask(v2, _mm512_set1_ps(x2_max), _CMP_GT_OQ))
+    {
+      norm_scalar(w, mask, x + j, index + j, 16, offset, grad_squared, norm_rest, ppu_rest);
+      continue;
+    }
+    __mmask16 tiny = _mm512_cmp_ps_mask(v2, _mm512_set1_ps(x2_min), _CMP_LT_OQ);
+    __m512 clamped = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(v, zero, _CMP_GT_OQ), _mm512_set1_ps(-x_min), _mm512_set1_ps(x_min));
+    v = _mm512_mask_blend_ps(tiny, v, clamped);
+    v2 = _mm512_mask_blend_ps(tiny, v2, _mm512_set1_ps(x2_min));
+
+    __m512 w0 = load_row16(at, 0), w1 = load_row16(at, 1), w2 = load_row16(at, 2), w3 = load_row16(at, 3);
+    transpose(w0, w1, w2, w3);
+    w1 = _mm512_add_ps(w1, _mm512_mul_ps(g, v2));
+    __m512 v_abs = _mm512_abs_ps(v);
+    __mmask16 grown = _mm512_cmp_ps_mask(v_abs, w2, _CMP_GT_OQ);
+    __mmask16 rescaled = grown & _mm512_cmp_ps_mask(w2, zero, _CMP_GT_OQ);
+    w0 = _mm512_mask_blend_ps(rescaled, w0, _mm512_mul_ps(w0, _mm512_div_ps(w2, v_abs)));
+    w2 = _mm512_mask_blend_ps(grown, w2, v_abs);
+    norm = _mm512_add_ps(norm, _mm512_div_ps(v2, _mm512_mul_ps(w2, w2)));
+    w3 = _mm512_mul_ps(rsqrt16(w1), _mm512_div_ps(one, w2));
+    ppu = _mm512_add_ps(ppu, _mm512_mul_ps(v2, w3));
+    transpose(w0, w1, w2, w3);
+    store_row16(at, 0, w0);
+    store_row16(at, 1, w1);
+    store_row16(at, 2, w2);
+    store_row16(at, 3, w3);
+  }
+  norm_scalar(w, mask, x + j, index + j, n - j, offset, grad_squared, norm_rest, ppu_rest);
+  norm_x += sum16(norm) + norm_rest;
+  pred_per_update += sum16(ppu) + ppu_rest;
+}
+
+GD_AVX512 void update_avx512(float* w, uint64_t mask, const float* x, const uint64_t* index, size_t n, uint64_t offset,
+                             float update)
+{
+  const __m512 u = _mm512_set1_ps(update);
+  size_t j = 0;
+  for (; j + 16 <= n; j += 16)
+  {
+    float* at[16];
+    if (!blocks16(w, index + j, offset, mask, at))
+    {
+      update_scalar(w, mask, x + j, index + j, 16, offset, update);
+      continue;
+    }
+    __m512 w0 = load_row16(at, 0), w1 = load_row16(at, 1), w2 = load_row16(at, 2), w3 = load_row16(at, 3);
+    transpose(w0, w1, w2, w3);
+    w0 = _mm512_add_ps(w0, _mm512_mul_ps(u, _mm512_mul_ps(_mm512_loadu_ps(x + j), w3)));
+    transpose(w0, w1, w2, w3);
+    store_row16(at, 0, w0);
+    store_row16(at, 1, w1);
+    store_row16(at, 2, w2);
+    store_row16(at, 3, w3);
+  }
+  update_scalar(w, mask, x + j, index + j, n - j, offset, update);
+}
+
+simd_level detect_simd_level()
+{
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512cd"))
+    return simd_level::avx512;
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return simd_level::avx2;
+  return simd_level::none;
+}
+#else
+simd_level detect_simd_level() { return simd_level::none; }
+#endif
+}
+
+simd_level best_simd_level()
+{
+  static const simd_level best = detect_simd_level();
+  return best;
+}
+
+simd_level parse_simd_level(const std::string& s)
+{
+  simd_level requested;
+  if (s == "auto" || s == "avx512")
+    requested = simd_level::avx512;
+  else if (s == "avx2")
+    requested = simd_level::avx2;
+  else if (s == "none")
+    requested = simd_level::none;
+  else
+    THROW("--simd must be auto, avx512, avx2 or none, not " << s);
+  return requested < best_simd_level() ? requested : best_simd_level();
+}
+
+const char* simd_level_name(simd_level level)
+{
+  switch (level)
+  {
+  case simd_level::avx512: return "avx512";
+  case simd_level::avx2: return "avx2";
+  default: return "none";
+  }
+}
+
+float simd_dot(simd_level level, const float* w, uint64_t mask, const float* x, const uint64_t* index, size_t n,
+               uint64_t offset)
+{
+#ifdef GD_AVX2
+  if (level == simd_level::avx512)
+    return dot_avx512(w, mask, x, index, n, offset);
+  if (level == simd_level::avx2)
+    return dot_avx2(w, mask, x, index, n, offset);
+#endif
+  return dot_scalar(w, mask, x, index, n, offset);
+}
+
+void simd_norm_pass(simd_level level, float* w, uint64_t mask, const float* x, const uint64_t* index, size_t n,
+                    uint64_t offset, float grad_squared, float& norm_x, float& pred_per_update)
+{
+#ifdef GD_AVX2
+  if (level == simd_level::avx512)
+    return norm_avx512(w, mask, x, index, n, offset, grad_squared, norm_x, pred_per_update);
+  if (level == simd_level::avx2)
+    return norm_avx2(w, mask, x, index, n, offset, grad_squared, norm_x, pred_per_update);
+#endif
+  norm_scalar(w, mask, x, index, n, offset, grad_squared, norm_x, pred_per_update);
+}
+
+void simd_update_pass(simd_level level, float* w, uint64_t mask, const float* x, const uint64_t* index, size_t n,
+                      uint64_t offset, float update)
+{
+#ifdef GD_AVX2
+  if (level == simd_level::avx512)
+    return update_avx512(w, mask, x, index, n, offset, update);
+  if (level == simd_level::avx2)
+    return update_avx2(w, mask, x, index, n, offset, update);
+#endif
+  update_scalar(w, mask, x, index, n, offset, update);
+}
@@ -0,0 +1,45 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+/* Vector kernels for the linear terms of gd over dense weights (--simd).  They cover the plain
+** prediction and the two passes of the default update: adaptive, normalized, power_t 0.5 and
+** no feature mask.  Each kernel walks one namespace, 8 (AVX2) or 16 (AVX-512) features at a
+** time.  Prediction gathers the weights; the update loads each feature's block of four floats
+** and transposes the blocks so that every float of the block gets its own vector.  A group of
+** features sharing a weight is done one feature at a time, in order.
+**
+** The weights come out bit for bit as gd's scalar code leaves them: the same operations run
+** per weight, with rsqrt giving the same estimate at every width.  Sums over features
+** (prediction, pred_per_update, the normalizer's norm_x) are added up in a different order,
+** so they differ from the scalar sums by rounding only: for n features, by less than about
+** n * 2^-24 times the sum of the terms' magnitudes.  Since the update is computed from those
+** sums, a model trained with vectors drifts from a scalar one by that much per example.
+**
+** They are off unless --simd asks for them, as they change results by that rounding.  --simd auto
+** picks the widest the CPU supports at runtime, and any level asked for is capped at that.
+*/
+enum class simd_level { none, avx2, avx512 };
+
+simd_level best_simd_level(); // the widest the CPU and the build support
+simd_level parse_simd_level(const std::string& s); // auto, avx512, avx2 or none, capped at the best
+const char* simd_level_name(simd_level level);
+
+// Sums x[j] * w[(index[j] + offset) & mask] over n features.
+float simd_dot(simd_level level, const float* w, uint64_t mask, const float* x, const uint64_t* index, size_t n,
+               uint64_t offset);
+
+// The first update pass: accumulates the adaptive sum and the normalizer of every weight, sets
+// its rate, and adds the features' contributions to norm_x and pred_per_update.
+void simd_norm_pass(simd_level level, float* w, uint64_t mask, const float* x, const uint64_t* index, size_t n,
+                    uint64_t offset, float grad_squared, float& norm_x, float& pred_per_update);
+
+// The second update pass: w[0] += update * x * rate.
+void simd_update_pass(simd_level level, float* w, uint64_t mask, const float* x, const uint64_t* index, size_t n,
+                      uint64_t offset, float update);
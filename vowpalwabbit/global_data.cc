@@ -482,6 +482,7 @@ vw::vw()
   file_options = new std::stringstream;
 
   bfgs = false;
+  gd_base = false;
   no_bias = false;
   hessian_on = false;
   active = false;
@@ -489,6 +490,8 @@ vw::vw()
   default_bits = true;
   daemon = false;
   num_children = 10;
+  learn_threads = 1;
+  thread_average = false;
   save_resume = false;
   preserve_performance_counters = false;
 
@@ -532,6 +535,9 @@ vw::vw()
   initial_constant = 0.0;
 
   all_reduce = nullptr;
+  allreduce_async = false;
+  pending_avg = nullptr;
+  allreduce_delta = nullptr;
 
   for (size_t i = 0; i < 256; i++)
   {
@@ -543,6 +549,7 @@ vw::vw()
   }
 
   interactions = v_init<v_string>();
+  interaction_cache = nullptr;
 
   //by default use invariant normalized adaptive updates
   adaptive = true;
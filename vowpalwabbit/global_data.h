@@ -404,10 +404,17 @@ struct shared_data
 
 enum AllReduceType
 { Socket,
-  Thread
+  Thread,
+  Hierarchy
 };
 
 class AllReduce;
+struct background_avg;
+struct delta_sync;
+
+namespace INTERACTIONS
+{ struct interaction_cache;
+}
 
 // avoid name clash
 namespace label_type
@@ -456,6 +463,9 @@ struct vw
 #endif
   AllReduceType all_reduce_type;
   AllReduce* all_reduce;
+  bool allreduce_async; // average the weights at pass ends while the next pass learns (--allreduce_async)
+  background_avg* pending_avg; // that averaging, while it runs
+  delta_sync* allreduce_delta; // what --allreduce_delta keeps between averagings, else nullptr
 
   LEARNER::base_learner* l;//the top level learner
   LEARNER::base_learner* scorer;//a scoring function
@@ -476,12 +486,15 @@ struct vw
 
   bool daemon;
   size_t num_children;
+  size_t learn_threads; // threads learning from the example ring at once (--learn_threads)
+  bool thread_average; // each learner thread keeps its own weights, averaged at pass ends (--thread_average)
 
   bool save_per_pass;
   float initial_weight;
   float initial_constant;
 
   bool bfgs;
+  bool gd_base; // GD::setup built the base learner
   bool hessian_on;
 
   bool save_resume;
@@ -520,6 +533,7 @@ struct vw
   uint64_t parse_mask; // 1 << num_bits -1
   bool permutations; // if true - permutations of features generated instead of simple combinations. false by default
   v_array<v_string> interactions; // interactions of namespaces to cross.
+  INTERACTIONS::interaction_cache* interaction_cache; // generated interaction features kept across calls (--interaction_cache)
   std::vector<std::string> pairs; // pairs of features to cross.
   std::vector<std::string> triples; // triples of features to cross.
   bool ignore_some;
@@ -1,5 +1,6 @@
 #include "interactions.h"
 #include "vw_exception.h"
+#include "floatbits.h"
 using namespace std;
 namespace INTERACTIONS
 {
@@ -501,4 +502,96 @@ void eval_count_of_generated_ft(vw& all, example& ec, size_t& new_features_cnt,
 
 
 
+/*
+ *  Interaction cache
+ */
+
+interaction_cache* create_interaction_cache(size_t megabytes)
+{
+  interaction_cache& cache = calloc_or_throw<interaction_cache>();
+  cache.table = v_init<cached_example>();
+  cache.table.resize(1024);
+  cache.features = v_init<cached_feature>();
+  cache.max_features = (megabytes << 20) / sizeof(cached_feature);
+  return &cache;
+}
+
+void destroy_interaction_cache(vw& all)
+{
+  interaction_cache* cache = all.interaction_cache;
+  if (cache == nullptr)
+    return;
+  if (!all.quiet && cache->hits + cache->misses > 0)
+    all.trace_message << "interaction cache: " << cache->examples << " examples, " << cache->features.size()
+                      << " features, " << 100. * cache->hits / (cache->hits + cache->misses) << "% hits"
+                      << (cache->full ? " (full)" : "") << endl;
+  cache->table.delete_v();
+  cache->features.delete_v();
+  free(cache);
+  all.interaction_cache = nullptr;
+}
+
+inline void mix(uint64_t& h, uint64_t v) { h = (h ^ v) * 0x100000001B3ULL; }
+
+uint64_t interaction_fingerprint(vw& all, example& ec, size_t& count, uint64_t& first)
+{
+  bool seen[256] = {};
+  bool cached = false;
+  uint64_t mask = all.weights.mask(); // the cache file keeps indices masked, the text parser doesn't
+  uint64_t h = 0xCBF29CE484222325ULL;
+  count = 0;
+  first = 0;
+  for (v_string& inter : all.interactions)
+    if (inter.size() >= cached_interaction_length)
+    {
+      cached = true;
+      for (unsigned char n : inter)
+        if (!seen[n])
+        {
+          seen[n] = true;
+          features& fs = ec.feature_space[n];
+          if (count == 0 && fs.size() > 0)
+            first = fs.indicies[0] & mask;
+          count += fs.size();
+          mix(h, ((uint64_t)fs.size() << 8) | n);
+          for (size_t j = 0; j < fs.size(); j++)
+          {
+            mix(h, fs.indicies[j] & mask);
+            mix(h, float_to_bits(fs.values[j]));
+          }
+        }
+    }
+  return cached ? h | 1 : 0;
+}
+
+cached_example* find_cached(interaction_cache& cache, uint64_t fingerprint)
+{
+  size_t mask = (cache.table.end_array - cache.table.begin()) - 1;
+  for (size_t slot = ((fingerprint ^ (fingerprint >> 32)) >> 1) & mask; ; slot = (slot + 1) & mask)
+  {
+    cached_example& e = cache.table[slot];
+    if (e.fingerprint == fingerprint || e.fingerprint == 0)
+      return &e;
+  }
+}
+
+cached_example* add_cached(interaction_cache& cache, uint64_t fingerprint, size_t count, uint64_t first, size_t begin)
+{
+  size_t capacity = cache.table.end_array - cache.table.begin();
+  if (2 * (cache.examples + 1) > capacity)
+  {
+    v_array<cached_example> old = cache.table;
+    cache.table = v_init<cached_example>();
+    cache.table.resize(2 * capacity);
+    for (cached_example* e = old.begin(); e != old.end_array; ++e)
+      if (e->fingerprint != 0)
+        *find_cached(cache, e->fingerprint) = *e;
+    old.delete_v();
+  }
+  cached_example* e = find_cached(cache, fingerprint);
+  *e = { fingerprint, count, first, begin, cache.features.size() };
+  cache.examples++;
+  return e;
+}
+
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <algorithm>
+#include <type_traits>
 #include "global_data.h"
 #include "constant.h"
 
@@ -95,13 +97,30 @@ inline float INTERACTION_VALUE(float value1, float value2) { return value1*value
 
 // #define GEN_INTER_LOOP
 
+// Whether weights of type W are prefetched for T taking feature indices as well, as they are for
+// T taking weights: true for weights whose index callbacks go on to look them up.
+template <class W>
+struct prefetch_for_indices { static const bool value = false; };
+
 template <class R, class S, void(*T)(R&, float, S), bool audit, void(*audit_func)(R&, const audit_strings*), class W>
 inline void inner_kernel(R& dat, features::iterator_all& begin, features::iterator_all& end, const uint64_t offset, W& weights, feature_value ft_value, feature_index halfhash)
 {
+  // the weights of generated features are prefetched weights.prefetch_distance() features
+  // ahead, unless T takes the feature index rather than its weight
+  features::iterator_all ahead = begin;
+  if (!std::is_reference<S>::value && !prefetch_for_indices<W>::value)
+    ahead = end;
+  for (size_t i = weights.prefetch_distance(); i > 0 && ahead != end; i--, ++ahead)
+    weights.prefetch((ahead.index() ^ halfhash) + offset);
+
   if (audit)
   {
     for (; begin != end; ++begin)
     {
+      if (ahead != end)
+      { weights.prefetch((ahead.index() ^ halfhash) + offset);
+        ++ahead;
+      }
       audit_func(dat, begin.audit().get());
       call_T<R, T>(dat, weights,  INTERACTION_VALUE(ft_value, begin.value()), (begin.index() ^ halfhash) + offset);
       audit_func(dat, nullptr);
@@ -109,7 +128,12 @@ inline void inner_kernel(R& dat, features::iterator_all& begin, features::iterat
   }
   else
   { for (; begin != end; ++begin)
+    { if (ahead != end)
+      { weights.prefetch((ahead.index() ^ halfhash) + offset);
+        ++ahead;
+      }
       call_T<R, T>(dat, weights, INTERACTION_VALUE(ft_value, begin.value()), (begin.index() ^ halfhash) + offset);
+    }
   }
 }
 
@@ -117,8 +141,23 @@ inline void inner_kernel(R& dat, features::iterator_all& begin, features::iterat
 // this templated function generates new features for given example and set of interactions
 // and passes each of them to given function T()
 // it must be in header file to avoid compilation problems
+// Interactions of this many namespaces or more take the generic loop; --interaction_cache keeps
+// only those, as pairs and triples are generated faster than they can be read back.
+#ifdef GEN_INTER_LOOP
+const size_t cached_interaction_length = 2;
+#else
+const size_t cached_interaction_length = 4;
+#endif
+
+enum class interaction_set { all, cached, uncached };
+
+inline bool in_set(interaction_set set, size_t length)
+{ return set == interaction_set::all || (length >= cached_interaction_length) == (set == interaction_set::cached);
+}
+
+// selected, when given, picks interactions by their position in all.interactions.
  template <class R, class S, void(*T)(R&, float, S), bool audit, void(*audit_func)(R&, const audit_strings*), class W> // nullptr func can't be used as template param in old compilers
- inline void generate_interactions(vw& all, example& ec, R& dat, W& weights) // default value removed to eliminate ambiguity in old complers
+ inline void generate_uncached_interactions(vw& all, example& ec, R& dat, W& weights, interaction_set set = interaction_set::all, const bool* selected = nullptr)
  {
    features* features_data = ec.feature_space;
 
@@ -138,6 +177,8 @@ inline void inner_kernel(R& dat, features::iterator_all& begin, features::iterat
   // loop throw the set of possible interactions
   for (v_string& ns : all.interactions)
   { // current list of namespaces to interact.
+    if (!in_set(set, ns.size()) || (selected != nullptr && !selected[&ns - all.interactions.begin()]))
+      continue;
 
 #ifndef GEN_INTER_LOOP
 
@@ -364,18 +405,151 @@ inline void inner_kernel(R& dat, features::iterator_all& begin, features::iterat
   state_data.delete_v();
 }
 
+/*
+ *  Interaction cache (--interaction_cache)
+ */
+
+// A generated interaction feature: its value and its weight index, masked, less the example's
+// offset, so that one entry serves every offset a reduction predicts the example at.
+struct cached_feature
+{ float x;
+  uint32_t index;
+};
+
+// The generated interaction features of one example, cache.features[begin, end).  Examples are
+// told apart by a 64 bit fingerprint, and a hit must also have the same number of features and
+// the same first index, so that replaying another example's features takes a fingerprint
+// collision between examples that agree on those too.
+struct cached_example
+{ uint64_t fingerprint; // 0 marks an empty slot
+  size_t count; // features of the namespaces taking part
+  uint64_t first; // index of the first of them
+  size_t begin;
+  size_t end;
+};
+
+// Keeps the interaction features generated for examples, found by a fingerprint of the features
+// of the namespaces that interact.  Later calls on the same features (further passes, reductions
+// like oaa or csoaa predicting an example several times) replay them instead of hashing again.
+// Examples are added until their features fill max_features; nothing is evicted.
+struct interaction_cache
+{ v_array<cached_example> table; // open addressed, a power of 2 in size
+  size_t examples;
+  v_array<cached_feature> features;
+  size_t max_features;
+  bool full;
+  uint64_t hits;
+  uint64_t misses;
+};
+
+interaction_cache* create_interaction_cache(size_t megabytes);
+void destroy_interaction_cache(vw& all);
+// hash of the indices and values of every namespace taking part in a cached interaction, 0 if
+// there are none; count and first are set as in cached_example
+uint64_t interaction_fingerprint(vw& all, example& ec, size_t& count, uint64_t& first);
+// the slot of fingerprint: its entry, or the empty slot it would go in
+cached_example* find_cached(interaction_cache& cache, uint64_t fingerprint);
+// adds the features recorded since begin, returns the entry
+cached_example* add_cached(interaction_cache& cache, uint64_t fingerprint, size_t count, uint64_t first, size_t begin);
+
+struct interaction_recorder
+{ interaction_cache* cache;
+  uint64_t offset;
+  uint64_t mask;
+};
+
+inline void record_feature(interaction_recorder& r, float x, uint64_t index)
+{ interaction_cache& cache = *r.cache;
+  v_array<cached_feature>& features = cache.features;
+  if (features.end() == features.end_array)
+  { size_t size = features.size();
+    if (size == cache.max_features)
+    { cache.full = true;
+      return;
+    }
+    features.resize(std::min(2 * size + 3, cache.max_features));
+  }
+  features.push_back({ x, (uint32_t)((index - r.offset) & r.mask) });
+}
+
+template <class R>
+inline void dummy_func(R&, const audit_strings*) {} // should never be called due to call_audit overload
+
+// Generates the interaction features of ec into the cache; nullptr once they don't fit.
+template <class W>
+cached_example* record_interactions(vw& all, example& ec, W& weights, uint64_t fingerprint, size_t count, uint64_t first)
+{ interaction_cache& cache = *all.interaction_cache;
+  if (weights.mask() > UINT32_MAX) // indices don't fit the entries
+  { cache.full = true;
+    return nullptr;
+  }
+  size_t begin = cache.features.size();
+  interaction_recorder r = { &cache, ec.ft_offset, weights.mask() };
+  generate_uncached_interactions<interaction_recorder, uint64_t, record_feature, false, dummy_func<interaction_recorder>, W>(all, ec, r, weights, interaction_set::cached);
+  if (cache.full)
+  { cache.features.end() = cache.features.begin() + begin;
+    return nullptr;
+  }
+  return add_cached(cache, fingerprint, count, first, begin);
+}
+
+// this templated function generates new features for given example and set of interactions
+// and passes each of them to given function T(), replaying the cached interactions from
+// all.interaction_cache when the example's features were seen before (after the others, so
+// features can come in a different order than without the cache)
+template <class R, class S, void(*T)(R&, float, S), bool audit, void(*audit_func)(R&, const audit_strings*), class W> // nullptr func can't be used as template param in old compilers
+inline void generate_interactions(vw& all, example& ec, R& dat, W& weights) // default value removed to eliminate ambiguity in old complers
+{ if (audit || all.interaction_cache == nullptr || all.interactions.empty())
+  { generate_uncached_interactions<R, S, T, audit, audit_func, W>(all, ec, dat, weights);
+    return;
+  }
+
+  size_t count;
+  uint64_t first;
+  uint64_t fingerprint = interaction_fingerprint(all, ec, count, first);
+  if (fingerprint == 0)
+  { generate_uncached_interactions<R, S, T, audit, audit_func, W>(all, ec, dat, weights);
+    return;
+  }
+  generate_uncached_interactions<R, S, T, audit, audit_func, W>(all, ec, dat, weights, interaction_set::uncached);
+
+  interaction_cache& cache = *all.interaction_cache;
+  cached_example* cached = find_cached(cache, fingerprint);
+  if (cached->fingerprint == 0 || cached->count != count || cached->first != first)
+  { cache.misses++;
+    if (cached->fingerprint != 0 || cache.full ||
+        (cached = record_interactions(all, ec, weights, fingerprint, count, first)) == nullptr)
+    { generate_uncached_interactions<R, S, T, audit, audit_func, W>(all, ec, dat, weights, interaction_set::cached);
+      return;
+    }
+  }
+  else
+    cache.hits++;
+
+  const uint64_t offset = ec.ft_offset;
+  const cached_feature* begin = cache.features.begin() + cached->begin;
+  const cached_feature* end = cache.features.begin() + cached->end;
+  const cached_feature* ahead = std::is_reference<S>::value || prefetch_for_indices<W>::value ? begin : end;
+  for (size_t i = weights.prefetch_distance(); i > 0 && ahead != end; i--, ++ahead)
+    weights.prefetch((uint64_t)ahead->index + offset);
+  for (; begin != end; ++begin)
+  { if (ahead != end)
+    { weights.prefetch((uint64_t)ahead->index + offset);
+      ++ahead;
+    }
+    call_T<R, T>(dat, weights, begin->x, (uint64_t)begin->index + offset);
+  }
+}
+
 template <class R, class S, void(*T)(R&, float, S), bool audit, void(*audit_func)(R&, const audit_strings*)> // nullptr func can't be used as template param in old compilers
 inline void generate_interactions(vw& all, example& ec, R& dat) // default value removed to eliminate ambiguity in old complers
 {
 	if (all.weights.sparse)
 		generate_interactions<R, S, T, audit, audit_func, sparse_parameters>(all, ec, dat, all.weights.sparse_weights);
 	else
-		generate_interactions<R, S, T, audit, audit_func, dense_parameters>(all, ec, dat, all.weights.dense_weights);
+		generate_interactions<R, S, T, audit, audit_func, dense_parameters>(all, ec, dat, all.weights.learning_dense_weights());
 }
 
-template <class R>
-inline void dummy_func(R&, const audit_strings*) {} // should never be called due to call_audit overload
-
 // this code is for C++98/03 complience as I unable to pass null function-pointer as template argument in g++-4.6
 template <class R, class S, void (*T)(R&, float, S)>
 inline void generate_interactions(vw& all, example& ec, R& dat)
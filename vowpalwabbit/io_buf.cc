@@ -42,6 +42,22 @@ size_t buf_read(io_buf &i, char* &pointer, size_t n)
   }
 }
 
+bool buf_ready(io_buf &i)
+{
+  while (i.head == i.space.end())
+  {
+    // as buf_read does when it runs out of bytes
+    i.head = i.space.begin();
+    i.space.end() = i.space.begin();
+    if (i.current >= i.files.size())
+      return false;
+    if (i.fill(i.files[i.current]) > 0)
+      return true;
+    i.current++;
+  }
+  return true;
+}
+
 bool isbinary(io_buf &i)
 {
   if (i.space.end() == i.head)
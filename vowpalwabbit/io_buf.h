@@ -135,6 +135,21 @@ public:
     head = space.begin();
   }
 
+  // Moves reading f to offset, counted back from the end of the file when negative, dropping
+  // what was buffered.  Returns false when f can't seek.
+  virtual bool seek_file(int f, int64_t offset)
+  {
+#ifdef _WIN32
+    if (_lseeki64(f, offset, offset < 0 ? SEEK_END : SEEK_SET) == -1)
+#else
+    if (lseek(f, offset, offset < 0 ? SEEK_END : SEEK_SET) == -1)
+#endif
+      return false;
+    space.end() = space.begin();
+    head = space.begin();
+    return true;
+  }
+
   io_buf()
   { init();
   }
@@ -154,7 +169,7 @@ public:
 
   static ssize_t read_file_or_socket(int f, void* buf, size_t nbytes);
 
-  ssize_t fill(int f)
+  virtual ssize_t fill(int f)
   { // if the loaded values have reached the allocated space
     if (space.end_array - space.end() == 0)
     { // reallocate to twice as much space
@@ -208,6 +223,9 @@ public:
 void buf_write(io_buf &o, char* &pointer, size_t n);
 size_t buf_read(io_buf &i, char* &pointer, size_t n);
 bool isbinary(io_buf &i);
+// loads the next byte, moving on to the next file when the current one is used up, so that
+// i.current is the file it comes from.  Returns false at the end of the last file.
+bool buf_ready(io_buf &i);
 size_t readto(io_buf &i, char* &pointer, char terminal);
 
 //if read_message is null, just read it in.  Otherwise do a comparison and barf on read_message.
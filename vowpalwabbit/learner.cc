@@ -1,8 +1,11 @@
+#include <exception>
 #include "parser.h"
 #include "vw.h"
 #include "parse_regressor.h"
 using namespace std;
 
+thread_local dense_parameters* parameters::thread_dense_weights = nullptr;
+
 void dispatch_example(vw& all, example& ec)
 {
   all.learn(&ec);
@@ -75,6 +78,226 @@ template <class T, void(*f)(T, example*)> void generic_driver(vw& all, T context
   all.l->end_examples();
 }
 
+/* Hogwild learning (--learn_threads).  Learner threads take examples off the ring in turn and
+** learn from them concurrently, updating the shared weights without locks: an update racing
+** another on the same weight may be lost, which SGD shrugs off.  Examples are still finished
+** in input order, so predictions and progress come out as they would from one thread.  An end
+** of pass, a save command or an empty example waits for every example before it and runs
+** alone.  With --thread_average each thread learns into its own copy of the weights instead,
+** and the copies are averaged before an end of pass or a save and once at the end.
+*/
+struct hogwild
+{
+  vw* all;
+  MUTEX take_lock; // held while taking an example, and throughout an example running alone
+  MUTEX lock;
+  CV example_finished;
+  size_t taken; // examples taken off the ring, under take_lock
+  size_t finished; // examples finished, always the first ones taken
+  exception_ptr error; // the first exception a learner thread threw
+  size_t num_threads;
+  dense_parameters** copies; // of the weights, learned into by threads 1 and up with --thread_average
+};
+
+struct hogwild_learner
+{
+  hogwild* h;
+  dense_parameters* weights; // this thread's own, or nullptr to learn into all.weights
+};
+
+// Waits until the examples taken before ticket are finished; false if a learner thread failed.
+bool wait_for_turn(hogwild& h, size_t ticket)
+{
+  mutex_lock(&h.lock);
+  while (h.finished != ticket && h.error == nullptr)
+    condition_variable_wait(&h.example_finished, &h.lock);
+  bool turn = h.error == nullptr;
+  mutex_unlock(&h.lock);
+  return turn;
+}
+
+void end_turn(hogwild& h)
+{
+  mutex_lock(&h.lock);
+  h.finished++;
+  condition_variable_signal_all(&h.example_finished);
+  mutex_unlock(&h.lock);
+}
+
+// Averages all.weights with the per-thread copies, leaving every table equal to the average.
+void average_weights(hogwild& h, bool copy_back)
+{
+  if (h.copies == nullptr)
+    return;
+  weight* avg = h.all->weights.dense_weights.first();
+  size_t count = h.all->weights.dense_weights.mask() + 1;
+  for (size_t t = 1; t < h.num_threads; t++)
+  {
+    weight* w = h.copies[t]->first();
+    for (size_t i = 0; i < count; i++)
+      avg[i] += w[i];
+  }
+  float scale = 1.f / h.num_threads;
+  for (size_t i = 0; i < count; i++)
+    avg[i] *= scale;
+  if (copy_back)
+    for (size_t t = 1; t < h.num_threads; t++)
+      memcpy(h.copies[t]->first(), avg, count * sizeof(weight));
+}
+
+void learn_hogwild(hogwild& h)
+{
+  vw& all = *h.all;
+  while (!all.early_terminate)
+  {
+    mutex_lock(&h.take_lock);
+    example* ec = VW::get_example(all.p);
+    if (ec == nullptr)
+    {
+      mutex_unlock(&h.take_lock);
+      break;
+    }
+    size_t ticket = h.taken++;
+
+    if (ec->indices.size() > 1) // 1+ nonconstant feature. (most common case first)
+    {
+      mutex_unlock(&h.take_lock);
+      all.learn(ec);
+      if (!wait_for_turn(h, ticket))
+        return;
+      all.l->finish_example(all, *ec);
+      end_turn(h);
+    }
+    else
+    {
+      // keep take_lock so that nothing starts until this is done
+      if (!wait_for_turn(h, ticket))
+      {
+        mutex_unlock(&h.take_lock);
+        return;
+      }
+      try
+      {
+        if (ec->end_pass || (ec->tag.size() >= 4 && !strncmp((const char*) ec->tag.begin(), "save", 4)))
+          average_weights(h, true);
+        process_example(all, ec);
+      }
+      catch (...)
+      {
+        // a save that failed, say: the other threads must not be left waiting for take_lock
+        end_turn(h);
+        mutex_unlock(&h.take_lock);
+        throw;
+      }
+      end_turn(h);
+      mutex_unlock(&h.take_lock);
+    }
+  }
+}
+
+#ifdef _WIN32
+DWORD WINAPI hogwild_thread(LPVOID in)
+#else
+void *hogwild_thread(void *in)
+#endif
+{
+  hogwild_learner& learner = *(hogwild_learner*)in;
+  hogwild& h = *learner.h;
+  parameters::thread_dense_weights = learner.weights;
+  try
+  {
+    learn_hogwild(h);
+  }
+  catch (...)
+  {
+    mutex_lock(&h.lock);
+    if (h.error == nullptr)
+      h.error = current_exception();
+    h.all->early_terminate = true;
+    condition_variable_signal_all(&h.example_finished);
+    mutex_unlock(&h.lock);
+  }
+  parameters::thread_dense_weights = nullptr;
+  return 0L;
+}
+
+void hogwild_driver(vw& all)
+{
+#ifndef _WIN32
+  if (all.weights.sparse)
+    all.weights.share(all.length()); // concurrent inserts
+#endif
+
+  hogwild h;
+  h.all = &all;
+  initialize_mutex(&h.take_lock);
+  initialize_mutex(&h.lock);
+  initialize_condition_variable(&h.example_finished);
+  h.taken = 0;
+  h.finished = 0;
+  h.num_threads = all.learn_threads;
+  h.copies = nullptr;
+
+  hogwild_learner* learners = calloc_or_throw<hogwild_learner>(h.num_threads);
+  if (all.thread_average)
+  {
+    dense_parameters& weights = all.weights.dense_weights;
+    h.copies = calloc_or_throw<dense_parameters*>(h.num_threads);
+    for (size_t t = 1; t < h.num_threads; t++)
+    {
+      h.copies[t] = new dense_parameters(all.length(), weights.stride_shift(), all.weights.placement);
+      h.copies[t]->prefetch_distance(weights.prefetch_distance());
+      memcpy(h.copies[t]->first(), weights.first(), (weights.mask() + 1) * sizeof(weight));
+      learners[t].weights = h.copies[t];
+    }
+  }
+
+#ifndef _WIN32
+  pthread_t* threads = calloc_or_throw<pthread_t>(h.num_threads);
+#else
+  HANDLE* threads = calloc_or_throw<HANDLE>(h.num_threads);
+#endif
+  for (size_t t = 0; t < h.num_threads; t++)
+  {
+    learners[t].h = &h;
+#ifndef _WIN32
+    pthread_create(&threads[t], nullptr, hogwild_thread, &learners[t]);
+#else
+    threads[t] = ::CreateThread(nullptr, 0, static_cast<LPTHREAD_START_ROUTINE>(hogwild_thread), &learners[t], 0L, nullptr);
+#endif
+  }
+  for (size_t t = 0; t < h.num_threads; t++)
+  {
+#ifndef _WIN32
+    pthread_join(threads[t], nullptr);
+#else
+    ::WaitForSingleObject(threads[t], INFINITE);
+    ::CloseHandle(threads[t]);
+#endif
+  }
+  free(threads);
+
+  average_weights(h, false);
+  if (h.copies != nullptr)
+  {
+    for (size_t t = 1; t < h.num_threads; t++)
+      delete h.copies[t];
+    free(h.copies);
+  }
+  free(learners);
+  delete_mutex(&h.take_lock);
+  delete_mutex(&h.lock);
+
+  if (h.error != nullptr)
+    rethrow_exception(h.error);
+
+  example* ec = nullptr;
+  if (all.early_terminate) //drain any extra examples from parser.
+    while ((ec = VW::get_example(all.p)) != nullptr)
+      VW::finish_example(all, ec);
+  all.l->end_examples();
+}
+
 void process_multiple(vector<vw*> alls, example* ec)
 {
   // start with last as the first instance will free the example as it is the owner
@@ -93,5 +316,16 @@ void generic_driver(vector<vw*> alls)
 }
 
 void generic_driver(vw& all)
-{ generic_driver<vw&, process_example>(all, all); }
+{
+  if (all.learn_threads > 1)
+    hogwild_driver(all);
+  else
+    generic_driver<vw&, process_example>(all, all);
+}
+}
+
+namespace VW
+{
+void predict_batch(vw& all, v_array<example*>& examples)
+{ all.l->predict_batch(examples); }
 }
@@ -55,6 +55,8 @@ struct learn_data
   void (*predict_f)(void* data, base_learner& base, example&);
   void (*update_f)(void* data, base_learner& base, example&);
   void (*multipredict_f)(void* data, base_learner& base, example&, size_t count, size_t step, polyprediction*pred, bool finalize_predictions);
+  void (*predict_batch_f)(void* data, base_learner& base, v_array<example*>& examples);
+  void (*multilearn_f)(void* data, base_learner& base, example&, size_t count, size_t step, label_data* labels, polyprediction* pred, bool finalize_predictions);
 };
 
 struct sensitivity_data
@@ -84,6 +86,8 @@ inline float noop_sensitivity(void*, base_learner&, example&) { return 0.; }
 typedef void (*tlearn)(void* d, base_learner& base, example& ec);
 typedef float (*tsensitivity)(void* d, base_learner& base, example& ec);
 typedef void (*tmultipredict)(void* d, base_learner& base, example& ec, size_t, size_t, polyprediction*, bool);
+typedef void (*tpredict_batch)(void* d, base_learner& base, v_array<example*>& examples);
+typedef void (*tmultilearn)(void* d, base_learner& base, example& ec, size_t, size_t, label_data*, polyprediction*, bool);
 typedef void (*tsl)(void* d, io_buf& io, bool read, bool text);
 typedef void (*tfunc)(void*d);
 typedef void (*tend_example)(vw& all, void* d, example& ec);
@@ -114,6 +118,9 @@ public:
   size_t weights; //this stores the number of "weight vectors" required by the learner.
   size_t increment;
 
+  // the learner this one reduces to, nullptr for a base algorithm
+  base_learner* learn_base() { return learn_fd.base; }
+
   //called once for each example.  Must work under reduction.
   inline void learn(example& ec, size_t i=0)
   { ec.ft_offset += (uint32_t)(increment*i);
@@ -143,9 +150,51 @@ public:
       ec.ft_offset -= (uint32_t)(increment*lo);
     }
   }
+  //learns count problems of ec at once: problem c is learn(ec, lo+c) with labels[c].label and
+  //labels[c].weight in place of ec's label and weight.  pred gets the predictions made before the
+  //updates, as multipredict would give them; a problem with a test label or no weight is only
+  //predicted.  Learners that can walk the features once for all the problems set multilearn.
+  inline void multilearn(example& ec, size_t lo, size_t count, label_data* labels, polyprediction* pred, bool finalize_predictions)
+  { ec.ft_offset += (uint32_t)(increment*lo);
+    if (learn_fd.multilearn_f == nullptr)
+    { float label = ec.l.simple.label;
+      float weight = ec.weight;
+      for (size_t c=0; c<count; c++)
+      { ec.l.simple.label = labels[c].label;
+        ec.weight = labels[c].weight;
+        if (ec.l.simple.label != FLT_MAX && ec.weight > 0)
+          learn_fd.learn_f(learn_fd.data, *learn_fd.base, ec);
+        else
+          learn_fd.predict_f(learn_fd.data, *learn_fd.base, ec);
+        if (finalize_predictions) pred[c] = ec.pred;
+        else                      pred[c].scalar = ec.partial_prediction;
+        ec.ft_offset += (uint32_t)increment;
+      }
+      ec.ft_offset -= (uint32_t)(increment*count);
+      ec.l.simple.label = label;
+      ec.weight = weight;
+    }
+    else
+      learn_fd.multilearn_f(learn_fd.data, *learn_fd.base, ec, count, increment, labels, pred, finalize_predictions);
+    ec.ft_offset -= (uint32_t)(increment*lo);
+  }
+  //predicts several independent examples at once; learners that can share work across them set predict_batch
+  inline void predict_batch(v_array<example*>& examples, size_t i=0)
+  { for (example* ec : examples)
+      ec->ft_offset += (uint32_t)(increment*i);
+    if (learn_fd.predict_batch_f == nullptr)
+      for (example* ec : examples)
+        learn_fd.predict_f(learn_fd.data, *learn_fd.base, *ec);
+    else
+      learn_fd.predict_batch_f(learn_fd.data, *learn_fd.base, examples);
+    for (example* ec : examples)
+      ec->ft_offset -= (uint32_t)(increment*i);
+  }
   inline void set_predict(void (*u)(T& data, base_learner& base, example&)) { learn_fd.predict_f = (tlearn)u; }
   inline void set_learn(void (*u)(T&, base_learner&, example&)) { learn_fd.learn_f = (tlearn)u; }
   inline void set_multipredict(void (*u)(T&, base_learner&, example&, size_t, size_t, polyprediction*, bool)) { learn_fd.multipredict_f = (tmultipredict)u; }
+  inline void set_predict_batch(void (*u)(T&, base_learner&, v_array<example*>&)) { learn_fd.predict_batch_f = (tpredict_batch)u; }
+  inline void set_multilearn(void (*u)(T&, base_learner&, example&, size_t, size_t, label_data*, polyprediction*, bool)) { learn_fd.multilearn_f = (tmultilearn)u; }
 
   inline void update(example& ec, size_t i=0)
   { ec.ft_offset += (uint32_t)(increment*i);
@@ -245,6 +294,8 @@ learner<T>& init_learner(T* dat, void (*learn)(T&, base_learner&, example&),
   ret.learn_fd.update_f = (tlearn)learn;
   ret.learn_fd.predict_f = (tlearn)learn;
   ret.learn_fd.multipredict_f = nullptr;
+  ret.learn_fd.predict_batch_f = nullptr;
+  ret.learn_fd.multilearn_f = nullptr;
   ret.sensitivity_fd.sensitivity_f = (tsensitivity)noop_sensitivity;
   ret.finish_example_fd.data = dat;
   ret.finish_example_fd.finish_example_f = return_simple_example;
@@ -274,6 +325,8 @@ learner<T>& init_learner(T* dat, base_learner* base,
   ret.learn_fd.update_f = (tlearn)learn;
   ret.learn_fd.predict_f = (tlearn)predict;
   ret.learn_fd.multipredict_f = nullptr;
+  ret.learn_fd.predict_batch_f = nullptr;
+  ret.learn_fd.multilearn_f = nullptr;
   ret.learn_fd.base = base;
 
   ret.finisher_fd.data = dat;
@@ -0,0 +1,150 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD (revised)
+license as described in the file LICENSE.
+ */
+#include "mmap_io.h"
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+mmap_io_buf::mmap_io_buf(size_t window_size)
+  : heap(v_init<char>()), mapped_fd(-1), window(nullptr), window_length(0), window_offset(0), file_size(0),
+    window_size(window_size)
+{}
+
+mmap_io_buf::~mmap_io_buf()
+{
+  release_window(false);
+}
+
+int mmap_io_buf::open_file(const char* name, bool stdin_off, int flag)
+{
+  int ret = io_buf::open_file(name, stdin_off, flag);
+  // the mapped file was closed behind our back and its descriptor reused
+  if (ret == mapped_fd)
+    release_window(false);
+  return ret;
+}
+
+void mmap_io_buf::reset_file(int f)
+{
+  release_window(false);
+  io_buf::reset_file(f);
+}
+
+bool mmap_io_buf::seek_file(int f, int64_t offset)
+{
+  release_window(false);
+  return io_buf::seek_file(f, offset);
+}
+
+bool mmap_io_buf::close_file()
+{
+  if (files.size() > 0 && files.last() == mapped_fd)
+    release_window(false);
+  return io_buf::close_file();
+}
+
+ssize_t mmap_io_buf::fill(int f)
+{
+#ifndef _WIN32
+  size_t left = space.end() - head;
+
+  if (f == mapped_fd)
+  {
+    // buf_read and readto have copied the unread tail of the window to its front; map
+    // the window again from where that tail sits in the file instead.
+    uint64_t next = window_offset + window_length;
+    if (next >= file_size)
+      return 0;
+    if (!map_window(f, next - left, left))
+      return io_buf::fill(f);
+    return (ssize_t)(window_offset + window_length - next);
+  }
+
+  if (left == 0)
+  {
+    release_window(false);
+    struct stat st;
+    off_t offset = lseek(f, 0, SEEK_CUR);
+    if (offset >= 0 && fstat(f, &st) == 0 && S_ISREG(st.st_mode) && (uint64_t)offset < (uint64_t)st.st_size)
+    {
+      file_size = st.st_size;
+      if (map_window(f, offset, 0))
+        return (ssize_t)window_length - (space.begin() - window);
+    }
+  }
+  else
+    release_window(true); // the record continues into this file, read it as io_buf would
+#endif
+  return io_buf::fill(f);
+}
+
+bool mmap_io_buf::map_window(int f, uint64_t offset, size_t min_length)
+{
+#ifndef _WIN32
+  static const uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+  uint64_t aligned = offset & ~(page - 1);
+  size_t skip = (size_t)(offset - aligned);
+  // a record longer than the budget gets a window long enough to make progress
+  size_t length = skip + 2 * min_length + (size_t)page;
+  if (length < window_size)
+    length = window_size;
+  if (length > file_size - aligned)
+    length = (size_t)(file_size - aligned);
+
+  char* m = (char*)mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, f, (off_t)aligned);
+  if (m == MAP_FAILED)
+  {
+    release_window(min_length > 0);
+    return false;
+  }
+  madvise(m, length, MADV_SEQUENTIAL);
+  madvise(m, length, MADV_WILLNEED);
+
+  if (window == nullptr)
+    heap = space;
+  else
+    munmap(window, window_length);
+  window = m;
+  window_length = length;
+  window_offset = aligned;
+  mapped_fd = f;
+
+  // keep the descriptor positioned after the window, where io_buf would have left it
+  lseek(f, (off_t)(aligned + length), SEEK_SET);
+
+  space.begin() = window + skip;
+  space.end() = window + length;
+  space.end_array = window + length;
+  head = space.begin();
+  return true;
+#else
+  return false;
+#endif
+}
+
+// Goes back to io_buf's heap buffer, optionally carrying over the unread bytes.
+void mmap_io_buf::release_window(bool keep_unread)
+{
+#ifndef _WIN32
+  if (window == nullptr)
+    return;
+
+  size_t left = keep_unread ? space.end() - head : 0;
+  char* unread = head;
+  space = heap;
+  if (space.end_array - space.begin() < (ptrdiff_t)left)
+    space.resize(left);
+  memcpy(space.begin(), unread, left);
+  space.end() = space.begin() + left;
+  head = space.begin();
+
+  munmap(window, window_length);
+  window = nullptr;
+  window_length = 0;
+  mapped_fd = -1;
+#endif
+}
@@ -0,0 +1,46 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#pragma once
+#include "io_buf.h"
+
+/* An io_buf that reads regular files through a memory mapped window instead of read().
+** While a file is mapped, space.begin..space.end_array is the window itself, so buf_read
+** and readto hand out pointers straight into the mapping and nothing is copied.  When the
+** reader runs off the end of the window, fill() maps the next window starting at the page
+** holding the unread bytes, so records never straddle two windows.  The mapping is
+** private: in-place parsing only dirties the pages it writes to.
+**
+** Pipes, sockets, stdin and the rare record that continues from one file into the next
+** fall back to the usual heap buffer and read(), exactly as in io_buf.
+*/
+class mmap_io_buf : public io_buf
+{
+public:
+  mmap_io_buf(size_t window_size);
+  virtual ~mmap_io_buf();
+
+  virtual int open_file(const char* name, bool stdin_off, int flag=READ);
+
+  virtual void reset_file(int f);
+
+  virtual bool seek_file(int f, int64_t offset);
+
+  virtual ssize_t fill(int f);
+
+  virtual bool close_file();
+
+private:
+  bool map_window(int f, uint64_t offset, size_t min_length);
+  void release_window(bool keep_unread);
+
+  v_array<char> heap; // io_buf's own buffer, parked here while space points into the window
+  int mapped_fd; // file the window belongs to, -1 when reading through the heap buffer
+  char* window;
+  size_t window_length;
+  uint64_t window_offset; // file offset of window
+  uint64_t file_size;
+  size_t window_size; // address budget for one window
+};
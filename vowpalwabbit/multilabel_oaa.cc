@@ -13,6 +13,8 @@ using namespace std;
 struct multi_oaa
 {
   size_t k;
+  polyprediction* pred; // for multipredict
+  label_data* labels; // for multilearn
 };
 
 template <bool is_learn>
@@ -24,24 +26,25 @@ void predict_or_learn(multi_oaa& o, LEARNER::base_learner& base, example& ec)
 
   ec.l.simple = {FLT_MAX, 1.f, 0.f};
   uint32_t multilabel_index = 0;
-  for (uint32_t i = 0; i < o.k; i++)
+  if (is_learn)
   {
-    if (is_learn)
+    for (uint32_t i = 0; i < o.k; i++)
     {
-      ec.l.simple.label = -1.f;
+      o.labels[i] = { -1.f, ec.weight, 0.f };
       if (multilabels.label_v.size() > multilabel_index
           && multilabels.label_v[multilabel_index] == i)
       {
-        ec.l.simple.label = 1.f;
+        o.labels[i].label = 1.f;
         multilabel_index++;
       }
-      base.learn(ec, i);
     }
-    else
-      base.predict(ec, i);
-    if (ec.pred.scalar > 0.)
-      preds.label_v.push_back(i);
+    base.multilearn(ec, 0, o.k, o.labels, o.pred, true);
   }
+  else
+    base.multipredict(ec, 0, o.k, o.pred, true);
+  for (uint32_t i = 0; i < o.k; i++)
+    if (o.pred[i].scalar > 0.)
+      preds.label_v.push_back(i);
   if (is_learn && multilabel_index < multilabels.label_v.size())
     cout << "label " << multilabels.label_v[multilabel_index] << " is not in {0," << o.k-1 << "} This won't work right." << endl;
 
@@ -55,6 +58,12 @@ void finish_example(vw& all, multi_oaa&, example& ec)
   VW::finish_example(all, &ec);
 }
 
+void finish(multi_oaa& o)
+{
+  free(o.pred);
+  free(o.labels);
+}
+
 LEARNER::base_learner* multilabel_oaa_setup(vw& all)
 {
   if (missing_option<size_t, true>(all, "multilabel_oaa", "One-against-all multilabel with <k> labels"))
@@ -62,10 +71,13 @@ LEARNER::base_learner* multilabel_oaa_setup(vw& all)
 
   multi_oaa& data = calloc_or_throw<multi_oaa>();
   data.k = all.vm["multilabel_oaa"].as<size_t>();
+  data.pred = calloc_or_throw<polyprediction>(data.k);
+  data.labels = calloc_or_throw<label_data>(data.k);
 
   LEARNER::learner<multi_oaa>& l = LEARNER::init_learner(&data, setup_base(all), predict_or_learn<true>,
                                    predict_or_learn<false>, data.k, prediction_type::multilabels);
   l.set_finish_example(finish_example);
+  l.set_finish(finish);
   all.p->lp = MULTILABEL::multilabel;
   all.label_type = label_type::multi;
   all.delete_prediction = MULTILABEL::multilabel.delete_label;
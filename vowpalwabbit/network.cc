@@ -29,7 +29,7 @@ license as described in the file LICENSE.
 
 using namespace std;
 
-int open_socket(const char* host)
+int open_socket(const char* host, char id)
 {
 #ifdef _WIN32
   const char* colon = strchr(host,':');
@@ -62,7 +62,6 @@ int open_socket(const char* host)
   if (connect(sd,(sockaddr*)&far_end, sizeof(far_end)) == -1)
     THROWERRNO("connect(" << host << ':' << port << ")");
 
-  char id = '\0';
   if (
 #ifdef _WIN32
     _write(sd, &id, sizeof(id)) < (int)sizeof(id)
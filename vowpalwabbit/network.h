@@ -4,4 +4,5 @@ individual contributors. All rights reserved.  Released under a BSD
 license as described in the file LICENSE.
  */
 #pragma once
-int open_socket(const char* host);
+// connects to host[:port] and writes id, the byte that tells the daemon what format follows
+int open_socket(const char* host, char id = '\0');
@@ -17,6 +17,8 @@ struct oaa
   size_t k;
   vw* all; // for raw
   polyprediction* pred;  // for multipredict
+  label_data* labels; // for multilearn
+  bool linked; // the scorer applies a --link other than identity
   size_t num_subsample; // for randomized subsampling, how many negatives to draw?
   uint32_t* subsample_order; // for randomized subsampling, in what order should we touch classes
   size_t subsample_id; // for randomized subsampling, where do we live in the list
@@ -73,7 +75,16 @@ void predict_or_learn(oaa& o, LEARNER::base_learner& base, example& ec)
     scores_array = ec.pred.scalars;
 
   ec.l.simple = { FLT_MAX, 0.f, 0.f };
-  base.multipredict(ec, 0, o.k, o.pred, true);
+  // Each class learns from its prediction after --link.  multilearn would update from the one
+  // before, the same only for the identity link, so any other predicts first and then updates.
+  if (is_learn && !o.linked)
+  {
+    for (uint32_t i=1; i<=o.k; i++)
+      o.labels[i-1] = { (mc_label_data.label == i) ? 1.f : -1.f, ec.weight, 0.f };
+    base.multilearn(ec, 0, o.k, o.labels, o.pred, true);
+  }
+  else
+    base.multipredict(ec, 0, o.k, o.pred, true);
   for (uint32_t i=2; i<=o.k; i++)
     if (o.pred[i-1].scalar > o.pred[prediction-1].scalar)
       prediction = i;
@@ -82,7 +93,7 @@ void predict_or_learn(oaa& o, LEARNER::base_learner& base, example& ec)
     for (uint32_t i=1; i<=o.k; i++)
       add_passthrough_feature(ec, i, o.pred[i-1].scalar);
 
-  if (is_learn)
+  if (is_learn && o.linked)
   {
     for (uint32_t i=1; i<=o.k; i++)
     {
@@ -128,6 +139,7 @@ void predict_or_learn(oaa& o, LEARNER::base_learner& base, example& ec)
 void finish(oaa&o)
 {
   free(o.pred);
+  free(o.labels);
   free(o.subsample_order);
 }
 
@@ -224,6 +236,7 @@ LEARNER::base_learner* oaa_setup(vw& all)
 
   data.all = &all;
   data.pred = calloc_or_throw<polyprediction>(data.k);
+  data.labels = calloc_or_throw<label_data>(data.k);
   data.num_subsample = 0;
   data.subsample_order = nullptr;
   data.subsample_id = 0;
@@ -277,6 +290,9 @@ LEARNER::base_learner* oaa_setup(vw& all)
     l = &LEARNER::init_multiclass_learner(data_ptr, setup_base(all),predict_or_learn<true, false, false, false>,
                                           predict_or_learn<false, false, false, false>, all.p, data.k, prediction_type::multiclass);
 
+  // known once the scorer below is set up
+  data.linked = all.vm.count("link") && all.vm["link"].as<string>() != "identity";
+
   if (data.num_subsample > 0)
     l->set_learn(learn_randomized);
   l->set_finish(finish);
@@ -14,6 +14,7 @@ license as described in the file LICENSE.
 
 #include "parse_regressor.h"
 #include "parser.h"
+#include "prefetch_io.h"
 #include "parse_primitives.h"
 #include "vw.h"
 #include "interactions.h"
@@ -415,10 +416,21 @@ void parse_source(vw& all)
   ("port_file", po::value< string >(), "Write port used in persistent daemon mode")
   ("cache,c", "Use a cache.  The default is <data>.cache")
   ("cache_file", po::value< vector<string> >(), "The location(s) of cache_file.")
+  ("cache_format", po::value<size_t>()->default_value(1), "format of new cache files: 1 for a row stream, 2 for indexed blocks of compressed columns")
+  ("cache_shards", po::value<size_t>(&(all.p->num_cache_shards)), "split the cache file over this many files <cache>.0, <cache>.1, ..., decoded on a thread each")
+  ("shuffle_shards", "visit cache shards in a random order for every round of stripes; needs --holdout_off")
+  ("shuffle_blocks", "read the blocks of a columnar cache file in a random order every pass, through its block index; needs --holdout_off")
   ("json", "Enable JSON parsing.")
   ("dsjson", "Enable Decision Service JSON parsing.")
   ("kill_cache,k", "do not reuse existing cache: create a new one always")
   ("compressed", "use gzip format whenever possible. If a cache file is being created, this option creates a compressed cache file. A mixture of raw-text & compressed inputs are supported with autodetection.")
+  ("gzip_threads", po::value<size_t>()->default_value(1), "inflate block gzip (BGZF) input on this many threads")
+  ("gzip_blocks", "write compressed cache files as independent gzip blocks (BGZF) that can be inflated in parallel")
+  ("mmap_input", "read regular input and cache files through a memory mapped window instead of copying them into a buffer")
+  ("mmap_window", po::value<size_t>()->default_value(256), "size in MB of the --mmap_input window")
+  ("prefetch_input", "read input and cache files ahead of the parser on a background thread")
+  ("prefetch_buffers", po::value<size_t>()->default_value(2), "number of --prefetch_input buffers, at least 2")
+  ("prefetch_buffer_size", po::value<size_t>()->default_value(1024), "size in KB of each --prefetch_input buffer")
   ("no_stdin", "do not default to reading from stdin");
   add_options(all);
 
@@ -459,6 +471,42 @@ void parse_source(vw& all)
   else
     all.data_filename = "";
 
+  bool mmap_input = vm.count("mmap_input") > 0;
+  if (mmap_input && all.p->input->compressed())
+  {
+    all.trace_message << "warning: --mmap_input is ignored for compressed input" << endl;
+    mmap_input = false;
+  }
+  if (mmap_input)
+  {
+    set_mmap_input(all.p, vm["mmap_window"].as<size_t>() << 20);
+    if (vm.count("prefetch_input"))
+      all.trace_message << "warning: --prefetch_input is ignored with --mmap_input" << endl;
+  }
+  else if (vm.count("prefetch_input") && !all.daemon && !all.active)
+  {
+    size_t buffers = vm["prefetch_buffers"].as<size_t>();
+    size_t buffer_size = vm["prefetch_buffer_size"].as<size_t>() << 10;
+    if (buffers < 2 || buffer_size == 0)
+      THROW("--prefetch_input needs at least 2 buffers of at least 1 KB");
+    set_prefetch_input(all.p, buffer_size, buffers);
+  }
+
+  if (all.p->input->compressed())
+    ((comp_io_buf*)all.p->input)->inflate_threads = vm["gzip_threads"].as<size_t>();
+  if (vm.count("gzip_blocks") && all.p->output->compressed())
+    ((comp_io_buf*)all.p->output)->block_output = true;
+
+  size_t cache_format = vm["cache_format"].as<size_t>();
+  if (cache_format != 1 && cache_format != 2)
+    THROW("--cache_format must be 1 or 2");
+  all.p->write_columnar_cache = cache_format == 2;
+
+  if (all.p->num_cache_shards == 0)
+    THROW("--cache_shards must be at least 1");
+  all.p->shuffle_shards = vm.count("shuffle_shards") > 0;
+  all.p->shuffle_blocks = vm.count("shuffle_blocks") > 0;
+
   if ((vm.count("cache") || vm.count("cache_file")) && vm.count("invert_hash"))
     THROW("invert_hash is incompatible with a cache file.  Use it in single pass mode only.");
 
@@ -593,7 +641,8 @@ void parse_feature_tweaks(vw& all)
   ("quadratic,q", po::value< vector<string> > (), "Create and use quadratic features")
   ("q:", po::value< string >(), ": corresponds to a wildcard for all printable characters")
   ("cubic", po::value< vector<string> > (),
-   "Create and use cubic features");
+   "Create and use cubic features")
+  ("interaction_cache", po::value<size_t>(), "keep the generated interaction features of examples, up to <arg> MB, for later passes and repeated predictions");
   add_options(all);
 
   po::variables_map& vm = all.vm;
@@ -783,6 +832,18 @@ void parse_feature_tweaks(vw& all)
     }
   }
 
+  if (vm.count("interaction_cache"))
+  {
+    bool cached = false;
+    for (v_string& i : all.interactions)
+      cached = cached || i.size() >= INTERACTIONS::cached_interaction_length;
+    if (cached)
+      all.interaction_cache = INTERACTIONS::create_interaction_cache(vm["interaction_cache"].as<size_t>());
+    else if (!all.quiet)
+      all.trace_message << "warning: --interaction_cache keeps only interactions of "
+                        << INTERACTIONS::cached_interaction_length << " namespaces or more, and there are none" << endl;
+  }
+
 
   for (size_t i = 0; i < 256; i++)
   {
@@ -1318,9 +1379,13 @@ vw& parse_args(int argc, char *argv[], trace_message_t trace_listener, void* tra
 
     new_options(all, "VW options")
     ("random_seed", po::value<uint64_t>(&(all.random_seed)), "seed random number generator")
-    ("ring_size", po::value<size_t>(&(all.p->ring_size)), "size of example ring");
+    ("ring_size", po::value<size_t>(&(all.p->ring_size)), "size of example ring")
+    ("lockfree_ring", "hand examples from the parser to the learner without locking the example ring")
+    ("parse_threads", po::value<size_t>(&(all.p->parse_threads)), "number of threads hashing plain text examples; examples still reach the learner in input order");
     add_options(all);
 
+    all.p->lockfree_ring = all.vm.count("lockfree_ring") > 0;
+
     new_options(all, "Update options")
     ("learning_rate,l", po::value<float>(&(all.eta)), "Set learning rate")
     ("power_t", po::value<float>(&(all.power_t)), "t power value")
@@ -1337,6 +1402,10 @@ vw& parse_args(int argc, char *argv[], trace_message_t trace_listener, void* tra
     ("normal_weights", po::value<bool>(&(all.normal_weights)), "make initial weights normal")
     ("truncated_normal_weights", po::value<bool>(&(all.tnormal_weights)), "make initial weights truncated normal")
     ("sparse_weights", "Use a sparse datastructure for weights")
+    ("sparse_capacity", po::value<size_t>(&(all.weights.sparse_capacity)), "weights sparse weights shared with --daemon children or seeded instances have room for (default 2^b, at most 2^24)")
+    ("huge_pages", po::value<string>(), "back dense weights with huge pages: transparent, 2m or 1g (2m and 1g need pages reserved in /proc/sys/vm/nr_hugepages)")
+    ("numa", po::value<string>(), "place dense weights on NUMA nodes: interleave over all nodes, or local to the node loading the model")
+    ("weight_prefetch", po::value<size_t>(&(all.weights.prefetch_distance)), "prefetch dense weights this many features ahead (default 8, 0 for none)")
     ("input_feature_regularizer", po::value< string >(&(all.per_feature_regularizer_input)), "Per feature regularization input file");
     add_options(all);
 
@@ -1345,23 +1414,78 @@ vw& parse_args(int argc, char *argv[], trace_message_t trace_listener, void* tra
       all.weights.sparse = true;
     else
       all.weights.sparse = false;
+    if (vm.count("huge_pages"))
+      all.weights.placement.pages = parse_huge_pages(vm["huge_pages"].as<string>());
+    if (vm.count("numa"))
+      all.weights.placement.numa = parse_numa_policy(vm["numa"].as<string>());
 
     new_options(all, "Parallelization options")
     ("span_server", po::value<string>(), "Location of server for setting up spanning tree")
+    ("allreduce", po::value<string>()->default_value("tree"), "how --span_server nodes reduce: tree, or ring (every node sends and receives about twice the data, in chunks, at once)")
+    ("allreduce_chunk", po::value<size_t>()->default_value(ar_ring_chunk_size), "bytes the ring sends or receives at once")
+    ("allreduce_streams", po::value<size_t>()->default_value(1), "connections of the ring to each neighbour, each carrying its share of the data")
+    ("allreduce_async", "average the weights at the end of a pass while the next pass learns, applying the change at its end")
+    ("allreduce_delta", "average the weights at the end of a pass exchanging only those that changed since the last averaging")
+    ("allreduce_delta_bits", po::value<size_t>()->default_value(32), "bits of each change --allreduce_delta sends when not --adaptive: 32, 16 or 8, what rounding leaves out going into the next averaging")
     ("threads", "Enable multi-threading")
     ("unique_id", po::value<size_t>()->default_value(0), "unique id used for cluster parallel jobs")
-    ("total", po::value<size_t>()->default_value(1), "total number of nodes used in cluster parallel job")
-    ("node", po::value<size_t>()->default_value(0), "node number in cluster parallel job");
+    ("total", po::value<size_t>()->default_value(1), "total number of nodes used in cluster parallel job, or of hosts with --local_total")
+    ("node", po::value<size_t>()->default_value(0), "node number in cluster parallel job, or host number with --local_total")
+    ("local_total", po::value<size_t>()->default_value(1), "processes of the job on each host, which reduce through shared memory, --local_node 0 reducing the result with the other hosts")
+    ("local_node", po::value<size_t>()->default_value(0), "this process among the --local_total of its host")
+    ("learn_threads", po::value<size_t>(&(all.learn_threads)), "number of threads learning at once, updating the weights without locks")
+    ("thread_average", "give each --learn_threads thread its own weights, averaged at the end of each pass");
     add_options(all);
 
-    if (vm.count("span_server"))
+    all.thread_average = vm.count("thread_average") > 0;
+
+    all.allreduce_async = vm.count("allreduce_async") > 0;
+
+    size_t local_total = vm["local_total"].as<size_t>();
+    if (vm.count("span_server") || local_total > 1)
     {
-      all.all_reduce_type = AllReduceType::Socket;
-      all.all_reduce = new AllReduceSockets(
-        vm["span_server"].as<string>(),
-        vm["unique_id"].as<size_t>(),
-        vm["total"].as<size_t>(),
-        vm["node"].as<size_t>());
+      string algorithm = vm["allreduce"].as<string>();
+      if (algorithm != "tree" && algorithm != "ring")
+        THROW("--allreduce must be tree or ring, not " << algorithm);
+      if (vm["allreduce_chunk"].as<size_t>() == 0 || vm["allreduce_streams"].as<size_t>() == 0)
+        THROW("--allreduce_chunk and --allreduce_streams must be at least 1");
+      if (vm.count("allreduce_delta"))
+      {
+        size_t bits = vm["allreduce_delta_bits"].as<size_t>();
+        if (bits != 32 && bits != 16 && bits != 8)
+          THROW("--allreduce_delta_bits must be 32, 16 or 8, not " << bits);
+        all.allreduce_delta = new_delta_sync(bits);
+      }
+      if (local_total > 1)
+      {
+        if (vm["local_node"].as<size_t>() >= local_total)
+          THROW("--local_node must be less than --local_total");
+        if (vm["total"].as<size_t>() > 1 && !vm.count("span_server"))
+          THROW("hosts reduce through --span_server");
+        all.all_reduce_type = AllReduceType::Hierarchy;
+        all.all_reduce = new AllReduceHierarchy(
+          vm.count("span_server") ? vm["span_server"].as<string>() : "",
+          vm["unique_id"].as<size_t>(),
+          vm["total"].as<size_t>(),
+          vm["node"].as<size_t>(),
+          local_total,
+          vm["local_node"].as<size_t>(),
+          algorithm == "ring" ? AllReduceAlgorithm::ring : AllReduceAlgorithm::tree,
+          vm["allreduce_chunk"].as<size_t>(),
+          vm["allreduce_streams"].as<size_t>());
+      }
+      else
+      {
+        all.all_reduce_type = AllReduceType::Socket;
+        all.all_reduce = new AllReduceSockets(
+          vm["span_server"].as<string>(),
+          vm["unique_id"].as<size_t>(),
+          vm["total"].as<size_t>(),
+          vm["node"].as<size_t>(),
+          algorithm == "ring" ? AllReduceAlgorithm::ring : AllReduceAlgorithm::tree,
+          vm["allreduce_chunk"].as<size_t>(),
+          vm["allreduce_streams"].as<size_t>());
+      }
     }
 
     all.random_state = all.random_seed;
@@ -1396,6 +1520,32 @@ bool check_interaction_settings_collision(vw& all)
   return opts_has_inter;
 }
 
+// Several threads run plain gradient descent safely enough: the state its updates share besides
+// the weights is a few running sums, and the scorer above it keeps none.
+void check_learn_threads(vw& all)
+{
+  if (all.learn_threads < 2)
+    return;
+  LEARNER::base_learner* base = all.l->learn_base();
+  if (!all.gd_base || base == nullptr || base->learn_base() != nullptr)
+    THROW("--learn_threads only supports gradient descent without reductions");
+  if (all.reg_mode > 0)
+    THROW("--learn_threads does not support --l1 or --l2");
+  if (all.p->lockfree_ring)
+    THROW("--lockfree_ring hands examples to a single learner, so it can't be used with --learn_threads");
+#ifdef _WIN32
+  if (all.weights.sparse)
+    THROW("--learn_threads does not support --sparse_weights on Windows");
+#endif
+  if (all.thread_average && all.weights.sparse)
+    THROW("--thread_average does not support --sparse_weights");
+  if (all.interaction_cache != nullptr)
+    THROW("--interaction_cache is filled by one learner at a time, so it can't be used with --learn_threads");
+  if (all.weights.sparse && all.weights.sparse_capacity == 0 && all.length() > default_sparse_capacity && !all.quiet)
+    all.trace_message << "warning: the learner threads share sparse weights in a table with room for "
+                      << default_sparse_capacity << " weights, use --sparse_capacity for more" << endl;
+}
+
 void parse_modules(vw& all, io_buf& model)
 {
   save_load_header(all, model, true, false);
@@ -1438,6 +1588,8 @@ void parse_modules(vw& all, io_buf& model)
 
   parse_reductions(all);
 
+  check_learn_threads(all);
+
   if (!all.quiet)
   {
     all.trace_message << "Num weight bits = " << all.num_bits << endl;
@@ -1612,6 +1764,10 @@ vw* seed_vw_model(vw* vw_model, const string extra_args, trace_message_t trace_l
   free_it(new_model->sd);
 
   // reference model states stored in the specified VW instance
+#ifndef _WIN32
+  if (vw_model->weights.sparse) // sparse weights are inserted as they are touched, by either instance
+    vw_model->weights.share(vw_model->length());
+#endif
   new_model->weights.shallow_copy(vw_model->weights); // regressor
   new_model->sd = vw_model->sd; // shared data
 
@@ -1690,6 +1846,9 @@ void finish(vw& all, bool delete_all)
     all.trace_message << endl << "total feature number = " << all.sd->total_features;
     if (all.sd->queries > 0)
       all.trace_message << endl << "total queries = " << all.sd->queries;
+    if (all.p->prefetch != nullptr)
+      all.trace_message << endl << "read-ahead stalls: reader = " << all.p->prefetch->reader_stalls
+                        << ", parser = " << all.p->prefetch->parser_stalls;
     all.trace_message << endl;
   }
 
@@ -1753,6 +1912,9 @@ void finish(vw& all, bool delete_all)
   delete all.loss;
 
   delete all.all_reduce;
+  free_delta_sync(all.allreduce_delta);
+
+  INTERACTIONS::destroy_interaction_cache(all);
 
   // destroy all interactions and array of them
   for (v_string& i : all.interactions) i.delete_v();
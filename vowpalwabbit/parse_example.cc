@@ -70,6 +70,7 @@ public:
   bool* spelling_features;
   v_array<char> spelling;
   uint32_t hash_seed;
+  uint64_t example_number; // for warnings
 
   vector<feature_dict*>* namespace_dictionaries;
 
@@ -78,7 +79,7 @@ public:
   inline void parserWarning(const char* message, char* begin, char* pos, const char* message2)
   {
     cout << message << std::string(begin, pos - begin).c_str() << message2
-         << "in Example #" << this->p->end_parsed_examples << ": \"" << std::string(this->beginLine, this->endLine).c_str() << "\""
+         << "in Example #" << this->example_number << ": \"" << std::string(this->beginLine, this->endLine).c_str() << "\""
          << endl;
   }
 
@@ -371,7 +372,7 @@ public:
     }
   }
 
-  TC_parser(char* reading_head, char* endLine, vw& all, example* ae)
+  TC_parser(char* reading_head, char* endLine, vw& all, example* ae, uint64_t example_number)
   {
     spelling = v_init<char>();
     if (endLine != reading_head)
@@ -388,6 +389,7 @@ public:
       this->namespace_dictionaries = all.namespace_dictionaries;
       this->base = nullptr;
       this->hash_seed = all.hash_seed;
+      this->example_number = example_number;
       listNameSpace();
       if (base != nullptr)
         free(base);
@@ -395,7 +397,7 @@ public:
   }
 };
 
-void substring_to_example(vw* all, example* ae, substring example)
+char* substring_to_example_label(vw* all, example* ae, substring example)
 {
   all->p->lp.default_label(&ae->l);
   char* bar_location = safe_index(example.begin, '|', example.end);
@@ -430,10 +432,21 @@ void substring_to_example(vw* all, example* ae, substring example)
   if (all->p->words.size() > 0)
     all->p->lp.parse_label(all->p, all->sd, &ae->l, all->p->words);
 
+  return bar_location;
+}
+
+void substring_to_example_features(vw* all, example* ae, substring features, uint64_t example_number)
+{
   if (all->audit || all->hash_inv)
-    TC_parser<true> parser_line(bar_location,example.end,*all,ae);
+    TC_parser<true> parser_line(features.begin,features.end,*all,ae,example_number);
   else
-    TC_parser<false> parser_line(bar_location,example.end,*all,ae);
+    TC_parser<false> parser_line(features.begin,features.end,*all,ae,example_number);
+}
+
+void substring_to_example(vw* all, example* ae, substring example)
+{
+  substring features = { substring_to_example_label(all, ae, example), example.end };
+  substring_to_example_features(all, ae, features, all->p->end_parsed_examples);
 }
 
 
@@ -16,6 +16,11 @@ typedef enum
 } FeatureInputType;
 
 void substring_to_example(vw* all, example* ae, substring example);
+// the two halves of substring_to_example: the label and tag must be parsed in input order,
+// the features (everything from the first '|') only touch the example itself.  example_number
+// is only used in warnings.
+char* substring_to_example_label(vw* all, example* ae, substring example);
+void substring_to_example_features(vw* all, example* ae, substring features, uint64_t example_number);
 
 namespace VW
 {
@@ -18,6 +18,7 @@ license as described in the file LICENSE.
 #include "cb.h"
 #include "best_constant.h"
 #include <boost/algorithm/string.hpp>
+#include <memory>
 
 // portability fun
 #ifndef _WIN32
@@ -35,6 +36,63 @@ struct BaseState;
 template<bool audit>
 struct Context;
 
+// Remembers the hashes of recently seen (hasher, seed, string) triples: namespaces, keys
+// and categorical values repeat from one request to the next, so most of them are looked
+// up instead of hashed again. Direct mapped, a new triple replaces whatever was in its slot.
+struct json_hash_cache
+{
+	static const size_t slots = 1 << 10;
+	static const size_t max_length = 36;
+
+	struct entry
+	{
+		hash_func_t hasher; // a parser may serve several vw instances
+		uint64_t seed;
+		uint64_t hash;
+		uint32_t length;
+		char str[max_length];
+	};
+
+	entry* entries;
+
+	json_hash_cache() : entries(nullptr)
+	{ }
+
+	~json_hash_cache()
+	{
+		free(entries);
+	}
+
+	uint64_t hash(hash_func_t hasher, const char* str, size_t length, uint64_t seed)
+	{
+		substring ss = { (char*)str, (char*)str + length };
+		if (length == 0 || length > max_length)
+			return hasher(ss, seed);
+
+		if (entries == nullptr)
+			entries = calloc_or_throw<entry>(slots);
+
+		// the first and last 8 bytes (overlapping for short strings) and the length pick the slot
+		uint64_t head = 0, tail = 0;
+		size_t n = length < 8 ? length : 8;
+		memcpy(&head, str, n);
+		memcpy(&tail, str + length - n, n);
+		uint64_t mix = (head * 0x9E3779B97F4A7C15ULL) ^ ((tail + length) * 0xC2B2AE3D27D4EB4FULL) ^ seed;
+		entry& e = entries[(mix ^ (mix >> 31)) & (slots - 1)];
+
+		if (e.length != length || e.seed != seed || e.hasher != hasher || memcmp(e.str, str, length))
+		{
+			e.hasher = hasher;
+			e.seed = seed;
+			e.hash = hasher(ss, seed);
+			e.length = (uint32_t)length;
+			memcpy(e.str, str, length);
+		}
+
+		return e.hash;
+	}
+};
+
 template<bool audit>
 struct Namespace
 {
@@ -58,11 +116,9 @@ struct Namespace
 			ftrs->space_names.push_back(audit_strings_ptr(new audit_strings(name, feature_name)));
 	}
 
-	void AddFeature(vw* all, const char* str)
+	void AddFeature(Context<audit>& ctx, const char* str, size_t length)
 	{
-		ftrs->push_back(
-			1.,
-			VW::hash_feature(*all, str, namespace_hash));
+		ftrs->push_back(1., ctx.HashFeature(str, length, namespace_hash));
 		feature_count++;
 
 		if (audit)
@@ -364,7 +420,7 @@ struct TextState : BaseState<audit>
 			case '\t':
 				*p = '\0';
 				if (p - start > 0)
-					ns.AddFeature(ctx.all, start);
+					ns.AddFeature(ctx, start, p - start);
 
 				start = p + 1;
 				break;
@@ -377,7 +433,7 @@ struct TextState : BaseState<audit>
 		}
 
 		if (start < end)
-			ns.AddFeature(ctx.all, start);
+			ns.AddFeature(ctx, start, end - start);
 
 		return ctx.previous_state;
 	}
@@ -674,7 +730,7 @@ public:
 		char* prepend = (char*)str - ctx.key_length;
 		memmove(prepend, ctx.key, ctx.key_length);
 
-		ctx.CurrentNamespace().AddFeature(ctx.all, prepend);
+		ctx.CurrentNamespace().AddFeature(ctx, prepend, ctx.key_length + length);
 
 		return this;
 	}
@@ -682,7 +738,7 @@ public:
 	BaseState<audit>* Bool(Context<audit>& ctx, bool b)
 	{
 		if (b)
-			ctx.CurrentNamespace().AddFeature(ctx.all, ctx.key);
+			ctx.CurrentNamespace().AddFeature(ctx, ctx.key, ctx.key_length);
 
 		return this;
 	}
@@ -729,7 +785,7 @@ public:
 	BaseState<audit>* Float(Context<audit>& ctx, float f)
 	{
 		auto& ns = ctx.CurrentNamespace();
-		ns.AddFeature(f, VW::hash_feature(*ctx.all, ctx.key, ns.namespace_hash), ctx.key);
+		ns.AddFeature(f, ctx.HashFeature(ctx.key, ctx.key_length, ns.namespace_hash), ctx.key);
 
 		return this;
 	}
@@ -949,6 +1005,8 @@ struct Context
   VW::example_factory_t example_factory;
   void* example_factory_context;
 
+  json_hash_cache hash_cache;
+
 	// states
 	DefaultState<audit> default_state;
 	LabelState<audit> label_state;
@@ -1011,7 +1069,7 @@ struct Context
 	{
 		Namespace<audit> n;
 		n.feature_group = ns[0];
-		n.namespace_hash = VW::hash_space(*all, ns);
+		n.namespace_hash = (uint32_t)hash_cache.hash(all->p->hasher, ns, strlen(ns), all->hash_seed);
 		n.ftrs = ex->feature_space + ns[0];
 		n.feature_count = 0;
 		n.return_state = return_state;
@@ -1039,6 +1097,11 @@ struct Context
 		return namespace_path.pop().return_state;
 	}
 
+	feature_index HashFeature(const char* str, size_t length, uint64_t seed)
+	{
+		return (uint32_t)(hash_cache.hash(all->p->hasher, str, length, seed) & all->parse_mask);
+	}
+
 	Namespace<audit>& CurrentNamespace()
 	{
 		return *(namespace_path._end - 1);
@@ -1142,13 +1205,17 @@ namespace VW
 		}
 
       InsituStringStream ss(line);
-      json_parser<audit> parser;
 
-      VWReaderHandler<audit>& handler = parser.handler;
+      // callers parse requests on threads of their own, so rather than the reader's parser each
+      // thread keeps one, and with it the hash cache, across requests
+      static thread_local json_parser<audit> thread_parser;
+      json_parser<audit>* parser = &thread_parser;
+
+      VWReaderHandler<audit>& handler = parser->handler;
       handler.init(&all, &examples, &ss, example_factory, ex_factory_context);
       handler.ctx.SetStartStateToDecisionService(data);
 
-      ParseResult result = parser.reader.template Parse<kParseInsituFlag, InsituStringStream, VWReaderHandler<audit>>(ss, handler);
+      ParseResult result = parser->reader.template Parse<kParseInsituFlag, InsituStringStream, VWReaderHandler<audit>>(ss, handler);
       if (!result.IsError())
         return;
 
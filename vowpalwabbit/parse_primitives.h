@@ -20,6 +20,16 @@ typedef pthread_mutex_t MUTEX;
 typedef pthread_cond_t CV;
 #endif
 
+// portable wrappers around the above, defined in parser.cc
+void initialize_mutex(MUTEX* pm);
+void delete_mutex(MUTEX* pm);
+void initialize_condition_variable(CV* pcv);
+void mutex_lock(MUTEX* pm);
+void mutex_unlock(MUTEX* pm);
+void condition_variable_wait(CV* pcv, MUTEX* pm);
+void condition_variable_signal(CV* pcv);
+void condition_variable_signal_all(CV* pcv);
+
 struct substring
 { char *begin;
   char *end;
@@ -25,6 +25,7 @@ using namespace std;
 #include "vw_validate.h"
 #include "vw_versions.h"
 #include "gd.h"
+#include "accumulate.h"
 
 template <class T> class set_initial_wrapper
 {
@@ -88,6 +89,26 @@ template<class T> double calculate_sd(vw& all,T& weights)
   double sq_sum = inner_product(diff.begin(), diff.end(), diff.begin(), 0.0);
   return sqrt(sq_sum / my_size);
 }
+void allocate_weights(vw& all, sparse_parameters& weights, size_t length, uint32_t ss)
+{
+  new(&weights) sparse_parameters(length, ss);
+}
+
+void allocate_weights(vw& all, dense_parameters& weights, size_t length, uint32_t ss)
+{
+  new(&weights) dense_parameters(length, ss, all.weights.placement);
+  weights.prefetch_distance(all.weights.prefetch_distance);
+  const weight_memory& got = weights.memory();
+  const weight_memory& asked = all.weights.placement;
+  if (!asked.plain() && !all.quiet)
+  {
+    all.trace_message << "weight memory = " << describe_weight_memory(got);
+    if (got.pages != asked.pages || got.numa != asked.numa)
+      all.trace_message << " (less than --huge_pages/--numa asked for)";
+    all.trace_message << endl;
+  }
+}
+
 template<class T> void initialize_regressor(vw& all, T& weights)
 {
   // Regressor is already initialized.
@@ -99,7 +120,7 @@ template<class T> void initialize_regressor(vw& all, T& weights)
   {
     uint32_t ss = weights.stride_shift();
     weights.~T();//dealloc so that we can realloc, now with a known size
-    new(&weights) T(length, ss);
+    allocate_weights(all, weights, length, ss);
   }
   catch (VW::vw_exception anExc)
   {
@@ -519,6 +540,7 @@ void save_load_header(vw& all, io_buf& model_file, bool read, bool text)
 
 void dump_regressor(vw& all, io_buf& buf, bool as_text)
 {
+  finish_background_avg(all, all.weights); // a model saved before it would miss what the averaging changed
   save_load_header(all, buf, false, as_text);
   if (all.l != nullptr)
     all.l->save_load(buf, false, as_text);
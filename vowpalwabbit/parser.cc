@@ -43,6 +43,9 @@ int getpid()
 #include <errno.h>
 #include <stdio.h>
 #include <assert.h>
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#endif
 namespace po = boost::program_options;
 
 #include "parse_example.h"
@@ -53,6 +56,9 @@ namespace po = boost::program_options;
 #include "interactions.h"
 #include "vw_exception.h"
 #include "parse_example_json.h"
+#include "mmap_io.h"
+#include "prefetch_io.h"
+#include "cache_shards.h"
 
 using namespace std;
 
@@ -128,6 +134,67 @@ void condition_variable_signal_all(CV * pcv)
 #endif
 }
 
+// Lock-free example ring (--lockfree_ring).  The parser thread is the only producer and the
+// learner the only consumer: the producer owns begin_parsed_examples and the consumer owns
+// used_index, end_parsed_examples publishes parsed examples and ring_slot_busy returns
+// finished ones.  A side that finds nothing to do spins for a while and then parks on the
+// usual condition variable; the other side only takes examples_lock when ring_waiters says
+// someone is parked.  All ring atomics are sequentially consistent so that a waiter
+// announcing itself and a publisher checking for waiters can't miss each other.
+const size_t ring_spin_count = 1 << 10;
+
+inline void ring_pause()
+{
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+  _mm_pause();
+#endif
+}
+
+template<class T, bool (*ready)(parser&, T)> void ring_wait(parser& p, CV& cv, T arg)
+{
+  for (size_t i = 0; i < ring_spin_count; i++)
+  {
+    if (ready(p, arg))
+      return;
+    ring_pause();
+  }
+
+  mutex_lock(&p.examples_lock);
+  p.ring_waiters++;
+  while (!ready(p, arg))
+    condition_variable_wait(&cv, &p.examples_lock);
+  p.ring_waiters--;
+  mutex_unlock(&p.examples_lock);
+}
+
+void ring_wake(parser& p, CV& cv)
+{
+  if (p.ring_waiters.load() == 0)
+    return;
+  mutex_lock(&p.examples_lock);
+  condition_variable_signal_all(&cv);
+  mutex_unlock(&p.examples_lock);
+}
+
+bool ring_slot_free(parser& p, size_t slot) { return !p.ring_slot_busy[slot].load(); }
+
+bool ring_example_ready(parser& p, uint64_t used_index) { return p.end_parsed_examples.load() != used_index || p.done.load(); }
+
+// Marks the parser as finished and wakes a learner waiting for more examples.
+void set_parser_done(parser& p)
+{
+  if (p.lockfree_ring)
+  {
+    p.done = true;
+    ring_wake(p, p.example_available);
+    return;
+  }
+  mutex_lock(&p.examples_lock);
+  p.done = true;
+  condition_variable_signal_all(&p.example_available);
+  mutex_unlock(&p.examples_lock);
+}
+
 //This should not? matter in a library mode.
 bool got_sigterm;
 
@@ -153,9 +220,21 @@ parser* new_parser()
   ret.local_example_number = 0;
   ret.in_pass_counter = 0;
   ret.ring_size = 1 << 8;
+  ret.parse_threads = 0;
   ret.done = false;
   ret.used_index = 0;
+  ret.lockfree_ring = false;
+  ret.ring_slot_busy = nullptr;
+  ret.ring_waiters = 0;
   ret.jsonp = nullptr;
+  ret.prefetch = nullptr;
+  ret.write_columnar_cache = false;
+  ret.columns = nullptr;
+  ret.cache_formats = v_init<char>();
+  ret.num_cache_shards = 1;
+  ret.shuffle_shards = false;
+  ret.shuffle_blocks = false;
+  ret.shards = nullptr;
 
   return &ret;
 }
@@ -167,9 +246,35 @@ void set_compressed(parser* par)
   par->output = new comp_io_buf;
 }
 
-uint32_t cache_numbits(io_buf* buf, int filepointer)
+void set_mmap_input(parser* par, size_t window_size)
+{
+  delete par->input;
+  par->input = new mmap_io_buf(window_size);
+}
+
+void set_prefetch_input(parser* par, size_t block_size, size_t num_blocks)
+{
+  if (par->input->compressed())
+  {
+    prefetch_io_buf<comp_io_buf>* input = new prefetch_io_buf<comp_io_buf>(block_size, num_blocks);
+    par->prefetch = &input->ahead;
+    delete par->input;
+    par->input = input;
+  }
+  else
+  {
+    prefetch_io_buf<io_buf>* input = new prefetch_io_buf<io_buf>(block_size, num_blocks);
+    par->prefetch = &input->ahead;
+    delete par->input;
+    par->input = input;
+  }
+}
+
+uint32_t cache_numbits(io_buf* buf, int filepointer, char* format)
 {
   v_array<char> t = v_init<char>();
+  if (format != nullptr)
+    *format = 'c';
 
   try
   {
@@ -198,8 +303,10 @@ uint32_t cache_numbits(io_buf* buf, int filepointer)
     if (buf->read_file(filepointer, &temp, 1) < 1)
       THROW("failed to read");
 
-    if (temp != 'c')
+    if (temp != 'c' && temp != 'C')
       THROW("data file is not a cache file");
+    if (format != nullptr)
+      *format = temp;
   }
   catch(...)
   {
@@ -231,13 +338,21 @@ void reset_source(vw& all, size_t numbits)
   input->current = 0;
   if (all.p->write_cache)
   {
-    all.p->output->flush();
+    cache_shards* shards = all.p->shards;
+    for (size_t i = 0; i < (shards != nullptr ? shards->count : 1); i++)
+    {
+      io_buf* output = shards != nullptr ? shards->outputs[i] : all.p->output;
+      cache_columns* columns = shards != nullptr ? shards->columns[i] : all.p->columns;
+      if (columns != nullptr)
+        finish_cache_columns(*output, *columns);
+      output->flush();
+      output->close_file();
+      remove(output->finalname.begin());
+
+      if (0 != rename(output->currentname.begin(), output->finalname.begin()))
+        THROW("WARN: reset_source(vw& all, size_t numbits) cannot rename: " << output->currentname << " to " << output->finalname);
+    }
     all.p->write_cache = false;
-    all.p->output->close_file();
-    remove(all.p->output->finalname.begin());
-
-    if (0 != rename(all.p->output->currentname.begin(), all.p->output->finalname.begin()))
-      THROW("WARN: reset_source(vw& all, size_t numbits) cannot rename: " << all.p->output->currentname << " to " << all.p->output->finalname);
 
     while(input->num_files() > 0)
       if (input->compressed())
@@ -248,8 +363,16 @@ void reset_source(vw& all, size_t numbits)
         if (!member(all.final_prediction_sink, (size_t) fd))
           io_buf::close_file_or_socket(fd);
       }
-    input->open_file(all.p->output->finalname.begin(), all.stdin_off, io_buf::READ); //pushing is merged into open_file
-    all.p->reader = read_cached_features;
+    if (shards != nullptr)
+      for (size_t i = 0; i < shards->count; i++)
+      {
+        io_buf* shard = new_shard_io_buf(*input);
+        shard->open_file(shards->outputs[i]->finalname.begin(), all.stdin_off, io_buf::READ);
+        add_read_shard(*shards, shard, shards->columns[i] != nullptr);
+      }
+    else
+      input->open_file(all.p->output->finalname.begin(), all.stdin_off, io_buf::READ); //pushing is merged into open_file
+    all.p->reader = all.p->columns != nullptr ? read_cached_columns : read_cached_features;
   }
   if ( all.p->resettable == true )
   {
@@ -282,6 +405,11 @@ void reset_source(vw& all, size_t numbits)
         all.p->reader = read_cached_features;
         all.print = binary_print_result;
       }
+      else if (is_wire_stream(*(all.p->input)))
+      {
+        all.p->reader = read_wire_features;
+        all.print = binary_print_result;
+      }
       else
       {
         all.p->reader = read_features_string;
@@ -296,6 +424,22 @@ void reset_source(vw& all, size_t numbits)
         if (cache_numbits(input, input->files[i]) < numbits)
           THROW("argh, a bug in caching of some sort!");
       }
+      if (all.p->columns != nullptr)
+        reset_cache_columns(*all.p->columns, 0);
+      if (all.p->shards != nullptr && all.p->shards->reading)
+      {
+        stop_shard_readers(*all.p->shards);
+        for (size_t i = 0; i < all.p->shards->count; i++)
+        {
+          shard_reader& r = all.p->shards->readers[i];
+          r.input->current = 0;
+          r.input->reset_file(r.input->files[0]);
+          if (cache_numbits(r.input, r.input->files[0]) < numbits)
+            THROW("argh, a bug in caching of some sort!");
+          if (r.columns != nullptr)
+            reset_cache_columns(*r.columns, 0);
+        }
+      }
     }
   }
 }
@@ -312,6 +456,17 @@ void finalize_source(parser* p)
   p->input->close_files();
 
   delete p->input;
+  p->prefetch = nullptr;
+  if (p->shards != nullptr)
+  {
+    delete_cache_shards(*p->shards->all, p->shards);
+    p->shards = nullptr;
+  }
+  if (p->columns != nullptr)
+  {
+    delete_cache_columns(p->columns);
+    p->columns = nullptr;
+  }
   p->output->close_files();
   delete p->output;
   if (p->jsonp)
@@ -324,6 +479,28 @@ void finalize_source(parser* p)
   }
 }
 
+// Starts writing the cache newname to output.  Returns the size of the header written, or 0
+// if the file can't be created.
+size_t open_write_cache(vw& all, io_buf* output, string &newname)
+{
+  string temp = newname+string(".writing");
+  push_many(output->currentname,temp.c_str(),temp.length()+1);
+
+  int f = output->open_file(temp.c_str(), all.stdin_off, io_buf::WRITE);
+  if (f == -1)
+    return 0;
+
+  size_t v_length = (uint64_t)version.to_string().length()+1;
+
+  output->write_file(f, &v_length, sizeof(v_length));
+  output->write_file(f,version.to_string().c_str(),v_length);
+  output->write_file(f, all.p->write_columnar_cache ? "C" : "c", 1);
+  output->write_file(f, &all.num_bits, sizeof(all.num_bits));
+
+  push_many(output->finalname,newname.c_str(),newname.length()+1);
+  return sizeof(v_length) + v_length + 1 + sizeof(all.num_bits);
+}
+
 void make_write_cache(vw& all, string &newname, bool quiet)
 {
   io_buf* output = all.p->output;
@@ -333,29 +510,104 @@ void make_write_cache(vw& all, string &newname, bool quiet)
     return;
   }
 
-  string temp = newname+string(".writing");
-  push_many(output->currentname,temp.c_str(),temp.length()+1);
-
-  int f = output->open_file(temp.c_str(), all.stdin_off, io_buf::WRITE);
-  if (f == -1)
+  size_t header = open_write_cache(all, output, newname);
+  if (header == 0)
   {
     all.trace_message << "can't create cache file !" << endl;
     return;
   }
 
-  size_t v_length = (uint64_t)version.to_string().length()+1;
-
-  output->write_file(f, &v_length, sizeof(v_length));
-  output->write_file(f,version.to_string().c_str(),v_length);
-  output->write_file(f,"c",1);
-  output->write_file(f, &all.num_bits, sizeof(all.num_bits));
+  if (all.p->write_columnar_cache)
+  {
+    if (all.p->columns == nullptr)
+      all.p->columns = new_cache_columns();
+    reset_cache_columns(*all.p->columns, header);
+  }
 
-  push_many(output->finalname,newname.c_str(),newname.length()+1);
   all.p->write_cache = true;
   if (!quiet)
     all.trace_message << "creating cache_file = " << newname << endl;
 }
 
+// parse_cache for a cache split over all.p->num_cache_shards files: reads the shards if every
+// one of them is usable, otherwise writes them all again.
+void parse_cache_shards(vw& all, po::variables_map &vm, string &name, bool quiet)
+{
+  cache_shards* shards = new_cache_shards(all, all.p->num_cache_shards);
+  all.p->shards = shards;
+
+  vector<io_buf*> inputs;
+  vector<char> formats;
+  bool sorted = true;
+  for (size_t i = 0; i < shards->count && !vm.count("kill_cache"); i++)
+  {
+    string shard = cache_shard_name(name, i);
+    io_buf* input = new_shard_io_buf(*all.p->input);
+    int f = -1;
+    try
+    {
+      f = input->open_file(shard.c_str(), all.stdin_off, io_buf::READ);
+    }
+    catch (exception&) { f = -1; }
+    char format = 'c';
+    uint64_t c = f == -1 ? 0 : cache_numbits(input, f, &format);
+    if (f != -1 && c < all.num_bits && !quiet)
+      all.trace_message << "WARNING: cache file is ignored as it's made with less bit precision than required!" << endl;
+    inputs.push_back(input);
+    if (f == -1 || c < all.num_bits)
+      break;
+    formats.push_back(format);
+    sorted = sorted && c == all.num_bits;
+  }
+
+  // a cache split differently would be read in the wrong order
+  if (formats.size() == shards->count && ifstream(cache_shard_name(name, shards->count).c_str()).good())
+  {
+    if (!quiet)
+      all.trace_message << "WARNING: cache file is ignored as it has more shards than --cache_shards!" << endl;
+    formats.clear();
+  }
+
+  if (formats.size() == shards->count)
+  {
+    if (!quiet)
+      all.trace_message << "using cache_file = " << name << " in " << shards->count << " shards" << endl;
+    for (size_t i = 0; i < shards->count; i++)
+      add_read_shard(*shards, inputs[i], formats[i] == 'C');
+    all.p->reader = read_cached_features;
+    all.p->sorted_cache = sorted;
+    all.p->resettable = true;
+    return;
+  }
+
+  for (io_buf* input : inputs)
+  {
+    input->close_files();
+    delete input;
+  }
+  for (size_t i = shards->count; remove(cache_shard_name(name, i).c_str()) == 0; i++);
+  for (size_t i = 0; i < shards->count; i++)
+  {
+    io_buf* output = i == 0 ? all.p->output : new_shard_io_buf(*all.p->output);
+    string shard = cache_shard_name(name, i);
+    size_t header = open_write_cache(all, output, shard);
+    if (header == 0)
+      THROW("can't create cache file " << shard);
+    cache_columns* columns = nullptr;
+    if (all.p->write_columnar_cache)
+    {
+      columns = new_cache_columns();
+      reset_cache_columns(*columns, header);
+      if (i == 0)
+        all.p->columns = columns;
+    }
+    add_write_shard(*shards, output, columns);
+  }
+  all.p->write_cache = true;
+  if (!quiet)
+    all.trace_message << "creating cache_file = " << name << " in " << shards->count << " shards" << endl;
+}
+
 void parse_cache(vw& all, po::variables_map &vm, string source,
                  bool quiet)
 {
@@ -367,6 +619,14 @@ void parse_cache(vw& all, po::variables_map &vm, string source,
 
   all.p->write_cache = false;
 
+  if (all.p->num_cache_shards > 1 && caches.size() > 0)
+  {
+    if (caches.size() > 1)
+      THROW("--cache_shards splits a single cache file, not " << caches.size());
+    parse_cache_shards(all, vm, caches[0], quiet);
+    caches.clear();
+  }
+
   for (size_t i = 0; i < caches.size(); i++)
   {
     int f = -1;
@@ -380,7 +640,8 @@ void parse_cache(vw& all, po::variables_map &vm, string source,
       make_write_cache(all, caches[i], quiet);
     else
     {
-      uint64_t c = cache_numbits(all.p->input, f);
+      char format;
+      uint64_t c = cache_numbits(all.p->input, f, &format);
       if (c < all.num_bits)
       {
         if (!quiet)
@@ -392,7 +653,7 @@ void parse_cache(vw& all, po::variables_map &vm, string source,
       {
         if (!quiet)
           all.trace_message << "using cache_file = " << caches[i].c_str() << endl;
-        all.p->reader = read_cached_features;
+        all.p->cache_formats.push_back(format);
         if (c == all.num_bits)
           all.p->sorted_cache = true;
         else
@@ -402,8 +663,17 @@ void parse_cache(vw& all, po::variables_map &vm, string source,
     }
   }
 
+  // each file read may be in either format
+  bool rows = false, columns = false;
+  for (char format : all.p->cache_formats)
+    (format == 'C' ? columns : rows) = true;
+  if (columns && all.p->columns == nullptr)
+    all.p->columns = new_cache_columns();
+  if (rows || columns)
+    all.p->reader = !columns ? read_cached_features : !rows ? read_cached_columns : read_cached_mixed;
+
   all.parse_mask = ((uint64_t)1 << all.num_bits) - 1;
-  if (caches.size() == 0)
+  if (caches.size() == 0 && all.p->shards == nullptr)
   {
     if (!quiet)
       all.trace_message << "using no cache" << endl;
@@ -506,7 +776,15 @@ void enable_sources(vw& all, bool quiet, size_t passes)
 #else
       fclose(stdin);
       // weights will be shared across processes, accessible to children
+      weight_memory placed = all.weights.sparse ? weight_memory() : all.weights.dense_weights.memory();
       all.weights.share(all.length());
+      if (!all.weights.sparse)
+      {
+        const weight_memory& got = all.weights.dense_weights.memory();
+        if (got.pages != placed.pages || got.numa != placed.numa)
+          all.trace_message << "warning: the weights shared with the children got " << describe_weight_memory(got)
+                            << " instead of " << describe_weight_memory(placed) << endl;
+      }
 
       // learning state to be shared across children
       shared_data* sd = (shared_data *)mmap(0,sizeof(shared_data),
@@ -601,6 +879,11 @@ child:
         all.p->reader = read_cached_features;
         all.print = binary_print_result;
       }
+      else if (is_wire_stream(*(all.p->input)))
+      {
+        all.p->reader = read_wire_features;
+        all.print = binary_print_result;
+      }
       else
       {
         all.p->reader = read_features_string;
@@ -611,7 +894,7 @@ child:
   }
   else
   {
-    if (all.p->input->files.size() > 0)
+    if (all.p->input->files.size() > 0 || (all.p->shards != nullptr && all.p->shards->reading))
     {
       if (!quiet)
         all.trace_message << "ignoring text input in favor of cache input" << endl;
@@ -668,15 +951,13 @@ child:
 
   all.p->input->count = all.p->input->files.size();
   if (!quiet && !all.daemon)
-    all.trace_message << "num sources = " << all.p->input->files.size() << endl;
+    all.trace_message << "num sources = " << (all.p->shards != nullptr && all.p->shards->reading ? all.p->shards->count : all.p->input->files.size()) << endl;
 }
 
 void set_done(vw& all)
 {
   all.early_terminate = true;
-  mutex_lock(&all.p->examples_lock);
-  all.p->done = true;
-  mutex_unlock(&all.p->examples_lock);
+  set_parser_done(*all.p);
 }
 
 void addgrams(vw& all, size_t ngram, size_t skip_gram, features& fs,
@@ -725,17 +1006,17 @@ void addgrams(vw& all, size_t ngram, size_t skip_gram, features& fs,
  * Hash is evaluated using the principle h(a, b) = h(a)*X + h(b), where X is a random no.
  * 32 random nos. are maintained in an array and are used in the hashing.
  */
-void generateGrams(vw& all, example* &ex)
+void generateGrams(vw& all, example* &ex, v_array<size_t>& gram_mask)
 {
   for(namespace_index index : ex->indices)
   {
     size_t length = ex->feature_space[index].size();
     for (size_t n = 1; n < all.ngram[index]; n++)
     {
-      all.p->gram_mask.erase();
-      all.p->gram_mask.push_back((size_t)0);
+      gram_mask.erase();
+      gram_mask.push_back((size_t)0);
       addgrams(all, n, all.skips[index], ex->feature_space[index],
-               length, all.p->gram_mask, 0);
+               length, gram_mask, 0);
     }
   }
 }
@@ -758,59 +1039,48 @@ void feature_limit(vw& all, example* ex)
     }
 }
 
-namespace VW
-{
-example& get_unused_example(vw* all)
-{
-  parser* p = all->p;
-  while (true)
-  {
-    mutex_lock(&p->examples_lock);
-    if (p->examples[p->begin_parsed_examples % p->ring_size].in_use == false)
-    {
-      example& ret = p->examples[p->begin_parsed_examples++ % p->ring_size];
-      ret.in_use = true;
-      mutex_unlock(&p->examples_lock);
-      return ret;
-    }
-    else
-      condition_variable_wait(&p->example_unused, &p->examples_lock);
-    mutex_unlock(&p->examples_lock);
-  }
-}
-
-void setup_examples(vw& all, v_array<example*>& examples)
-{
-  for (example* ae : examples)
-    setup_example(all, ae);
-}
-
-void setup_example(vw& all, example* ae)
+// sorts the example and appends it to the cache being written, if any
+void cache_example(vw& all, example* ae)
 {
   if (all.p->sort_features && ae->sorted == false)
     unique_sort_features(all.parse_mask, ae);
 
   if (all.p->write_cache)
   {
-    all.p->lp.cache_label(&ae->l, *(all.p->output));
-    cache_features(*(all.p->output), ae, all.parse_mask);
+    if (all.p->shards != nullptr)
+      cache_example_shard(all, *all.p->shards, ae);
+    else if (all.p->columns != nullptr)
+      cache_example_columns(all, *all.p->output, *all.p->columns, ae);
+    else
+    {
+      all.p->lp.cache_label(&ae->l, *(all.p->output));
+      cache_features(*(all.p->output), ae, all.parse_mask);
+    }
   }
+}
 
-  ae->partial_prediction = 0.;
-  ae->num_features = 0;
-  ae->total_sum_feat_sq = 0;
-  ae->loss = 0.;
-
-  ae->example_counter = (size_t)(all.p->end_parsed_examples);
+// the part of setup_example that depends on the example's position in the input
+void count_example(vw& all, example* ae, bool newline, uint64_t example_counter)
+{
+  ae->example_counter = (size_t)example_counter;
   if (!all.p->emptylines_separate_examples)
     all.p->in_pass_counter++;
 
   ae->test_only = is_test_only(all.p->in_pass_counter, all.holdout_period, all.holdout_after, all.holdout_set_off, all.p->emptylines_separate_examples ? (all.holdout_period-1) : 0);
 
-  if (all.p->emptylines_separate_examples && example_is_newline(*ae))
+  if (all.p->emptylines_separate_examples && newline)
     all.p->in_pass_counter++;
 
   ae->weight = all.p->lp.get_weight(&ae->l);
+}
+
+// the part of setup_example that only touches the example, safe to run on a parse worker
+void setup_example_features(vw& all, example* ae, v_array<size_t>& gram_mask)
+{
+  ae->partial_prediction = 0.;
+  ae->num_features = 0;
+  ae->total_sum_feat_sq = 0;
+  ae->loss = 0.;
 
   if (all.ignore_some)
     for (unsigned char* i = ae->indices.begin(); i != ae->indices.end(); i++)
@@ -824,7 +1094,7 @@ void setup_example(vw& all, example* ae)
       }
 
   if(all.ngram_strings.size() > 0)
-    generateGrams(all, ae);
+    generateGrams(all, ae, gram_mask);
 
   if (all.add_constant)//add constant feature
     VW::add_constant_feature(all,ae);
@@ -852,6 +1122,49 @@ void setup_example(vw& all, example* ae)
   ae->num_features += new_features_cnt;
   ae->total_sum_feat_sq += new_features_sum_feat_sq;
 }
+
+namespace VW
+{
+example& get_unused_example(vw* all)
+{
+  parser* p = all->p;
+  if (p->lockfree_ring)
+  {
+    size_t slot = p->begin_parsed_examples++ % p->ring_size;
+    ring_wait<size_t, ring_slot_free>(*p, p->example_unused, slot);
+    p->ring_slot_busy[slot].store(true, std::memory_order_relaxed);
+    example& ret = p->examples[slot];
+    ret.in_use = true;
+    return ret;
+  }
+  while (true)
+  {
+    mutex_lock(&p->examples_lock);
+    if (p->examples[p->begin_parsed_examples % p->ring_size].in_use == false)
+    {
+      example& ret = p->examples[p->begin_parsed_examples++ % p->ring_size];
+      ret.in_use = true;
+      mutex_unlock(&p->examples_lock);
+      return ret;
+    }
+    else
+      condition_variable_wait(&p->example_unused, &p->examples_lock);
+    mutex_unlock(&p->examples_lock);
+  }
+}
+
+void setup_examples(vw& all, v_array<example*>& examples)
+{
+  for (example* ae : examples)
+    setup_example(all, ae);
+}
+
+void setup_example(vw& all, example* ae)
+{
+  cache_example(all, ae);
+  count_example(all, ae, example_is_newline(*ae) != 0, all.p->end_parsed_examples);
+  setup_example_features(all, ae, all.p->gram_mask);
+}
 }
 
 namespace VW
@@ -877,6 +1190,22 @@ example* read_example(vw& all, char* example_line)
 
 example* read_example(vw& all, string example_line) { return read_example(all, (char*)example_line.c_str()); }
 
+example* read_wire_example(vw& all, const char* data, size_t length, size_t& consumed)
+{
+  consumed = 0;
+  if (wire_frame_size(data, length) == 0)
+    return nullptr;
+
+  example* ret = &get_unused_example(&all);
+  consumed = ::read_wire_example(all, data, length, ret);
+  setup_example(all, ret);
+  all.p->end_parsed_examples++;
+
+  return ret;
+}
+
+void write_wire_example(vw& all, example& ec, v_array<char>& out) { ::write_wire_example(all, ec, out); }
+
 void add_constant_feature(vw& vw, example*ec)
 {
   ec->indices.push_back(constant_namespace);
@@ -977,13 +1306,28 @@ void finish_example(vw& all, example* ec)
   if (!is_ring_example(all, ec))
     return;
 
-  mutex_lock(&all.p->output_lock);
-  all.p->local_example_number++;
-  condition_variable_signal(&all.p->output_done);
-  mutex_unlock(&all.p->output_lock);
+  // only the daemon waits on output_done
+  if (all.p->lockfree_ring && !all.daemon)
+    all.p->local_example_number++;
+  else
+  {
+    mutex_lock(&all.p->output_lock);
+    all.p->local_example_number++;
+    condition_variable_signal(&all.p->output_done);
+    mutex_unlock(&all.p->output_lock);
+  }
 
   empty_example(all, *ec);
 
+  if (all.p->lockfree_ring)
+  {
+    assert(ec->in_use);
+    ec->in_use = false;
+    all.p->ring_slot_busy[ec - all.p->examples] = false;
+    ring_wake(*all.p, all.p->example_unused);
+    return;
+  }
+
   mutex_lock(&all.p->examples_lock);
   assert(ec->in_use);
   ec->in_use = false;
@@ -994,6 +1338,292 @@ void finish_example(vw& all, example* ec)
 }
 }
 
+// Publishes n newly set up examples to the learner; finished also ends parsing.
+void publish_examples(parser& p, size_t n, bool finished)
+{
+  if (p.lockfree_ring)
+  {
+    p.end_parsed_examples+=n;
+    if (finished)
+      p.done = true;
+    ring_wake(p, p.example_available);
+  }
+  else
+  {
+    mutex_lock(&p.examples_lock);
+    p.end_parsed_examples+=n;
+    if (finished)
+      p.done = true;
+    condition_variable_signal_all(&p.example_available);
+    mutex_unlock(&p.examples_lock);
+  }
+}
+
+// Parallel text parsing (--parse_threads).  The parser thread still reads each line, parses
+// its label and claims ring slots in input order, while the features are hashed and set up
+// on a pool of workers one batch of lines at a time.  Batches come back and are published
+// to the learner strictly in the order they were read, so results match a single parser.
+struct parse_batch
+{
+  v_array<example*> examples;
+  v_array<substring> features; // the part of each line from the first '|' on
+  v_array<bool> newline; // example_is_newline before setup, filled in by the worker
+  uint64_t first; // number of the first example, for warnings
+  bool parsed;
+};
+
+struct parse_pool
+{
+  vw* all;
+  size_t num_threads;
+#ifndef _WIN32
+  pthread_t* threads;
+#else
+  HANDLE* threads;
+#endif
+  MUTEX lock;
+  CV batch_ready; // a batch was submitted or the pool is stopping
+  CV batch_parsed; // a worker finished a batch
+
+  parse_batch* batches; // ring of batches; the one at filled is being filled by the parser thread
+  size_t num_batches;
+  size_t batch_size;
+  uint64_t filled; // batches submitted to the workers
+  uint64_t taken; // batches picked up by a worker
+  uint64_t published; // batches handed on to the learner
+  bool stop;
+  v_array<char> error;
+
+  v_array<char>* lines; // copy of each in-flight line, indexed by ring slot
+};
+
+#ifdef _WIN32
+DWORD WINAPI parse_worker(LPVOID in)
+#else
+void *parse_worker(void *in)
+#endif
+{
+  parse_pool& pool = *(parse_pool*)in;
+  vw& all = *pool.all;
+  v_array<size_t> gram_mask = v_init<size_t>();
+
+  while (true)
+  {
+    mutex_lock(&pool.lock);
+    while (pool.taken == pool.filled && !pool.stop)
+      condition_variable_wait(&pool.batch_ready, &pool.lock);
+    if (pool.taken == pool.filled)
+    {
+      mutex_unlock(&pool.lock);
+      break;
+    }
+    parse_batch& b = pool.batches[pool.taken++ % pool.num_batches];
+    mutex_unlock(&pool.lock);
+
+    string error;
+    try
+    {
+      for (size_t i = 0; i < b.examples.size(); i++)
+      {
+        example* ae = b.examples[i];
+        substring_to_example_features(&all, ae, b.features[i], b.first + i);
+        b.newline[i] = example_is_newline(*ae) != 0;
+        if (!all.p->write_cache) // otherwise the features are cached in order first
+        {
+          cache_example(all, ae);
+          setup_example_features(all, ae, gram_mask);
+        }
+      }
+    }
+    catch (exception& e)
+    {
+      error = e.what();
+    }
+
+    mutex_lock(&pool.lock);
+    if (!error.empty() && pool.error.empty())
+    {
+      push_many(pool.error, error.c_str(), error.size());
+      pool.error.push_back('\0');
+    }
+    b.parsed = true;
+    condition_variable_signal_all(&pool.batch_parsed);
+    mutex_unlock(&pool.lock);
+  }
+
+  gram_mask.delete_v();
+  return 0L;
+}
+
+parse_pool* start_parse_pool(vw& all)
+{
+  // feature dictionaries are not safe to look up concurrently
+  if (all.p->parse_threads < 2 || all.loaded_dictionaries.size() > 0)
+    return nullptr;
+
+  parse_pool* pool = &calloc_or_throw<parse_pool>();
+  pool->all = &all;
+  pool->num_threads = all.p->parse_threads;
+  pool->num_batches = 2 * pool->num_threads;
+  // keep the parsed-but-unpublished examples well inside the ring
+  pool->batch_size = max((size_t)1, min((size_t)64, all.p->ring_size / (2 * (pool->num_batches + 1))));
+  pool->batches = calloc_or_throw<parse_batch>(pool->num_batches);
+  pool->lines = calloc_or_throw<v_array<char>>(all.p->ring_size);
+  initialize_mutex(&pool->lock);
+  initialize_condition_variable(&pool->batch_ready);
+  initialize_condition_variable(&pool->batch_parsed);
+
+#ifndef _WIN32
+  pool->threads = calloc_or_throw<pthread_t>(pool->num_threads);
+  for (size_t i = 0; i < pool->num_threads; i++)
+    pthread_create(&pool->threads[i], nullptr, parse_worker, pool);
+#else
+  pool->threads = calloc_or_throw<HANDLE>(pool->num_threads);
+  for (size_t i = 0; i < pool->num_threads; i++)
+    pool->threads[i] = ::CreateThread(nullptr, 0, static_cast<LPTHREAD_START_ROUTINE>(parse_worker), pool, 0L, nullptr);
+#endif
+
+  return pool;
+}
+
+void stop_parse_pool(vw& all, parse_pool* pool)
+{
+  mutex_lock(&pool->lock);
+  pool->stop = true;
+  condition_variable_signal_all(&pool->batch_ready);
+  mutex_unlock(&pool->lock);
+
+  for (size_t i = 0; i < pool->num_threads; i++)
+  {
+#ifndef _WIN32
+    pthread_join(pool->threads[i], nullptr);
+#else
+    ::WaitForSingleObject(pool->threads[i], INFINITE);
+    ::CloseHandle(pool->threads[i]);
+#endif
+  }
+  free(pool->threads);
+  delete_mutex(&pool->lock);
+
+  for (size_t i = 0; i < pool->num_batches; i++)
+  {
+    pool->batches[i].examples.delete_v();
+    pool->batches[i].features.delete_v();
+    pool->batches[i].newline.delete_v();
+  }
+  free(pool->batches);
+  for (size_t i = 0; i < all.p->ring_size; i++)
+    pool->lines[i].delete_v();
+  free(pool->lines);
+  pool->error.delete_v();
+  free(pool);
+}
+
+// Finishes setting up parsed batches and publishes them in read order: blocks until
+// at least the batches before until are published, then takes whatever else is ready.
+void publish_parsed(vw& all, parse_pool& pool, uint64_t until)
+{
+  while (pool.published < pool.filled)
+  {
+    parse_batch& b = pool.batches[pool.published % pool.num_batches];
+    mutex_lock(&pool.lock);
+    while (!b.parsed && pool.published < until)
+      condition_variable_wait(&pool.batch_parsed, &pool.lock);
+    bool parsed = b.parsed;
+    bool failed = !pool.error.empty();
+    mutex_unlock(&pool.lock);
+    if (failed)
+      THROW(pool.error.begin());
+    if (!parsed)
+      return;
+
+    for (size_t i = 0; i < b.examples.size(); i++)
+    {
+      example* ae = b.examples[i];
+      if (all.p->write_cache)
+        cache_example(all, ae);
+      count_example(all, ae, b.newline[i], all.p->end_parsed_examples + i);
+      if (all.p->write_cache)
+        setup_example_features(all, ae, all.p->gram_mask);
+    }
+    publish_examples(*all.p, b.examples.size(), false);
+
+    b.examples.erase();
+    b.features.erase();
+    b.newline.erase();
+    b.parsed = false;
+    pool.published++;
+  }
+}
+
+// Hands the batch being filled to the workers.  The next batch to fill must be free, so
+// once every batch is in flight this waits for the oldest one.
+void submit_batch(vw& all, parse_pool& pool)
+{
+  if (pool.batches[pool.filled % pool.num_batches].examples.empty())
+    return;
+  mutex_lock(&pool.lock);
+  pool.filled++;
+  condition_variable_signal(&pool.batch_ready);
+  mutex_unlock(&pool.lock);
+
+  if (pool.filled - pool.published == pool.num_batches)
+    publish_parsed(all, pool, pool.published + 1);
+}
+
+void drain_parse_pool(vw& all, parse_pool& pool)
+{
+  submit_batch(all, pool);
+  publish_parsed(all, pool, pool.filled);
+}
+
+// read_features_string for the pool: reads one line and parses its label, leaving the
+// features to a worker.
+int read_features_string_pooled(vw& all, parse_pool& pool, example* ae)
+{
+  char* line;
+  size_t num_chars;
+  size_t num_chars_initial = read_features(&all, line, num_chars);
+  if (num_chars_initial < 1)
+    return (int)num_chars_initial;
+
+  // the io_buf is refilled before the worker gets to the line
+  v_array<char>& copy = pool.lines[ae - all.p->examples];
+  copy.erase();
+  push_many(copy, line, num_chars);
+  copy.push_back('\0');
+  substring example = { copy.begin(), copy.begin() + num_chars };
+  substring features = { substring_to_example_label(&all, ae, example), example.end };
+
+  parse_batch& b = pool.batches[pool.filled % pool.num_batches];
+  if (b.examples.empty()) // the slot of every example is claimed in input order
+    b.first = all.p->begin_parsed_examples - 1;
+  b.examples.push_back(ae);
+  b.features.push_back(features);
+  b.newline.push_back(false);
+  if (b.examples.size() == pool.batch_size)
+    submit_batch(all, pool);
+
+  return (int)num_chars_initial;
+}
+
+bool parse_pool_pending(parse_pool& pool)
+{
+  return pool.published != pool.filled || !pool.batches[pool.filled % pool.num_batches].examples.empty();
+}
+
+// Whether claiming the next ring slot could block on the learner.
+bool next_example_unused(parser& p)
+{
+  size_t slot = p.begin_parsed_examples % p.ring_size;
+  if (p.lockfree_ring)
+    return ring_slot_free(p, slot);
+  mutex_lock(&p.examples_lock);
+  bool unused = !p.examples[slot].in_use;
+  mutex_unlock(&p.examples_lock);
+  return unused;
+}
+
 #ifdef _WIN32
 DWORD WINAPI main_parse_loop(LPVOID in)
 #else
@@ -1003,22 +1633,44 @@ void *main_parse_loop(void *in)
   v_array<example*> examples = v_init<example*>();
   vw* all = (vw*)in;
   size_t example_number = 0;  // for variable-size batch learning algorithms
+  parse_pool* pool = nullptr;
 
   try
   {
-    size_t examples_available;
+    pool = start_parse_pool(*all);
     while(!all->p->done)
     {
+      // the learner may be holding the slot we need until it sees the examples still in the pool
+      if (pool != nullptr && parse_pool_pending(*pool) && !next_example_unused(*all->p))
+        drain_parse_pool(*all, *pool);
       examples.push_back(&VW::get_unused_example(all)); // need at least 1 example
+      bool pooled = pool != nullptr && all->p->reader == read_features_string;
+      bool sharded = all->p->shards != nullptr && all->p->shards->reading;
       if (!all->do_reset_source && example_number != all->pass_length && all->max_examples > example_number
-          && all->p->reader(all, examples) > 0)
+          && (pooled ? read_features_string_pooled(*all, *pool, examples[0])
+              : sharded ? read_cached_shards(*all, examples[0]) : all->p->reader(all, examples)) > 0)
       {
-        VW::setup_examples(*all, examples);
-        example_number+=examples.size();
-        examples_available=examples.size();
+        if (pooled)
+        {
+          example_number++;
+          publish_parsed(*all, *pool, pool->published);
+        }
+        else if (sharded) // set up by the shard readers
+        {
+          example_number++;
+          publish_examples(*all->p, 1, false);
+        }
+        else
+        {
+          VW::setup_examples(*all, examples);
+          example_number+=examples.size();
+          publish_examples(*all->p, examples.size(), false);
+        }
       }
       else
       {
+        if (pool != nullptr)
+          drain_parse_pool(*all, *pool);
         reset_source(*all, all->num_bits);
         all->do_reset_source = false;
         all->passes_complete++;
@@ -1029,19 +1681,12 @@ void *main_parse_loop(void *in)
           all->passes_complete = 0;
           all->pass_length = all->pass_length*2+1;
         }
-        if (all->passes_complete >= all->numpasses && all->max_examples >= example_number)
-        {
-          mutex_lock(&all->p->examples_lock);
-          all->p->done = true;
-          mutex_unlock(&all->p->examples_lock);
-        }
+        // done is only raised together with publishing the end-of-pass example,
+        // otherwise the learner could see done with nothing left and drop it.
+        bool finished = all->passes_complete >= all->numpasses && all->max_examples >= example_number;
         example_number = 0;
-        examples_available=1;
+        publish_examples(*all->p, 1, finished);
       }
-      mutex_lock(&all->p->examples_lock);
-      all->p->end_parsed_examples+=examples_available;
-      condition_variable_signal_all(&all->p->example_available);
-      mutex_unlock(&all->p->examples_lock);
       examples.erase();
     }
   }
@@ -1055,12 +1700,10 @@ void *main_parse_loop(void *in)
   }
 
   if (!all->p->done)
-  {
-    mutex_lock(&all->p->examples_lock);
-    all->p->done = true;
-    mutex_unlock(&all->p->examples_lock);
-  }
+    set_parser_done(*all->p);
 
+  if (pool != nullptr)
+    stop_parse_pool(*all, pool);
   examples.delete_v();
   return 0L;
 }
@@ -1069,6 +1712,17 @@ namespace VW
 {
 example* get_example(parser* p)
 {
+  if (p->lockfree_ring)
+  {
+    ring_wait<uint64_t, ring_example_ready>(*p, p->example_available, p->used_index);
+    if (p->end_parsed_examples.load() == p->used_index)
+      return nullptr; // done and drained
+
+    size_t ring_index = p->used_index++ % p->ring_size;
+    assert((p->examples+ring_index)->in_use);
+    return p->examples + ring_index;
+  }
+
   mutex_lock(&p->examples_lock);
   if (p->end_parsed_examples != p->used_index)
   {
@@ -1161,6 +1815,9 @@ void initialize_examples(vw& all)
     memset(&all.p->examples[i].l, 0, sizeof(polylabel));
     all.p->examples[i].in_use = false;
   }
+
+  if (all.p->lockfree_ring)
+    all.p->ring_slot_busy = calloc_or_throw<std::atomic<bool>>(all.p->ring_size);
 }
 
 void adjust_used_index(vw& all)
@@ -1194,6 +1851,7 @@ void free_parser(vw& all)
   all.p->channels.delete_v();
   all.p->words.delete_v();
   all.p->name.delete_v();
+  all.p->cache_formats.delete_v();
 
   if(all.ngram_strings.size() > 0)
     all.p->gram_mask.delete_v();
@@ -1205,6 +1863,7 @@ void free_parser(vw& all)
 
     free(all.p->examples);
   }
+  free(all.p->ring_slot_busy);
 
   io_buf* output = all.p->output;
   if (output != nullptr)
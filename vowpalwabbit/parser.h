@@ -4,6 +4,7 @@ individual contributors. All rights reserved.  Released under a BSD
 license as described in the file LICENSE.
  */
 #pragma once
+#include <atomic>
 #include "io_buf.h"
 #include "parse_primitives.h"
 #include "example.h"
@@ -12,6 +13,9 @@ license as described in the file LICENSE.
 namespace po = boost::program_options;
 
 struct vw;
+class read_ahead;
+struct cache_columns;
+struct cache_shards;
 
 struct parser
 { v_array<substring> channels;//helper(s) for text parsing
@@ -19,6 +23,7 @@ struct parser
   v_array<substring> name;
 
   io_buf* input; //Input source(s)
+  read_ahead* prefetch; // input's read-ahead stage, if any
   int (*reader)(vw*, v_array<example*>& examples);
   hash_func_t hasher;
   bool resettable; //Whether or not the input can be reset.
@@ -26,10 +31,18 @@ struct parser
   bool write_cache;
   bool sort_features;
   bool sorted_cache;
+  bool write_columnar_cache; // new caches use the columnar format (--cache_format 2)
+  cache_columns* columns; // state of the columnar cache being written or read, if any
+  v_array<char> cache_formats; // 'c' (rows) or 'C' (columns) for each cache file read
+  size_t num_cache_shards; // the cache is split over this many files (--cache_shards)
+  bool shuffle_shards; // visit the cache shards in a new order every round of stripes
+  bool shuffle_blocks; // read the blocks of a columnar cache in a new order every pass
+  cache_shards* shards; // state of the sharded cache, if any
 
   size_t ring_size;
+  size_t parse_threads; // text parsing workers; below 2 the parser thread parses on its own
   uint64_t begin_parsed_examples; // The index of the beginning parsed example.
-  uint64_t end_parsed_examples; // The index of the fully parsed example.
+  std::atomic<uint64_t> end_parsed_examples; // The index of the fully parsed example.
   uint64_t local_example_number;
   uint32_t in_pass_counter;
   example* examples;
@@ -41,7 +54,11 @@ struct parser
   MUTEX output_lock;
   CV output_done;
 
-  bool done;
+  bool lockfree_ring; // hand examples to the learner through atomics, parking on the CVs above only when idle
+  std::atomic<bool>* ring_slot_busy; // per-slot ownership for the lock-free ring; mirrors example::in_use
+  std::atomic<uint32_t> ring_waiters; // threads parked on example_available/example_unused
+
+  std::atomic<bool> done;
   v_array<size_t> gram_mask;
 
   v_array<size_t> ids; //unique ids for sources
@@ -80,5 +97,12 @@ bool inconsistent_cache(size_t numbits, io_buf& cache);
 void reset_source(vw& all, size_t numbits);
 void finalize_source(parser* source);
 void set_compressed(parser* par);
+void set_mmap_input(parser* par, size_t window_size);
+void set_prefetch_input(parser* par, size_t block_size, size_t num_blocks);
+uint32_t cache_numbits(io_buf* buf, int filepointer, char* format = nullptr);
 void initialize_examples(vw& all);
 void free_parser(vw& all);
+
+//the steps of setting up an example shared with the threads decoding cache shards
+void count_example(vw& all, example* ae, bool newline, uint64_t example_counter);
+void setup_example_features(vw& all, example* ae, v_array<size_t>& gram_mask);
@@ -0,0 +1,144 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD (revised)
+license as described in the file LICENSE.
+ */
+#include "prefetch_io.h"
+
+#ifdef _WIN32
+DWORD WINAPI prefetch_reader(LPVOID in)
+#else
+void *prefetch_reader(void *in)
+#endif
+{
+  ((read_ahead*)in)->reader_loop();
+  return 0L;
+}
+
+read_ahead::read_ahead(io_buf& source, size_t block_size, size_t num_blocks)
+  : reader_stalls(0), parser_stalls(0), source(source), num_blocks(num_blocks), block_size(block_size),
+    filled(0), drained(0), consumed(0), reading(-1), eof(false), stopping(false), running(false)
+{
+  blocks = calloc_or_throw<prefetch_block>(num_blocks);
+  for (size_t i = 0; i < num_blocks; i++)
+    blocks[i].data = calloc_or_throw<char>(block_size);
+  initialize_mutex(&lock);
+  initialize_condition_variable(&block_filled);
+  initialize_condition_variable(&block_drained);
+}
+
+read_ahead::~read_ahead()
+{
+  discard();
+  for (size_t i = 0; i < num_blocks; i++)
+    free(blocks[i].data);
+  free(blocks);
+  delete_mutex(&lock);
+}
+
+void read_ahead::reader_loop()
+{
+  mutex_lock(&lock);
+  while (!stopping)
+  {
+    if (filled - drained == num_blocks)
+    {
+      reader_stalls++;
+      condition_variable_wait(&block_drained, &lock);
+      continue;
+    }
+    prefetch_block& b = blocks[filled % num_blocks];
+    mutex_unlock(&lock);
+    ssize_t num_read = source.read_file(reading, b.data, block_size);
+    mutex_lock(&lock);
+    // publish even when asked to stop, so the file position always matches the blocks
+    if (num_read <= 0)
+      eof = true;
+    else
+    {
+      b.length = num_read;
+      filled++;
+    }
+    condition_variable_signal(&block_filled);
+    if (eof)
+      break;
+  }
+  mutex_unlock(&lock);
+}
+
+ssize_t read_ahead::read(int f, char* buf, size_t nbytes)
+{
+  if (f != reading)
+  {
+    discard();
+    reading = f;
+  }
+
+  mutex_lock(&lock);
+  if (!running && !eof)
+  {
+    running = true;
+#ifndef _WIN32
+    pthread_create(&thread, nullptr, prefetch_reader, this);
+#else
+    thread = ::CreateThread(nullptr, 0, static_cast<LPTHREAD_START_ROUTINE>(prefetch_reader), this, 0L, nullptr);
+#endif
+  }
+  if (filled == drained && !eof)
+  {
+    parser_stalls++;
+    do
+      condition_variable_wait(&block_filled, &lock);
+    while (filled == drained && !eof);
+  }
+  if (filled == drained)
+  {
+    mutex_unlock(&lock);
+    return 0;
+  }
+  prefetch_block& b = blocks[drained % num_blocks];
+  mutex_unlock(&lock);
+
+  // the reader leaves full blocks alone until they are drained
+  size_t n = min(nbytes, b.length - consumed);
+  memcpy(buf, b.data + consumed, n);
+  consumed += n;
+
+  if (consumed == b.length)
+  {
+    mutex_lock(&lock);
+    consumed = 0;
+    drained++;
+    condition_variable_signal(&block_drained);
+    mutex_unlock(&lock);
+  }
+  return (ssize_t)n;
+}
+
+void read_ahead::halt()
+{
+  if (!running)
+    return;
+  mutex_lock(&lock);
+  stopping = true;
+  condition_variable_signal(&block_drained);
+  mutex_unlock(&lock);
+#ifndef _WIN32
+  pthread_join(thread, nullptr);
+#else
+  ::WaitForSingleObject(thread, INFINITE);
+  ::CloseHandle(thread);
+#endif
+  stopping = false;
+  running = false;
+}
+
+void read_ahead::discard()
+{
+  halt();
+  filled = 0;
+  drained = 0;
+  consumed = 0;
+  eof = false;
+  reading = -1;
+}
@@ -0,0 +1,117 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#pragma once
+#include "io_buf.h"
+#include "parse_primitives.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+/* Read-ahead below io_buf (--prefetch_input).  A reader thread keeps a ring of large blocks
+** filled from the current file through io_buf::read_file, so disk waits and gzip inflation
+** overlap with parsing instead of landing on the parser thread.  fill() copies out of the
+** oldest full block and hands it back to the reader once it is drained.
+**
+** The reader always publishes what it has read, so halting it never loses bytes: the file
+** position is exactly the end of the last full block.  Seeking or closing discards the
+** blocks together with the reader.
+*/
+struct prefetch_block
+{ char* data;
+  size_t length;
+};
+
+class read_ahead
+{
+public:
+  read_ahead(io_buf& source, size_t block_size, size_t num_blocks);
+  ~read_ahead();
+
+  // copies up to nbytes of f into buf, starting or resuming the reader on f as needed
+  ssize_t read(int f, char* buf, size_t nbytes);
+  // stops the reader, keeping the blocks it has filled
+  void halt();
+  // stops the reader and drops everything it has read
+  void discard();
+
+  int file() { return reading; }
+
+  uint64_t reader_stalls; // the reader found every block full
+  uint64_t parser_stalls; // fill() found no block ready
+
+  void reader_loop();
+
+private:
+  io_buf& source;
+  prefetch_block* blocks;
+  size_t num_blocks;
+  size_t block_size;
+
+  MUTEX lock;
+  CV block_filled;
+  CV block_drained;
+  uint64_t filled; // blocks published by the reader
+  uint64_t drained; // blocks handed back by fill()
+  size_t consumed; // bytes already copied out of blocks[drained % num_blocks]
+  int reading; // file being read ahead, -1 if none
+  bool eof; // the reader hit the end of reading (or an error)
+  bool stopping;
+  bool running; // a reader thread exists and must be joined
+#ifndef _WIN32
+  pthread_t thread;
+#else
+  HANDLE thread;
+#endif
+};
+
+template<class base> class prefetch_io_buf : public base
+{
+public:
+  prefetch_io_buf(size_t block_size, size_t num_blocks) : ahead(*this, block_size, num_blocks) {}
+
+  virtual ~prefetch_io_buf() { ahead.discard(); }
+
+  virtual int open_file(const char* name, bool stdin_off, int flag = io_buf::READ)
+  { // opening may reallocate state read_file relies on (comp_io_buf::gz_files)
+    ahead.halt();
+    // the file being read was closed behind our back, and its descriptor may be handed out again
+    if (ahead.file() != -1 && !v_array_contains(this->files, ahead.file()))
+      ahead.discard();
+    return base::open_file(name, stdin_off, flag);
+  }
+
+  virtual void reset_file(int f)
+  { ahead.discard();
+    base::reset_file(f);
+  }
+
+  virtual bool seek_file(int f, int64_t offset)
+  { ahead.discard();
+    return base::seek_file(f, offset);
+  }
+
+  virtual bool close_file()
+  { ahead.discard();
+    return base::close_file();
+  }
+
+  virtual ssize_t fill(int f)
+  { if (this->space.end_array - this->space.end() == 0)
+    { size_t head_loc = this->head - this->space.begin();
+      this->space.resize(2 * (this->space.end_array - this->space.begin()));
+      this->head = this->space.begin() + head_loc;
+    }
+    ssize_t num_read = ahead.read(f, this->space.end(), this->space.end_array - this->space.end());
+    if (num_read > 0)
+    { this->space.end() = this->space.end() + num_read;
+      return num_read;
+    }
+    return 0;
+  }
+
+  read_ahead ahead;
+};
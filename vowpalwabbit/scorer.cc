@@ -29,6 +29,30 @@ inline void multipredict(scorer&, LEARNER::base_learner& base, example& ec, size
     pred[c].scalar = link(pred[c].scalar);
 }
 
+template <float (*link)(float in)>
+inline void multilearn(scorer& s, LEARNER::base_learner& base, example& ec, size_t count, size_t, label_data* labels, polyprediction* pred, bool finalize_predictions)
+{
+  for (size_t c=0; c<count; c++)
+    s.all->set_minmax(s.all->sd, labels[c].label);
+  base.multilearn(ec, 0, count, labels, pred, finalize_predictions);
+  for (size_t c=0; c<count; c++)
+    pred[c].scalar = link(pred[c].scalar);
+}
+
+template <float (*link)(float in)>
+void predict_batch(scorer& s, LEARNER::base_learner& base, v_array<example*>& examples)
+{
+  for (example* ec : examples)
+    s.all->set_minmax(s.all->sd, ec->l.simple.label);
+  base.predict_batch(examples);
+  for (example* ec : examples)
+  {
+    if(ec->weight > 0 && ec->l.simple.label != FLT_MAX)
+      ec->loss = s.all->loss->getLoss(s.all->sd, ec->pred.scalar, ec->l.simple.label) * ec->weight;
+    ec->pred.scalar = link(ec->pred.scalar);
+  }
+}
+
 void update(scorer& s, LEARNER::base_learner& base, example& ec)
 {
   s.all->set_minmax(s.all->sd, ec.l.simple.label);
@@ -58,6 +82,8 @@ LEARNER::base_learner* scorer_setup(vw& all)
   LEARNER::base_learner* base = setup_base(all);
   LEARNER::learner<scorer>* l;
   void (*multipredict_f)(scorer&, LEARNER::base_learner&, example&, size_t, size_t, polyprediction*, bool) = multipredict<id>;
+  void (*predict_batch_f)(scorer&, LEARNER::base_learner&, v_array<example*>&) = predict_batch<id>;
+  void (*multilearn_f)(scorer&, LEARNER::base_learner&, example&, size_t, size_t, label_data*, polyprediction*, bool) = multilearn<id>;
 
   string link = vm["link"].as<string>();
   if (!vm.count("link") || link.compare("identity") == 0)
@@ -68,6 +94,8 @@ LEARNER::base_learner* scorer_setup(vw& all)
     l = &init_learner(&s, base, predict_or_learn<true, logistic>,
                       predict_or_learn<false, logistic>);
     multipredict_f = multipredict<logistic>;
+    predict_batch_f = predict_batch<logistic>;
+    multilearn_f = multilearn<logistic>;
   }
   else if (link.compare("glf1") == 0)
   {
@@ -75,17 +103,23 @@ LEARNER::base_learner* scorer_setup(vw& all)
     l = &init_learner(&s, base, predict_or_learn<true, glf1>,
                       predict_or_learn<false, glf1>);
     multipredict_f = multipredict<glf1>;
+    predict_batch_f = predict_batch<glf1>;
+    multilearn_f = multilearn<glf1>;
   }
   else if (link.compare("poisson") == 0)
   {
     *all.file_options << " --link=poisson ";
     l = &init_learner(&s, base, predict_or_learn<true, expf>, predict_or_learn<false, expf>);
     multipredict_f = multipredict<expf>;
+    predict_batch_f = predict_batch<expf>;
+    multilearn_f = multilearn<expf>;
   }
   else
     THROW("Unknown link function: " << link);
 
   l->set_multipredict(multipredict_f);
+  l->set_predict_batch(predict_batch_f);
+  l->set_multilearn(multilearn_f);
   l->set_update(update);
   all.scorer = make_base(*l);
 
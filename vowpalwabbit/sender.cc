@@ -29,11 +29,13 @@ struct sender
   example** delay_ring;
   size_t sent_index;
   size_t received_index;
+  bool wire; // sends wire frames, which daemons older than the format don't read
+  v_array<char> frame; // wire frame of the example being sent
 };
 
 void open_sockets(sender& s, string host)
 {
-  s.sd = open_socket(host.c_str());
+  s.sd = open_socket(host.c_str(), s.wire ? wire_marker : '\0');
   s.buf = new io_buf();
   s.buf->files.push_back(s.sd);
 }
@@ -52,6 +54,18 @@ void send_features(io_buf *b, example& ec, uint32_t mask)
   b->flush();
 }
 
+void send_frame(sender& s, example& ec)
+{
+  // label, tag and hashed features in one frame, without the constant
+  s.frame.erase();
+  write_wire_example(*s.all, ec, s.frame);
+  char* c;
+  buf_write(*s.buf, c, s.frame.size());
+  memcpy(c, s.frame.begin(), s.frame.size());
+  s.buf->set(c + s.frame.size());
+  s.buf->flush();
+}
+
 void receive_result(sender& s)
 {
   float res, weight;
@@ -72,9 +86,14 @@ void learn(sender& s, LEARNER::base_learner&, example& ec)
     receive_result(s);
 
   s.all->set_minmax(s.all->sd, ec.l.simple.label);
-  s.all->p->lp.cache_label(&ec.l, *s.buf);//send label information.
-  cache_tag(*s.buf, ec.tag);
-  send_features(s.buf,ec, (uint32_t)s.all->parse_mask);
+  if (s.wire)
+    send_frame(s, ec);
+  else
+  {
+    s.all->p->lp.cache_label(&ec.l, *s.buf);//send label information.
+    cache_tag(*s.buf, ec.tag);
+    send_features(s.buf,ec, (uint32_t)s.all->parse_mask);
+  }
   s.delay_ring[s.sent_index++ % s.all->p->ring_size] = &ec;
 }
 
@@ -92,6 +111,7 @@ void finish(sender& s)
 {
   s.buf->files.delete_v();
   s.buf->space.delete_v();
+  s.frame.delete_v();
   free(s.delay_ring);
   delete s.buf;
 }
@@ -100,9 +120,14 @@ LEARNER::base_learner* sender_setup(vw& all)
 {
   if (missing_option<string, true>(all, "sendto", "send examples to <host>"))
     return nullptr;
+  new_options(all, "Sender options")
+  ("sendto_wire", "send examples as wire frames, which only daemons that know the wire format read");
+  add_options(all);
 
   sender& s = calloc_or_throw<sender>();
   s.sd = -1;
+  s.wire = all.vm.count("sendto_wire") > 0;
+  s.frame = v_init<char>();
   if (all.vm.count("sendto"))
   {
     string host = all.vm["sendto"].as< string >();
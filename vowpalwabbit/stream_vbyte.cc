@@ -0,0 +1,152 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD (revised)
+license as described in the file LICENSE.
+ */
+#include <string.h>
+#include "stream_vbyte.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SVB_SSSE3 __attribute__((target("ssse3")))
+#include <tmmintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define SVB_SSSE3
+#include <intrin.h>
+#include <tmmintrin.h>
+#endif
+
+struct svb_tables
+{
+  uint8_t shuffle[256][16]; // moves the bytes of four values into four 32-bit lanes
+  uint8_t length[256]; // data bytes covered by a control byte
+
+  svb_tables()
+  {
+    for (size_t c = 0; c < 256; c++)
+    {
+      uint8_t pos = 0;
+      for (size_t lane = 0; lane < 4; lane++)
+      {
+        uint8_t len = ((c >> (2 * lane)) & 3) + 1;
+        for (uint8_t b = 0; b < 4; b++)
+          shuffle[c][4 * lane + b] = b < len ? pos + b : 0xff;
+        pos += len;
+      }
+      length[c] = pos;
+    }
+  }
+};
+
+static const svb_tables& tables()
+{
+  static const svb_tables t;
+  return t;
+}
+
+size_t svb_max_size(size_t count) { return (count + 3) / 4 + 4 * count; }
+
+size_t svb_encode(const uint32_t* in, size_t count, char* out)
+{
+  uint8_t* ctrl = (uint8_t*)out;
+  uint8_t* data = ctrl + (count + 3) / 4;
+  memset(ctrl, 0, (count + 3) / 4);
+  for (size_t i = 0; i < count; i++)
+  {
+    uint32_t v = in[i];
+    uint8_t code = v < (1u << 8) ? 0 : v < (1u << 16) ? 1 : v < (1u << 24) ? 2 : 3;
+    ctrl[i >> 2] |= code << (2 * (i & 3));
+    for (uint8_t b = 0; b <= code; b++)
+      *data++ = (uint8_t)(v >> (8 * b));
+  }
+  return (char*)data - out;
+}
+
+// checks that the data bytes named by the control bytes fit in length
+static bool svb_fits(const uint8_t* ctrl, size_t length, size_t count)
+{
+  size_t ctrl_bytes = (count + 3) / 4;
+  if (ctrl_bytes > length)
+    return false;
+  const svb_tables& t = tables();
+  size_t data = 0;
+  for (size_t i = 0; i < count / 4; i++)
+    data += t.length[ctrl[i]];
+  for (size_t i = count & ~(size_t)3; i < count; i++)
+    data += ((ctrl[i >> 2] >> (2 * (i & 3))) & 3) + 1;
+  return data <= length - ctrl_bytes;
+}
+
+static void decode_tail(const uint8_t* ctrl, const uint8_t* data, size_t from, size_t count, uint32_t* out)
+{
+  for (size_t i = from; i < count; i++)
+  {
+    size_t len = ((ctrl[i >> 2] >> (2 * (i & 3))) & 3) + 1;
+    uint32_t v = 0;
+    for (size_t b = 0; b < len; b++)
+      v |= (uint32_t)data[b] << (8 * b);
+    data += len;
+    out[i] = v;
+  }
+}
+
+bool svb_decode_scalar(const char* in, size_t length, size_t count, uint32_t* out)
+{
+  const uint8_t* ctrl = (const uint8_t*)in;
+  if (!svb_fits(ctrl, length, count))
+    return false;
+  decode_tail(ctrl, ctrl + (count + 3) / 4, 0, count, out);
+  return true;
+}
+
+#ifdef SVB_SSSE3
+SVB_SSSE3 static void decode_ssse3(const uint8_t* ctrl, const uint8_t* data, size_t count, uint32_t* out)
+{
+  const svb_tables& t = tables();
+  size_t quads = count / 4;
+  for (size_t i = 0; i < quads; i++)
+  {
+    uint8_t c = ctrl[i];
+    __m128i v = _mm_loadu_si128((const __m128i*)data);
+    v = _mm_shuffle_epi8(v, _mm_loadu_si128((const __m128i*)t.shuffle[c]));
+    _mm_storeu_si128((__m128i*)(out + 4 * i), v);
+    data += t.length[c];
+  }
+  decode_tail(ctrl, data, 4 * quads, count, out);
+}
+
+static bool detect_ssse3()
+{
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 1);
+  return (info[2] & (1 << 9)) != 0;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("ssse3") != 0;
+#endif
+}
+
+bool svb_simd_available()
+{
+  static const bool available = detect_ssse3();
+  return available;
+}
+
+bool svb_decode(const char* in, size_t length, size_t count, uint32_t* out)
+{
+  if (!svb_simd_available())
+    return svb_decode_scalar(in, length, count, out);
+  const uint8_t* ctrl = (const uint8_t*)in;
+  if (!svb_fits(ctrl, length, count))
+    return false;
+  decode_ssse3(ctrl, ctrl + (count + 3) / 4, count, out);
+  return true;
+}
+#else
+bool svb_simd_available() { return false; }
+
+bool svb_decode(const char* in, size_t length, size_t count, uint32_t* out)
+{
+  return svb_decode_scalar(in, length, count, out);
+}
+#endif
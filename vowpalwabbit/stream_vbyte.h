@@ -0,0 +1,31 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/* Stream VByte (Lemire, Kurz and Rupp): 32-bit integers stored in 1 to 4 bytes each, with
+** the byte lengths of every four values packed into one control byte.  All control bytes
+** come first, then all data bytes.  With the lengths out of the data stream a decoder can
+** expand four values at once with a single byte shuffle instead of testing every byte for
+** a continuation bit.
+*/
+
+// upper bound on the encoded size of count values
+size_t svb_max_size(size_t count);
+
+// returns the number of bytes written to out
+size_t svb_encode(const uint32_t* in, size_t count, char* out);
+
+// Decodes count values from the length bytes at in.  Returns false if in is too short for
+// them.  in must stay readable for 16 bytes past length: the vector decoder loads a full
+// register at a time.
+bool svb_decode(const char* in, size_t length, size_t count, uint32_t* out);
+
+// the portable decoder, which svb_decode uses when the CPU lacks SSSE3
+bool svb_decode_scalar(const char* in, size_t length, size_t count, uint32_t* out);
+
+bool svb_simd_available();
@@ -63,6 +63,12 @@ example* read_example(vw& all, std::string example_line);
 //after you create and fill feature_spaces, get an example with everything filled in.
 example* import_example(vw& all, std::string label, primitive_feature_space* features, size_t len);
 
+//An example in the wire format of cache.h, whose features are already hashed.  consumed is set to the bytes the
+//frame takes, and nullptr is returned when data does not hold a whole frame.
+example* read_wire_example(vw& all, const char* data, size_t length, size_t& consumed);
+//appends ec, which must have a simple label, to out as a wire frame.
+void write_wire_example(vw& all, example& ec, v_array<char>& out);
+
 // callers must free memory using release_example
 // this interface must be used with care as finish_example is a no-op for these examples.
 // thus any delay introduced when freeing examples must be at least as long as the one
@@ -94,6 +100,10 @@ void return_features(feature* f);
 void add_constant_feature(vw& all, example*ec);
 void add_label(example* ec, float label, float weight = 1, float base = 0);
 
+// Predicts independent examples together, without learning from them.  Learners that can
+// share work across a batch do, e.g. repeated namespaces are looked up in the weights once.
+void predict_batch(vw& all, v_array<example*>& examples);
+
 //notify VW that you are done with the example.
 void finish_example(vw& all, example* ec);
 void empty_example(vw& all, example& ec);
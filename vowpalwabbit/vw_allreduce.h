@@ -9,7 +9,10 @@ license as described in the file LICENSE.
 #include "vw.h"
 #include "allreduce.h"
 
-template <class T, void(*f)(T&, const T&)> void all_reduce(vw& all, T* buffer, const size_t n)
+void wait_background_avg(vw& all);
+
+// without waiting for an averaging in the background, which reduces through this itself
+template <class T, void(*f)(T&, const T&)> void all_reduce_now(vw& all, T* buffer, const size_t n)
 { switch (all.all_reduce_type)
   { case AllReduceType::Socket:
       ((AllReduceSockets*)all.all_reduce)->all_reduce<T, f>(buffer, n);
@@ -18,5 +21,16 @@ template <class T, void(*f)(T&, const T&)> void all_reduce(vw& all, T* buffer, c
     case AllReduceType::Thread:
       ((AllReduceThreads*)all.all_reduce)->all_reduce<T, f>(buffer, n);
       break;
+
+    case AllReduceType::Hierarchy:
+      ((AllReduceHierarchy*)all.all_reduce)->all_reduce<T, f>(buffer, n);
+      break;
   }
 }
+
+// Reductions follow one another on the same connections, so one waits for the averaging in
+// the background to be done with them.
+template <class T, void(*f)(T&, const T&)> void all_reduce(vw& all, T* buffer, const size_t n)
+{ wait_background_avg(all);
+  all_reduce_now<T, f>(all, buffer, n);
+}
@@ -98,6 +98,22 @@ VW_DLL_MEMBER VW_EXAMPLE VW_CALLING_CONV VW_ReadExampleA(VW_HANDLE handle, const
   return static_cast<VW_EXAMPLE>(VW::read_example(*pointer, const_cast<char*>(line)));
 }
 
+VW_DLL_MEMBER VW_EXAMPLE VW_CALLING_CONV VW_ReadWireExample(VW_HANDLE handle, const char * data, size_t length, size_t * consumed)
+{ vw * pointer = static_cast<vw*>(handle);
+  return static_cast<VW_EXAMPLE>(VW::read_wire_example(*pointer, data, length, *consumed));
+}
+
+VW_DLL_MEMBER size_t VW_CALLING_CONV VW_WriteWireExample(VW_HANDLE handle, VW_EXAMPLE e, char * buffer, size_t capacity)
+{ vw * pointer = static_cast<vw*>(handle);
+  v_array<char> frame = v_init<char>();
+  VW::write_wire_example(*pointer, *static_cast<example*>(e), frame);
+  size_t size = frame.size();
+  if (size <= capacity)
+    memcpy(buffer, frame.begin(), size);
+  frame.delete_v();
+  return size;
+}
+
 VW_DLL_MEMBER void VW_CALLING_CONV VW_StartParser(VW_HANDLE handle)
 { vw * pointer = static_cast<vw*>(handle);
   VW::start_parser(*pointer);
@@ -79,6 +79,10 @@ VW_DLL_MEMBER void VW_CALLING_CONV VW_ReleaseFeatureSpace(VW_FEATURE_SPACE * fea
 VW_DLL_MEMBER VW_EXAMPLE VW_CALLING_CONV VW_ReadExample(VW_HANDLE handle, const char16_t * line);
 #endif
 VW_DLL_MEMBER VW_EXAMPLE VW_CALLING_CONV VW_ReadExampleA(VW_HANDLE handle, const char * line);
+// wire frames of pre-hashed examples, see cache.h.  VW_ReadWireExample returns NULL when data holds no whole
+// frame, and VW_WriteWireExample returns the size of the frame, writing it only when it fits in capacity.
+VW_DLL_MEMBER VW_EXAMPLE VW_CALLING_CONV VW_ReadWireExample(VW_HANDLE handle, const char * data, size_t length, size_t * consumed);
+VW_DLL_MEMBER size_t VW_CALLING_CONV VW_WriteWireExample(VW_HANDLE handle, VW_EXAMPLE e, char * buffer, size_t capacity);
 
 VW_DLL_MEMBER void VW_CALLING_CONV VW_StartParser(VW_HANDLE handle);
 VW_DLL_MEMBER void VW_CALLING_CONV VW_EndParser(VW_HANDLE handle);
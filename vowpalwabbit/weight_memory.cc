@@ -0,0 +1,274 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD (revised)
+license as described in the file LICENSE.
+ */
+#include <string.h>
+#include <sstream>
+#include <fstream>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+#if defined(__APPLE__) && !defined(MAP_ANONYMOUS)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include "weight_memory.h"
+#include "v_array.h"
+
+using namespace std;
+
+#ifdef __linux__
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+// mbind(2) modes, to do without libnuma
+const int mpol_bind = 2;
+const int mpol_interleave = 3;
+const size_t max_numa_nodes = 1024;
+
+// Reads the online NUMA nodes ("0-1,4") into a node mask; returns how many there are.
+size_t online_numa_nodes(unsigned long* mask)
+{
+  memset(mask, 0, max_numa_nodes / 8);
+  ifstream online("/sys/devices/system/node/online");
+  string ranges;
+  if (!(online >> ranges))
+    return 0;
+  size_t count = 0;
+  stringstream ss(ranges);
+  string range;
+  while (getline(ss, range, ','))
+  {
+    size_t first = 0, last = 0;
+    char dash;
+    stringstream rs(range);
+    if (!(rs >> first))
+      continue;
+    last = first;
+    if (rs >> dash >> last && dash != '-')
+      last = first;
+    for (size_t n = first; n <= last && n < max_numa_nodes; n++, count++)
+      mask[n / (8 * sizeof(unsigned long))] |= 1ul << (n % (8 * sizeof(unsigned long)));
+  }
+  return count;
+}
+
+// Applies the NUMA policy to the untouched mapping at data.
+void place_weight_memory(void* data, size_t length, const weight_memory& requested, weight_memory& obtained)
+{
+  unsigned long mask[max_numa_nodes / (8 * sizeof(unsigned long))];
+  size_t nodes = online_numa_nodes(mask);
+  if (nodes < 2)
+    return; // nothing to choose between
+  if (requested.numa == numa_policy::interleave)
+  {
+    if (syscall(SYS_mbind, data, length, mpol_interleave, mask, max_numa_nodes, 0) == 0)
+    {
+      obtained.numa = numa_policy::interleave;
+      obtained.numa_nodes = nodes;
+    }
+  }
+  else if (requested.numa == numa_policy::local)
+  {
+    unsigned cpu = 0, node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0 || node >= max_numa_nodes)
+      return;
+    memset(mask, 0, sizeof(mask));
+    mask[node / (8 * sizeof(unsigned long))] = 1ul << (node % (8 * sizeof(unsigned long)));
+    if (syscall(SYS_mbind, data, length, mpol_bind, mask, max_numa_nodes, 0) == 0)
+    {
+      obtained.numa = numa_policy::local;
+      obtained.numa_nodes = node;
+    }
+  }
+}
+
+// Maps length bytes of anonymous memory aligned to align, or returns nullptr.  sharing is
+// MAP_PRIVATE or MAP_SHARED.
+void* map_aligned(size_t length, size_t align, int sharing)
+{
+  char* p = (char*)mmap(nullptr, length + align, PROT_READ | PROT_WRITE, sharing | MAP_ANONYMOUS, -1, 0);
+  if (p == (char*)MAP_FAILED)
+    return nullptr;
+  char* aligned = (char*)(((uintptr_t)p + align - 1) & ~(uintptr_t)(align - 1));
+  if (aligned > p)
+    munmap(p, aligned - p);
+  munmap(aligned + length, p + align - aligned);
+  return aligned;
+}
+
+// Maps count floats placed as requested, or returns nullptr.
+float* map_weight_memory(size_t count, const weight_memory& requested, weight_memory& obtained, size_t& mapped, int sharing)
+{
+  const size_t huge_2mb = (size_t)1 << 21;
+  const size_t huge_1gb = (size_t)1 << 30;
+  size_t bytes = count * sizeof(float);
+  void* data = nullptr;
+
+  // explicit huge pages come out of the pool reserved in /proc/sys/vm/nr_hugepages
+  if (requested.pages == huge_pages::huge_1gb || requested.pages == huge_pages::huge_2mb)
+  {
+    bool gb = requested.pages == huge_pages::huge_1gb;
+    size_t page = gb ? huge_1gb : huge_2mb;
+    size_t length = (bytes + page - 1) & ~(page - 1);
+    data = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                sharing | MAP_ANONYMOUS | MAP_HUGETLB | ((gb ? 30 : 21) << MAP_HUGE_SHIFT), -1, 0);
+    if (data == MAP_FAILED)
+      data = nullptr;
+    else
+    {
+      mapped = length;
+      obtained.pages = requested.pages;
+    }
+  }
+
+  if (data == nullptr)
+  {
+    size_t length = (bytes + huge_2mb - 1) & ~(huge_2mb - 1);
+    data = map_aligned(length, huge_2mb, sharing);
+    if (data == nullptr)
+      return nullptr;
+    mapped = length;
+#ifdef MADV_HUGEPAGE
+    if (requested.pages != huge_pages::none && madvise(data, length, MADV_HUGEPAGE) == 0)
+      obtained.pages = huge_pages::transparent;
+#endif
+  }
+
+  // fresh anonymous pages are zero, and placed when first touched
+  if (requested.numa != numa_policy::none)
+    place_weight_memory(data, mapped, requested, obtained);
+  return (float*)data;
+}
+#endif
+
+float* alloc_weight_memory(size_t count, const weight_memory& requested, weight_memory& obtained, size_t& mapped)
+{
+  obtained = weight_memory();
+  mapped = 0;
+  if (count == 0)
+    return nullptr;
+#ifdef __linux__
+  if (!requested.plain())
+  {
+    float* data = map_weight_memory(count, requested, obtained, mapped, MAP_PRIVATE);
+    if (data == nullptr)
+    {
+      const char* msg = "internal error: memory allocation failed!\n";
+      fputs(msg, stderr);
+      THROW(msg);
+    }
+    return data;
+  }
+#endif
+  return calloc_mergable_or_throw<float>(count);
+}
+
+void free_weight_memory(float* weights, size_t mapped)
+{
+  if (weights == nullptr)
+    return;
+#ifndef _WIN32
+  if (mapped > 0)
+  {
+    munmap(weights, mapped);
+    return;
+  }
+#endif
+  free(weights);
+}
+
+#ifndef _WIN32
+float* alloc_shared_weight_memory(size_t count, const weight_memory& requested, weight_memory& obtained, size_t& mapped)
+{
+  obtained = weight_memory();
+  mapped = 0;
+  if (count == 0)
+    return nullptr;
+  float* data = nullptr;
+#ifdef __linux__
+  if (!requested.plain())
+    data = map_weight_memory(count, requested, obtained, mapped, MAP_SHARED);
+#endif
+  if (data == nullptr)
+  {
+    mapped = count * sizeof(float);
+    data = (float*)mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (data == (float*)MAP_FAILED)
+    {
+      const char* msg = "internal error: memory allocation failed!\n";
+      fputs(msg, stderr);
+      THROW(msg);
+    }
+  }
+  return data;
+}
+
+void* alloc_shared_memory(size_t bytes)
+{
+  // pages are only backed once touched, so room reserved for growth costs little
+  void* data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (data == MAP_FAILED)
+  {
+    const char* msg = "internal error: memory allocation failed!\n";
+    fputs(msg, stderr);
+    THROW(msg);
+  }
+  return data;
+}
+
+void free_shared_memory(void* data, size_t bytes)
+{
+  if (data != nullptr)
+    munmap(data, bytes);
+}
+#endif
+
+string describe_weight_memory(const weight_memory& memory)
+{
+  stringstream s;
+  switch (memory.pages)
+  {
+  case huge_pages::none:
+    s << "normal pages";
+    break;
+  case huge_pages::transparent:
+    s << "transparent huge pages";
+    break;
+  case huge_pages::huge_2mb:
+    s << "2 MB huge pages";
+    break;
+  case huge_pages::huge_1gb:
+    s << "1 GB huge pages";
+    break;
+  }
+  if (memory.numa == numa_policy::interleave)
+    s << ", interleaved over " << memory.numa_nodes << " NUMA nodes";
+  else if (memory.numa == numa_policy::local)
+    s << ", bound to NUMA node " << memory.numa_nodes;
+  return s.str();
+}
+
+huge_pages parse_huge_pages(const string& s)
+{
+  if (s == "transparent")
+    return huge_pages::transparent;
+  if (s == "2m")
+    return huge_pages::huge_2mb;
+  if (s == "1g")
+    return huge_pages::huge_1gb;
+  THROW("--huge_pages must be transparent, 2m or 1g, not " << s);
+}
+
+numa_policy parse_numa_policy(const string& s)
+{
+  if (s == "interleave")
+    return numa_policy::interleave;
+  if (s == "local")
+    return numa_policy::local;
+  THROW("--numa must be interleave or local, not " << s);
+}
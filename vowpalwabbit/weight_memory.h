@@ -0,0 +1,45 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#pragma once
+#include <stddef.h>
+#include <string>
+
+/* Placement of the dense weight table (--huge_pages, --numa).  Predicting touches weights
+** at random across the whole table, so with large -b most lookups miss the TLB.  Huge pages
+** cover the table with far fewer TLB entries.  On machines with several NUMA nodes the
+** table can be interleaved over all of them, or kept on the node of the thread allocating
+** it.  Anything the system refuses falls back to the next best thing; weight_memory records
+** what was actually obtained.
+*/
+enum class huge_pages { none, transparent, huge_2mb, huge_1gb };
+enum class numa_policy { none, interleave, local };
+
+struct weight_memory
+{
+  huge_pages pages;
+  numa_policy numa;
+  size_t numa_nodes; // nodes interleaved over, or the node bound to for numa_policy::local
+
+  weight_memory() : pages(huge_pages::none), numa(numa_policy::none), numa_nodes(0) {}
+  bool plain() const { return pages == huge_pages::none && numa == numa_policy::none; }
+};
+
+// Allocates count zeroed floats as requested.  mapped is set to the size of the mapping to
+// release with free_weight_memory, or 0 if the floats came from the heap.
+float* alloc_weight_memory(size_t count, const weight_memory& requested, weight_memory& obtained, size_t& mapped);
+void free_weight_memory(float* weights, size_t mapped);
+
+#ifndef _WIN32
+// alloc_weight_memory for memory shared with processes forked later, always mapped
+float* alloc_shared_weight_memory(size_t count, const weight_memory& requested, weight_memory& obtained, size_t& mapped);
+// bytes of zeroed memory shared with processes forked later, for a concurrent sparse table
+void* alloc_shared_memory(size_t bytes);
+void free_shared_memory(void* data, size_t bytes);
+#endif
+
+std::string describe_weight_memory(const weight_memory& memory);
+huge_pages parse_huge_pages(const std::string& s);
+numa_policy parse_numa_policy(const std::string& s);